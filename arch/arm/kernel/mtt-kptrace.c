@@ -32,6 +32,7 @@
 #include <linux/mtt/kptrace.h>
 #include <asm/mtt-kptrace.h>
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 /*
  * target specific context switch handler
  * */
@@ -46,6 +47,7 @@ static int context_switch_pre_handler(struct kprobe *p, struct pt_regs *regs)
 
 	return mtt_cswitch(prev, new);
 }
+#endif
 
 /*
  * target specific core events
@@ -53,8 +55,12 @@ static int context_switch_pre_handler(struct kprobe *p, struct pt_regs *regs)
 void arch_init_core_event_logging(struct kp_tracepoint_set *set)
 {
 	/* get context switches before finish_task_switch on ARM */
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+	kptrace_create_sched_switch_tracepoint(set, "finish_task_switch");
+#else
 	kptrace_create_tracepoint(set, "finish_task_switch",
 			context_switch_pre_handler, NULL);
+#endif
 }
 
 /*
@@ -0,0 +1,15 @@
+#ifndef __ASM_SH_CLOCKSOURCE_H
+#define __ASM_SH_CLOCKSOURCE_H
+
+/*
+ * A clock source whose counter is a single 32-bit register can be read
+ * by the vDSO: vread_reg is the register address as the CPU sees it
+ * (0 if the counter can't be read from user space), and the count is
+ * the register contents XORed with vread_xor (for down counters).
+ */
+struct arch_clocksource_data {
+	unsigned long vread_reg;
+	u32 vread_xor;
+};
+
+#endif /* __ASM_SH_CLOCKSOURCE_H */
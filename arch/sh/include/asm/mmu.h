@@ -39,6 +39,8 @@
 #include <linux/threads.h>
 #include <asm/page.h>
 
+struct tlb_wired;
+
 /* Default "unsigned long" context */
 typedef unsigned long mm_context_id_t[NR_CPUS];
 
@@ -46,6 +48,9 @@ typedef struct {
 #ifdef CONFIG_MMU
 	mm_context_id_t		id;
 	void			*vdso;
+#ifdef CONFIG_TLB_WIRED_USER
+	struct tlb_wired	*wired;
+#endif
 #else
 	unsigned long		end_brk;
 #endif
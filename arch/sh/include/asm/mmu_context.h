@@ -102,9 +102,39 @@ static inline int init_new_context(struct task_struct *tsk,
 	for (i = 0; i < num_online_cpus(); i++)
 		cpu_context(i, mm) = NO_CONTEXT;
 
+#ifdef CONFIG_TLB_WIRED_USER
+	mm->context.wired = NULL;
+#endif
+
 	return 0;
 }
 
+#ifdef CONFIG_TLB_WIRED_USER
+extern struct tlb_wired *tlb_wired_loaded;
+extern void __tlb_wired_switch(struct mm_struct *mm);
+extern void __tlb_wired_flush(void);
+
+/*
+ * Swap the wired TLB entries of user space buffers over, see
+ * arch/sh/mm/tlb-wired.c. This is a no-op unless someone uses them.
+ */
+static inline void tlb_wired_switch(struct mm_struct *mm)
+{
+	if (unlikely(mm->context.wired || tlb_wired_loaded))
+		__tlb_wired_switch(mm);
+}
+
+/* Unwire them for local_flush_tlb_all(), with interrupts disabled */
+static inline void tlb_wired_flush(void)
+{
+	if (unlikely(tlb_wired_loaded))
+		__tlb_wired_flush();
+}
+#else
+static inline void tlb_wired_switch(struct mm_struct *mm) { }
+static inline void tlb_wired_flush(void) { }
+#endif
+
 /*
  * After we have set current->mm to a new value, this activates
  * the context for the new mm so we see the new mappings.
@@ -113,6 +143,7 @@ static inline void activate_context(struct mm_struct *mm, unsigned int cpu)
 {
 	get_mmu_context(mm, cpu);
 	set_asid(cpu_asid(cpu, mm));
+	tlb_wired_switch(mm);
 }
 
 static inline void switch_mm(struct mm_struct *prev,
@@ -59,7 +59,11 @@ pages_do_alias(unsigned long addr1, unsigned long addr2)
 	return (addr1 ^ addr2) & shm_align_mask;
 }
 
+#ifdef CONFIG_SH_STORE_QUEUES_PAGE_OPS
+extern void clear_page(void *to);
+#else
 #define clear_page(page)	memset((void *)(page), 0, PAGE_SIZE)
+#endif
 extern void copy_page(void *to, void *from);
 
 struct page;
@@ -16,9 +16,38 @@
 void stm_l2_flush_wback(unsigned long start, int size, int is_phys);
 void stm_l2_flush_purge(unsigned long start, int size, int is_phys);
 void stm_l2_flush_invalidate(unsigned long start, int size, int is_phys);
+
+/* Batched version of the above: many ranges, a single L2 sync (and
+ * whole cache operations when the ranges add up to more than the
+ * /sys/kernel/mm/l2/whole_threshold size, by default the cache size).
+ * The batch must be committed before the memory is handed to the DMA. */
+
+struct stm_l2_batch {
+	int pending;
+	int mode;
+	unsigned int whole;
+	unsigned long size;
+};
+
+#define STM_L2_BATCH_INIT { 0 }
+
 #ifdef CONFIG_STM_L2_CACHE
+void stm_l2_batch_wback(struct stm_l2_batch *batch, unsigned long start,
+		int size, int is_phys);
+void stm_l2_batch_purge(struct stm_l2_batch *batch, unsigned long start,
+		int size, int is_phys);
+void stm_l2_batch_invalidate(struct stm_l2_batch *batch, unsigned long start,
+		int size, int is_phys);
+void stm_l2_batch_commit(struct stm_l2_batch *batch);
 void stm_l2_disable(void);
 #else
+static inline void stm_l2_batch_wback(struct stm_l2_batch *batch,
+		unsigned long start, int size, int is_phys) { }
+static inline void stm_l2_batch_purge(struct stm_l2_batch *batch,
+		unsigned long start, int size, int is_phys) { }
+static inline void stm_l2_batch_invalidate(struct stm_l2_batch *batch,
+		unsigned long start, int size, int is_phys) { }
+static inline void stm_l2_batch_commit(struct stm_l2_batch *batch) { }
 static inline void stm_l2_disable(void) { }
 #endif
 
@@ -121,6 +121,25 @@ static inline void tlb_unwire_entry(void)
 }
 #endif
 
+#if defined(CONFIG_TLB_SUPERPAGES) || defined(CONFIG_TLB_WIRED_USER)
+/*
+ * PTE bits which must match across the pages of a large TLB entry: all
+ * but the PPN, and the young bit, which the users set on the whole block.
+ */
+#define TLB_LARGE_ATTR_MASK	(~PTE_PHYS_MASK & ~_PAGE_ACCESSED)
+
+extern int tlb_purge_range(unsigned long start, unsigned long size);
+#endif
+
+#ifdef CONFIG_TLB_SUPERPAGES
+extern int tlb_superpage_miss(unsigned long address, pte_t *ptep);
+#else
+static inline int tlb_superpage_miss(unsigned long address, pte_t *ptep)
+{
+	return 0;
+}
+#endif
+
 #else /* CONFIG_MMU */
 
 #define tlb_start_vma(tlb, vma)				do { } while (0)
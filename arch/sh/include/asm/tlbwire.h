@@ -0,0 +1,30 @@
+#ifndef __ASM_SH_TLBWIRE_H
+#define __ASM_SH_TLBWIRE_H
+
+#include <linux/ioctl.h>
+
+/*
+ * /dev/tlbwire: wire the TLB entries for a few hot buffers of the calling
+ * process, so that accesses to them never take a TLB miss.
+ *
+ * The buffer must be locked in memory (mlock()) or be a driver mapping
+ * of device or reserved memory. Sizes other than 4KB need the block to
+ * be naturally aligned and physically contiguous. Entries are dropped
+ * when the file is closed, so at the latest when the process exits.
+ */
+struct tlbwire_entry {
+	unsigned long	addr;	/* Start of the block, aligned to size */
+	unsigned long	size;	/* TLBWIRE_SIZE_* */
+};
+
+#define TLBWIRE_SIZE_4KB	0x1000
+#define TLBWIRE_SIZE_64KB	0x10000
+#define TLBWIRE_SIZE_1MB	0x100000
+
+#define TLBWIRE_IOC_MAGIC	0xB5
+
+#define TLBWIRE_IOC_WIRE	_IOW(TLBWIRE_IOC_MAGIC, 0, struct tlbwire_entry)
+#define TLBWIRE_IOC_UNWIRE	_IOW(TLBWIRE_IOC_MAGIC, 1, struct tlbwire_entry)
+#define TLBWIRE_IOC_MAX		_IOR(TLBWIRE_IOC_MAGIC, 2, unsigned int)
+
+#endif /* __ASM_SH_TLBWIRE_H */
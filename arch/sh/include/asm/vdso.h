@@ -0,0 +1,41 @@
+#ifndef __ASM_SH_VDSO_H
+#define __ASM_SH_VDSO_H
+
+/*
+ * The vDSO mapping is made of the code page, the data page below and,
+ * when the clock source counter can be read from user space, the
+ * uncached page holding the counter register.
+ */
+#define VDSO_DATA_OFFSET	PAGE_SIZE
+#define VDSO_VREAD_OFFSET	(2 * PAGE_SIZE)
+
+/* vread_offset when the counter is not mapped */
+#define VDSO_VREAD_NONE		(~0U)
+
+#ifndef __ASSEMBLY__
+
+#include <linux/types.h>
+
+/*
+ * Updated by update_vsyscall() under seq, which is odd while the
+ * update is in progress. The counter is limited to 32 bits.
+ */
+struct vdso_data {
+	u32 seq;
+	u32 vread_offset;	/* Counter offset in the counter page */
+	u32 vread_xor;
+	u32 cycle_last;
+	u32 mask;
+	u32 mult;
+	u32 shift;
+	u32 wall_sec;
+	u32 wall_nsec;
+	u32 wtm_sec;
+	u32 wtm_nsec;
+	s32 tz_minuteswest;
+	s32 tz_dsttime;
+};
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_SH_VDSO_H */
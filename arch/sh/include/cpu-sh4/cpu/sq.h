@@ -27,10 +27,31 @@
 #define SQ_QACR1		(P4SEG_REG_BASE  + 0x3c)
 #define SQ_ADDRMAX              (P4SEG_STORE_QUE + 0x04000000)
 
+/* Wait for the store queues to drain */
+#define store_queue_barrier()			\
+do {						\
+	(void)__raw_readl(P4SEG_STORE_QUE);	\
+	__raw_writel(0, P4SEG_STORE_QUE + 0);	\
+	__raw_writel(0, P4SEG_STORE_QUE + 8);	\
+} while (0)
+
 /* arch/sh/kernel/cpu/sh4/sq.c */
 unsigned long sq_remap(unsigned long phys, unsigned int size,
 		       const char *name, pgprot_t prot);
+unsigned long sq_remap_window(unsigned int size, const char *name);
 void sq_unmap(unsigned long vaddr);
 void sq_flush_range(unsigned long start, unsigned int len);
 
+/* arch/sh/kernel/cpu/sh4/sq-page.c */
+int sq_clear_page(void *to);
+int sq_copy_page(void *to, void *from);
+unsigned long sq_memcpy_toio(volatile void __iomem *to, const void *from,
+			     unsigned long count);
+unsigned long sq_memset_io(volatile void __iomem *to, int c,
+			   unsigned long count);
+void __clear_page(void *to);
+void __copy_page(void *to, void *from);
+
+extern unsigned long sq_io_min;
+
 #endif /* __ASM_CPU_SH4_SQ_H */
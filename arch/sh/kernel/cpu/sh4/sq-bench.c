@@ -0,0 +1,207 @@
+/*
+ * arch/sh/kernel/cpu/sh4/sq-bench.c
+ *
+ * Compare the cached and Store Queue paths for page clearing/copying and
+ * uncached writes. Results go to the kernel log when the module is loaded.
+ *
+ * Copyright (C) 2013  STMicroelectronics Limited
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/slab.h>
+#include <linux/math64.h>
+#include <linux/io.h>
+#include <linux/hrtimer.h>
+#include <asm/cacheflush.h>
+#include <cpu/sq.h>
+
+/* Working set, in pages: 4 fits in the L1 cache, 64 doesn't */
+static unsigned int pages_hot = 4;
+module_param(pages_hot, uint, 0444);
+static unsigned int pages_cold = 64;
+module_param(pages_cold, uint, 0444);
+
+static unsigned int rounds = 16;
+module_param(rounds, uint, 0444);
+
+enum sq_bench_op { SQB_CLEAR, SQB_COPY };
+
+/* KiB/s, for a run of @bytes in @ns */
+static unsigned long sq_bench_rate(unsigned long long bytes, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+
+	return div64_u64(bytes * (NSEC_PER_SEC / 1024), ns);
+}
+
+static s64 sq_bench_pages(void **pages, unsigned int n, void *src,
+			  enum sq_bench_op op, int sq)
+{
+	ktime_t start = ktime_get();
+	unsigned int round, i;
+
+	for (round = 0; round < rounds; round++)
+		for (i = 0; i < n; i++) {
+			switch (op) {
+			case SQB_CLEAR:
+				if (!sq || sq_clear_page(pages[i]))
+					__clear_page(pages[i]);
+				break;
+			case SQB_COPY:
+				if (!sq || sq_copy_page(pages[i], src))
+					__copy_page(pages[i], src);
+				break;
+			}
+		}
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static void sq_bench_page_ops(void **pages, void *src)
+{
+	static const char *names[] = { "clear_page", "copy_page" };
+	unsigned int sets[] = { pages_hot, pages_cold };
+	enum sq_bench_op op;
+	unsigned int set;
+
+	for (op = SQB_CLEAR; op <= SQB_COPY; op++)
+		for (set = 0; set < ARRAY_SIZE(sets); set++) {
+			unsigned long long bytes;
+			s64 cached, sq;
+
+			bytes = (unsigned long long)sets[set] * rounds *
+				PAGE_SIZE;
+			cached = sq_bench_pages(pages, sets[set], src, op, 0);
+			sq = sq_bench_pages(pages, sets[set], src, op, 1);
+
+			pr_info("sq_bench: %-10s %3u pages: cached %7lu KiB/s, "
+				"store queues %7lu KiB/s\n", names[op],
+				sets[set], sq_bench_rate(bytes, cached),
+				sq_bench_rate(bytes, sq));
+		}
+}
+
+/* The uncached side is memcpy_toio()/memset_io() without store queues */
+static void sq_bench_io_one(void __iomem *io, void *src, unsigned long len,
+			    int fill)
+{
+	unsigned long i;
+
+	if (fill) {
+		for (i = 0; i < len; i++)
+			writeb(0, io + i);
+	} else {
+		for (i = 0; i < len; i += 4)
+			__raw_writel(*(u32 *)(src + i), io + i);
+	}
+	mb();
+}
+
+static s64 sq_bench_io(void __iomem *io, void *src, unsigned long len,
+		       int fill, int sq)
+{
+	ktime_t start = ktime_get();
+	unsigned long done = 0;
+	unsigned int round;
+
+	for (round = 0; round < rounds; round++) {
+		if (sq)
+			done = fill ? sq_memset_io(io, 0, len) :
+				      sq_memcpy_toio(io, src, len);
+		sq_bench_io_one(io + done, src + done, len - done, fill);
+	}
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static void sq_bench_io_ops(void *src)
+{
+	struct page *page;
+	void __iomem *io;
+	unsigned long len;
+	int fill;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return;
+
+	__flush_purge_region(page_address(page), PAGE_SIZE);
+	io = ioremap_nocache(page_to_phys(page), PAGE_SIZE);
+	if (!io) {
+		pr_info("sq_bench: no uncached mapping, skipping I/O tests\n");
+		goto out;
+	}
+
+	for (fill = 0; fill <= 1; fill++)
+		for (len = SQ_SIZE; len <= PAGE_SIZE; len <<= 1) {
+			unsigned long long bytes = (unsigned long long)len *
+						   rounds;
+			s64 cached, sq;
+
+			cached = sq_bench_io(io, src, len, fill, 0);
+			sq = sq_bench_io(io, src, len, fill, 1);
+
+			pr_info("sq_bench: %-10s %5lu bytes: uncached %7lu KiB/s, "
+				"store queues %7lu KiB/s\n",
+				fill ? "memset_io" : "memcpy_toio", len,
+				sq_bench_rate(bytes, cached),
+				sq_bench_rate(bytes, sq));
+		}
+
+	iounmap(io);
+out:
+	__free_page(page);
+}
+
+static int __init sq_bench_init(void)
+{
+	unsigned int n = max(pages_hot, pages_cold);
+	void **pages;
+	void *src;
+	int i, ret = -ENOMEM;
+
+	pages = kcalloc(n, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	src = (void *)__get_free_page(GFP_KERNEL);
+	if (!src)
+		goto out;
+	memset(src, 0x5a, PAGE_SIZE);
+
+	for (i = 0; i < n; i++) {
+		pages[i] = (void *)__get_free_page(GFP_KERNEL);
+		if (!pages[i])
+			goto out;
+	}
+
+	sq_bench_page_ops(pages, src);
+	sq_bench_io_ops(src);
+	ret = 0;
+
+out:
+	for (i = 0; i < n && pages[i]; i++)
+		free_page((unsigned long)pages[i]);
+	free_page((unsigned long)src);
+	kfree(pages);
+
+	return ret;
+}
+
+static void __exit sq_bench_exit(void)
+{
+}
+
+module_init(sq_bench_init);
+module_exit(sq_bench_exit);
+
+MODULE_DESCRIPTION("SH-4 Store Queue page and uncached write benchmark");
+MODULE_LICENSE("GPL");
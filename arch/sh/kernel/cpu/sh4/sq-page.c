@@ -0,0 +1,469 @@
+/*
+ * arch/sh/kernel/cpu/sh4/sq-page.c
+ *
+ * Store Queue backed clear_page(), copy_page() and uncached bulk writes
+ *
+ * Copyright (C) 2013  STMicroelectronics Limited
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ *
+ * The store queues write 32 bytes at a time straight to memory, without
+ * allocating (and so evicting) cache lines, and as bursts even where the
+ * destination is uncached. Each CPU owns one page of store queue space,
+ * which is pointed at the destination page by rewriting its pte.
+ *
+ * Whether this beats the cached paths depends on the memory system, so
+ * it is measured at boot, see sq_page_calibrate().
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/io.h>
+#include <linux/hrtimer.h>
+#include <linux/hardirq.h>
+#include <linux/prefetch.h>
+#include <linux/bpa2.h>
+#include <asm/page.h>
+#include <asm/pgtable.h>
+#include <asm/tlbflush.h>
+#include <asm/mmu_context.h>
+#include <asm/cacheflush.h>
+#include <cpu/sq.h>
+
+static unsigned long sq_window;
+static pte_t *sq_window_pte;
+
+/* -1: measure at boot, 0: never use the store queues, 1: always */
+static int sq_page_force = -1;
+module_param_named(force, sq_page_force, int, 0444);
+
+/* How much slower (in %) the store queues may be and still be used */
+static unsigned int sq_page_bias = 10;
+module_param_named(bias, sq_page_bias, uint, 0644);
+
+static bool sq_clear_enabled __read_mostly;
+module_param_named(clear_page, sq_clear_enabled, bool, 0644);
+
+static bool sq_copy_enabled __read_mostly;
+module_param_named(copy_page, sq_copy_enabled, bool, 0644);
+
+/* Smallest memcpy_toio()/memset_io() going through the store queues */
+unsigned long sq_io_min __read_mostly = ULONG_MAX;
+EXPORT_SYMBOL_GPL(sq_io_min);
+
+/* Below two blocks the alignment head leaves nothing worth bursting */
+static int sq_io_min_set(const char *val, const struct kernel_param *kp)
+{
+	unsigned long min;
+	int ret;
+
+	ret = kstrtoul(val, 0, &min);
+	if (ret)
+		return ret;
+	if (min < 2 * SQ_SIZE)
+		return -EINVAL;
+
+	sq_io_min = min;
+	return 0;
+}
+
+static struct kernel_param_ops sq_io_min_ops = {
+	.set = sq_io_min_set,
+	.get = param_get_ulong,
+};
+module_param_cb(io_min, &sq_io_min_ops, &sq_io_min, 0644);
+
+static pte_t *sq_lookup_pte(unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset_k(addr);
+	if (pgd_none(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud))
+		return NULL;
+
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd))
+		return NULL;
+
+	return pte_offset_kernel(pmd, addr);
+}
+
+/* Point this CPU's window at @pfn, called with interrupts off */
+static unsigned long sq_window_map(unsigned long pfn)
+{
+	unsigned int idx = smp_processor_id();
+
+	set_pte(sq_window_pte + idx, pfn_pte(pfn, PAGE_KERNEL));
+
+	return sq_window + idx * PAGE_SIZE;
+}
+
+static void sq_window_unmap(unsigned long sq)
+{
+	/* Drain the queues before the translation goes */
+	store_queue_barrier();
+	local_flush_tlb_one(get_asid(), sq & PAGE_MASK);
+}
+
+static void sq_fill(unsigned long sq, u32 val, unsigned int len)
+{
+	volatile u32 *p = (volatile u32 *)sq;
+
+	for (; len; len -= SQ_SIZE, p += SQ_SIZE / 4) {
+		p[0] = val;
+		p[1] = val;
+		p[2] = val;
+		p[3] = val;
+		p[4] = val;
+		p[5] = val;
+		p[6] = val;
+		p[7] = val;
+		barrier();
+		prefetchw((void *)p);
+	}
+}
+
+static void sq_copy(unsigned long sq, const u32 *src, unsigned int len)
+{
+	volatile u32 *p = (volatile u32 *)sq;
+
+	for (; len; len -= SQ_SIZE, p += SQ_SIZE / 4, src += SQ_SIZE / 4) {
+		p[0] = src[0];
+		p[1] = src[1];
+		p[2] = src[2];
+		p[3] = src[3];
+		p[4] = src[4];
+		p[5] = src[5];
+		p[6] = src[6];
+		p[7] = src[7];
+		barrier();
+		prefetchw((void *)p);
+	}
+}
+
+/*
+ * Write a kernel page through the store queues. The pages these are
+ * used on are freshly allocated, so only the kernel mapping can have
+ * lines for them: those are dropped first, as they'd be stale.
+ */
+static int sq_page_write(void *to, const void *from)
+{
+	unsigned long flags, sq;
+
+	if (unlikely(!sq_window || !virt_addr_valid(to)))
+		return -EINVAL;
+
+	__flush_invalidate_region(to, PAGE_SIZE);
+	__l2_flush_invalidate_region(to, PAGE_SIZE);
+
+	local_irq_save(flags);
+	sq = sq_window_map(page_to_pfn(virt_to_page(to)));
+	if (from)
+		sq_copy(sq, from, PAGE_SIZE);
+	else
+		sq_fill(sq, 0, PAGE_SIZE);
+	sq_window_unmap(sq);
+	local_irq_restore(flags);
+
+	return 0;
+}
+
+int sq_clear_page(void *to)
+{
+	return sq_page_write(to, NULL);
+}
+EXPORT_SYMBOL_GPL(sq_clear_page);
+
+int sq_copy_page(void *to, void *from)
+{
+	return sq_page_write(to, from);
+}
+EXPORT_SYMBOL_GPL(sq_copy_page);
+
+void __clear_page(void *to)
+{
+	memset(to, 0, PAGE_SIZE);
+}
+EXPORT_SYMBOL_GPL(__clear_page);
+EXPORT_SYMBOL_GPL(__copy_page);
+
+void clear_page(void *to)
+{
+	if (!sq_clear_enabled || sq_clear_page(to))
+		__clear_page(to);
+}
+EXPORT_SYMBOL(clear_page);
+
+void copy_page(void *to, void *from)
+{
+	if (!sq_copy_enabled || sq_copy_page(to, from))
+		__copy_page(to, from);
+}
+
+/* Physical address behind an uncached kernel mapping, or 0 */
+static unsigned long sq_io_phys(unsigned long addr)
+{
+	pte_t *pte;
+
+#ifdef CONFIG_29BIT
+	if (PXSEG(addr) == P2SEG)
+		return addr & 0x1fffffff;
+#endif
+
+	if (addr < VMALLOC_START || addr >= VMALLOC_END)
+		return 0;
+
+	pte = sq_lookup_pte(addr);
+	if (!pte || !pte_present(*pte))
+		return 0;
+
+	return (pte_pfn(*pte) << PAGE_SHIFT) | (addr & ~PAGE_MASK);
+}
+
+/*
+ * Bursts are only safe into memory, not into device registers: either
+ * system memory, or a bpa2 buffer (where framebuffers and the like live).
+ */
+static int sq_io_is_memory(unsigned long phys, unsigned long len)
+{
+	if (pfn_valid(phys >> PAGE_SHIFT))
+		return 1;
+
+#ifdef CONFIG_BPA2
+	if (bpa2_find_part_addr(phys, len))
+		return 1;
+#endif
+
+	return 0;
+}
+
+static unsigned long sq_io_write(unsigned long to, const u32 *from, u32 val,
+				 unsigned long count)
+{
+	unsigned long done = 0;
+
+	/* bpa2_find_part_addr() can't be used from interrupts */
+	if (!sq_window || in_interrupt())
+		return 0;
+
+	count &= ~(SQ_SIZE - 1);
+
+	while (done < count) {
+		unsigned long addr = to + done;
+		unsigned long phys = sq_io_phys(addr);
+		unsigned long len, flags, sq;
+
+		len = min(count - done, PAGE_SIZE - (addr & ~PAGE_MASK));
+		if (!phys || !sq_io_is_memory(phys, len))
+			break;
+
+		local_irq_save(flags);
+		sq = sq_window_map(phys >> PAGE_SHIFT) + (phys & ~PAGE_MASK);
+		if (from)
+			sq_copy(sq, from + done / 4, len);
+		else
+			sq_fill(sq, val, len);
+		sq_window_unmap(sq);
+		local_irq_restore(flags);
+
+		done += len;
+	}
+
+	return done;
+}
+
+/**
+ * sq_memcpy_toio - Copy to an uncached mapping through the Store Queues
+ * @to: 32 byte aligned destination, an uncached kernel mapping
+ * @from: 4 byte aligned source
+ * @count: length, only whole 32 byte blocks are copied
+ *
+ * Returns the number of bytes copied, which is short (possibly 0) where
+ * @to stops being a mapping of memory the store queues can write to.
+ */
+unsigned long sq_memcpy_toio(volatile void __iomem *to, const void *from,
+			     unsigned long count)
+{
+	return sq_io_write((unsigned long)to, from, 0, count);
+}
+EXPORT_SYMBOL_GPL(sq_memcpy_toio);
+
+/**
+ * sq_memset_io - Fill an uncached mapping through the Store Queues
+ * @to: 32 byte aligned destination, an uncached kernel mapping
+ * @c: byte to fill with
+ * @count: length, only whole 32 byte blocks are written
+ *
+ * Returns the number of bytes written, as sq_memcpy_toio().
+ */
+unsigned long sq_memset_io(volatile void __iomem *to, int c,
+			   unsigned long count)
+{
+	return sq_io_write((unsigned long)to, NULL, (u8)c * 0x01010101U, count);
+}
+EXPORT_SYMBOL_GPL(sq_memset_io);
+
+/*
+ * Boot time cost model: each path is timed on a working set larger than
+ * the L1 cache, and the store queues are used when they are no more
+ * than sq_page_bias % slower, as they also leave the cache alone.
+ */
+#define SQ_CAL_PAGES	16
+#define SQ_CAL_ROUNDS	4
+
+static s64 __init sq_cal_pages(void **pages, void *src, int sq)
+{
+	ktime_t start = ktime_get();
+	int round, i;
+
+	for (round = 0; round < SQ_CAL_ROUNDS; round++)
+		for (i = 0; i < SQ_CAL_PAGES; i++) {
+			if (src && sq)
+				sq_copy_page(pages[i], src);
+			else if (src)
+				__copy_page(pages[i], src);
+			else if (sq)
+				sq_clear_page(pages[i]);
+			else
+				__clear_page(pages[i]);
+		}
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static bool __init sq_cal_choose(const char *what, s64 cached, s64 sq)
+{
+	bool use = sq * 100 <= cached * (100 + sq_page_bias);
+
+	pr_info("sq: %s: cached %lld ns, store queues %lld ns, using %s\n",
+		what, cached, sq, use ? "store queues" : "cache");
+
+	return use;
+}
+
+static s64 __init sq_cal_io(void __iomem *io, void *src, unsigned long len,
+			   int sq)
+{
+	ktime_t start = ktime_get();
+	unsigned long done = 0;
+	int round;
+
+	for (round = 0; round < SQ_CAL_ROUNDS; round++) {
+		if (sq)
+			done = sq_memcpy_toio(io, src, len);
+		memcpy_toio(io + done, src + done, len - done);
+	}
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static void __init sq_cal_io_min(void *src)
+{
+	struct page *page;
+	void __iomem *io;
+	unsigned long len;
+
+	/* An io_min= given on the command line wins */
+	if (sq_io_min != ULONG_MAX)
+		return;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return;
+
+	__flush_purge_region(page_address(page), PAGE_SIZE);
+	io = ioremap_nocache(page_to_phys(page), PAGE_SIZE);
+	if (!io)
+		goto out;
+
+	for (len = 2 * SQ_SIZE; len <= PAGE_SIZE; len <<= 1) {
+		s64 cached, sq;
+
+		cached = sq_cal_io(io, src, len, 0);
+		sq = sq_cal_io(io, src, len, 1);
+
+		if (sq <= cached)
+			break;
+	}
+
+	sq_io_min = len <= PAGE_SIZE ? len : ULONG_MAX;
+	pr_info("sq: uncached writes of %lu bytes and more use store queues\n",
+		sq_io_min);
+
+	iounmap(io);
+out:
+	__free_page(page);
+}
+
+static void __init sq_page_calibrate(void)
+{
+	void *pages[SQ_CAL_PAGES];
+	void *src;
+	int i, n;
+
+	src = (void *)__get_free_page(GFP_KERNEL);
+	if (!src)
+		return;
+	memset(src, 0x5a, PAGE_SIZE);
+
+	for (n = 0; n < SQ_CAL_PAGES; n++) {
+		pages[n] = (void *)__get_free_page(GFP_KERNEL);
+		if (!pages[n])
+			goto out;
+	}
+
+	sq_clear_enabled = sq_cal_choose("clear_page",
+					 sq_cal_pages(pages, NULL, 0),
+					 sq_cal_pages(pages, NULL, 1));
+	sq_copy_enabled = sq_cal_choose("copy_page",
+					sq_cal_pages(pages, src, 0),
+					sq_cal_pages(pages, src, 1));
+	sq_cal_io_min(src);
+
+out:
+	for (i = 0; i < n; i++)
+		free_page((unsigned long)pages[i]);
+	free_page((unsigned long)src);
+}
+
+static int __init sq_page_init(void)
+{
+	unsigned long window;
+
+	if (sq_page_force == 0)
+		return 0;
+
+	window = sq_remap_window(nr_cpu_ids * PAGE_SIZE, "sq_page");
+	if (IS_ERR_VALUE(window)) {
+		pr_err("sq: no window for page operations (%ld)\n",
+		       (long)window);
+		return window;
+	}
+
+	sq_window_pte = sq_lookup_pte(window);
+	BUG_ON(!sq_window_pte);
+	sq_window = window;
+
+	if (sq_page_force == 1) {
+		sq_clear_enabled = true;
+		sq_copy_enabled = true;
+		if (sq_io_min == ULONG_MAX)
+			sq_io_min = 2 * SQ_SIZE;
+	} else {
+		sq_page_calibrate();
+	}
+
+	return 0;
+}
+/* After sq_api_init() */
+late_initcall(sq_page_init);
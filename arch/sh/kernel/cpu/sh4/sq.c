@@ -42,13 +42,6 @@ static DEFINE_SPINLOCK(sq_mapping_lock);
 static struct kmem_cache *sq_cache;
 static unsigned long *sq_bitmap;
 
-#define store_queue_barrier()			\
-do {						\
-	(void)__raw_readl(P4SEG_STORE_QUE);	\
-	__raw_writel(0, P4SEG_STORE_QUE + 0);	\
-	__raw_writel(0, P4SEG_STORE_QUE + 8);	\
-} while (0);
-
 /**
  * sq_flush_range - Flush (prefetch) a specific SQ range
  * @start: the store queue address to start flushing from
@@ -131,36 +124,13 @@ static int __sq_remap(struct sq_mapping *map, pgprot_t prot)
 	return 0;
 }
 
-/**
- * sq_remap - Map a physical address through the Store Queues
- * @phys: Physical address of mapping.
- * @size: Length of mapping.
- * @name: User invoking mapping.
- * @prot: Protection bits.
- *
- * Remaps the physical address @phys through the next available store queue
- * address of @size length. @name is logged at boot time as well as through
- * the sysfs interface.
- */
-unsigned long sq_remap(unsigned long phys, unsigned int size,
-		       const char *name, pgprot_t prot)
+static unsigned long __sq_alloc(unsigned long phys, unsigned int size,
+				const char *name, pgprot_t prot)
 {
 	struct sq_mapping *map;
-	unsigned long end;
 	unsigned int psz;
 	int ret, page;
 
-	/* Don't allow wraparound or zero size */
-	end = phys + size - 1;
-	if (unlikely(!size || end < phys))
-		return -EINVAL;
-	/* Don't allow anyone to remap normal memory.. */
-	if (unlikely(phys < virt_to_phys(high_memory)))
-		return -EINVAL;
-
-	phys &= PAGE_MASK;
-	size = PAGE_ALIGN(end + 1) - phys;
-
 	map = kmem_cache_alloc(sq_cache, GFP_KERNEL);
 	if (unlikely(!map))
 		return -ENOMEM;
@@ -196,8 +166,57 @@ out:
 	kmem_cache_free(sq_cache, map);
 	return ret;
 }
+
+/**
+ * sq_remap - Map a physical address through the Store Queues
+ * @phys: Physical address of mapping.
+ * @size: Length of mapping.
+ * @name: User invoking mapping.
+ * @prot: Protection bits.
+ *
+ * Remaps the physical address @phys through the next available store queue
+ * address of @size length. @name is logged at boot time as well as through
+ * the sysfs interface.
+ */
+unsigned long sq_remap(unsigned long phys, unsigned int size,
+		       const char *name, pgprot_t prot)
+{
+	unsigned long end;
+
+	/* Don't allow wraparound or zero size */
+	end = phys + size - 1;
+	if (unlikely(!size || end < phys))
+		return -EINVAL;
+	/* Don't allow anyone to remap normal memory.. */
+	if (unlikely(phys < virt_to_phys(high_memory)))
+		return -EINVAL;
+
+	phys &= PAGE_MASK;
+	size = PAGE_ALIGN(end + 1) - phys;
+
+	return __sq_alloc(phys, size, name, prot);
+}
 EXPORT_SYMBOL(sq_remap);
 
+#ifdef CONFIG_MMU
+/**
+ * sq_remap_window - Allocate a Store Queue window to be retargeted
+ * @size: Length of the window.
+ * @name: User invoking mapping.
+ *
+ * Allocates @size bytes of store queue address space, with page tables
+ * behind it. The window initially maps the start of physical memory;
+ * the caller then points its ptes at whatever it needs to write, one
+ * page at a time (see sq-page.c). Release it with sq_unmap().
+ */
+unsigned long sq_remap_window(unsigned int size, const char *name)
+{
+	return __sq_alloc(__pa(PAGE_OFFSET), PAGE_ALIGN(size), name,
+			  PAGE_KERNEL);
+}
+#endif
+
+
 /**
  * sq_unmap - Unmap a Store Queue allocation
  * @vaddr: Pre-allocated Store Queue mapping.
@@ -9,6 +9,8 @@
  */
 #include <linux/dma-mapping.h>
 #include <linux/io.h>
+#include <asm/cacheflush.h>
+#include <asm/stm-l2-cache.h>
 
 static dma_addr_t nommu_map_page(struct device *dev, struct page *page,
 				 unsigned long offset, size_t size,
@@ -23,6 +25,42 @@ static dma_addr_t nommu_map_page(struct device *dev, struct page *page,
 	return addr;
 }
 
+/*
+ * dma_cache_sync() on each entry, but with a single L2 sync for the whole
+ * list rather than one per entry.
+ */
+static void nommu_cache_sync_sg(struct scatterlist *sg, int nents,
+				enum dma_data_direction dir)
+{
+	struct stm_l2_batch batch = STM_L2_BATCH_INIT;
+	struct scatterlist *s;
+	int i;
+
+	for_each_sg(sg, s, nents, i) {
+		void *addr = sg_virt(s);
+
+		switch (dir) {
+		case DMA_FROM_DEVICE:		/* invalidate only */
+			__flush_invalidate_region(addr, s->length);
+			stm_l2_batch_invalidate(&batch, sg_phys(s),
+						s->length, 1);
+			break;
+		case DMA_TO_DEVICE:		/* writeback only */
+			__flush_wback_region(addr, s->length);
+			stm_l2_batch_wback(&batch, sg_phys(s), s->length, 1);
+			break;
+		case DMA_BIDIRECTIONAL:		/* writeback and invalidate */
+			__flush_purge_region(addr, s->length);
+			stm_l2_batch_purge(&batch, sg_phys(s), s->length, 1);
+			break;
+		default:
+			BUG();
+		}
+	}
+
+	stm_l2_batch_commit(&batch);
+}
+
 static int nommu_map_sg(struct device *dev, struct scatterlist *sg,
 			int nents, enum dma_data_direction dir,
 			struct dma_attrs *attrs)
@@ -35,12 +73,12 @@ static int nommu_map_sg(struct device *dev, struct scatterlist *sg,
 	for_each_sg(sg, s, nents, i) {
 		BUG_ON(!sg_page(s));
 
-		dma_cache_sync(dev, sg_virt(s), s->length, dir);
-
 		s->dma_address = sg_phys(s);
 		s->dma_length = s->length;
 	}
 
+	nommu_cache_sync_sg(sg, nents, dir);
+
 	return nents;
 }
 
@@ -54,11 +92,7 @@ static void nommu_sync_single(struct device *dev, dma_addr_t addr,
 static void nommu_sync_sg(struct device *dev, struct scatterlist *sg,
 			  int nelems, enum dma_data_direction dir)
 {
-	struct scatterlist *s;
-	int i;
-
-	for_each_sg(sg, s, nelems, i)
-		dma_cache_sync(dev, sg_virt(s), s->length, dir);
+	nommu_cache_sync_sg(sg, nelems, dir);
 }
 #endif
 
@@ -12,6 +12,9 @@
 #include <linux/pci.h>
 #include <asm/machvec.h>
 #include <asm/io.h>
+#ifdef CONFIG_SH_STORE_QUEUES_PAGE_OPS
+#include <cpu/sq.h>
+#endif
 
 /*
  * Copy data from IO memory space to "real" memory space.
@@ -81,6 +84,30 @@ EXPORT_SYMBOL(memcpy_fromio);
  */
 void memcpy_toio(volatile void __iomem *to, const void *from, unsigned long count)
 {
+#ifdef CONFIG_SH_STORE_QUEUES_PAGE_OPS
+	/*
+	 * Large copies into memory: align the destination, then let the
+	 * store queues burst what they can.
+	 */
+	unsigned long head = (-(u32)to) & (SQ_SIZE - 1);
+
+	if ((count >= sq_io_min) && (count >= head + SQ_SIZE) &&
+	    ((((u32)to | (u32)from) & 0x3) == 0)) {
+		unsigned long done;
+
+		for (; head; head -= 4, count -= 4) {
+			*(volatile u32 *)to = *(u32 *)from;
+			to += 4;
+			from += 4;
+		}
+
+		done = sq_memcpy_toio(to, from, count);
+		to += done;
+		from += done;
+		count -= done;
+	}
+#endif
+
 	if ((((u32)to | (u32)from) & 0x3) == 0) {
 		for ( ; count > 3; count -= 4) {
 			*(volatile u32 *)to = *(u32 *)from;
@@ -105,6 +132,23 @@ EXPORT_SYMBOL(memcpy_toio);
  */
 void memset_io(volatile void __iomem *dst, int c, unsigned long count)
 {
+#ifdef CONFIG_SH_STORE_QUEUES_PAGE_OPS
+	unsigned long head = (-(u32)dst) & (SQ_SIZE - 1);
+
+	if ((count >= sq_io_min) && (count >= head + SQ_SIZE)) {
+		unsigned long done;
+
+		for (; head; head--, count--) {
+			writeb(c, dst);
+			dst++;
+		}
+
+		done = sq_memset_io(dst, c, count);
+		dst += done;
+		count -= done;
+	}
+#endif
+
         while (count) {
                 count--;
                 writeb(c, dst);
@@ -0,0 +1,205 @@
+/*
+ * arch/sh/kernel/vsyscall/vsyscall-gettime.c
+ *
+ * User space clock_gettime() and gettimeofday() for the vsyscall page.
+ *
+ * This code runs in user mode, at whatever address the page is mapped:
+ * it must be position independent, must not use the GOT (nobody
+ * relocates the vDSO) and must not call into libgcc.
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+#include <linux/kernel.h>
+#include <linux/time.h>
+#include <linux/unistd.h>
+#include <asm/page.h>
+#include <asm/barrier.h>
+#include <asm/vdso.h>
+
+static notrace long vdso_syscall2(long nr, long arg0, long arg1)
+{
+	register long r3 __asm__("r3") = nr;
+	register long r4 __asm__("r4") = arg0;
+	register long r5 __asm__("r5") = arg1;
+	register long r0 __asm__("r0");
+
+	/* The "or r0,r0"s work around the SH-3/4 trapa hardware bug */
+	__asm__ __volatile__("trapa	#0x12\n\t"
+			     "or	r0, r0\n\t"
+			     "or	r0, r0\n\t"
+			     "or	r0, r0\n\t"
+			     "or	r0, r0\n\t"
+			     "or	r0, r0"
+			     : "=z" (r0)
+			     : "r" (r3), "r" (r4), "r" (r5)
+			     : "memory", "t");
+
+	return r0;
+}
+
+/* The vDSO base: the code is all in its first page */
+static inline notrace unsigned long vdso_base(void)
+{
+	unsigned long pc;
+
+	__asm__("mova	1f, %0\n\t"
+		".align	2\n"
+		"1:"
+		: "=z" (pc));
+
+	return pc & PAGE_MASK;
+}
+
+static inline notrace const struct vdso_data *vdso_get_data(void)
+{
+	return (const struct vdso_data *)(vdso_base() + VDSO_DATA_OFFSET);
+}
+
+static inline notrace u32 vdso_read_begin(const struct vdso_data *vdata)
+{
+	u32 seq;
+
+	while ((seq = ACCESS_ONCE(vdata->seq)) & 1)
+		;
+	/* Pairs with the smp_wmb()s of update_vsyscall() (synco on SH-4A) */
+	smp_rmb();
+
+	return seq;
+}
+
+static inline notrace int vdso_read_retry(const struct vdso_data *vdata,
+					  u32 seq)
+{
+	smp_rmb();
+
+	return ACCESS_ONCE(vdata->seq) != seq;
+}
+
+/* u64 >> shift without __lshrdi3 */
+static inline notrace u64 vdso_shr64(u64 val, u32 shift)
+{
+	u32 hi = val >> 32, lo = val;
+
+	if (shift >= 32)
+		return hi >> (shift - 32);
+	if (!shift)
+		return val;
+
+	return ((u64)(hi >> shift) << 32) | (lo >> shift) |
+		(hi << (32 - shift));
+}
+
+/* Nanoseconds since the last update, from the mapped counter */
+static inline notrace u64 vdso_cycles_ns(const struct vdso_data *vdata)
+{
+	const volatile u32 *reg;
+	u32 cycles;
+
+	reg = (const volatile u32 *)(vdso_base() + VDSO_VREAD_OFFSET +
+				     vdata->vread_offset);
+	cycles = (*reg ^ vdata->vread_xor) - vdata->cycle_last;
+	cycles &= vdata->mask;
+
+	return vdso_shr64((u64)cycles * vdata->mult, vdata->shift);
+}
+
+static inline notrace void vdso_ts_set(struct timespec *ts, u32 sec, u64 nsec)
+{
+	ts->tv_sec = sec;
+	while (nsec >= NSEC_PER_SEC) {
+		nsec -= NSEC_PER_SEC;
+		ts->tv_sec++;
+	}
+	ts->tv_nsec = (u32)nsec;
+}
+
+static notrace int do_realtime(struct timespec *ts, int coarse)
+{
+	const struct vdso_data *vdata = vdso_get_data();
+	u32 seq, sec;
+	u64 nsec;
+
+	do {
+		seq = vdso_read_begin(vdata);
+		if (!coarse && vdata->vread_offset == VDSO_VREAD_NONE)
+			return -1;
+		sec = vdata->wall_sec;
+		nsec = vdata->wall_nsec;
+		if (!coarse)
+			nsec += vdso_cycles_ns(vdata);
+	} while (vdso_read_retry(vdata, seq));
+
+	vdso_ts_set(ts, sec, nsec);
+
+	return 0;
+}
+
+static notrace int do_monotonic(struct timespec *ts, int coarse)
+{
+	const struct vdso_data *vdata = vdso_get_data();
+	u32 seq, sec;
+	u64 nsec;
+
+	do {
+		seq = vdso_read_begin(vdata);
+		if (!coarse && vdata->vread_offset == VDSO_VREAD_NONE)
+			return -1;
+		sec = vdata->wall_sec + vdata->wtm_sec;
+		nsec = (u64)vdata->wall_nsec + vdata->wtm_nsec;
+		if (!coarse)
+			nsec += vdso_cycles_ns(vdata);
+	} while (vdso_read_retry(vdata, seq));
+
+	vdso_ts_set(ts, sec, nsec);
+
+	return 0;
+}
+
+notrace int __kernel_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+	int ret = -1;
+
+	switch (clock) {
+	case CLOCK_REALTIME:
+		ret = do_realtime(ts, 0);
+		break;
+	case CLOCK_MONOTONIC:
+		ret = do_monotonic(ts, 0);
+		break;
+	case CLOCK_REALTIME_COARSE:
+		ret = do_realtime(ts, 1);
+		break;
+	case CLOCK_MONOTONIC_COARSE:
+		ret = do_monotonic(ts, 1);
+		break;
+	}
+
+	if (ret)
+		ret = vdso_syscall2(__NR_clock_gettime, clock, (long)ts);
+
+	return ret;
+}
+
+notrace int __kernel_gettimeofday(struct timeval *tv, struct timezone *tz)
+{
+	const struct vdso_data *vdata = vdso_get_data();
+	struct timespec ts;
+
+	if (tv) {
+		if (do_realtime(&ts, 0))
+			return vdso_syscall2(__NR_gettimeofday, (long)tv,
+					     (long)tz);
+		tv->tv_sec = ts.tv_sec;
+		/* tv_nsec / 1000, without __udivsi3 */
+		tv->tv_usec = ((u64)ts.tv_nsec * 0x10624dd3) >> 38;
+	}
+
+	if (tz) {
+		tz->tz_minuteswest = vdata->tz_minuteswest;
+		tz->tz_dsttime = vdata->tz_dsttime;
+	}
+
+	return 0;
+}
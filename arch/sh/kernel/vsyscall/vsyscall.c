@@ -11,6 +11,7 @@
  * for more details.
  */
 #include <linux/mm.h>
+#include <linux/mman.h>
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/gfp.h>
@@ -18,6 +19,10 @@
 #include <linux/elf.h>
 #include <linux/sched.h>
 #include <linux/err.h>
+#include <linux/clocksource.h>
+#include <linux/spinlock.h>
+#include <asm/addrspace.h>
+#include <asm/vdso.h>
 
 /*
  * Should the kernel map a VDSO page into processes and pass its
@@ -38,7 +43,28 @@ __setup("vdso=", vdso_setup);
  * of the ELF DSO images included therein.
  */
 extern const char vsyscall_trapa_start, vsyscall_trapa_end;
-static struct page *syscall_pages[1];
+
+#ifdef CONFIG_VSYSCALL_TIME
+#define VSYSCALL_PAGES		2
+#define VSYSCALL_MAP_SIZE	(VDSO_VREAD_OFFSET + PAGE_SIZE)
+#define VSYSCALL_MAP_FLAGS	MAP_SHARED	/* For colour alignment */
+
+static struct vdso_data *vdso_data;
+
+/* The counter page has no struct page, its PTEs are set up at exec */
+static struct page *vread_pages[1];
+
+static DEFINE_SPINLOCK(vread_lock);
+static unsigned long vread_reg;		/* Current clock source counter */
+static unsigned long vread_phys;	/* Counter page mapped at exec */
+static int vread_fixed;
+#else
+#define VSYSCALL_PAGES		1
+#define VSYSCALL_MAP_SIZE	PAGE_SIZE
+#define VSYSCALL_MAP_FLAGS	0
+#endif
+
+static struct page *syscall_pages[VSYSCALL_PAGES];
 
 int __init vsyscall_init(void)
 {
@@ -50,13 +76,172 @@ int __init vsyscall_init(void)
 	 * to adding the page to ELF core dumps
 	 */
 
+	BUG_ON(&vsyscall_trapa_end - &vsyscall_trapa_start > PAGE_SIZE);
 	memcpy(syscall_page,
 	       &vsyscall_trapa_start,
 	       &vsyscall_trapa_end - &vsyscall_trapa_start);
 
+#ifdef CONFIG_VSYSCALL_TIME
+	/*
+	 * Without the data page, the vDSO time functions cannot run: the
+	 * vDSO is then not advertised to user space. The code page is still
+	 * mapped, for the signal return trampolines.
+	 */
+	vdso_data = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!vdso_data) {
+		pr_err("vsyscall: no memory for the vDSO data page\n");
+		vdso_enabled = 0;
+		return -ENOMEM;
+	}
+	vdso_data->vread_offset = VDSO_VREAD_NONE;
+	syscall_pages[1] = virt_to_page(vdso_data);
+#endif
+
 	return 0;
 }
 
+#ifdef CONFIG_VSYSCALL_TIME
+/*
+ * Physical address a user mapping needs to reach the counter register,
+ * or 0. The control registers in P4 are only mirrored in area 7, which
+ * can be mapped through the TLB, in 29-bit mode.
+ */
+static unsigned long vread_reg_to_phys(unsigned long reg)
+{
+	if (PXSEG(reg) == P4SEG)
+		return reg & 0x1fffffff;
+
+	return 0;
+}
+
+/*
+ * The counter page every process gets is fixed by the first exec, so
+ * that the vDSO only uses it while it matches the current clock source.
+ * Clock sources are registered by then, so in practice it is the
+ * best clock source's.
+ */
+static unsigned long vread_page(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&vread_lock, flags);
+	if (!vread_fixed) {
+		vread_phys = vread_reg_to_phys(vread_reg) & PAGE_MASK;
+		vread_fixed = 1;
+	}
+	spin_unlock_irqrestore(&vread_lock, flags);
+
+	return vread_phys;
+}
+
+void update_vsyscall(struct timespec *ts, struct timespec *wtm,
+		     struct clocksource *clock, u32 mult)
+{
+	struct vdso_data *vdata = vdso_data;
+	unsigned long phys;
+
+	if (!vdata)
+		return;
+
+	spin_lock(&vread_lock);
+	vread_reg = clock->mask <= 0xffffffff ? clock->archdata.vread_reg : 0;
+	phys = vread_reg_to_phys(vread_reg);
+
+	vdata->seq++;
+	smp_wmb();
+
+	if (vread_fixed && phys && (phys & PAGE_MASK) == vread_phys)
+		vdata->vread_offset = phys & ~PAGE_MASK;
+	else
+		vdata->vread_offset = VDSO_VREAD_NONE;
+	vdata->vread_xor = clock->archdata.vread_xor;
+	vdata->cycle_last = clock->cycle_last;
+	vdata->mask = clock->mask;
+	vdata->mult = mult;
+	vdata->shift = clock->shift;
+	vdata->wall_sec = ts->tv_sec;
+	vdata->wall_nsec = ts->tv_nsec;
+	vdata->wtm_sec = wtm->tv_sec;
+	vdata->wtm_nsec = wtm->tv_nsec;
+
+	smp_wmb();
+	vdata->seq++;
+	spin_unlock(&vread_lock);
+}
+
+void update_vsyscall_tz(void)
+{
+	struct vdso_data *vdata = vdso_data;
+	unsigned long flags;
+
+	if (!vdata)
+		return;
+
+	/* Serialised with update_vsyscall(), which runs in interrupts */
+	spin_lock_irqsave(&vread_lock, flags);
+	vdata->seq++;
+	smp_wmb();
+	vdata->tz_minuteswest = sys_tz.tz_minuteswest;
+	vdata->tz_dsttime = sys_tz.tz_dsttime;
+	smp_wmb();
+	vdata->seq++;
+	spin_unlock_irqrestore(&vread_lock, flags);
+}
+
+static int vsyscall_map_vread(struct mm_struct *mm, unsigned long addr)
+{
+	struct vm_area_struct *vma;
+	unsigned long phys = vread_page();
+	int ret;
+
+	if (!phys || !vdso_data)
+		return 0;
+
+	ret = install_special_mapping(mm, addr, PAGE_SIZE,
+				      VM_READ | VM_MAYREAD, vread_pages);
+	if (unlikely(ret))
+		return ret;
+
+	vma = find_vma(mm, addr);
+	return remap_pfn_range(vma, addr, phys >> PAGE_SHIFT, PAGE_SIZE,
+			       pgprot_noncached(vma->vm_page_prot));
+}
+
+/*
+ * Colour of the code page that puts the data page at the same colour
+ * as the kernel's view of it: the updates are then seen by the user
+ * without any cache maintenance.
+ */
+static unsigned long vsyscall_pgoff(void)
+{
+	if (!vdso_data)
+		return 0;
+
+	return ((unsigned long)vdso_data >> PAGE_SHIFT) - 1;
+}
+
+/* Only the code page when the data page could not be allocated */
+static inline unsigned long vsyscall_pages_size(void)
+{
+	return vdso_data ? VSYSCALL_PAGES * PAGE_SIZE : PAGE_SIZE;
+}
+#else
+static inline int vsyscall_map_vread(struct mm_struct *mm, unsigned long addr)
+{
+	return 0;
+}
+
+static inline unsigned long vsyscall_pgoff(void)
+{
+	return 0;
+}
+
+static inline unsigned long vsyscall_pages_size(void)
+{
+	return PAGE_SIZE;
+}
+#endif
+
 /* Setup a VMA at program startup for the vsyscall page */
 int arch_setup_additional_pages(struct linux_binprm *bprm, int uses_interp)
 {
@@ -65,13 +250,14 @@ int arch_setup_additional_pages(struct linux_binprm *bprm, int uses_interp)
 	int ret;
 
 	down_write(&mm->mmap_sem);
-	addr = get_unmapped_area(NULL, 0, PAGE_SIZE, 0, 0);
+	addr = get_unmapped_area(NULL, 0, VSYSCALL_MAP_SIZE, vsyscall_pgoff(),
+				 VSYSCALL_MAP_FLAGS);
 	if (IS_ERR_VALUE(addr)) {
 		ret = addr;
 		goto up_fail;
 	}
 
-	ret = install_special_mapping(mm, addr, PAGE_SIZE,
+	ret = install_special_mapping(mm, addr, vsyscall_pages_size(),
 				      VM_READ | VM_EXEC |
 				      VM_MAYREAD | VM_MAYWRITE | VM_MAYEXEC,
 				      syscall_pages);
@@ -80,6 +266,8 @@ int arch_setup_additional_pages(struct linux_binprm *bprm, int uses_interp)
 
 	current->mm->context.vdso = (void *)addr;
 
+	ret = vsyscall_map_vread(mm, addr + VDSO_VREAD_OFFSET);
+
 up_fail:
 	up_write(&mm->mmap_sem);
 	return ret;
@@ -0,0 +1,232 @@
+/*
+ * arch/sh/lib/csum-test.c
+ *
+ * Check csum_partial_copy_generic() against a plain C version, for all
+ * source and destination alignments and a range of lengths, including
+ * faulting user copies, then report its throughput. Results go to the
+ * kernel log when the module is loaded.
+ *
+ * Copyright (C) 2013  STMicroelectronics Limited
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/math64.h>
+#include <linux/hrtimer.h>
+#include <linux/uaccess.h>
+#include <net/checksum.h>
+#include <asm/unaligned.h>
+
+static unsigned int rounds = 256;
+module_param(rounds, uint, 0444);
+
+#define CSUM_TEST_MAX	4096
+#define CSUM_TEST_GUARD	64
+#define CSUM_TEST_BUF	(CSUM_TEST_MAX + 2 * CSUM_TEST_GUARD)
+#define CSUM_TEST_OFFS	32	/* Destination offsets tried */
+
+/* The generic C csum_partial_copy(): copy, then sum 16 bits at a time */
+static __wsum csum_test_ref(const u8 *src, u8 *dst, int len, __wsum sum)
+{
+	u64 acc = (__force u32)sum;
+	int i;
+
+	memcpy(dst, src, len);
+
+	for (i = 0; i + 1 < len; i += 2)
+		acc += get_unaligned((u16 *)(src + i));
+	if (len & 1)
+#ifdef __LITTLE_ENDIAN
+		acc += src[len - 1];
+#else
+		acc += src[len - 1] << 8;
+#endif
+
+	while (acc >> 32)
+		acc = (acc & 0xffffffff) + (acc >> 32);
+
+	return (__force __wsum)acc;
+}
+
+static int csum_test_one(u8 *src, u8 *dst, u8 *ref, int len, __wsum sum)
+{
+	__wsum got, want;
+
+	memset(dst, 0xa5, CSUM_TEST_BUF);
+	got = csum_partial_copy_nocheck(src + CSUM_TEST_GUARD,
+					dst + CSUM_TEST_GUARD, len, sum);
+	want = csum_test_ref(src + CSUM_TEST_GUARD, ref, len, sum);
+
+	if (csum_fold(got) != csum_fold(want)) {
+		pr_err("csum_test: %p -> %p, %d bytes, sum %08x: got %04x, "
+		       "expected %04x\n", src + CSUM_TEST_GUARD,
+		       dst + CSUM_TEST_GUARD, len, (__force u32)sum,
+		       (__force u16)csum_fold(got),
+		       (__force u16)csum_fold(want));
+		return -EINVAL;
+	}
+
+	if (memcmp(dst + CSUM_TEST_GUARD, ref, len) ||
+	    memchr_inv(dst, 0xa5, CSUM_TEST_GUARD) ||
+	    memchr_inv(dst + CSUM_TEST_GUARD + len, 0xa5, CSUM_TEST_GUARD)) {
+		pr_err("csum_test: %p -> %p, %d bytes: bad copy\n",
+		       src + CSUM_TEST_GUARD, dst + CSUM_TEST_GUARD, len);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int csum_test_check(u8 *src, u8 *dst, u8 *ref)
+{
+	static const __wsum sums[] = {
+		0, (__force __wsum)0xffffffff, (__force __wsum)0x12345678,
+	};
+	int so, dof, len, i, ret, tests = 0;
+
+	for (so = 0; so < 4; so++)
+		for (dof = 0; dof < CSUM_TEST_OFFS; dof++)
+			for (len = 0; len <= CSUM_TEST_MAX;
+			     len += len < 160 ? 1 : 61) {
+				__wsum sum = sums[len % ARRAY_SIZE(sums)];
+
+				ret = csum_test_one(src + so, dst + dof, ref,
+						    len, sum);
+				if (ret)
+					return ret;
+				tests++;
+			}
+
+	/* All ones, to exercise the carries */
+	memset(src, 0xff, CSUM_TEST_BUF);
+	for (i = 0; i < 4; i++) {
+		ret = csum_test_one(src + i, dst + 3 - i, ref, 1500,
+				    (__force __wsum)0xffffffff);
+		if (ret)
+			return ret;
+		tests++;
+	}
+
+	pr_info("csum_test: %d copies checked\n", tests);
+
+	return 0;
+}
+
+/* A user buffer running into an unmapped page must fault cleanly */
+static int csum_test_fault(u8 *dst)
+{
+	unsigned long addr;
+	int off, err, ret = 0;
+	void __user *src;
+
+	addr = vm_mmap(NULL, 0, 2 * PAGE_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS, 0);
+	if (IS_ERR_VALUE(addr))
+		return 0;
+	vm_munmap(addr + PAGE_SIZE, PAGE_SIZE);
+
+	for (off = 1; off <= 256; off += 51) {
+		src = (void __user *)(addr + PAGE_SIZE - off);
+		err = 0;
+		memset(dst, 0xa5, 512);
+		csum_partial_copy_from_user(src, dst, 512, 0, &err);
+		if (err != -EFAULT || memchr_inv(dst, 0, 512)) {
+			pr_err("csum_test: fault %d bytes in: err %d\n",
+			       off, err);
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	vm_munmap(addr, PAGE_SIZE);
+
+	return ret;
+}
+
+/* MB/s, for a run of @bytes in @ns */
+static unsigned long csum_test_rate(unsigned long long bytes, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+
+	return div64_u64(bytes * (NSEC_PER_SEC / 1000000), ns);
+}
+
+static void csum_test_bench(u8 *src, u8 *dst)
+{
+	static const int lens[] = { 64, 256, 1500, CSUM_TEST_MAX };
+	static const int aligns[][2] = {
+		{ 0, 0 }, { 0, 2 }, { 2, 0 }, { 1, 0 },
+	};
+	unsigned int i, a, round;
+
+	for (i = 0; i < ARRAY_SIZE(lens); i++)
+		for (a = 0; a < ARRAY_SIZE(aligns); a++) {
+			u8 *s = src + aligns[a][0], *d = dst + aligns[a][1];
+			unsigned long long bytes = (unsigned long long)lens[i] *
+						   rounds;
+			ktime_t start;
+			s64 asm_ns, c_ns;
+
+			start = ktime_get();
+			for (round = 0; round < rounds; round++)
+				csum_partial_copy_nocheck(s, d, lens[i], 0);
+			asm_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+			start = ktime_get();
+			for (round = 0; round < rounds; round++)
+				csum_test_ref(s, d, lens[i], 0);
+			c_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+			pr_info("csum_test: %4d bytes, src+%d dst+%d: "
+				"%5lu MB/s, generic C %5lu MB/s\n", lens[i],
+				aligns[a][0], aligns[a][1],
+				csum_test_rate(bytes, asm_ns),
+				csum_test_rate(bytes, c_ns));
+		}
+}
+
+static int __init csum_test_init(void)
+{
+	u8 *src, *dst, *ref;
+	int ret = -ENOMEM;
+
+	src = kmalloc(CSUM_TEST_BUF, GFP_KERNEL);
+	dst = kmalloc(CSUM_TEST_BUF + CSUM_TEST_OFFS, GFP_KERNEL);
+	ref = kmalloc(CSUM_TEST_BUF, GFP_KERNEL);
+	if (!src || !dst || !ref)
+		goto out;
+
+	get_random_bytes(src, CSUM_TEST_BUF);
+
+	ret = csum_test_check(src, dst, ref);
+	if (!ret)
+		ret = csum_test_fault(dst);
+	if (!ret)
+		csum_test_bench(src, dst);
+
+out:
+	kfree(ref);
+	kfree(dst);
+	kfree(src);
+
+	return ret;
+}
+
+static void __exit csum_test_exit(void)
+{
+}
+
+module_init(csum_test_init);
+module_exit(csum_test_exit);
+
+MODULE_DESCRIPTION("SH csum_partial_copy_generic self test and benchmark");
+MODULE_LICENSE("GPL");
@@ -18,6 +18,7 @@
 #include <linux/perf_event.h>
 #include <asm/io_trapped.h>
 #include <asm/mmu_context.h>
+#include <asm/tlb.h>
 #include <asm/tlbflush.h>
 #include <asm/traps.h>
 
@@ -420,6 +421,9 @@ handle_tlbmiss(struct pt_regs *regs, unsigned long writeaccess,
 		local_flush_tlb_one(get_asid(), address & PAGE_MASK);
 #endif
 
+	if (tlb_superpage_miss(address, pte))
+		return 0;
+
 	update_mmu_cache(NULL, address, pte);
 
 	return 0;
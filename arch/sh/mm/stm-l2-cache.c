@@ -27,6 +27,7 @@
 #include <linux/io.h>
 #include <linux/pm.h>
 #include <linux/uaccess.h>
+#include <linux/perf_event.h>
 #include <asm/addrspace.h>
 #include <asm/page.h>
 #include <asm/pgtable.h>
@@ -76,7 +77,7 @@ static DEFINE_SPINLOCK(stm_l2_current_mode_lock);
 
 /* Performance informations */
 
-#if defined(CONFIG_DEBUG_FS)
+#if defined(CONFIG_DEBUG_FS) || defined(CONFIG_PERF_EVENTS)
 
 static struct stm_l2_perf_counter {
 	enum { EVENT, CYCLE } type;
@@ -107,24 +108,35 @@ static struct stm_l2_perf_counter {
 	{ CYCLE,  5, "HPML", "Hit on Pending Miss Latency" },
 };
 
-static int stm_l2_perf_seq_printf_counter(struct seq_file *s,
-		struct stm_l2_perf_counter *counter)
+static u64 stm_l2_perf_read(struct stm_l2_perf_counter *counter)
 {
 	void *address;
-	long long unsigned int val64;
+	u32 high, low;
 
 	switch (counter->type) {
 	case EVENT:
-		address = stm_l2_base + L2ECA(counter->index);
-		return seq_printf(s, "%u", readl(address));
+		return readl(stm_l2_base + L2ECA(counter->index));
 	case CYCLE:
+		/* 48 bits, the low word may wrap while being read */
 		address = stm_l2_base + L2CCA(counter->index);
-		val64 = readl(address + 4) & 0xffff;
-		val64 = (val64 << 32) | readl(address);
-		return seq_printf(s, "%llu", val64);
+		do {
+			high = readl(address + 4) & 0xffff;
+			low = readl(address);
+		} while (high != (readl(address + 4) & 0xffff));
+		return ((u64)high << 32) | low;
 	}
 	BUG();
-	return -EFAULT;
+	return 0;
+}
+
+#endif /* defined(CONFIG_DEBUG_FS) || defined(CONFIG_PERF_EVENTS) */
+
+#if defined(CONFIG_DEBUG_FS)
+
+static int stm_l2_perf_seq_printf_counter(struct seq_file *s,
+		struct stm_l2_perf_counter *counter)
+{
+	return seq_printf(s, "%llu", stm_l2_perf_read(counter));
 }
 
 static int stm_l2_perf_get_overflow(struct stm_l2_perf_counter *counter)
@@ -329,6 +341,153 @@ device_initcall(stm_l2_perf_counters_init);
 
 
 
+/* perf_event interface
+ *
+ * The counters are exported as the "stm_l2" PMU, config being the index
+ * of the counter in stm_l2_perf_counters (so in debugfs "all" file), eg.
+ * "perf stat -e stm_l2/config=1/ -e stm_l2/config=0/ <command>" gives the
+ * 32-byte load misses and hits of a task. The cache and its counters are
+ * shared, so a task gets what happened while it was running. There is no
+ * overflow interrupt, so events can be counted but not sampled. */
+
+#if defined(CONFIG_PERF_EVENTS)
+
+static struct pmu stm_l2_pmu;
+static DEFINE_SPINLOCK(stm_l2_pmu_lock);
+static int stm_l2_pmu_users;
+static int stm_l2_pmu_enabled_pmc;
+
+static void stm_l2_pmu_get(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&stm_l2_pmu_lock, flags);
+	if (stm_l2_pmu_users++ == 0 && !(readl(stm_l2_base + L2PMC) & 1)) {
+		writel(1, stm_l2_base + L2PMC);
+		stm_l2_pmu_enabled_pmc = 1;
+	}
+	spin_unlock_irqrestore(&stm_l2_pmu_lock, flags);
+}
+
+static void stm_l2_pmu_put(struct perf_event *event)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&stm_l2_pmu_lock, flags);
+	if (--stm_l2_pmu_users == 0 && stm_l2_pmu_enabled_pmc) {
+		writel(0, stm_l2_base + L2PMC);
+		stm_l2_pmu_enabled_pmc = 0;
+	}
+	spin_unlock_irqrestore(&stm_l2_pmu_lock, flags);
+}
+
+static void stm_l2_pmu_update(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+	struct stm_l2_perf_counter *counter = &stm_l2_perf_counters[hwc->idx];
+	u64 mask = counter->type == EVENT ? 0xffffffffULL : 0xffffffffffffULL;
+	u64 prev, now;
+
+	do {
+		prev = local64_read(&hwc->prev_count);
+		now = stm_l2_perf_read(counter);
+	} while (local64_cmpxchg(&hwc->prev_count, prev, now) != prev);
+
+	local64_add((now - prev) & mask, &event->count);
+}
+
+static int stm_l2_pmu_event_init(struct perf_event *event)
+{
+	struct perf_event_attr *attr = &event->attr;
+
+	if (attr->type != stm_l2_pmu.type)
+		return -ENOENT;
+
+	if (attr->config >= ARRAY_SIZE(stm_l2_perf_counters))
+		return -EINVAL;
+
+	if (is_sampling_event(event) || attr->exclude_user ||
+			attr->exclude_kernel || attr->exclude_hv ||
+			attr->exclude_idle)
+		return -EOPNOTSUPP;
+
+	event->hw.idx = attr->config;
+	event->destroy = stm_l2_pmu_put;
+	stm_l2_pmu_get();
+
+	return 0;
+}
+
+static void stm_l2_pmu_start(struct perf_event *event, int flags)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	local64_set(&hwc->prev_count,
+			stm_l2_perf_read(&stm_l2_perf_counters[hwc->idx]));
+	hwc->state = 0;
+}
+
+static void stm_l2_pmu_stop(struct perf_event *event, int flags)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	if (!(hwc->state & PERF_HES_STOPPED)) {
+		stm_l2_pmu_update(event);
+		hwc->state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+	}
+}
+
+static int stm_l2_pmu_add(struct perf_event *event, int flags)
+{
+	event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+
+	if (flags & PERF_EF_START)
+		stm_l2_pmu_start(event, PERF_EF_RELOAD);
+
+	return 0;
+}
+
+static void stm_l2_pmu_del(struct perf_event *event, int flags)
+{
+	stm_l2_pmu_stop(event, PERF_EF_UPDATE);
+}
+
+PMU_FORMAT_ATTR(event, "config:0-4");
+
+static struct attribute_group stm_l2_pmu_format_group = {
+	.name = "format",
+	.attrs = (struct attribute * []) {
+		&format_attr_event.attr,
+		NULL
+	},
+};
+
+static struct pmu stm_l2_pmu = {
+	.attr_groups = (const struct attribute_group * []) {
+		&stm_l2_pmu_format_group,
+		NULL
+	},
+	.event_init = stm_l2_pmu_event_init,
+	.add = stm_l2_pmu_add,
+	.del = stm_l2_pmu_del,
+	.start = stm_l2_pmu_start,
+	.stop = stm_l2_pmu_stop,
+	.read = stm_l2_pmu_update,
+};
+
+static int __init stm_l2_pmu_init(void)
+{
+	if (!stm_l2_base)
+		return 0;
+
+	return perf_pmu_register(&stm_l2_pmu, "stm_l2", -1);
+}
+device_initcall(stm_l2_pmu_init);
+
+#endif /* defined(CONFIG_PERF_EVENTS) */
+
+
+
 /* Wait for the cache to finalize all pending operations */
 
 static void stm_l2_sync(void)
@@ -422,89 +581,199 @@ static void stm_l2_flush_common(unsigned long start, int size, int is_phys,
 	}
 }
 
-void stm_l2_flush_wback(unsigned long start, int size, int is_phys)
-{
-	if (!stm_l2_base)
-		return;
+/* Cache operations, by address and on the whole cache, in each mode */
 
-	switch (stm_l2_current_mode) {
-	case MODE_COPY_BACK:
-		stm_l2_flush_common(start, size, is_phys, L2FA);
-		/* Fall through */
-	case MODE_WRITE_THROUGH:
-		/* Since this is for the purposes of DMA, we have to
-		 * guarantee that the data has all got out to memory
-		 * before returning. */
-		stm_l2_sync();
-		break;
-	case MODE_BYPASS:
-		break;
-	default:
-		BUG();
-		break;
-	}
+enum stm_l2_op {
+	OP_WBACK,
+	OP_PURGE,
+	OP_INVALIDATE,
+	OP_LAST
+};
+
+static const struct stm_l2_op_regs {
+	unsigned int line;
+	unsigned int whole;
+} stm_l2_ops[MODE_LAST][OP_LAST] = {
+	[MODE_COPY_BACK] = {
+		[OP_WBACK] = { L2FA, L2FE },
+		/* Invalidating by set would drop unrelated dirty lines */
+		[OP_PURGE] = { L2PA, 0 },
+		[OP_INVALIDATE] = { L2IA, 0 },
+	},
+	[MODE_WRITE_THROUGH] = {
+		/* The cache is always clean, only the sync is needed... */
+		[OP_WBACK] = { 0, 0 },
+		[OP_PURGE] = { 0, 0 },
+		/* ... except to get rid of stale lines */
+		[OP_INVALIDATE] = { L2IA, L2IS },
+	},
+};
+
+/* Ranges larger than that are dealt with on the whole cache (0 = auto) */
+static unsigned long stm_l2_whole_threshold;
+
+static unsigned long stm_l2_get_whole_threshold(unsigned int l2reg)
+{
+	if (stm_l2_whole_threshold)
+		return stm_l2_whole_threshold;
 
+	/* Past this size, there are more lines than entries (or sets) */
+	if (l2reg == L2FE)
+		return stm_l2_block_size * stm_l2_n_sets * stm_l2_n_ways;
+	else
+		return stm_l2_block_size * stm_l2_n_sets;
 }
-EXPORT_SYMBOL(stm_l2_flush_wback);
 
-void stm_l2_flush_purge(unsigned long start, int size, int is_phys)
+static void stm_l2_flush_all(unsigned int l2reg)
 {
-	if (!stm_l2_base)
-		return;
+	unsigned long top = stm_l2_block_size * stm_l2_n_sets;
+	unsigned long entry;
 
-	switch (stm_l2_current_mode) {
-	case MODE_COPY_BACK:
-		stm_l2_flush_common(start, size, is_phys, L2PA);
-		/* Fall through */
-	case MODE_WRITE_THROUGH:
-		/* Since this is for the purposes of DMA, we have to
-		 * guarantee that the data has all got out to memory
-		 * before returning. */
-		stm_l2_sync();
-		break;
-	case MODE_BYPASS:
-		break;
-	default:
-		BUG();
-		break;
-	}
+	/* By entry (way and set) or by set */
+	if (l2reg == L2FE)
+		top *= stm_l2_n_ways;
+
+	/* Ensure L1 writeback is done before starting writeback on L2 */
+	asm volatile("synco"
+			: /* no output */
+			: /* no input */
+			: "memory");
+
+	for (entry = 0; entry < top; entry += stm_l2_block_size)
+		writel(entry, stm_l2_base + l2reg);
 }
-EXPORT_SYMBOL(stm_l2_flush_purge);
 
-void stm_l2_flush_invalidate(unsigned long start, int size, int is_phys)
+static void stm_l2_flush(unsigned long start, int size, int is_phys,
+		enum stm_l2_op op)
 {
-	if (!stm_l2_base)
+	enum stm_l2_mode mode = stm_l2_current_mode;
+	const struct stm_l2_op_regs *regs = &stm_l2_ops[mode][op];
+
+	if (!stm_l2_base || mode == MODE_BYPASS)
 		return;
 
-	/* The L2 sync here is just belt-n-braces.  It's not required in the
-	 * same way as for wback and purge, because the subsequent DMA is
-	 * _from_ a device so isn't reliant on it to see the correct data.
-	 * When the CPU gets to read the DMA'd-in data later, because the L2
-	 * keeps the ops in-order, there is no hazard in terms of the L1 miss
-	 * being serviced from the stale line in the L2.
+	if (regs->whole && size >= stm_l2_get_whole_threshold(regs->whole))
+		stm_l2_flush_all(regs->whole);
+	else if (regs->line)
+		stm_l2_flush_common(start, size, is_phys, regs->line);
+
+	/* Since this is for the purposes of DMA, we have to guarantee that
+	 * the data has all got out to memory before returning.
+	 *
+	 * The L2 sync after an invalidate is just belt-n-braces.  It's not
+	 * required in the same way as for wback and purge, because the
+	 * subsequent DMA is _from_ a device so isn't reliant on it to see the
+	 * correct data.  When the CPU gets to read the DMA'd-in data later,
+	 * because the L2 keeps the ops in-order, there is no hazard in terms
+	 * of the L1 miss being serviced from the stale line in the L2.
 	 *
 	 * The reason I'm doing this is in case somehow a line in the L2 that's
 	 * about to get invalidated gets evicted just before it in the L2 op
 	 * queue and the DMA onto the same memory line has already begun.  This
 	 * may actually be a non-issue (may be impossible in view of L2
 	 * implementation), or is going to be at least very rare. */
-	switch (stm_l2_current_mode) {
-	case MODE_COPY_BACK:
-	case MODE_WRITE_THROUGH:
-		stm_l2_flush_common(start, size, is_phys, L2IA);
-		stm_l2_sync();
-		break;
-	case MODE_BYPASS:
-		break;
-	default:
-		BUG();
-		break;
-	}
+	stm_l2_sync();
+}
+
+void stm_l2_flush_wback(unsigned long start, int size, int is_phys)
+{
+	stm_l2_flush(start, size, is_phys, OP_WBACK);
+}
+EXPORT_SYMBOL(stm_l2_flush_wback);
+
+void stm_l2_flush_purge(unsigned long start, int size, int is_phys)
+{
+	stm_l2_flush(start, size, is_phys, OP_PURGE);
+}
+EXPORT_SYMBOL(stm_l2_flush_purge);
+
+void stm_l2_flush_invalidate(unsigned long start, int size, int is_phys)
+{
+	stm_l2_flush(start, size, is_phys, OP_INVALIDATE);
 }
 EXPORT_SYMBOL(stm_l2_flush_invalidate);
 
 
 
+/* Batched flushing interface
+ *
+ * The by-address operations are issued as the ranges are added, but the
+ * L2 sync is only done once, by stm_l2_batch_commit(). When the ranges add
+ * up to more than the whole cache threshold, the remaining ones are dropped
+ * and the operation is done on the whole cache at commit time instead. */
+
+static void stm_l2_batch_add(struct stm_l2_batch *batch, unsigned long start,
+		int size, int is_phys, enum stm_l2_op op)
+{
+	enum stm_l2_mode mode = stm_l2_current_mode;
+	const struct stm_l2_op_regs *regs;
+
+	if (!stm_l2_base || mode == MODE_BYPASS)
+		return;
+
+	if (!batch->pending) {
+		batch->pending = 1;
+		batch->mode = mode;
+	}
+	regs = &stm_l2_ops[batch->mode][op];
+
+	if (regs->whole) {
+		if (batch->whole & (1 << op))
+			return;
+
+		batch->size += size;
+		if (batch->size >= stm_l2_get_whole_threshold(regs->whole)) {
+			batch->whole |= 1 << op;
+			return;
+		}
+	}
+
+	if (regs->line)
+		stm_l2_flush_common(start, size, is_phys, regs->line);
+}
+
+void stm_l2_batch_wback(struct stm_l2_batch *batch, unsigned long start,
+		int size, int is_phys)
+{
+	stm_l2_batch_add(batch, start, size, is_phys, OP_WBACK);
+}
+EXPORT_SYMBOL(stm_l2_batch_wback);
+
+void stm_l2_batch_purge(struct stm_l2_batch *batch, unsigned long start,
+		int size, int is_phys)
+{
+	stm_l2_batch_add(batch, start, size, is_phys, OP_PURGE);
+}
+EXPORT_SYMBOL(stm_l2_batch_purge);
+
+void stm_l2_batch_invalidate(struct stm_l2_batch *batch, unsigned long start,
+		int size, int is_phys)
+{
+	stm_l2_batch_add(batch, start, size, is_phys, OP_INVALIDATE);
+}
+EXPORT_SYMBOL(stm_l2_batch_invalidate);
+
+void stm_l2_batch_commit(struct stm_l2_batch *batch)
+{
+	enum stm_l2_op op;
+
+	if (!batch->pending)
+		return;
+
+	for (op = 0; op < OP_LAST; op++)
+		if (batch->whole & (1 << op))
+			stm_l2_flush_all(stm_l2_ops[batch->mode][op].whole);
+
+	stm_l2_sync();
+
+	batch->pending = 0;
+	batch->whole = 0;
+	batch->size = 0;
+}
+EXPORT_SYMBOL(stm_l2_batch_commit);
+
+
+
 /* Mode control */
 static void stm_l2_invalidate(void)
 {
@@ -669,10 +938,35 @@ static ssize_t stm_l2_mode_store(struct device *dev,
 static struct device_attribute stm_l2_mode_attr =
 	__ATTR(mode, S_IRUGO | S_IWUSR, stm_l2_mode_show, stm_l2_mode_store);
 
+static ssize_t stm_l2_whole_threshold_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", stm_l2_whole_threshold);
+}
+
+static ssize_t stm_l2_whole_threshold_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	unsigned long threshold;
+
+	if (kstrtoul(buf, 0, &threshold))
+		return -EINVAL;
+
+	stm_l2_whole_threshold = threshold;
+
+	return count;
+}
+
+static struct device_attribute stm_l2_whole_threshold_attr =
+	__ATTR(whole_threshold, S_IRUGO | S_IWUSR,
+			stm_l2_whole_threshold_show,
+			stm_l2_whole_threshold_store);
+
 static struct attribute_group stm_l2_attr_group = {
 	.name = "l2",
 	.attrs = (struct attribute * []) {
 		&stm_l2_mode_attr.attr,
+		&stm_l2_whole_threshold_attr.attr,
 		NULL
 	},
 };
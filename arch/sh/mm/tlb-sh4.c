@@ -89,6 +89,13 @@ void local_flush_tlb_all(void)
 	 * Flush all the TLB.
 	 */
 	local_irq_save(flags);
+
+	/*
+	 * Wired user entries are dropped as well, lowering the URB. They
+	 * are loaded again when their mm is next activated.
+	 */
+	tlb_wired_flush();
+
 	jump_to_uncached();
 
 	status = __raw_readl(MMUCR);
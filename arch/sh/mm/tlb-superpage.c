@@ -0,0 +1,248 @@
+/*
+ * arch/sh/mm/tlb-superpage.c
+ *
+ * Transparent large TLB entries for contiguous mappings on SH-4.
+ *
+ * Copyright (C) 2013  STMicroelectronics Limited
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ *
+ * The page tables stay made of 4KB ptes. When a TLB miss hits a pte which
+ * belongs to an aligned 64KB or 1MB block of ptes that are all present,
+ * physically contiguous and with the same attributes (as remap_pfn_range()
+ * of a bpa2 buffer, or ioremap(), produce), a single entry of that size is
+ * loaded instead of a 4KB one. Each pte keeps its own pfn, and the
+ * hardware ignores the low PPN bits of large entries.
+ *
+ * Changing any pte of a block flushes its address from the TLB, and the
+ * associative purge drops the large entry as well, so a block which stops
+ * qualifying simply goes back to 4KB entries on the next miss. Loading a
+ * large entry over smaller ones covering part of the block would be a
+ * multiple hit, so those are purged first, and blocks holding a wired
+ * entry (see tlb-wired.c) keep smaller entries.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/io.h>
+#include <asm/mmu_context.h>
+#include <asm/tlbflush.h>
+#include <asm/pgtable.h>
+#include <asm/tlb.h>
+
+static struct {
+	unsigned int shift;
+	unsigned long sz;
+	const char *name;
+} tlb_sp_sizes[] = {
+	{ 20, _PAGE_SZ0 | _PAGE_SZ1, "1MB" },
+	{ 16, _PAGE_SZ1, "64KB" },
+};
+
+#define TLB_SP_NR_SIZES	ARRAY_SIZE(tlb_sp_sizes)
+
+struct tlb_sp_stats {
+	unsigned long misses;			/* TLB misses on present ptes */
+	unsigned long loads[TLB_SP_NR_SIZES];	/* Large entries loaded */
+	unsigned long purged;			/* Entries purged to load them */
+};
+
+static DEFINE_PER_CPU(struct tlb_sp_stats, tlb_sp_stats);
+
+static int tlb_sp_enabled __read_mostly = 1;
+
+static int tlb_sp_block_ok(pte_t *ptep, unsigned long address,
+			   unsigned int shift)
+{
+	unsigned int nr = 1 << (shift - PAGE_SHIFT);
+	unsigned int idx = (address >> PAGE_SHIFT) & (nr - 1);
+	unsigned long pfn = pte_pfn(*ptep) - idx;
+	unsigned long attr = pte_val(*ptep) & TLB_LARGE_ATTR_MASK;
+	pte_t *first = ptep - idx;
+	unsigned int i;
+
+	/* Virtual and physical addresses must be aligned alike */
+	if (pfn & (nr - 1))
+		return 0;
+
+	for (i = 0; i < nr; i++) {
+		pte_t pte = first[i];
+
+		if (!pte_present(pte) || pte_pfn(pte) != pfn + i ||
+		    (pte_val(pte) & TLB_LARGE_ATTR_MASK) != attr)
+			return 0;
+
+		/* Alias handling only happens on 4KB loads, see __update_cache */
+		if (boot_cpu_data.dcache.n_aliases && pfn_valid(pfn + i) &&
+		    !test_bit(PG_dcache_clean, &pfn_to_page(pfn + i)->flags))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * The large entry will serve accesses to every page of the block without
+ * further misses, so they all count as referenced from here on. Reclaim
+ * clearing a young bit flushes that address, which drops the large entry
+ * and brings the next access back through here.
+ */
+static void tlb_sp_block_mkyoung(pte_t *ptep, unsigned long address,
+				 unsigned int shift)
+{
+	unsigned int nr = 1 << (shift - PAGE_SHIFT);
+	pte_t *first = ptep - ((address >> PAGE_SHIFT) & (nr - 1));
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		if (!pte_young(first[i]))
+			set_pte(&first[i], pte_mkyoung(first[i]));
+}
+
+/**
+ * tlb_superpage_miss - Try to satisfy a TLB miss with a large entry
+ * @address: faulting address
+ * @ptep: its (present) pte
+ *
+ * Called from handle_tlbmiss() with interrupts disabled. Returns 1 when
+ * a large entry was loaded, 0 when the caller should load @ptep itself.
+ */
+int tlb_superpage_miss(unsigned long address, pte_t *ptep)
+{
+	unsigned int i;
+	int purged;
+
+	__this_cpu_inc(tlb_sp_stats.misses);
+
+	if (!tlb_sp_enabled)
+		return 0;
+
+	/* Only 4KB ptes (not hugetlb), in user space or the vmalloc area */
+	if ((pte_val(*ptep) & _PAGE_SZ_MASK) != _PAGE_FLAGS_HARD)
+		return 0;
+	if (address >= TASK_SIZE &&
+	    (address < VMALLOC_START || address >= VMALLOC_END))
+		return 0;
+
+	/* Try the biggest size first, the smaller one is implied by it */
+	for (i = 0; i < TLB_SP_NR_SIZES; i++) {
+		unsigned int shift = tlb_sp_sizes[i].shift;
+		unsigned long start = address & ~((1UL << shift) - 1);
+		pte_t entry;
+
+		if (!tlb_sp_block_ok(ptep, address, shift))
+			continue;
+
+		/* A block holding a wired entry keeps smaller entries */
+		purged = tlb_purge_range(start, 1UL << shift);
+		if (purged < 0)
+			continue;
+		__this_cpu_add(tlb_sp_stats.purged, purged);
+
+		tlb_sp_block_mkyoung(ptep, address, shift);
+
+		entry = __pte((pte_val(*ptep) & ~_PAGE_SZ_MASK) |
+			      tlb_sp_sizes[i].sz);
+		__update_tlb(NULL, start, entry);
+
+		__this_cpu_inc(tlb_sp_stats.loads[i]);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int tlb_sp_seq_show(struct seq_file *file, void *iter)
+{
+	unsigned int cpu, i;
+
+	seq_printf(file, "enabled: %d\n", tlb_sp_enabled);
+	seq_printf(file, "cpu      misses");
+	for (i = 0; i < TLB_SP_NR_SIZES; i++)
+		seq_printf(file, " %10s", tlb_sp_sizes[i].name);
+	seq_printf(file, "     purged\n");
+
+	for_each_online_cpu(cpu) {
+		struct tlb_sp_stats *stats = &per_cpu(tlb_sp_stats, cpu);
+
+		seq_printf(file, "%3u %11lu", cpu, stats->misses);
+		for (i = 0; i < TLB_SP_NR_SIZES; i++)
+			seq_printf(file, " %10lu", stats->loads[i]);
+		seq_printf(file, " %10lu\n", stats->purged);
+	}
+
+	return 0;
+}
+
+static int tlb_sp_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tlb_sp_seq_show, inode->i_private);
+}
+
+/* "0"/"1" disables/enables large entries, "reset" clears the counters */
+static ssize_t tlb_sp_debugfs_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	char cmd[8];
+	unsigned int cpu;
+
+	if (count >= sizeof(cmd))
+		return -EINVAL;
+	if (copy_from_user(cmd, buf, count))
+		return -EFAULT;
+	cmd[count] = '\0';
+
+	if (sysfs_streq(cmd, "0") || sysfs_streq(cmd, "1")) {
+		tlb_sp_enabled = cmd[0] - '0';
+		if (!tlb_sp_enabled)
+			flush_tlb_all();
+	} else if (sysfs_streq(cmd, "reset")) {
+		for_each_possible_cpu(cpu)
+			memset(&per_cpu(tlb_sp_stats, cpu), 0,
+			       sizeof(struct tlb_sp_stats));
+	} else {
+		return -EINVAL;
+	}
+
+	return count;
+}
+
+static const struct file_operations tlb_sp_debugfs_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tlb_sp_debugfs_open,
+	.read		= seq_read,
+	.write		= tlb_sp_debugfs_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init tlb_sp_debugfs_init(void)
+{
+	struct dentry *dentry;
+
+	dentry = debugfs_create_file("tlb_superpages", S_IRUSR | S_IWUSR,
+				     arch_debugfs_dir, NULL,
+				     &tlb_sp_debugfs_fops);
+	if (unlikely(!dentry))
+		return -ENOMEM;
+
+	return 0;
+}
+module_init(tlb_sp_debugfs_init);
+#endif
+
+static int __init tlb_sp_setup(char *s)
+{
+	tlb_sp_enabled = simple_strtoul(s, NULL, 0);
+	return 1;
+}
+__setup("tlb_superpages=", tlb_sp_setup);
@@ -28,13 +28,17 @@ void tlb_wire_entry(struct vm_area_struct *vma, unsigned long addr, pte_t pte)
 	urb = (status & MMUCR_URB) >> MMUCR_URB_SHIFT;
 	status &= ~MMUCR_URC;
 
+	/*
+	 * An URB of 0 means that nothing is wired yet.
+	 */
+	if (!urb)
+		urb = MMUCR_URB_NENTRIES;
+
 	/*
 	 * Make sure we're not trying to wire the last TLB entry slot.
 	 */
 	BUG_ON(!--urb);
 
-	urb = urb % MMUCR_URB_NENTRIES;
-
 	/*
 	 * Insert this entry into the highest non-wired TLB slot (via
 	 * the URC field).
@@ -91,3 +95,94 @@ void tlb_unwire_entry(void)
 
 	local_irq_restore(flags);
 }
+
+#if defined(CONFIG_TLB_SUPERPAGES) || defined(CONFIG_TLB_WIRED_USER)
+static const struct {
+	unsigned long addr;
+	unsigned long data;
+	unsigned int nentries;
+} tlb_arrays[] = {
+	{ MMU_UTLB_ADDRESS_ARRAY, MMU_UTLB_DATA_ARRAY, MMUCR_URB_NENTRIES },
+	{ MMU_ITLB_ADDRESS_ARRAY, MMU_ITLB_DATA_ARRAY, 4 },
+};
+
+/*
+ * Does entry 'entry' of TLB 't' overlap [start, start + size)? Its extent
+ * comes from the SZ bits of the data array, as large entries may start
+ * below the range. Called uncached.
+ */
+static int tlb_entry_overlaps(unsigned int t, unsigned int entry,
+			      unsigned long start, unsigned long size)
+{
+	unsigned long ofs = entry << MMU_TLB_ENTRY_SHIFT;
+	unsigned long vpn, esize;
+
+	vpn = __raw_readl(tlb_arrays[t].addr | ofs);
+	if (!(vpn & 0x100))
+		return 0;
+
+	switch (__raw_readl(tlb_arrays[t].data | ofs) & _PAGE_SZ_MASK) {
+	case _PAGE_SZ0 | _PAGE_SZ1:
+		esize = 1UL << 20;
+		break;
+	case _PAGE_SZ1:
+		esize = 1UL << 16;
+		break;
+	case _PAGE_SZ0:
+		esize = 1UL << 12;
+		break;
+	default:
+		esize = 1UL << 10;
+		break;
+	}
+
+	vpn &= 0xfffffc00 & ~(esize - 1);
+
+	return vpn < start + size && start < vpn + esize;
+}
+
+/*
+ * Purge the unwired UTLB entries and the ITLB entries which overlap
+ * [start, start + size), before loading a large or wired entry there.
+ * If a wired entry overlaps the range, loading another one would be a
+ * multiple hit, so nothing is purged and -EBUSY is returned. Otherwise
+ * returns the number of entries purged. Interrupts must be disabled.
+ */
+int tlb_purge_range(unsigned long start, unsigned long size)
+{
+	unsigned int t, entry, urb;
+	int purged = 0;
+
+	jump_to_uncached();
+
+	/*
+	 * An URB of 0 means that nothing is wired.
+	 */
+	urb = (__raw_readl(MMUCR) & MMUCR_URB) >> MMUCR_URB_SHIFT;
+	if (!urb)
+		urb = MMUCR_URB_NENTRIES;
+
+	for (entry = urb; entry < MMUCR_URB_NENTRIES; entry++)
+		if (tlb_entry_overlaps(0, entry, start, size)) {
+			back_to_cached();
+			return -EBUSY;
+		}
+
+	for (t = 0; t < ARRAY_SIZE(tlb_arrays); t++) {
+		unsigned int n = t ? tlb_arrays[t].nentries : urb;
+
+		for (entry = 0; entry < n; entry++) {
+			if (!tlb_entry_overlaps(t, entry, start, size))
+				continue;
+
+			__raw_writel(0, tlb_arrays[t].addr |
+					(entry << MMU_TLB_ENTRY_SHIFT));
+			purged++;
+		}
+	}
+
+	back_to_cached();
+
+	return purged;
+}
+#endif
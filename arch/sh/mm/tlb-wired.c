@@ -0,0 +1,495 @@
+/*
+ * arch/sh/mm/tlb-wired.c
+ *
+ * Wired TLB entries for user space buffers.
+ *
+ * Copyright (C) 2013  STMicroelectronics Limited
+ *
+ * This file is subject to the terms and conditions of the GNU General Public
+ * License.  See the file "COPYING" in the main directory of this archive
+ * for more details.
+ *
+ * A process opens /dev/tlbwire and registers a few blocks of its address
+ * space (see <asm/tlbwire.h>). Whenever its mm is activated, the entries
+ * for these blocks are loaded with tlb_wire_entry() above the URB, where
+ * they are never chosen for replacement; they are unwired again as soon
+ * as another mm is activated, so the rest of the system keeps the whole
+ * UTLB.
+ *
+ * The entries are always rebuilt from the page tables, never remembered:
+ * a block which no longer maps what it did at wire time is skipped, and
+ * any TLB flush covering a block purges its wired entry like any other,
+ * so this never maps anything the page tables don't. local_flush_tlb_all()
+ * unwires and clears them all; they come back on the next activation of
+ * their mm, typically the next context switch to the process.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
+#include <linux/capability.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <asm/mmu_context.h>
+#include <asm/cacheflush.h>
+#include <asm/tlbflush.h>
+#include <asm/tlb.h>
+#include <asm/tlbwire.h>
+
+#define TLB_WIRED_MAX	CONFIG_TLB_WIRED_USER_MAX
+
+struct tlb_wired {
+	struct list_head	list;
+	struct mm_struct	*mm;
+	pid_t			pid;
+	char			comm[TASK_COMM_LEN];
+	unsigned int		nr;
+	struct tlbwire_entry	entry[TLB_WIRED_MAX];
+	unsigned long		loads;
+};
+
+/* Registered processes, for debugfs */
+static LIST_HEAD(tlb_wired_list);
+static DEFINE_MUTEX(tlb_wired_mutex);
+
+/* What is wired right now, only changed with interrupts disabled */
+struct tlb_wired *tlb_wired_loaded;
+static unsigned long tlb_wired_loaded_asid;
+static unsigned int tlb_wired_loaded_nr;
+
+static unsigned long tlb_wired_sz(unsigned long size)
+{
+	switch (size) {
+	case TLBWIRE_SIZE_1MB:
+		return _PAGE_SZ0 | _PAGE_SZ1;
+	case TLBWIRE_SIZE_64KB:
+		return _PAGE_SZ1;
+	case TLBWIRE_SIZE_4KB:
+		return _PAGE_SZ0;
+	}
+
+	return 0;
+}
+
+static pmd_t *tlb_wired_pmd(struct mm_struct *mm, unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, addr);
+	if (pgd_none(*pgd) || pgd_bad(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud) || pud_bad(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd) || pmd_bad(*pmd))
+		return NULL;
+
+	return pmd;
+}
+
+/*
+ * Build the TLB entry for block @e from its ptes, which must all be
+ * present, physically contiguous from an aligned pfn and alike.
+ */
+static int tlb_wired_block(pte_t *ptep, const struct tlbwire_entry *e,
+			   pte_t *entry)
+{
+	unsigned long nr = e->size >> PAGE_SHIFT;
+	pte_t first = ptep[0];
+	unsigned long i;
+
+	if (!pte_present(first))
+		return -EFAULT;
+	if ((pte_val(first) & _PAGE_SZ_MASK) != _PAGE_FLAGS_HARD ||
+	    (pte_pfn(first) & (nr - 1)))
+		return -EINVAL;
+
+	for (i = 1; i < nr; i++) {
+		pte_t pte = ptep[i];
+
+		if (!pte_present(pte))
+			return -EFAULT;
+		if (pte_pfn(pte) != pte_pfn(first) + i ||
+		    (pte_val(pte) & TLB_LARGE_ATTR_MASK) !=
+		    (pte_val(first) & TLB_LARGE_ATTR_MASK))
+			return -EINVAL;
+	}
+
+	*entry = __pte((pte_val(first) & ~_PAGE_SZ_MASK) |
+		       tlb_wired_sz(e->size));
+
+	return 0;
+}
+
+static void tlb_wired_unload(void)
+{
+	/* The entries stay valid, merely replaceable again */
+	while (tlb_wired_loaded_nr) {
+		tlb_unwire_entry();
+		tlb_wired_loaded_nr--;
+	}
+
+	tlb_wired_loaded = NULL;
+}
+
+static void tlb_wired_load(struct tlb_wired *w, unsigned long asid)
+{
+	unsigned int i;
+
+	for (i = 0; i < w->nr; i++) {
+		const struct tlbwire_entry *e = &w->entry[i];
+		pmd_t *pmd;
+		pte_t pte;
+
+		pmd = tlb_wired_pmd(w->mm, e->addr);
+		if (!pmd || tlb_wired_block(pte_offset_kernel(pmd, e->addr),
+					    e, &pte))
+			continue;
+
+		/* Any entry already covering part of the block would clash */
+		if (tlb_purge_range(e->addr, e->size) < 0)
+			continue;
+
+		tlb_wire_entry(NULL, e->addr, pte);
+		tlb_wired_loaded_nr++;
+	}
+
+	tlb_wired_loaded = w;
+	tlb_wired_loaded_asid = asid;
+	w->loads++;
+}
+
+/*
+ * Called from activate_context(), once @mm has its ASID set, whenever
+ * either @mm or the previously activated one has wired entries.
+ */
+void __tlb_wired_switch(struct mm_struct *mm)
+{
+	struct tlb_wired *w = mm->context.wired;
+	unsigned long flags, asid;
+
+	local_irq_save(flags);
+
+	asid = get_asid();
+	if (w != tlb_wired_loaded || (w && asid != tlb_wired_loaded_asid)) {
+		tlb_wired_unload();
+		if (w)
+			tlb_wired_load(w, asid);
+	}
+
+	local_irq_restore(flags);
+}
+
+/*
+ * Called from local_flush_tlb_all() with interrupts disabled: unwiring
+ * lets it clear the entries with the rest, and as nothing is loaded any
+ * more, the next activate_context() of their mm wires them again.
+ */
+void __tlb_wired_flush(void)
+{
+	tlb_wired_unload();
+}
+
+/* Rewire after a change to the entries of the current process */
+static void tlb_wired_reload(struct tlb_wired *w)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	if (tlb_wired_loaded == w)
+		tlb_wired_unload();
+	local_irq_restore(flags);
+
+	tlb_wired_switch(current->mm);
+}
+
+/*
+ * Mark the ptes of the block young, and dirty when writable, so that
+ * using it never causes an initial page write exception, which would
+ * purge the wired entry. The D-cache aliases are dealt with here too,
+ * as it won't happen on a TLB miss.
+ */
+static int tlb_wired_prepare(struct vm_area_struct *vma,
+			     const struct tlbwire_entry *e)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long addr;
+	spinlock_t *ptl;
+	pte_t *ptep, entry;
+	pmd_t *pmd;
+	int ret;
+
+	pmd = tlb_wired_pmd(mm, e->addr);
+	if (!pmd)
+		return -EFAULT;
+
+	ptep = pte_offset_map_lock(mm, pmd, e->addr, &ptl);
+
+	for (addr = e->addr; addr < e->addr + e->size; addr += PAGE_SIZE) {
+		pte_t *p = ptep + ((addr - e->addr) >> PAGE_SHIFT);
+		pte_t pte = *p;
+
+		if (!pte_present(pte))
+			continue;
+
+		pte = pte_mkyoung(pte);
+		if ((vma->vm_flags & VM_WRITE) && pte_write(pte))
+			pte = pte_mkdirty(pte);
+		set_pte_at(mm, addr, p, pte);
+
+		__update_cache(vma, addr, pte);
+	}
+
+	ret = tlb_wired_block(ptep, e, &entry);
+
+	pte_unmap_unlock(ptep, ptl);
+
+	return ret;
+}
+
+static int tlb_wired_add(struct tlb_wired *w, const struct tlbwire_entry *e)
+{
+	struct mm_struct *mm = w->mm;
+	struct vm_area_struct *vma;
+	unsigned long flags;
+	unsigned int i;
+	int ret;
+
+	if (!tlb_wired_sz(e->size) || (e->addr & (e->size - 1)) ||
+	    e->addr >= TASK_SIZE || TASK_SIZE - e->addr < e->size)
+		return -EINVAL;
+
+	if (w->nr == TLB_WIRED_MAX)
+		return -ENOSPC;
+
+	for (i = 0; i < w->nr; i++)
+		if (e->addr < w->entry[i].addr + w->entry[i].size &&
+		    w->entry[i].addr < e->addr + e->size)
+			return -EBUSY;
+
+	down_read(&mm->mmap_sem);
+
+	/* Only memory which stays mapped: mlock()ed or driver memory */
+	vma = find_vma(mm, e->addr);
+	if (!vma || vma->vm_start > e->addr ||
+	    vma->vm_end - e->addr < e->size) {
+		ret = -EFAULT;
+		goto out;
+	}
+	if (!(vma->vm_flags & (VM_LOCKED | VM_IO | VM_PFNMAP | VM_RESERVED))) {
+		ret = -EPERM;
+		goto out;
+	}
+
+	ret = tlb_wired_prepare(vma, e);
+	if (ret)
+		goto out;
+
+	local_irq_save(flags);
+	w->entry[w->nr++] = *e;
+	local_irq_restore(flags);
+
+	tlb_wired_reload(w);
+
+out:
+	up_read(&mm->mmap_sem);
+
+	return ret;
+}
+
+static int tlb_wired_remove(struct tlb_wired *w, const struct tlbwire_entry *e)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	for (i = 0; i < w->nr; i++)
+		if (w->entry[i].addr == e->addr && w->entry[i].size == e->size)
+			break;
+	if (i == w->nr)
+		return -ENOENT;
+
+	local_irq_save(flags);
+	w->nr--;
+	memmove(&w->entry[i], &w->entry[i + 1],
+		(w->nr - i) * sizeof(w->entry[0]));
+	local_irq_restore(flags);
+
+	tlb_wired_reload(w);
+
+	return 0;
+}
+
+static long tlb_wired_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	struct tlb_wired *w = file->private_data;
+	struct tlbwire_entry e;
+	long ret;
+
+	if (cmd == TLBWIRE_IOC_MAX)
+		return put_user(TLB_WIRED_MAX, (unsigned int __user *)arg);
+
+	if (cmd != TLBWIRE_IOC_WIRE && cmd != TLBWIRE_IOC_UNWIRE)
+		return -ENOTTY;
+
+	/* The entries belong to the mm of whoever opened the file */
+	if (current->mm != w->mm)
+		return -EPERM;
+
+	if (copy_from_user(&e, (void __user *)arg, sizeof(e)))
+		return -EFAULT;
+
+	mutex_lock(&tlb_wired_mutex);
+	if (cmd == TLBWIRE_IOC_WIRE)
+		ret = tlb_wired_add(w, &e);
+	else
+		ret = tlb_wired_remove(w, &e);
+	mutex_unlock(&tlb_wired_mutex);
+
+	return ret;
+}
+
+static int tlb_wired_open(struct inode *inode, struct file *file)
+{
+	struct mm_struct *mm = current->mm;
+	struct tlb_wired *w;
+	int ret = 0;
+
+	if (!capable(CAP_IPC_LOCK))
+		return -EPERM;
+	if (!mm)
+		return -EINVAL;
+
+	w = kzalloc(sizeof(*w), GFP_KERNEL);
+	if (!w)
+		return -ENOMEM;
+
+	w->mm = mm;
+	w->pid = task_tgid_vnr(current);
+	get_task_comm(w->comm, current);
+
+	mutex_lock(&tlb_wired_mutex);
+	if (mm->context.wired) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	atomic_inc(&mm->mm_count);
+	mm->context.wired = w;
+	list_add_tail(&w->list, &tlb_wired_list);
+	file->private_data = w;
+
+out:
+	mutex_unlock(&tlb_wired_mutex);
+	if (ret)
+		kfree(w);
+
+	return ret;
+}
+
+/* Closing the file, at the latest on exit, drops all the entries */
+static int tlb_wired_release(struct inode *inode, struct file *file)
+{
+	struct tlb_wired *w = file->private_data;
+	unsigned long flags;
+
+	mutex_lock(&tlb_wired_mutex);
+
+	local_irq_save(flags);
+	if (tlb_wired_loaded == w)
+		tlb_wired_unload();
+	w->mm->context.wired = NULL;
+	local_irq_restore(flags);
+
+	list_del(&w->list);
+
+	mutex_unlock(&tlb_wired_mutex);
+
+	mmdrop(w->mm);
+	kfree(w);
+
+	return 0;
+}
+
+static const struct file_operations tlb_wired_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tlb_wired_open,
+	.release	= tlb_wired_release,
+	.unlocked_ioctl	= tlb_wired_ioctl,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice tlb_wired_miscdev = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "tlbwire",
+	.fops		= &tlb_wired_fops,
+};
+
+#ifdef CONFIG_DEBUG_FS
+static int tlb_wired_seq_show(struct seq_file *file, void *iter)
+{
+	struct tlb_wired *w;
+	unsigned int i;
+
+	mutex_lock(&tlb_wired_mutex);
+
+	seq_printf(file, "wired now: %u (pid %d)\n", tlb_wired_loaded_nr,
+		   tlb_wired_loaded ? tlb_wired_loaded->pid : 0);
+
+	list_for_each_entry(w, &tlb_wired_list, list) {
+		seq_printf(file, "pid %d (%s): %u entries, loaded %lu times\n",
+			   w->pid, w->comm, w->nr, w->loads);
+		for (i = 0; i < w->nr; i++)
+			seq_printf(file, "  0x%08lx %5luKB\n", w->entry[i].addr,
+				   w->entry[i].size >> 10);
+	}
+
+	mutex_unlock(&tlb_wired_mutex);
+
+	return 0;
+}
+
+static int tlb_wired_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tlb_wired_seq_show, inode->i_private);
+}
+
+static const struct file_operations tlb_wired_debugfs_fops = {
+	.owner		= THIS_MODULE,
+	.open		= tlb_wired_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init tlb_wired_debugfs_init(void)
+{
+	debugfs_create_file("tlb_wired", S_IRUSR, arch_debugfs_dir, NULL,
+			    &tlb_wired_debugfs_fops);
+}
+#else
+static inline void tlb_wired_debugfs_init(void) { }
+#endif
+
+static int __init tlb_wired_init(void)
+{
+	int ret;
+
+	ret = misc_register(&tlb_wired_miscdev);
+	if (ret)
+		return ret;
+
+	tlb_wired_debugfs_init();
+
+	return 0;
+}
+module_init(tlb_wired_init);
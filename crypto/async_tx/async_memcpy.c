@@ -26,7 +26,9 @@
 #include <linux/kernel.h>
 #include <linux/highmem.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/mm.h>
+#include <linux/completion.h>
 #include <linux/dma-mapping.h>
 #include <linux/async_tx.h>
 
@@ -94,6 +96,59 @@ async_memcpy(struct page *dest, struct page *src, unsigned int dest_offset,
 }
 EXPORT_SYMBOL_GPL(async_memcpy);
 
+#ifdef CONFIG_ASYNC_TX_DMA_COPY
+static unsigned int copy_threshold = 4 * PAGE_SIZE;
+module_param(copy_threshold, uint, 0644);
+MODULE_PARM_DESC(copy_threshold,
+		"Smallest copy (in bytes) offloaded by async_copy_pages");
+
+static void async_copy_pages_done(void *param)
+{
+	complete(param);
+}
+
+/**
+ * async_copy_pages - copy physically contiguous pages with a dma engine
+ * @dest: first destination page
+ * @src: first source page
+ * @len: length in bytes
+ *
+ * Offloads copies of at least copy_threshold bytes to a memcpy channel and
+ * sleeps until the copy is done, leaving the CPU to other tasks meanwhile.
+ * Returns -ENODEV, without copying, if the copy is too small or no channel
+ * is available: the caller then copies with the CPU.
+ */
+int async_copy_pages(struct page *dest, struct page *src, size_t len)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct dma_async_tx_descriptor *tx;
+	struct async_submit_ctl submit;
+	struct dma_chan *chan;
+
+	might_sleep();
+
+	/* The synchronous fallback of async_memcpy() needs lowmem pages */
+	if (len < copy_threshold || PageHighMem(dest) || PageHighMem(src))
+		return -ENODEV;
+
+	init_async_submit(&submit, ASYNC_TX_ACK, NULL, async_copy_pages_done,
+			  &done, NULL);
+
+	chan = async_tx_find_channel(&submit, DMA_MEMCPY, &dest, 1, &src, 1,
+				     len);
+	if (!chan)
+		return -ENODEV;
+
+	tx = async_memcpy(dest, src, 0, 0, len, &submit);
+	async_tx_issue_pending(tx);
+
+	wait_for_completion(&done);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(async_copy_pages);
+#endif
+
 MODULE_AUTHOR("Intel Corporation");
 MODULE_DESCRIPTION("asynchronous memcpy api");
 MODULE_LICENSE("GPL");
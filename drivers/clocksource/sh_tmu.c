@@ -225,6 +225,9 @@ static int sh_tmu_register_clocksource(struct sh_tmu_priv *p,
 				       char *name, unsigned long rating)
 {
 	struct clocksource *cs = &p->cs;
+#ifdef CONFIG_VSYSCALL_TIME
+	struct resource *res;
+#endif
 
 	cs->name = name;
 	cs->rating = rating;
@@ -235,6 +238,12 @@ static int sh_tmu_register_clocksource(struct sh_tmu_priv *p,
 	cs->resume = sh_tmu_clocksource_enable;
 	cs->mask = CLOCKSOURCE_MASK(32);
 	cs->flags = CLOCK_SOURCE_IS_CONTINUOUS;
+#ifdef CONFIG_VSYSCALL_TIME
+	/* Let the vDSO read (and invert) TCNT itself */
+	res = platform_get_resource(p->pdev, IORESOURCE_MEM, 0);
+	cs->archdata.vread_reg = res->start + (TCNT << 2);
+	cs->archdata.vread_xor = 0xffffffff;
+#endif
 
 	dev_info(&p->pdev->dev, "used as clock source\n");
 
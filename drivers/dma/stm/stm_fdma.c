@@ -31,6 +31,40 @@
  * Interrupt functions
  */
 
+static void stm_fdma_complete_schedule(struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_device *fdev = fchan->fdev;
+
+	/* Latency is measured from the first interrupt not yet completed */
+	if (!test_bit(fchan->id, &fdev->complete_pending))
+		stm_fdma_latency_stamp(fchan);
+
+	set_bit(fchan->id, &fdev->complete_pending);
+}
+
+static void stm_fdma_irq_mask(struct stm_fdma_device *fdev)
+{
+	unsigned long irqflags = 0;
+
+	spin_lock_irqsave(&fdev->lock, irqflags);
+	writel(0, fdev->io_base + fdev->regs.int_mask);
+	fdev->irq_masked = 1;
+	spin_unlock_irqrestore(&fdev->lock, irqflags);
+}
+
+static void stm_fdma_irq_unmask(struct stm_fdma_device *fdev)
+{
+	unsigned long irqflags = 0;
+
+	/* Channels may have been disabled while the engine was running */
+	spin_lock_irqsave(&fdev->lock, irqflags);
+	if (fdev->irq_masked) {
+		writel(0xffffffff, fdev->io_base + fdev->regs.int_mask);
+		fdev->irq_masked = 0;
+	}
+	spin_unlock_irqrestore(&fdev->lock, irqflags);
+}
+
 static void stm_fdma_irq_error(struct stm_fdma_chan *fchan)
 {
 	/* Print an error indicating the channel and hardware error code */
@@ -49,7 +83,7 @@ static void stm_fdma_irq_error(struct stm_fdma_chan *fchan)
 	stm_fdma_hw_channel_pause(fchan, 0);
 
 	/* Complete the active descriptor */
-	tasklet_hi_schedule(&fchan->tasklet_complete);
+	stm_fdma_complete_schedule(fchan);
 }
 
 static void stm_fdma_irq_complete(struct stm_fdma_chan *fchan)
@@ -100,12 +134,11 @@ static void stm_fdma_irq_complete(struct stm_fdma_chan *fchan)
 	}
 
 	/* Complete the descriptor */
-	tasklet_hi_schedule(&fchan->tasklet_complete);
+	stm_fdma_complete_schedule(fchan);
 }
 
-static irqreturn_t stm_fdma_irq_handler(int irq, void *dev_id)
+static irqreturn_t stm_fdma_irq_status(struct stm_fdma_device *fdev)
 {
-	struct stm_fdma_device *fdev = dev_id;
 	irqreturn_t result = IRQ_NONE;
 	u32 status;
 	int c;
@@ -152,6 +185,90 @@ static irqreturn_t stm_fdma_irq_handler(int irq, void *dev_id)
 	return result;
 }
 
+static irqreturn_t stm_fdma_irq_handler(int irq, void *dev_id)
+{
+	struct stm_fdma_device *fdev = dev_id;
+	irqreturn_t result;
+
+	/* Update channel states and mark the channels needing completion */
+	result = stm_fdma_irq_status(fdev);
+
+	/*
+	 * Completions from all channels are handled by a single engine run.
+	 * With interrupt mitigation the FDMA interrupts are masked until the
+	 * engine has drained them, polling the interrupt status meanwhile.
+	 */
+	if (fdev->complete_pending) {
+		if (fdev->irq_mitigation)
+			stm_fdma_irq_mask(fdev);
+
+		tasklet_hi_schedule(&fdev->tasklet_complete);
+	}
+
+	return result;
+}
+
+static int stm_fdma_irq_poll(struct stm_fdma_device *fdev)
+{
+	unsigned long irqflags = 0;
+	irqreturn_t result;
+
+	/* Status is processed exactly as in the interrupt handler */
+	local_irq_save(irqflags);
+	result = stm_fdma_irq_status(fdev);
+	local_irq_restore(irqflags);
+
+	return result == IRQ_HANDLED;
+}
+
+static void stm_fdma_complete_engine(unsigned long data)
+{
+	struct stm_fdma_device *fdev = (struct stm_fdma_device *) data;
+	int budget = fdev->complete_budget ? : STM_FDMA_COMPLETE_BUDGET;
+	int c = fdev->complete_next;
+	int idle = 0;
+
+	fdev->complete_runs++;
+
+	/*
+	 * Complete channels round-robin, so that a busy channel cannot starve
+	 * the others when the budget runs out. After a full pass without any
+	 * work, poll for new completions if the interrupts are masked. Each
+	 * poll is charged to the budget as well, as it may find only errors
+	 * or descriptor updates and never a channel to complete.
+	 */
+	while (budget > 0) {
+		if (test_and_clear_bit(c, &fdev->complete_pending)) {
+			struct stm_fdma_chan *fchan = &fdev->ch_list[c];
+
+			stm_fdma_latency_record(fchan);
+			stm_fdma_desc_complete(fchan);
+			budget--;
+			idle = 0;
+		} else if (++idle >= STM_FDMA_NUM_CHANNELS) {
+			if (!fdev->irq_masked || !stm_fdma_irq_poll(fdev))
+				break;
+			budget--;
+			idle = 0;
+		}
+
+		if (++c > STM_FDMA_MAX_CHANNEL)
+			c = STM_FDMA_MIN_CHANNEL;
+	}
+
+	fdev->complete_next = c;
+
+	/* Budget exhausted, let the rest of the system run first */
+	if (fdev->complete_pending) {
+		fdev->complete_resched++;
+		tasklet_hi_schedule(&fdev->tasklet_complete);
+		return;
+	}
+
+	/* Any interrupt raised while masked fires again once unmasked */
+	stm_fdma_irq_unmask(fdev);
+}
+
 
 /*
  * Clock functions.
@@ -244,9 +361,7 @@ static int stm_fdma_alloc_chan_resources(struct dma_chan *chan)
 	struct stm_fdma_device *fdev = fchan->fdev;
 	struct stm_dma_paced_config *paced;
 	unsigned long irqflags = 0;
-	LIST_HEAD(list);
 	int result;
-	int i;
 
 	dev_dbg(fdev->dev, "%s(chan=%p)\n", __func__, chan);
 
@@ -316,22 +431,11 @@ static int stm_fdma_alloc_chan_resources(struct dma_chan *chan)
 		return -EINVAL;
 	}
 
-	/* Allocate descriptors to a temporary list */
-	for (i = 0; i < STM_FDMA_DESCRIPTORS; ++i) {
-		struct stm_fdma_desc *fdesc;
-
-		fdesc = stm_fdma_desc_alloc(fchan);
-		if (!fdesc) {
-			dev_err(fdev->dev, "Failed to allocate desc\n");
-			break;
-		}
-
-		list_add_tail(&fdesc->node, &list);
-	}
+	/* Preallocate the first chunk of the descriptor pool */
+	if (stm_fdma_desc_pool_grow(fchan, GFP_KERNEL))
+		dev_err(fdev->dev, "Failed to allocate desc\n");
 
 	spin_lock_irqsave(&fchan->lock, irqflags);
-	fchan->desc_count = i;
-	list_splice(&list, &fchan->desc_free);
 	fchan->last_completed = chan->cookie = 1;
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
 
@@ -341,14 +445,13 @@ static int stm_fdma_alloc_chan_resources(struct dma_chan *chan)
 static void stm_fdma_free_chan_resources(struct dma_chan *chan)
 {
 	struct stm_fdma_chan *fchan = to_stm_fdma_chan(chan);
-	struct stm_fdma_desc *fdesc, *_fdesc;
 	unsigned long irqflags = 0;
-	LIST_HEAD(list);
 
 	dev_dbg(fchan->fdev->dev, "%s(chan=%p)\n", __func__, chan);
 
-	/* Stop the completion tasklet (this waits until tasklet finishes) */
-	tasklet_kill(&fchan->tasklet_complete);
+	/* Drop any pending completion and wait for the engine to finish */
+	clear_bit(fchan->id, &fchan->fdev->complete_pending);
+	tasklet_unlock_wait(&fchan->fdev->tasklet_complete);
 
 	spin_lock_irqsave(&fchan->lock, irqflags);
 
@@ -361,14 +464,10 @@ static void stm_fdma_free_chan_resources(struct dma_chan *chan)
 	BUG_ON(!list_empty(&fchan->desc_queue));
 	BUG_ON(!list_empty(&fchan->desc_active));
 
-	list_splice_init(&fchan->desc_free, &list);
-	fchan->desc_count = 0;
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
 
 	/* Free all allocated transfer descriptors */
-	list_for_each_entry_safe(fdesc, _fdesc, &list, node) {
-		stm_fdma_desc_free(fdesc);
-	}
+	stm_fdma_desc_pool_destroy(fchan);
 
 	/* Perform any channel configuration clean up */
 	switch (fchan->type) {
@@ -1064,6 +1163,75 @@ static void stm_fdma_issue_pending(struct dma_chan *chan)
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
 }
 
+
+/*
+ * Memcpy offload channel functions
+ */
+
+static void stm_fdma_memcpy_work(struct work_struct *work)
+{
+	struct stm_fdma_device *fdev =
+			container_of(work, struct stm_fdma_device, memcpy_work);
+	int result;
+
+	result = dma_async_device_register(&fdev->dma_memcpy);
+	if (result) {
+		dev_err(fdev->dev, "Failed to register memcpy DMA device\n");
+		return;
+	}
+
+	fdev->memcpy_registered = 1;
+
+	dev_notice(fdev->dev, "%d memcpy channels\n", fdev->memcpy_channels);
+}
+
+void stm_fdma_memcpy_register(struct stm_fdma_device *fdev)
+{
+	/*
+	 * Public channels are grabbed by dmaengine clients (async_tx, net_dma)
+	 * as soon as they are registered, so the memcpy device is published
+	 * only once the firmware is loaded, rather than have these clients
+	 * trigger the firmware load at probe time. Registration takes the
+	 * dmaengine list mutex, which may be held by our caller.
+	 */
+	if (fdev->memcpy_channels)
+		schedule_work(&fdev->memcpy_work);
+}
+
+static void stm_fdma_memcpy_init(struct stm_fdma_device *fdev)
+{
+	struct dma_device *dma_memcpy = &fdev->dma_memcpy;
+
+	INIT_WORK(&fdev->memcpy_work, stm_fdma_memcpy_work);
+
+	/* Memcpy only, so never selected for slave or cyclic transfers */
+	dma_cap_set(DMA_MEMCPY, dma_memcpy->cap_mask);
+
+	dma_memcpy->dev = fdev->dev;
+
+	dma_memcpy->device_alloc_chan_resources =
+		stm_fdma_alloc_chan_resources;
+	dma_memcpy->device_free_chan_resources =
+		stm_fdma_free_chan_resources;
+	dma_memcpy->device_prep_dma_memcpy	= stm_fdma_prep_dma_memcpy;
+	dma_memcpy->device_control		= stm_fdma_control;
+	dma_memcpy->device_tx_status		= stm_fdma_tx_status;
+	dma_memcpy->device_issue_pending	= stm_fdma_issue_pending;
+}
+
+static void stm_fdma_memcpy_exit(struct stm_fdma_device *fdev)
+{
+	if (!fdev->memcpy_channels)
+		return;
+
+	cancel_work_sync(&fdev->memcpy_work);
+
+	if (fdev->memcpy_registered)
+		dma_async_device_unregister(&fdev->dma_memcpy);
+	fdev->memcpy_registered = 0;
+}
+
+
 void stm_fdma_parse_dt(struct platform_device *pdev,
 		struct stm_fdma_device *fdev)
 {
@@ -1082,6 +1250,11 @@ void stm_fdma_parse_dt(struct platform_device *pdev,
 	of_property_read_u32(np, "xbar", &xbar);
 	fdev->xbar = xbar;
 
+	of_property_read_u32(np, "desc-pool-size", &fdev->desc_pool_size);
+	of_property_read_u32(np, "completion-budget", &fdev->complete_budget);
+	of_property_read_u32(np, "memcpy-channels", &fdev->memcpy_channels);
+	fdev->irq_mitigation = of_property_read_bool(np, "irq-mitigation");
+
 	/* fw */
 	fwnp = of_parse_phandle(np, "fw-regs", 0);
 	of_property_read_u32(fwnp, "fw-rev-id", (u32 *)&fw->rev_id);
@@ -1162,6 +1335,7 @@ static int __devinit stm_fdma_probe(struct platform_device *pdev)
 		fdev->fw = pdata->fw;
 		fdev->hw = pdata->hw;
 		fdev->xbar = pdata->xbar;
+		fdev->memcpy_channels = pdata->memcpy_channels;
 		fdev->fdma_id = pdev->id;
 	} else {
 		stm_fdma_parse_dt(pdev, fdev);
@@ -1169,6 +1343,18 @@ static int __devinit stm_fdma_probe(struct platform_device *pdev)
 
 	spin_lock_init(&fdev->lock);
 
+	/* Number of descriptors per channel pool chunk */
+	if (!fdev->desc_pool_size)
+		fdev->desc_pool_size = STM_FDMA_DESCRIPTORS;
+
+	/* Number of completions handled per engine run */
+	if (!fdev->complete_budget)
+		fdev->complete_budget = STM_FDMA_COMPLETE_BUDGET;
+
+	/* Number of channels reserved for memcpy offload */
+	if (fdev->memcpy_channels > STM_FDMA_MEMCPY_CHANNELS)
+		fdev->memcpy_channels = STM_FDMA_MEMCPY_CHANNELS;
+
 	/* Retrieve FDMA platform memory resource */
 	iores = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	if (!iores) {
@@ -1217,6 +1403,7 @@ static int __devinit stm_fdma_probe(struct platform_device *pdev)
 
 	/* Initialise list of FDMA channels */
 	INIT_LIST_HEAD(&fdev->dma_device.channels);
+	INIT_LIST_HEAD(&fdev->dma_memcpy.channels);
 	for (i = STM_FDMA_MIN_CHANNEL; i <= STM_FDMA_MAX_CHANNEL; ++i) {
 		struct stm_fdma_chan *fchan = &fdev->ch_list[i];
 		struct dma_chan *chan = &fchan->dma_chan;
@@ -1228,12 +1415,19 @@ static int __devinit stm_fdma_probe(struct platform_device *pdev)
 		/* Initialise channel lock and descriptor lists */
 		spin_lock_init(&fchan->lock);
 		INIT_LIST_HEAD(&fchan->desc_free);
+		INIT_LIST_HEAD(&fchan->desc_unacked);
+		INIT_LIST_HEAD(&fchan->desc_chunks);
 		INIT_LIST_HEAD(&fchan->desc_queue);
 		INIT_LIST_HEAD(&fchan->desc_active);
-
-		/* Initialise the completion tasklet */
-		tasklet_init(&fchan->tasklet_complete, stm_fdma_desc_complete,
-				(unsigned long) fchan);
+		INIT_WORK(&fchan->desc_grow_work, stm_fdma_desc_grow_work);
+
+		/* The last channels may be reserved for memcpy offload */
+		if (i > STM_FDMA_MAX_CHANNEL - fdev->memcpy_channels) {
+			chan->device = &fdev->dma_memcpy;
+			list_add_tail(&chan->device_node,
+					&fdev->dma_memcpy.channels);
+			continue;
+		}
 
 		/* Set the dmaengine channel data */
 		chan->device = &fdev->dma_device;
@@ -1242,6 +1436,10 @@ static int __devinit stm_fdma_probe(struct platform_device *pdev)
 		list_add_tail(&chan->device_node, &fdev->dma_device.channels);
 	}
 
+	/* Initialise the completion engine shared by all channels */
+	tasklet_init(&fdev->tasklet_complete, stm_fdma_complete_engine,
+			(unsigned long) fdev);
+
 	/* Initialise the FDMA dreq data (reserve 0 & 31 for FDMA use) */
 	spin_lock_init(&fdev->dreq_lock);
 	fdev->dreq_mask = (1 << 0) | (1 << 31);
@@ -1294,10 +1492,22 @@ static int __devinit stm_fdma_probe(struct platform_device *pdev)
 	/* Create the firmware loading wait queue */
 	init_waitqueue_head(&fdev->fw_load_q);
 
-	/* Set the FDMA device capabilities */
+	/*
+	 * Initialise the memcpy device, registered once firmware is loaded.
+	 * This must be done before the dmaengine device is registered, as
+	 * from then on its clients may trigger the firmware load.
+	 */
+	stm_fdma_memcpy_init(fdev);
+
+	/*
+	 * Set the FDMA device capabilities. The device is private, so that
+	 * public dmaengine clients can never take channels needed for slave
+	 * transfers: these must be obtained with dma_request_channel().
+	 */
 	dma_cap_set(DMA_SLAVE,  fdev->dma_device.cap_mask);
 	dma_cap_set(DMA_CYCLIC, fdev->dma_device.cap_mask);
 	dma_cap_set(DMA_MEMCPY, fdev->dma_device.cap_mask);
+	dma_cap_set(DMA_PRIVATE, fdev->dma_device.cap_mask);
 
 	/* Initialise the dmaengine device */
 	fdev->dma_device.dev = &pdev->dev;
@@ -1332,13 +1542,9 @@ error_register:
 error_req_irq:
 	dma_pool_destroy(fdev->dma_pool);
 error_dma_pool:
-	/* Kill completion tasklet for each channel */
-	for (i = STM_FDMA_MIN_CHANNEL; i <= STM_FDMA_MAX_CHANNEL; ++i) {
-		struct stm_fdma_chan *fchan = &fdev->ch_list[i];
-
-		tasklet_disable(&fchan->tasklet_complete);
-		tasklet_kill(&fchan->tasklet_complete);
-	}
+	/* Kill the completion tasklet */
+	tasklet_disable(&fdev->tasklet_complete);
+	tasklet_kill(&fdev->tasklet_complete);
 error_clk_enb:
 	stm_fdma_clk_disable(fdev);
 	return result;
@@ -1347,7 +1553,6 @@ error_clk_enb:
 static int __exit stm_fdma_remove(struct platform_device *pdev)
 {
 	struct stm_fdma_device *fdev = platform_get_drvdata(pdev);
-	int i;
 
 	/* Clear the platform driver data */
 	platform_set_drvdata(pdev, NULL);
@@ -1355,7 +1560,8 @@ static int __exit stm_fdma_remove(struct platform_device *pdev)
 	/* Unregister the device from debugfs */
 	stm_fdma_debugfs_unregister(fdev);
 
-	/* Unregister the dmaengine device */
+	/* Unregister the dmaengine devices */
+	stm_fdma_memcpy_exit(fdev);
 	dma_async_device_unregister(&fdev->dma_device);
 
 	/* Disable all channels */
@@ -1371,13 +1577,9 @@ static int __exit stm_fdma_remove(struct platform_device *pdev)
 	/* Destroy the dma pool */
 	dma_pool_destroy(fdev->dma_pool);
 
-	/* Kill tasklet for each channel */
-	for (i = STM_FDMA_MIN_CHANNEL; i <= STM_FDMA_MAX_CHANNEL; ++i) {
-		struct stm_fdma_chan *fchan = &fdev->ch_list[i];
-
-		tasklet_disable(&fchan->tasklet_complete);
-		tasklet_kill(&fchan->tasklet_complete);
-	}
+	/* Kill the completion tasklet */
+	tasklet_disable(&fdev->tasklet_complete);
+	tasklet_kill(&fdev->tasklet_complete);
 
 	return 0;
 }
@@ -16,6 +16,8 @@
 
 #include <linux/clk.h>
 #include <linux/interrupt.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
 #include <linux/dmaengine.h>
 #include <linux/libelf.h>
 #include <linux/stm/dma.h>
@@ -67,6 +69,9 @@ struct stm_fdma_dreq_router {
 #define STM_FDMA_IS_CYCLIC	1
 #define STM_FDMA_IS_PARKED	2
 
+#define STM_FDMA_COMPLETE_BUDGET	16	/* Completions per engine run */
+#define STM_FDMA_MEMCPY_CHANNELS	(STM_FDMA_NUM_CHANNELS / 2)	/* Max */
+
 enum stm_fdma_state {
 	STM_FDMA_STATE_IDLE,
 	STM_FDMA_STATE_RUNNING,
@@ -78,6 +83,20 @@ enum stm_fdma_state {
 struct stm_fdma_desc;
 struct stm_fdma_device;
 
+/*
+ * Completion latency histogram (interrupt to descriptor completion). Bucket n
+ * counts latencies below 2^n us, the last bucket counts everything above.
+ */
+
+#define STM_FDMA_LAT_BUCKETS	16
+
+struct stm_fdma_latency {
+	ktime_t stamp;
+	u32 count;
+	u32 max_us;
+	u32 hist[STM_FDMA_LAT_BUCKETS];
+};
+
 struct stm_fdma_chan {
 	struct stm_fdma_device *fdev;
 	struct dma_chan dma_chan;
@@ -91,15 +110,21 @@ struct stm_fdma_chan {
 	dma_addr_t dma_addr;
 
 	u32 desc_count;
+	u32 desc_free_count;
 	struct list_head desc_free;
+	struct list_head desc_unacked;
+	struct list_head desc_chunks;
+	struct work_struct desc_grow_work;
 	struct list_head desc_queue;
 	struct list_head desc_active;
 	struct stm_fdma_desc *desc_park;
 
-	struct tasklet_struct tasklet_complete;
-
 	dma_cookie_t last_completed;
 
+#ifdef CONFIG_DEBUG_FS
+	struct stm_fdma_latency latency;
+#endif
+
 	void *extension;
 };
 
@@ -133,6 +158,13 @@ struct stm_fdma_device {
 	u32 dreq_mask;
 
 	struct dma_pool *dma_pool;
+	u32 desc_pool_size;
+
+	/* Channels published for memcpy offload (async_tx, net_dma, ...) */
+	struct dma_device dma_memcpy;
+	u32 memcpy_channels;
+	struct work_struct memcpy_work;
+	int memcpy_registered;
 
 	struct stm_plat_fdma_hw *hw;
 	struct stm_plat_fdma_fw_regs *fw;
@@ -140,12 +172,26 @@ struct stm_fdma_device {
 
 	struct stm_fdma_regs regs;
 
+	/* Completion engine */
+	struct tasklet_struct tasklet_complete;
+	unsigned long complete_pending;
+	u32 complete_next;
+	u32 complete_budget;
+	u32 complete_runs;
+	u32 complete_resched;
+	u32 irq_mitigation;
+	int irq_masked;
+
 #ifdef CONFIG_DEBUG_FS
 	/* debugfs */
 	struct dentry *debug_dir;
 	struct dentry *debug_regs;
 	struct dentry *debug_dmem;
 	struct dentry *debug_chans[STM_FDMA_NUM_CHANNELS];
+	struct dentry *debug_budget;
+	struct dentry *debug_mitigation;
+	struct dentry *debug_runs;
+	struct dentry *debug_resched;
 #endif
 };
 
@@ -155,6 +201,7 @@ struct stm_fdma_device {
  */
 
 #define STM_FDMA_DESCRIPTORS	32
+#define STM_FDMA_DESC_CHUNKS	8	/* Maximum pool size in chunks */
 
 struct stm_fdma_desc {
 	struct list_head node;
@@ -163,10 +210,23 @@ struct stm_fdma_desc {
 
 	struct stm_fdma_llu *llu;
 	struct list_head llu_list;
+	u32 llu_count;
 
 	struct dma_async_tx_descriptor dma_desc;
 
 	void *extension;
+} ____cacheline_aligned;
+
+/*
+ * Chunk of the channel descriptor pool: the descriptors and their llu nodes
+ * (from a single coherent block) are allocated and freed together.
+ */
+struct stm_fdma_desc_chunk {
+	struct list_head node;
+	u32 count;
+	void *llu;		/* count nodes, STM_FDMA_LLU_STRIDE apart */
+	dma_addr_t llu_phys;
+	struct stm_fdma_desc desc[0];
 };
 
 
@@ -205,12 +265,21 @@ void stm_fdma_debugfs_exit(void);
 void stm_fdma_debugfs_register(struct stm_fdma_device *fdev);
 void stm_fdma_debugfs_unregister(struct stm_fdma_device *fdev);
 
+static inline void stm_fdma_latency_stamp(struct stm_fdma_chan *fchan)
+{
+	fchan->latency.stamp = ktime_get();
+}
+
+void stm_fdma_latency_record(struct stm_fdma_chan *fchan);
+
 #else
 
 #define stm_fdma_debugfs_init()		do { } while (0)
 #define stm_fdma_debugfs_exit()		do { } while (0)
 #define stm_fdma_debugfs_register(a)	do { } while (0)
 #define stm_fdma_debugfs_unregister(a)	do { } while (0)
+#define stm_fdma_latency_stamp(a)	do { } while (0)
+#define stm_fdma_latency_record(a)	do { } while (0)
 
 #endif
 
@@ -219,13 +288,16 @@ dma_cookie_t stm_fdma_tx_submit(struct dma_async_tx_descriptor *desc);
 
 struct stm_fdma_desc *stm_fdma_desc_alloc(struct stm_fdma_chan *fchan);
 void stm_fdma_desc_free(struct stm_fdma_desc *fdesc);
+int stm_fdma_desc_pool_grow(struct stm_fdma_chan *fchan, gfp_t gfp);
+void stm_fdma_desc_pool_destroy(struct stm_fdma_chan *fchan);
+void stm_fdma_desc_grow_work(struct work_struct *work);
 struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan);
 void stm_fdma_desc_put(struct stm_fdma_desc *fdesc);
 void stm_fdma_desc_chain(struct stm_fdma_desc **head,
 		struct stm_fdma_desc **prev, struct stm_fdma_desc *fdesc);
 void stm_fdma_desc_start(struct stm_fdma_chan *fchan);
 void stm_fdma_desc_unmap_buffers(struct stm_fdma_desc *fdesc);
-void stm_fdma_desc_complete(unsigned long data);
+void stm_fdma_desc_complete(struct stm_fdma_chan *fchan);
 
 int stm_fdma_register_dreq_router(struct stm_fdma_dreq_router *router);
 void stm_fdma_unregister_dreq_router(struct stm_fdma_dreq_router *router);
@@ -240,6 +312,8 @@ int stm_fdma_dreq_config(struct stm_fdma_chan *fchan,
 int stm_fdma_fw_check(struct stm_fdma_device *fdev);
 int stm_fdma_fw_load(struct stm_fdma_device *fdev, struct ELF32_info *elfinfo);
 
+void stm_fdma_memcpy_register(struct stm_fdma_device *fdev);
+
 void stm_fdma_hw_enable(struct stm_fdma_device *fdev);
 void stm_fdma_hw_disable(struct stm_fdma_device *fdev);
 void stm_fdma_hw_get_revisions(struct stm_fdma_device *fdev,
@@ -39,6 +39,50 @@ static char *stm_fdma_debugfs_direction[] = {
 	seq_printf(m, "%-30s (0x%p) = 0x%08x\n", s, a, readl(a));
 
 
+/*
+ * Completion latency functions
+ */
+
+void stm_fdma_latency_record(struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_latency *lat = &fchan->latency;
+	s64 us = ktime_us_delta(ktime_get(), lat->stamp);
+	int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(int, fls64(us), STM_FDMA_LAT_BUCKETS - 1);
+
+	lat->hist[bucket]++;
+	lat->count++;
+
+	if (us > lat->max_us)
+		lat->max_us = us;
+}
+
+static void stm_fdma_debugfs_latency_show(struct seq_file *m,
+		struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_latency *lat = &fchan->latency;
+	char buffer[80];
+	int i;
+
+	seq_printf(m, "%-30s              = %u (max %u us)\n",
+			"COMPLETIONS", lat->count, lat->max_us);
+
+	for (i = 0; i < STM_FDMA_LAT_BUCKETS; ++i) {
+		if (!lat->hist[i])
+			continue;
+
+		if (i == STM_FDMA_LAT_BUCKETS - 1)
+			sprintf(buffer, "LATENCY >= %u us", 1 << (i - 1));
+		else
+			sprintf(buffer, "LATENCY < %u us", 1 << i);
+		seq_printf(m, "%-30s              = %u\n", buffer,
+				lat->hist[i]);
+	}
+}
+
+
 /*
  * Debugfs register file functions
  */
@@ -193,6 +237,8 @@ static int stm_fdma_debugfs_chan_show(struct seq_file *m, void *v)
 			stm_fdma_debugfs_direction[fchan->dreq->direction]);
 	}
 
+	stm_fdma_debugfs_latency_show(m, fchan);
+
 	seq_printf(m, "\n");
 
 	return 0;
@@ -251,6 +297,18 @@ void stm_fdma_debugfs_register(struct stm_fdma_device *fdev)
 			goto error_chan_file;
 	}
 
+	/* Create entries for the completion engine */
+	fdev->debug_budget = debugfs_create_u32("completion_budget",
+			S_IRUGO | S_IWUSR, fdev->debug_dir,
+			&fdev->complete_budget);
+	fdev->debug_mitigation = debugfs_create_bool("irq_mitigation",
+			S_IRUGO | S_IWUSR, fdev->debug_dir,
+			&fdev->irq_mitigation);
+	fdev->debug_runs = debugfs_create_u32("completion_runs", S_IRUGO,
+			fdev->debug_dir, &fdev->complete_runs);
+	fdev->debug_resched = debugfs_create_u32("completion_resched",
+			S_IRUGO, fdev->debug_dir, &fdev->complete_resched);
+
 	return;
 
 error_chan_file:
@@ -279,6 +337,12 @@ void stm_fdma_debugfs_unregister(struct stm_fdma_device *fdev)
 {
 	int c;
 
+	/* Remove the completion engine entries */
+	debugfs_remove(fdev->debug_resched);
+	debugfs_remove(fdev->debug_runs);
+	debugfs_remove(fdev->debug_mitigation);
+	debugfs_remove(fdev->debug_budget);
+
 	/* Remove the debugfs entry for each channel */
 	for (c = STM_FDMA_MIN_CHANNEL; c <= STM_FDMA_MAX_CHANNEL; c++)
 		debugfs_remove(fdev->debug_chans[c]);
@@ -85,64 +85,179 @@ void stm_fdma_desc_free(struct stm_fdma_desc *fdesc)
 	stm_fdma_desc_dealloc(fdesc);
 }
 
-struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan)
+
+/*
+ * Descriptor pool functions
+ *
+ * Each channel carries a pool of descriptors allocated in chunks of
+ * desc_pool_size. The free list only ever holds descriptors that can be
+ * used straight away, so getting one is O(1). Transfers that complete
+ * without being ACKed are kept (with their llu_list) on the unacked list
+ * until the client ACKs them. The pool is grown from a work queue when it
+ * runs low, so the prep functions only allocate if it is exhausted.
+ */
+
+int stm_fdma_desc_pool_grow(struct stm_fdma_chan *fchan, gfp_t gfp)
 {
-	struct stm_fdma_desc *fdesc = NULL, *tdesc, *_tdesc;
+	struct stm_fdma_device *fdev = fchan->fdev;
+	struct stm_fdma_desc_chunk *chunk;
+	u32 count = fdev->desc_pool_size;
 	unsigned long irqflags = 0;
+	LIST_HEAD(list);
+	int i;
+
+	chunk = kzalloc(sizeof(*chunk) + count * sizeof(struct stm_fdma_desc),
+			gfp);
+	if (!chunk)
+		return -ENOMEM;
+
+	chunk->llu = dma_alloc_coherent(fdev->dev, count * STM_FDMA_LLU_STRIDE,
+			&chunk->llu_phys, gfp);
+	if (!chunk->llu) {
+		kfree(chunk);
+		return -ENOMEM;
+	}
+	chunk->count = count;
 
-	/*
-	 * Search the free list for the next available descriptor. Only those
-	 * descriptors that have been ACKed can be used. If a descriptor has
-	 * been ACKed but has a non-empty llu_list, add the descriptors in the
-	 * llu_list to the free list.
-	 *
-	 * We should only encounter a non-empty llu_list if a transfer is not
-	 * automatically ACKed upon completion. In case the transfer is to be
-	 * re-submitted, it is moved to the free list as a single complete
-	 * transfer entity.
-	 *
-	 * When the transfer is finally ACKed, the only time we can move the
-	 * llu_list to the free list is when getting the next available
-	 * descriptor.
-	 */
+	for (i = 0; i < count; ++i) {
+		struct stm_fdma_desc *fdesc = &chunk->desc[i];
+
+		fdesc->fchan = fchan;
+		fdesc->llu = chunk->llu + i * STM_FDMA_LLU_STRIDE;
+		INIT_LIST_HEAD(&fdesc->llu_list);
+
+		dma_async_tx_descriptor_init(&fdesc->dma_desc,
+				&fchan->dma_chan);
+		fdesc->dma_desc.phys = chunk->llu_phys + i * STM_FDMA_LLU_STRIDE;
+		fdesc->dma_desc.flags = DMA_CTRL_ACK;
+		fdesc->dma_desc.tx_submit = stm_fdma_tx_submit;
+
+		list_add_tail(&fdesc->node, &list);
+	}
 
 	spin_lock_irqsave(&fchan->lock, irqflags);
+	list_add_tail(&chunk->node, &fchan->desc_chunks);
+	list_splice_tail(&list, &fchan->desc_free);
+	fchan->desc_count += count;
+	fchan->desc_free_count += count;
+	spin_unlock_irqrestore(&fchan->lock, irqflags);
 
-	/* Search the free list for an available descriptor */
-	list_for_each_entry_safe(tdesc, _tdesc, &fchan->desc_free, node) {
-		/* If descriptor has been ACKed then remove from free list */
-		if (async_tx_test_ack(&tdesc->dma_desc)) {
-			/* Add llu_list to free list in case not empty */
-			list_splice_init(&tdesc->llu_list, &fchan->desc_free);
-			list_del_init(&tdesc->node);
-			fdesc = tdesc;
-			break;
-		}
-		dev_dbg(fchan->fdev->dev, "Descriptor %p not ACKed\n", tdesc);
+	return 0;
+}
+
+/*
+ * The channel must be idle with all its descriptors back in the pool.
+ */
+void stm_fdma_desc_pool_destroy(struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_desc_chunk *chunk, *_chunk;
+	unsigned long irqflags = 0;
+	LIST_HEAD(list);
+
+	cancel_work_sync(&fchan->desc_grow_work);
+
+	spin_lock_irqsave(&fchan->lock, irqflags);
+	list_splice_init(&fchan->desc_chunks, &list);
+	INIT_LIST_HEAD(&fchan->desc_free);
+	INIT_LIST_HEAD(&fchan->desc_unacked);
+	fchan->desc_count = 0;
+	fchan->desc_free_count = 0;
+	spin_unlock_irqrestore(&fchan->lock, irqflags);
+
+	list_for_each_entry_safe(chunk, _chunk, &list, node) {
+		dma_free_coherent(fchan->fdev->dev,
+				chunk->count * STM_FDMA_LLU_STRIDE, chunk->llu,
+				chunk->llu_phys);
+		kfree(chunk);
 	}
+}
 
-	if (!fdesc) {
+void stm_fdma_desc_grow_work(struct work_struct *work)
+{
+	struct stm_fdma_chan *fchan = container_of(work, struct stm_fdma_chan,
+			desc_grow_work);
+
+	if (stm_fdma_desc_pool_grow(fchan, GFP_KERNEL))
+		dev_err(fchan->fdev->dev, "Failed to grow descriptor pool\n");
+}
+
+/*
+ * This function should be called with the channel locked!
+ */
+static void stm_fdma_desc_release(struct stm_fdma_chan *fchan,
+		struct stm_fdma_desc *fdesc)
+{
+	/* Keep a transfer that is not ACKed in one piece for re-submission */
+	if (!async_tx_test_ack(&fdesc->dma_desc)) {
+		list_move(&fdesc->node, &fchan->desc_unacked);
+		return;
+	}
+
+	/* Return the transfer and all its linked descriptors in one go */
+	list_splice_init(&fdesc->llu_list, &fchan->desc_free);
+	list_move(&fdesc->node, &fchan->desc_free);
+	fchan->desc_free_count += 1 + fdesc->llu_count;
+}
+
+/*
+ * This function should be called with the channel locked!
+ */
+static void stm_fdma_desc_reclaim(struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_desc *fdesc, *_fdesc;
+
+	list_for_each_entry_safe(fdesc, _fdesc, &fchan->desc_unacked, node)
+		if (async_tx_test_ack(&fdesc->dma_desc))
+			stm_fdma_desc_release(fchan, fdesc);
+}
+
+struct stm_fdma_desc *stm_fdma_desc_get(struct stm_fdma_chan *fchan)
+{
+	struct stm_fdma_desc *fdesc = NULL;
+	unsigned long irqflags = 0;
+
+	spin_lock_irqsave(&fchan->lock, irqflags);
+
+	/* Transfers ACKed since their completion can now be recycled */
+	if (list_empty(&fchan->desc_free))
+		stm_fdma_desc_reclaim(fchan);
+
+	if (list_empty(&fchan->desc_free)) {
 		spin_unlock_irqrestore(&fchan->lock, irqflags);
 
-		/* No descriptors available, attempt to allocate a new one */
-		dev_dbg(fchan->fdev->dev, "Allocating a new descriptor\n");
-		fdesc = stm_fdma_desc_alloc(fchan);
-		if (!fdesc) {
+		/* Pool exhausted, grow it now as we cannot wait */
+		dev_dbg(fchan->fdev->dev, "Growing the descriptor pool\n");
+		if (stm_fdma_desc_pool_grow(fchan, GFP_NOWAIT)) {
 			dev_err(fchan->fdev->dev, "Not enough descriptors\n");
 			return NULL;
 		}
 
-		/* Increment number of descriptors allocated */
 		spin_lock_irqsave(&fchan->lock, irqflags);
-		fchan->desc_count++;
+		if (list_empty(&fchan->desc_free)) {
+			spin_unlock_irqrestore(&fchan->lock, irqflags);
+			return NULL;
+		}
 	}
 
+	fdesc = list_first_entry(&fchan->desc_free, struct stm_fdma_desc,
+			node);
+	list_del_init(&fdesc->node);
+	fchan->desc_free_count--;
+
+	/* Grow the pool in the background when it is running low */
+	if ((fchan->desc_free_count < fchan->fdev->desc_pool_size / 4) &&
+	    (fchan->desc_count < fchan->fdev->desc_pool_size *
+				STM_FDMA_DESC_CHUNKS))
+		schedule_work(&fchan->desc_grow_work);
+
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
 
 	/* Re-initialise the descriptor */
 	memset(fdesc->llu, 0, sizeof(struct stm_fdma_llu));
 	INIT_LIST_HEAD(&fdesc->llu_list);
+	fdesc->llu_count = 0;
 	fdesc->dma_desc.cookie = 0;
+	fdesc->dma_desc.flags = DMA_CTRL_ACK;
 	fdesc->dma_desc.callback = NULL;
 	fdesc->dma_desc.callback_param = NULL;
 	fdesc->dma_desc.tx_submit = stm_fdma_tx_submit;
@@ -158,9 +273,8 @@ void stm_fdma_desc_put(struct stm_fdma_desc *fdesc)
 
 		spin_lock_irqsave(&fchan->lock, irqflags);
 
-		/* Move all linked descriptors to the free list */
-		list_splice_init(&fdesc->llu_list, &fchan->desc_free);
-		list_add(&fdesc->node, &fchan->desc_free);
+		/* Move the descriptor and all linked descriptors to the pool */
+		stm_fdma_desc_release(fchan, fdesc);
 
 		spin_unlock_irqrestore(&fchan->lock, irqflags);
 	}
@@ -176,6 +290,7 @@ void stm_fdma_desc_chain(struct stm_fdma_desc **head,
 		/* Link previous descriptor to this one */
 		(*prev)->llu->next = fdesc->dma_desc.phys;
 		list_add_tail(&fdesc->node, &(*head)->llu_list);
+		(*head)->llu_count++;
 	}
 
 	/* Descriptor just added now becomes the previous */
@@ -240,13 +355,12 @@ void stm_fdma_desc_unmap_buffers(struct stm_fdma_desc *fdesc)
 	}
 }
 
-void stm_fdma_desc_complete(unsigned long data)
+void stm_fdma_desc_complete(struct stm_fdma_chan *fchan)
 {
-	struct stm_fdma_chan *fchan = (struct stm_fdma_chan *) data;
 	struct stm_fdma_desc *fdesc = NULL;
 	unsigned long irqflags = 0;
 
-	dev_dbg(fchan->fdev->dev, "%s(data=%08lx)\n", __func__, data);
+	dev_dbg(fchan->fdev->dev, "%s(fchan=%p)\n", __func__, fchan);
 
 	spin_lock_irqsave(&fchan->lock, irqflags);
 
@@ -290,23 +404,13 @@ void stm_fdma_desc_complete(unsigned long data)
 
 		/*
 		 * If the transfer has been ACKed, then all individual
-		 * descriptors that make up the transfer can be moved to the
-		 * free list. If the transfer has not been ACKed, then it is
-		 * possible that it will be re-used, in which case the transfer
-		 * should be moved to the free list as-is.
-		 *
-		 * Until the ACK bit is set, the descriptor will not be re-used.
-		 * When the ACK bit is eventually set, and the descriptor is
-		 * about to be re-used, if the llu_list is not empty, the
-		 * llu_list will be added to the free list.
+		 * descriptors that make up the transfer are returned to the
+		 * pool as a single batch. If the transfer has not been ACKed,
+		 * then it is possible that it will be re-used, in which case
+		 * the transfer is kept as-is on the unacked list until the
+		 * ACK bit is eventually set.
 		 */
-
-		/* Move the llu_list to the free list only if desriptor ACKed */
-		if (fdesc->dma_desc.flags & DMA_CTRL_ACK)
-			list_splice_init(&fdesc->llu_list, &fchan->desc_free);
-
-		/* Move the descriptor to the free list (regardless of ACK) */
-		list_move(&fdesc->node, &fchan->desc_free);
+		stm_fdma_desc_release(fchan, fdesc);
 	}
 
 	spin_unlock_irqrestore(&fchan->lock, irqflags);
@@ -207,6 +207,9 @@ static int stm_fdma_fw_request(struct stm_fdma_device *fdev)
 	/* Release the firmware */
 	release_firmware(fw);
 
+	/* Memcpy channels can now be published without loading firmware */
+	stm_fdma_memcpy_register(fdev);
+
 	return 0;
 
 error_elf_load:
@@ -113,6 +113,7 @@ int stm_fdma_hw_channel_enable_all(struct stm_fdma_device *fdev)
 
 	writel(0xffffffff, fdev->io_base + fdev->regs.int_mask);
 	writel(0xffffffff, fdev->io_base + fdev->regs.cmd_mask);
+	fdev->irq_masked = 0;
 	writel(1, fdev->io_base + fdev->regs.en);
 	result = readl(fdev->io_base + fdev->regs.en) & 1;
 
@@ -130,6 +131,7 @@ int stm_fdma_hw_channel_disable_all(struct stm_fdma_device *fdev)
 
 	writel(0, fdev->io_base + fdev->regs.int_mask);
 	writel(0, fdev->io_base + fdev->regs.cmd_mask);
+	fdev->irq_masked = 0;
 	writel(0, fdev->io_base + fdev->regs.en);
 	result = readl(fdev->io_base + fdev->regs.en) & ~1;
 
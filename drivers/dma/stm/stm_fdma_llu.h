@@ -74,6 +74,9 @@ struct stm_fdma_llu {
 #define STM_FDMA_LLU_SIZE		sizeof(struct stm_fdma_llu)
 #define STM_FDMA_LLU_ALIGN		64
 
+/* Distance between the nodes of a descriptor pool chunk */
+#define STM_FDMA_LLU_STRIDE		ALIGN(STM_FDMA_LLU_SIZE, STM_FDMA_LLU_ALIGN)
+
 
 /*
  * Defines for generic node control
@@ -20,7 +20,16 @@
 #include <linux/platform_device.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/partitions.h>
+#include <linux/mtd/rcache.h>
 #include <linux/of.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 
 #include "stm_spi_fsm.h"
 
@@ -29,6 +38,9 @@
 #define FLASH_PROBE_FREQ	10		/* Probe freq. (MHz) */
 #define FLASH_PAGESIZE		256
 #define FLASH_MAX_BUSY_WAIT	(300 * HZ)	/* Maximum 'CHIPERASE' time */
+#define FLASH_MMAP_MAX_SIZE	(16 * 1024 * 1024) /* 24-bit addressing */
+#define FSM_DMA_THRESHOLD	4096		/* Default min. DMA read */
+#define FSM_DMA_TIMEOUT		(HZ / 2)
 
 /*
  * Flags to tweak operation of default read/write/erase routines
@@ -40,6 +52,14 @@
 #define CFG_N25Q_CHECK_ERROR_FLAGS		0x00000020
 
 
+/* Read paths, for statistics */
+enum fsm_read_path {
+	FSM_READ_PIO,		/* FSM sequence, FIFO drained by the CPU */
+	FSM_READ_MMAP,		/* CPU copy from the memory-mapped window */
+	FSM_READ_DMA,		/* dmaengine copy from the memory-mapped window */
+	FSM_READ_PATHS
+};
+
 /*
  * SPI FSM Controller data
  */
@@ -56,6 +76,25 @@ struct stm_spi_fsm {
 	struct clk		*clk;
 	struct mutex		lock;
 	unsigned		partitioned;
+
+	/* Memory-mapped window, in CONTIG/FASTREAD mode (optional) */
+	void __iomem		*mmap_base;
+	resource_size_t		mmap_phys;
+	uint32_t		mmap_size;
+	unsigned		mmap_read;	/* CPU reads through the window */
+	unsigned		dma;		/* holding a dmaengine reference */
+	uint32_t		dma_threshold;	/* min. size of a DMA read */
+
+	struct fsm_read_stats {
+		unsigned long	ops;
+		u64		bytes;
+		u64		wall_ns;	/* elapsed time */
+		u64		cpu_ns;		/* time not spent asleep */
+	} stats[FSM_READ_PATHS];
+#ifdef CONFIG_DEBUG_FS
+	struct dentry		*debugfs;
+#endif
+
 	uint8_t	page_buf[FLASH_PAGESIZE]__aligned(4);
 };
 
@@ -878,6 +917,7 @@ static int fsm_write_status(struct stm_spi_fsm *fsm, uint8_t cmd,
 			    uint16_t status, int bytes, int wait_busy);
 static int fsm_enter_32bitaddr(struct stm_spi_fsm *fsm, int enter);
 static uint8_t fsm_wait_busy(struct stm_spi_fsm *fsm);
+static int fsm_set_mode(struct stm_spi_fsm *fsm, uint32_t mode);
 static int fsm_write_fifo(struct stm_spi_fsm *fsm,
 			  const uint32_t *buf, const uint32_t size);
 static int fsm_read_fifo(struct stm_spi_fsm *fsm,
@@ -1856,6 +1896,190 @@ static int fsm_read(struct stm_spi_fsm *fsm, uint8_t *const buf,
 	return 0;
 }
 
+/*
+ * Memory-mapped reads
+ *
+ * In CONTIG/FASTREAD mode, the controller maps the Serial Flash into the
+ * 'spi-fsm-mmap' window, issuing FAST READ commands (24-bit addressing) on
+ * demand.  The window is either read by the CPU or, for large transfers,
+ * copied by a dmaengine memcpy channel (e.g. FDMA), the CPU sleeping until
+ * the copy is done rather than draining the FIFO.
+ */
+static int fsm_can_mmap(struct stm_spi_fsm *fsm, const uint32_t size,
+			const uint32_t offset)
+{
+	return fsm->mmap_base && offset + size <= fsm->mmap_size;
+}
+
+static void fsm_mmap_enter(struct stm_spi_fsm *fsm)
+{
+	fsm_set_mode(fsm, SPI_MODESELECT_CONTIG | SPI_MODESELECT_FASTREAD);
+}
+
+static void fsm_mmap_exit(struct stm_spi_fsm *fsm)
+{
+	fsm_set_mode(fsm, SPI_MODESELECT_FSM);
+}
+
+#ifdef CONFIG_DMA_ENGINE
+static struct dma_chan *fsm_dma_chan(struct stm_spi_fsm *fsm)
+{
+	return fsm->dma ? dma_find_channel(DMA_MEMCPY) : NULL;
+}
+
+static void fsm_read_dma_done(void *param)
+{
+	complete(param);
+}
+
+/*
+ * Copy the physically contiguous, cache line aligned, head of the request from
+ * the window.  Returns the number of bytes read, or a negative error code if
+ * the CPU has to do the copy instead.
+ */
+static int fsm_read_dma(struct stm_spi_fsm *fsm, struct dma_chan *chan,
+			uint8_t *buf, uint32_t size, const uint32_t offset,
+			s64 *sleep_ns)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct device *dev = chan->device->dev;
+	struct dma_async_tx_descriptor *tx;
+	int vmapped = is_vmalloc_addr(buf);
+	dma_cookie_t cookie;
+	dma_addr_t dst;
+	ktime_t start;
+	long timeout;
+
+	size &= ~(L1_CACHE_BYTES - 1);
+	if (vmapped) {
+		size = min_t(uint32_t, size, PAGE_SIZE - offset_in_page(buf));
+		dst = dma_map_page(dev, vmalloc_to_page(buf),
+				   offset_in_page(buf), size, DMA_FROM_DEVICE);
+	} else {
+		dst = dma_map_single(dev, buf, size, DMA_FROM_DEVICE);
+	}
+	if (dma_mapping_error(dev, dst))
+		return -ENOMEM;
+
+	tx = chan->device->device_prep_dma_memcpy(chan, dst,
+			fsm->mmap_phys + offset, size,
+			DMA_PREP_INTERRUPT | DMA_CTRL_ACK |
+			DMA_COMPL_SKIP_SRC_UNMAP | DMA_COMPL_SKIP_DEST_UNMAP);
+	if (tx) {
+		tx->callback = fsm_read_dma_done;
+		tx->callback_param = &done;
+		cookie = dmaengine_submit(tx);
+		dma_async_issue_pending(chan);
+
+		start = ktime_get();
+		timeout = wait_for_completion_timeout(&done, FSM_DMA_TIMEOUT);
+
+		/*
+		 * The memcpy channel is shared with other clients, whose
+		 * transfers must not be aborted, so let the copy run to its
+		 * end: the buffer must not be unmapped, nor the completion on
+		 * our stack released, before that.  The CPU then reads the
+		 * request again.
+		 */
+		if (!timeout) {
+			dev_err(fsm->dev, "timeout on DMA read\n");
+			dma_sync_wait(chan, cookie);
+			wait_for_completion(&done);
+		}
+
+		*sleep_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	}
+
+	if (vmapped)
+		dma_unmap_page(dev, dst, size, DMA_FROM_DEVICE);
+	else
+		dma_unmap_single(dev, dst, size, DMA_FROM_DEVICE);
+
+	if (!tx)
+		return -EBUSY;
+
+	return timeout ? size : -ETIMEDOUT;
+}
+#else
+static struct dma_chan *fsm_dma_chan(struct stm_spi_fsm *fsm)
+{
+	return NULL;
+}
+
+static int fsm_read_dma(struct stm_spi_fsm *fsm, struct dma_chan *chan,
+			uint8_t *buf, uint32_t size, const uint32_t offset,
+			s64 *sleep_ns)
+{
+	return -ENODEV;
+}
+#endif
+
+/*
+ * Read the head of a request, using the best path available: a DMA copy for
+ * large transfers, the window (if enabled) otherwise, else an FSM sequence of
+ * up to FLASH_PAGESIZE bytes.  A misaligned head is read on its own, so that
+ * the bulk of the request goes straight to 'buf', avoiding the 'page_buf'
+ * bounce copy and partial cache lines.  Returns the number of bytes read.
+ */
+static uint32_t fsm_read_chunk(struct stm_spi_fsm *fsm, uint8_t *buf,
+			       uint32_t size, const uint32_t offset)
+{
+	struct fsm_read_stats *stats;
+	enum fsm_read_path path;
+	struct dma_chan *chan;
+	uint32_t align;
+	ktime_t start;
+	s64 wall_ns;
+	s64 sleep_ns = 0;
+	int ret = -ENODEV;
+
+	start = ktime_get();
+
+	chan = fsm_dma_chan(fsm);
+	if ((chan || fsm->mmap_read) && fsm_can_mmap(fsm, size, offset)) {
+		align = -(unsigned long)buf & (L1_CACHE_BYTES - 1);
+
+		fsm_mmap_enter(fsm);
+
+		if (chan && size >= align + fsm->dma_threshold) {
+			if (align) {
+				/* Bring 'buf' to a cache line boundary */
+				size = align;
+			} else {
+				ret = fsm_read_dma(fsm, chan, buf, size,
+						   offset, &sleep_ns);
+				path = FSM_READ_DMA;
+			}
+		}
+
+		if (ret < 0 && fsm->mmap_read) {
+			memcpy_fromio(buf, fsm->mmap_base + offset, size);
+			ret = size;
+			path = FSM_READ_MMAP;
+		}
+
+		fsm_mmap_exit(fsm);
+	}
+
+	if (ret < 0) {
+		align = -(unsigned long)buf & 0x3;
+		size = min_t(uint32_t, size, align ? align : FLASH_PAGESIZE);
+		fsm_read(fsm, buf, size, offset);
+		ret = size;
+		path = FSM_READ_PIO;
+	}
+
+	wall_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	stats = &fsm->stats[path];
+	stats->ops++;
+	stats->bytes += ret;
+	stats->wall_ns += wall_ns;
+	stats->cpu_ns += wall_ns - sleep_ns;
+
+	return ret;
+}
+
 static int fsm_write(struct stm_spi_fsm *fsm, const uint8_t *const buf,
 		     const uint32_t size, const uint32_t offset)
 {
@@ -2027,6 +2251,98 @@ static int fsm_set_freq(struct stm_spi_fsm *fsm, uint32_t freq)
 	return 0;
 }
 
+/*
+ * Read statistics
+ */
+#ifdef CONFIG_DEBUG_FS
+static int fsm_read_stats_show(struct seq_file *m, void *v)
+{
+	static const char * const names[FSM_READ_PATHS] = {
+		[FSM_READ_PIO] = "pio",
+		[FSM_READ_MMAP] = "mmap",
+		[FSM_READ_DMA] = "dma",
+	};
+	struct stm_spi_fsm *fsm = m->private;
+	int i;
+
+	seq_printf(m, "%-5s %10s %14s %10s %5s\n",
+		   "path", "reads", "bytes", "KiB/s", "cpu%");
+
+	mutex_lock(&fsm->lock);
+	for (i = 0; i < FSM_READ_PATHS; i++) {
+		struct fsm_read_stats *stats = &fsm->stats[i];
+		u64 rate = 0, cpu = 0;
+
+		if (stats->wall_ns) {
+			rate = div64_u64(stats->bytes * (NSEC_PER_SEC >> 10),
+					 stats->wall_ns);
+			cpu = div64_u64(stats->cpu_ns * 100, stats->wall_ns);
+		}
+
+		seq_printf(m, "%-5s %10lu %14llu %10llu %5llu\n", names[i],
+			   stats->ops, (unsigned long long)stats->bytes,
+			   (unsigned long long)rate, (unsigned long long)cpu);
+	}
+	mutex_unlock(&fsm->lock);
+
+	return 0;
+}
+
+static int fsm_read_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fsm_read_stats_show, inode->i_private);
+}
+
+/* Any write clears the statistics */
+static ssize_t fsm_read_stats_write(struct file *file,
+				    const char __user *buf, size_t count,
+				    loff_t *ppos)
+{
+	struct stm_spi_fsm *fsm = ((struct seq_file *)file->private_data)->private;
+
+	mutex_lock(&fsm->lock);
+	memset(fsm->stats, 0, sizeof(fsm->stats));
+	mutex_unlock(&fsm->lock);
+
+	return count;
+}
+
+static const struct file_operations fsm_read_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= fsm_read_stats_open,
+	.read		= seq_read,
+	.write		= fsm_read_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void fsm_debugfs_init(struct stm_spi_fsm *fsm)
+{
+	fsm->debugfs = debugfs_create_dir(dev_name(fsm->dev), NULL);
+	if (IS_ERR_OR_NULL(fsm->debugfs)) {
+		fsm->debugfs = NULL;
+		return;
+	}
+
+	debugfs_create_file("read_stats", S_IRUGO | S_IWUSR, fsm->debugfs,
+			    fsm, &fsm_read_stats_fops);
+}
+
+static void fsm_debugfs_exit(struct stm_spi_fsm *fsm)
+{
+	debugfs_remove_recursive(fsm->debugfs);
+	fsm->debugfs = NULL;
+}
+#else
+static void fsm_debugfs_init(struct stm_spi_fsm *fsm)
+{
+}
+
+static void fsm_debugfs_exit(struct stm_spi_fsm *fsm)
+{
+}
+#endif
+
 static int fsm_init(struct stm_spi_fsm *fsm)
 {
 	/* Perform a soft reset of the FSM controller */
@@ -2066,7 +2382,13 @@ static int fsm_init(struct stm_spi_fsm *fsm)
 
 static void fsm_exit(struct stm_spi_fsm *fsm)
 {
+	mtd_rcache_detach(&fsm->mtd);
+	fsm_debugfs_exit(fsm);
 
+	if (fsm->dma)
+		dmaengine_put();
+	if (fsm->mmap_base)
+		iounmap(fsm->mmap_base);
 }
 
 
@@ -2100,9 +2422,7 @@ static int fsm_mtd_read(struct mtd_info *mtd, loff_t from, size_t len,
 	mutex_lock(&fsm->lock);
 
 	while (len > 0) {
-		bytes = min(len, (size_t)FLASH_PAGESIZE);
-
-		fsm_read(fsm, buf, bytes, from);
+		bytes = fsm_read_chunk(fsm, buf, len, from);
 
 		buf += bytes;
 		from += bytes;
@@ -2283,6 +2603,9 @@ static void *stm_fsm_dt_get_pdata(struct platform_device *pdev)
 	of_property_read_string(np, "flash-name",
 				(const char **)&data->name);
 	of_property_read_u32(np, "max-freq", &data->max_freq);
+	data->mmap_read = of_property_read_bool(np, "mmap-read");
+	data->dma_read = of_property_read_bool(np, "dma-read");
+	of_property_read_u32(np, "dma-threshold", &data->dma_threshold);
 
 	data->pads = stm_of_get_pad_config(&pdev->dev);
 
@@ -2506,6 +2829,45 @@ static int __devinit stm_spi_fsm_probe(struct platform_device *pdev)
 		fsm->mtd.size = 16 * 1024 * 1024;
 	}
 
+	/* Optional memory-mapped window, for CPU or DMA reads.  The window
+	 * uses 24-bit addressing, so the device must not be left in 32-bit
+	 * address mode.
+	 */
+	resource = platform_get_resource_byname(pdev, IORESOURCE_MEM,
+						"spi-fsm-mmap");
+	if (resource && (data->mmap_read || data->dma_read) &&
+	    (!(info->capabilities & FLASH_CAPS_32BITADDR) ||
+	     (fsm->configuration & CFG_READ_TOGGLE32BITADDR))) {
+		fsm->mmap_phys = resource->start;
+		fsm->mmap_size = min_t(resource_size_t, resource_size(resource),
+				       FLASH_MMAP_MAX_SIZE);
+		fsm->mmap_base = ioremap_nocache(fsm->mmap_phys,
+						 fsm->mmap_size);
+		if (!fsm->mmap_base)
+			dev_warn(&pdev->dev, "failed to ioremap memory-mapped window\n");
+	}
+
+	if (fsm->mmap_base) {
+		fsm->mmap_read = data->mmap_read;
+		if (data->dma_read) {
+			dmaengine_get();
+			fsm->dma = 1;
+			fsm->dma_threshold = max_t(uint32_t, L1_CACHE_BYTES,
+						   data->dma_threshold ? :
+						   FSM_DMA_THRESHOLD);
+		}
+		dev_info(&pdev->dev, "memory-mapped reads:%s%s\n",
+			 fsm->mmap_read ? " cpu" : "", fsm->dma ? " dma" : "");
+	}
+
+	fsm_debugfs_init(fsm);
+
+	/* Small reads pay for a full FSM sequence each: cache them */
+	ret = mtd_rcache_attach(&fsm->mtd, 0, 0);
+	if (ret)
+		dev_warn(&pdev->dev, "failed to attach read cache (%d)\n",
+			 ret);
+
 	if (pdev->dev.of_node)
 		ppdata.of_node = of_parse_phandle(pdev->dev.of_node,
 							"partitions", 0);
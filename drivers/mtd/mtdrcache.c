@@ -0,0 +1,532 @@
+/*
+ * MTD read cache and read-ahead layer
+ *
+ * Copyright (C) 2013 STMicroelectronics Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Serial Flash controllers pay for a full command sequence on every read, so
+ * filesystems issuing many small reads at neighbouring offsets (JFFS2, cramfs)
+ * spend most of their time setting up commands.  This layer sits between the
+ * MTD API and the driver of a master device:
+ *
+ *  - reads smaller than a cache block are served from a small LRU cache of
+ *    aligned blocks, each filled by a single driver read;
+ *  - a run of sequential reads grows these fills into a read-ahead of up to
+ *    'rcache_readahead' blocks;
+ *  - larger reads go straight to the driver, without evicting the cache;
+ *  - writes (OOB and panic writes included) and erases go straight to the
+ *    driver, then invalidate the blocks they overlap.
+ *
+ * The cache lock is held across the driver calls, so a block can never be
+ * filled with data about to be overwritten: drivers serialise their
+ * operations anyway.  Drivers completing erases asynchronously must not use
+ * this layer.
+ *
+ * A driver opts in by calling mtd_rcache_attach() before registering the
+ * device (partitions call the master methods, so they are cached too), and
+ * mtd_rcache_detach() once it has been unregistered.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/log2.h>
+#include <linux/err.h>
+#include <linux/uio.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <linux/mtd/mtd.h>
+#include <linux/mtd/rcache.h>
+
+/* Default geometry, when not given by the driver */
+static unsigned int rcache_block_size = 4096;
+module_param(rcache_block_size, uint, S_IRUGO);
+MODULE_PARM_DESC(rcache_block_size, "Default read cache block size");
+
+static unsigned int rcache_blocks = 16;
+module_param(rcache_blocks, uint, S_IRUGO);
+MODULE_PARM_DESC(rcache_blocks,
+		 "Default number of read cache blocks (0 disables the cache)");
+
+static unsigned int rcache_readahead = 8;
+module_param(rcache_readahead, uint, S_IRUGO);
+MODULE_PARM_DESC(rcache_readahead, "Maximum read-ahead, in cache blocks");
+
+struct mtd_rcache_block {
+	struct list_head	list;		/* LRU, most recent first */
+	loff_t			offs;		/* -1 when invalid */
+	u_char			*data;
+};
+
+struct mtd_rcache {
+	struct mtd_info		*mtd;
+	struct mutex		lock;
+
+	/* Driver methods */
+	int (*read)(struct mtd_info *mtd, loff_t from, size_t len,
+		    size_t *retlen, u_char *buf);
+	int (*write)(struct mtd_info *mtd, loff_t to, size_t len,
+		     size_t *retlen, const u_char *buf);
+	int (*writev)(struct mtd_info *mtd, const struct kvec *vecs,
+		      unsigned long count, loff_t to, size_t *retlen);
+	int (*panic_write)(struct mtd_info *mtd, loff_t to, size_t len,
+			   size_t *retlen, const u_char *buf);
+	int (*write_oob)(struct mtd_info *mtd, loff_t to,
+			 struct mtd_oob_ops *ops);
+	int (*erase)(struct mtd_info *mtd, struct erase_info *instr);
+
+	unsigned int		block_size;
+	unsigned int		block_shift;
+	unsigned int		nr_blocks;
+	struct mtd_rcache_block	*blocks;
+	struct list_head	lru;
+
+	/* Sequential reads detection */
+	loff_t			next;		/* end of the previous read */
+	unsigned int		ra_blocks;	/* current read-ahead */
+	unsigned int		ra_max;
+	u_char			*ra_buf;
+
+	/* Statistics */
+	unsigned long		hits;
+	unsigned long		misses;
+	unsigned long		fills;		/* driver reads */
+	unsigned long		ra_fills;	/* blocks read ahead */
+	unsigned long		bypassed;
+	unsigned long		invalidated;
+	struct dentry		*debugfs;
+};
+
+static struct mtd_rcache_block *mtd_rcache_lookup(struct mtd_rcache *rc,
+						  loff_t offs)
+{
+	struct mtd_rcache_block *blk;
+
+	list_for_each_entry(blk, &rc->lru, list) {
+		if (blk->offs == offs)
+			return blk;
+		if (blk->offs < 0)	/* invalid blocks are at the tail */
+			break;
+	}
+
+	return NULL;
+}
+
+static void mtd_rcache_invalidate(struct mtd_rcache *rc, loff_t offs,
+				  uint64_t len)
+{
+	struct mtd_rcache_block *blk, *tmp;
+
+	list_for_each_entry_safe(blk, tmp, &rc->lru, list) {
+		if (blk->offs < 0 || blk->offs >= offs + len ||
+		    blk->offs + rc->block_size <= offs)
+			continue;
+
+		blk->offs = -1;
+		list_move_tail(&blk->list, &rc->lru);
+		rc->invalidated++;
+	}
+}
+
+/*
+ * Read the block at 'offs' into the least recently used one, along with as
+ * many of the following blocks as the read-ahead allows.  Returns the block
+ * at 'offs', most recently used.
+ */
+static struct mtd_rcache_block *mtd_rcache_fill(struct mtd_rcache *rc,
+						loff_t offs)
+{
+	struct mtd_rcache_block *blk;
+	unsigned int n = rc->ra_blocks;
+	size_t len, retlen;
+	u_char *buf;
+	int i, ret;
+
+	/* Stop at the end of the device, or at the first block cached */
+	n = min_t(uint64_t, n, (rc->mtd->size - offs) >> rc->block_shift);
+	for (i = 1; i < n; i++) {
+		loff_t next = offs + ((loff_t)i << rc->block_shift);
+
+		if (mtd_rcache_lookup(rc, next))
+			break;
+	}
+	n = i;
+	len = n << rc->block_shift;
+
+	if (n > 1) {
+		buf = rc->ra_buf;
+	} else {
+		blk = list_entry(rc->lru.prev, struct mtd_rcache_block, list);
+		blk->offs = -1;
+		buf = blk->data;
+	}
+
+	ret = rc->read(rc->mtd, offs, len, &retlen, buf);
+	if (ret || retlen != len)
+		return ERR_PTR(ret ? ret : -EIO);
+
+	rc->fills++;
+	rc->ra_fills += n - 1;
+
+	/* The block at 'offs' ends up first */
+	for (i = n - 1; i >= 0; i--) {
+		blk = list_entry(rc->lru.prev, struct mtd_rcache_block, list);
+		if (n > 1)
+			memcpy(blk->data, buf + (i << rc->block_shift),
+			       rc->block_size);
+		blk->offs = offs + ((loff_t)i << rc->block_shift);
+		list_move(&blk->list, &rc->lru);
+	}
+
+	return blk;
+}
+
+static int mtd_rcache_read(struct mtd_info *mtd, loff_t from, size_t len,
+			   size_t *retlen, u_char *buf)
+{
+	struct mtd_rcache *rc = mtd->rcache;
+	struct mtd_rcache_block *blk;
+	int ret = 0;
+
+	mutex_lock(&rc->lock);
+
+	/* Double the read-ahead for every read following on from the last */
+	if (rc->next >= 0 && from >= rc->next &&
+	    from <= rc->next + rc->block_size)
+		rc->ra_blocks = min(rc->ra_blocks * 2, rc->ra_max);
+	else
+		rc->ra_blocks = 1;
+	rc->next = from + len;
+
+	if (len >= rc->block_size) {
+		rc->bypassed++;
+		ret = rc->read(mtd, from, len, retlen, buf);
+		goto out;
+	}
+
+	*retlen = 0;
+	while (len) {
+		loff_t offs = from & ~(loff_t)(rc->block_size - 1);
+		size_t skip = from - offs;
+		size_t bytes = min_t(size_t, len, rc->block_size - skip);
+
+		blk = mtd_rcache_lookup(rc, offs);
+		if (blk) {
+			rc->hits++;
+			list_move(&blk->list, &rc->lru);
+		} else {
+			rc->misses++;
+			blk = mtd_rcache_fill(rc, offs);
+		}
+
+		if (IS_ERR(blk)) {
+			/* Let the driver report on the request itself */
+			size_t done = 0;
+
+			ret = rc->read(mtd, from, len, &done, buf);
+			*retlen += done;
+			break;
+		}
+
+		memcpy(buf, blk->data + skip, bytes);
+
+		buf += bytes;
+		from += bytes;
+		len -= bytes;
+		*retlen += bytes;
+	}
+
+out:
+	mutex_unlock(&rc->lock);
+
+	return ret;
+}
+
+static int mtd_rcache_write(struct mtd_info *mtd, loff_t to, size_t len,
+			    size_t *retlen, const u_char *buf)
+{
+	struct mtd_rcache *rc = mtd->rcache;
+	int ret;
+
+	mutex_lock(&rc->lock);
+	ret = rc->write(mtd, to, len, retlen, buf);
+	mtd_rcache_invalidate(rc, to, len);
+	mutex_unlock(&rc->lock);
+
+	return ret;
+}
+
+static int mtd_rcache_writev(struct mtd_info *mtd, const struct kvec *vecs,
+			     unsigned long count, loff_t to, size_t *retlen)
+{
+	struct mtd_rcache *rc = mtd->rcache;
+	uint64_t len = 0;
+	unsigned long i;
+	int ret;
+
+	for (i = 0; i < count; i++)
+		len += vecs[i].iov_len;
+
+	mutex_lock(&rc->lock);
+	ret = rc->writev(mtd, vecs, count, to, retlen);
+	mtd_rcache_invalidate(rc, to, len);
+	mutex_unlock(&rc->lock);
+
+	return ret;
+}
+
+/*
+ * Called with the other CPUs stopped, and possibly from the middle of a cache
+ * operation: the blocks are only marked invalid, without taking the lock nor
+ * touching the LRU list.  An invalid block ahead of valid ones only costs
+ * lookups a miss.
+ */
+static int mtd_rcache_panic_write(struct mtd_info *mtd, loff_t to, size_t len,
+				  size_t *retlen, const u_char *buf)
+{
+	struct mtd_rcache *rc = mtd->rcache;
+	int ret, i;
+
+	ret = rc->panic_write(mtd, to, len, retlen, buf);
+
+	for (i = 0; i < rc->nr_blocks; i++)
+		if (rc->blocks[i].offs >= 0 &&
+		    rc->blocks[i].offs < to + len &&
+		    rc->blocks[i].offs + rc->block_size > to)
+			rc->blocks[i].offs = -1;
+
+	return ret;
+}
+
+/* OOB writes may write in-band data as well */
+static int mtd_rcache_write_oob(struct mtd_info *mtd, loff_t to,
+				struct mtd_oob_ops *ops)
+{
+	struct mtd_rcache *rc = mtd->rcache;
+	int ret;
+
+	mutex_lock(&rc->lock);
+	ret = rc->write_oob(mtd, to, ops);
+	if (ops->datbuf)
+		mtd_rcache_invalidate(rc, to, ops->len);
+	mutex_unlock(&rc->lock);
+
+	return ret;
+}
+
+static int mtd_rcache_erase(struct mtd_info *mtd, struct erase_info *instr)
+{
+	struct mtd_rcache *rc = mtd->rcache;
+	loff_t addr = instr->addr;
+	uint64_t len = instr->len;
+	int ret;
+
+	mutex_lock(&rc->lock);
+	ret = rc->erase(mtd, instr);
+	mtd_rcache_invalidate(rc, addr, len);
+	mutex_unlock(&rc->lock);
+
+	return ret;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int mtd_rcache_show(struct seq_file *m, void *v)
+{
+	struct mtd_rcache *rc = m->private;
+
+	mutex_lock(&rc->lock);
+	seq_printf(m, "block size:   %u\n", rc->block_size);
+	seq_printf(m, "blocks:       %u\n", rc->nr_blocks);
+	seq_printf(m, "read-ahead:   %u/%u\n", rc->ra_blocks, rc->ra_max);
+	seq_printf(m, "hits:         %lu\n", rc->hits);
+	seq_printf(m, "misses:       %lu\n", rc->misses);
+	seq_printf(m, "fills:        %lu\n", rc->fills);
+	seq_printf(m, "read ahead:   %lu\n", rc->ra_fills);
+	seq_printf(m, "bypassed:     %lu\n", rc->bypassed);
+	seq_printf(m, "invalidated:  %lu\n", rc->invalidated);
+	mutex_unlock(&rc->lock);
+
+	return 0;
+}
+
+static int mtd_rcache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mtd_rcache_show, inode->i_private);
+}
+
+static const struct file_operations mtd_rcache_fops = {
+	.open		= mtd_rcache_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct dentry *mtd_rcache_root;
+static DEFINE_MUTEX(mtd_rcache_root_lock);
+
+static void mtd_rcache_debugfs_init(struct mtd_rcache *rc)
+{
+	mutex_lock(&mtd_rcache_root_lock);
+	if (!mtd_rcache_root)
+		mtd_rcache_root = debugfs_create_dir("mtd_rcache", NULL);
+	mutex_unlock(&mtd_rcache_root_lock);
+
+	if (IS_ERR_OR_NULL(mtd_rcache_root))
+		return;
+
+	rc->debugfs = debugfs_create_file(rc->mtd->name, S_IRUGO,
+					  mtd_rcache_root, rc,
+					  &mtd_rcache_fops);
+}
+
+static void mtd_rcache_debugfs_exit(struct mtd_rcache *rc)
+{
+	debugfs_remove(rc->debugfs);
+}
+#else
+static void mtd_rcache_debugfs_init(struct mtd_rcache *rc)
+{
+}
+
+static void mtd_rcache_debugfs_exit(struct mtd_rcache *rc)
+{
+}
+#endif
+
+static void mtd_rcache_free(struct mtd_rcache *rc)
+{
+	int i;
+
+	if (rc->blocks)
+		for (i = 0; i < rc->nr_blocks; i++)
+			kfree(rc->blocks[i].data);
+	kfree(rc->blocks);
+	vfree(rc->ra_buf);
+	kfree(rc);
+}
+
+/**
+ * mtd_rcache_attach - put a read cache in front of an MTD device
+ * @mtd: the MTD device, not yet registered
+ * @block_size: cache block size, a power of 2 up to the erase size (0 for
+ *	the 'rcache_block_size' default)
+ * @nr_blocks: number of cache blocks (0 for the 'rcache_blocks' default)
+ *
+ * Returns 0 on success, including when the cache is disabled, or a negative
+ * error code, the device being left uncached.
+ */
+int mtd_rcache_attach(struct mtd_info *mtd, unsigned int block_size,
+		      unsigned int nr_blocks)
+{
+	struct mtd_rcache *rc;
+	int i;
+
+	if (!block_size)
+		block_size = rcache_block_size;
+	if (!nr_blocks)
+		nr_blocks = rcache_blocks;
+	if (!nr_blocks)
+		return 0;
+
+	if (mtd->rcache || !mtd->_read || !is_power_of_2(block_size) ||
+	    block_size > mtd->erasesize)
+		return -EINVAL;
+
+	rc = kzalloc(sizeof(*rc), GFP_KERNEL);
+	if (!rc)
+		return -ENOMEM;
+
+	rc->mtd = mtd;
+	mutex_init(&rc->lock);
+	INIT_LIST_HEAD(&rc->lru);
+	rc->block_size = block_size;
+	rc->block_shift = ilog2(block_size);
+	rc->nr_blocks = nr_blocks;
+	rc->ra_max = clamp(rcache_readahead, 1U, nr_blocks);
+	rc->ra_blocks = 1;
+	rc->next = -1;
+
+	rc->blocks = kcalloc(nr_blocks, sizeof(*rc->blocks), GFP_KERNEL);
+	if (!rc->blocks)
+		goto nomem;
+
+	/* Separate blocks, so that drivers may DMA straight into them */
+	for (i = 0; i < nr_blocks; i++) {
+		rc->blocks[i].offs = -1;
+		rc->blocks[i].data = kmalloc(block_size, GFP_KERNEL);
+		if (!rc->blocks[i].data)
+			goto nomem;
+		list_add_tail(&rc->blocks[i].list, &rc->lru);
+	}
+
+	if (rc->ra_max > 1) {
+		rc->ra_buf = vmalloc(rc->ra_max * block_size);
+		if (!rc->ra_buf)
+			goto nomem;
+	}
+
+	rc->read = mtd->_read;
+	rc->write = mtd->_write;
+	rc->writev = mtd->_writev;
+	rc->panic_write = mtd->_panic_write;
+	rc->write_oob = mtd->_write_oob;
+	rc->erase = mtd->_erase;
+
+	mtd->rcache = rc;
+	mtd->_read = mtd_rcache_read;
+	if (rc->write)
+		mtd->_write = mtd_rcache_write;
+	if (rc->writev)
+		mtd->_writev = mtd_rcache_writev;
+	if (rc->panic_write)
+		mtd->_panic_write = mtd_rcache_panic_write;
+	if (rc->write_oob)
+		mtd->_write_oob = mtd_rcache_write_oob;
+	if (rc->erase)
+		mtd->_erase = mtd_rcache_erase;
+
+	mtd_rcache_debugfs_init(rc);
+
+	pr_info("%s: read cache of %u x %u bytes, read-ahead of up to %u "
+		"blocks\n", mtd->name, nr_blocks, block_size, rc->ra_max);
+
+	return 0;
+
+nomem:
+	mtd_rcache_free(rc);
+	return -ENOMEM;
+}
+EXPORT_SYMBOL_GPL(mtd_rcache_attach);
+
+/**
+ * mtd_rcache_detach - remove the read cache of an MTD device
+ * @mtd: the MTD device, unregistered
+ */
+void mtd_rcache_detach(struct mtd_info *mtd)
+{
+	struct mtd_rcache *rc = mtd->rcache;
+
+	if (!rc)
+		return;
+
+	mtd->_read = rc->read;
+	mtd->_write = rc->write;
+	mtd->_writev = rc->writev;
+	mtd->_panic_write = rc->panic_write;
+	mtd->_write_oob = rc->write_oob;
+	mtd->_erase = rc->erase;
+	mtd->rcache = NULL;
+
+	mtd_rcache_debugfs_exit(rc);
+	mtd_rcache_free(rc);
+}
+EXPORT_SYMBOL_GPL(mtd_rcache_detach);
@@ -45,6 +45,8 @@
 #include <linux/mtd/nand_bch.h>
 #include <linux/interrupt.h>
 #include <linux/bitops.h>
+#include <linux/prefetch.h>
+#include <linux/cache.h>
 #include <linux/leds.h>
 #include <linux/io.h>
 #include <linux/mtd/partitions.h>
@@ -1251,6 +1253,114 @@ out:
 }
 EXPORT_SYMBOL(nand_lock);
 
+/* Distance ahead of the current word at which the erased check prefetches */
+#define NAND_ERASED_PREFETCH	(2 * L1_CACHE_BYTES)
+
+/**
+ * nand_check_erased_buf - [GENERIC] count the bits at '0' in an erased buffer
+ * @buf: buffer to test
+ * @len: buffer length
+ * @bitflips_threshold: maximum number of bits at '0' to tolerate
+ *
+ * Erased pages are expected to read back as all 0xff, but devices are allowed
+ * a number of bits at '0' (read-disturb, stuck-at-zero cells). Once aligned,
+ * the buffer is tested a machine word at a time: all-0xff words, by far the
+ * common case, are skipped with a single compare, and the cache lines ahead
+ * are prefetched. Returns the number of bits at '0', or -EBADMSG as soon as
+ * @bitflips_threshold is exceeded.
+ */
+int nand_check_erased_buf(const void *buf, int len, int bitflips_threshold)
+{
+	const unsigned char *bitmap = buf;
+	const unsigned long *word;
+	int bitflips = 0;
+
+	for (; len && ((unsigned long)bitmap) % sizeof(long); len--, bitmap++) {
+		bitflips += hweight8((unsigned char)~*bitmap);
+		if (unlikely(bitflips > bitflips_threshold))
+			return -EBADMSG;
+	}
+
+	for (word = (const unsigned long *)bitmap; len >= sizeof(long);
+	     len -= sizeof(long), word++) {
+		if (!((unsigned long)word & (L1_CACHE_BYTES - 1)) &&
+		    len > NAND_ERASED_PREFETCH)
+			prefetch((const void *)word + NAND_ERASED_PREFETCH);
+
+		if (likely(*word == ~0UL))
+			continue;
+
+		bitflips += hweight_long(~*word);
+		if (unlikely(bitflips > bitflips_threshold))
+			return -EBADMSG;
+	}
+
+	for (bitmap = (const unsigned char *)word; len; len--, bitmap++) {
+		bitflips += hweight8((unsigned char)~*bitmap);
+		if (unlikely(bitflips > bitflips_threshold))
+			return -EBADMSG;
+	}
+
+	return bitflips;
+}
+EXPORT_SYMBOL_GPL(nand_check_erased_buf);
+
+/**
+ * nand_check_erased_ecc_chunk - [GENERIC] check if an ECC chunk is erased
+ * @data: data buffer to test
+ * @datalen: data length
+ * @ecc: ECC buffer (may be NULL)
+ * @ecclen: ECC length
+ * @extraoob: extra OOB buffer (may be NULL)
+ * @extraooblen: extra OOB length
+ * @bitflips_threshold: maximum number of bits at '0' to tolerate
+ *
+ * To be called when the ECC engine reports an uncorrectable error: if the
+ * chunk, ECC bytes included, has no more than @bitflips_threshold bits at
+ * '0', it is taken to be an erased chunk suffering from bitflips. The buffers
+ * are then set back to 0xff and the number of bitflips is returned, to be
+ * accounted as corrected. Otherwise -EBADMSG is returned and the buffers are
+ * left untouched, as the MTD API requires for uncorrectable data.
+ */
+int nand_check_erased_ecc_chunk(void *data, int datalen,
+				void *ecc, int ecclen,
+				void *extraoob, int extraooblen,
+				int bitflips_threshold)
+{
+	int data_flips, ecc_flips = 0, extraoob_flips = 0;
+
+	data_flips = nand_check_erased_buf(data, datalen,
+					   bitflips_threshold);
+	if (data_flips < 0)
+		return data_flips;
+	bitflips_threshold -= data_flips;
+
+	if (ecc) {
+		ecc_flips = nand_check_erased_buf(ecc, ecclen,
+						  bitflips_threshold);
+		if (ecc_flips < 0)
+			return ecc_flips;
+		bitflips_threshold -= ecc_flips;
+	}
+
+	if (extraoob) {
+		extraoob_flips = nand_check_erased_buf(extraoob, extraooblen,
+						       bitflips_threshold);
+		if (extraoob_flips < 0)
+			return extraoob_flips;
+	}
+
+	if (data_flips)
+		memset(data, 0xff, datalen);
+	if (ecc_flips)
+		memset(ecc, 0xff, ecclen);
+	if (extraoob_flips)
+		memset(extraoob, 0xff, extraooblen);
+
+	return data_flips + ecc_flips + extraoob_flips;
+}
+EXPORT_SYMBOL_GPL(nand_check_erased_ecc_chunk);
+
 /**
  * nand_read_page_raw - [INTERN] read raw page data without ecc
  * @mtd: mtd info structure
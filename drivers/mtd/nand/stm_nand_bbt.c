@@ -158,10 +158,7 @@ static int stmnand_check_bbt_block(struct mtd_info *mtd, uint64_t offs,
 			return ret;
 
 		/* Check for empty page */
-		e = 0;
-		for (j = 0; j < (page_size + oob_size) && e <= 1; j++)
-			e += hweight8(~buf[j]);
-		if (e <= 1)
+		if (nand_check_erased_buf(buf, page_size + oob_size, 1) >= 0)
 			return 0;
 
 		if (bch_remap)
@@ -47,6 +47,12 @@
 #define NANDI_BCH_MAX_BUF_LIST			8
 #define NANDI_BCH_BUF_LIST_SIZE			(4 * NANDI_BCH_MAX_BUF_LIST)
 
+/* Read-ahead: sequence node chains fetched by the BCH controller */
+#define NANDI_BCH_CHAIN_NODES			NANDI_BCH_MAX_BUF_LIST
+#define NANDI_BCH_CHAIN_SIZE			(NANDI_BCH_CHAIN_NODES *	\
+						 sizeof(struct bch_prog) +	\
+						 NANDI_BCH_BUF_LIST_SIZE)
+
 /* BCH ECC sizes */
 static int bch_ecc_sizes[] = {
 	[BCH_18BIT_ECC] = 32,
@@ -119,6 +125,20 @@ struct nandi_info {
 	struct	mtd_partition	*parts;		/* MTD partitions */
 };
 
+/* Chain of BCH page-read sequence nodes, one buffer list entry per page */
+struct bch_chain {
+	struct bch_prog		*nodes;		/* Sequence nodes */
+	uint32_t		*buf_list;	/* Buffer list */
+	unsigned long		nodes_phys;
+	unsigned long		list_phys;
+	unsigned long		buf_phys;
+
+	loff_t			offs;		/* First page */
+	uint8_t			*buf;		/* Page data */
+	int			pages;		/* Number of pages */
+	uint32_t		ecc[NANDI_BCH_CHAIN_NODES]; /* ECC scores */
+};
+
 /* NANDi Controller (Hamming/BCH) */
 struct nandi_controller {
 	void __iomem		*base;		/* Controller base*/
@@ -155,6 +175,9 @@ struct nandi_controller {
 	int			cached_page;	/* page number of page in
 						 *  'page_buf' */
 
+	int			read_ahead;	/* Max pages per chain (0: off) */
+	struct bch_chain	chain[2];	/* Ping-pong read-ahead chains */
+
 	struct nandi_info	info;		/* NAND device info */
 };
 
@@ -388,20 +411,34 @@ static uint8_t bch_erase_block(struct nandi_controller *nandi,
  */
 static int check_erased_page(uint8_t *data, uint32_t page_size, int max_zeros)
 {
-	uint8_t *b = data;
-	int i;
-	int zeros = 0;
+	int zeros;
 
-	for (i = 0; i < page_size; i++) {
-		zeros += hweight8(~*b++);
-		if (zeros > max_zeros)
-			return -1;
-	}
+	zeros = nand_check_erased_ecc_chunk(data, page_size, NULL, 0, NULL, 0,
+					    max_zeros);
+
+	return zeros < 0 ? -1 : zeros;
+}
 
-	if (zeros)
-		memset(data, 0xff, page_size);
+/* Returns the number of ECC errors, or '-1' for uncorrectable error */
+static int bch_page_ecc_errs(struct nandi_controller *nandi,
+			     uint8_t *buf, uint32_t ecc_err)
+{
+	int ret;
+
+	if (ecc_err == 0xff) {
+		/* Downgrade uncorrectable ECC error for an erased page,
+		 * tolerating 'sectors_per_page' bits at zero.
+		 */
+		ret = check_erased_page(buf, nandi->info.mtd.writesize,
+					nandi->sectors_per_page);
+		if (ret >= 0)
+			dev_dbg(nandi->dev, "%s: erased page detected: downgrading uncorrectable ECC error.\n",
+				__func__);
+	} else {
+		ret = (int)ecc_err;
+	}
 
-	return zeros;
+	return ret;
 }
 
 /* Returns the number of ECC errors, or '-1' for uncorrectable error */
@@ -414,7 +451,6 @@ static int bch_read_page(struct nandi_controller *nandi,
 	unsigned long list_phys;
 	unsigned long buf_phys;
 	uint32_t ecc_err;
-	int ret = 0;
 
 	dev_dbg(nandi->dev, "%s: offs = 0x%012llx\n", __func__, offs);
 
@@ -455,20 +491,96 @@ static int bch_read_page(struct nandi_controller *nandi,
 
 	/* Use the maximum per-sector ECC count! */
 	ecc_err = readl(nandi->base + NANDBCH_ECC_SCORE_REG_A) & 0xff;
-	if (ecc_err == 0xff) {
-		/* Downgrade uncorrectable ECC error for an erased page,
-		 * tolerating 'sectors_per_page' bits at zero.
-		 */
-		ret = check_erased_page(buf, page_size,
-					nandi->sectors_per_page);
-		if (ret >= 0)
-			dev_dbg(nandi->dev, "%s: erased page detected: downgrading uncorrectable ECC error.\n",
-				__func__);
-	} else {
-		ret = (int)ecc_err;
+
+	return bch_page_ecc_errs(nandi, buf, ecc_err);
+}
+
+/*
+ * Start reading 'pages' consecutive pages into 'buf' with a single chain of
+ * sequence nodes, fetched from memory by the controller.  Each node reads one
+ * page through its own buffer list entry, and records its ECC score in its own
+ * slot of the ECC_SCORE registers.
+ */
+static void bch_chain_start(struct nandi_controller *nandi,
+			    struct bch_chain *chain,
+			    loff_t offs, uint8_t *buf, int pages)
+{
+	uint32_t page_size = nandi->info.mtd.writesize;
+	struct bch_prog *node;
+	int i;
+
+	dev_dbg(nandi->dev, "%s: %d pages @ 0x%012llx\n", __func__, pages,
+		offs);
+
+	BUG_ON(pages > NANDI_BCH_CHAIN_NODES);
+
+	chain->offs = offs;
+	chain->buf = buf;
+	chain->pages = pages;
+
+	chain->buf_phys = dma_map_single(NULL, buf, pages * page_size,
+					 DMA_FROM_DEVICE);
+
+	memset(chain->buf_list, 0x00, NANDI_BCH_BUF_LIST_SIZE);
+	for (i = 0; i < pages; i++) {
+		node = &chain->nodes[i];
+
+		*node = bch_prog_read_page;
+		node->seq[0] = BCH_ECC_SCORE(i);
+		node->addr = (uint32_t)((offs >> (nandi->page_shift - 8)) &
+					0xffffff00);
+		if (i != pages - 1)
+			node->gen_cfg &= ~GEN_CFG_LAST_SEQ_NODE;
+
+		chain->buf_list[i] = (chain->buf_phys + i * page_size) |
+			(nandi->sectors_per_page - 1);
+
+		offs += page_size;
 	}
 
-	return ret;
+	chain->list_phys = dma_map_single(NULL, chain->buf_list,
+					  NANDI_BCH_BUF_LIST_SIZE,
+					  DMA_TO_DEVICE);
+	chain->nodes_phys = dma_map_single(NULL, chain->nodes,
+					   pages * sizeof(*node),
+					   DMA_TO_DEVICE);
+
+	INIT_COMPLETION(nandi->seq_completed);
+
+	/* Reset ECC stats */
+	writel(CFG_RESET_ECC_ALL | CFG_ENABLE_AFM,
+	       nandi->base + NANDBCH_CONTROLLER_CFG);
+	writel(CFG_ENABLE_AFM, nandi->base + NANDBCH_CONTROLLER_CFG);
+
+	writel(chain->list_phys, nandi->base + NANDBCH_BUFFER_LIST_PTR);
+
+	/* The controller runs the nodes up to 'GEN_CFG_LAST_SEQ_NODE' */
+	writel(chain->nodes_phys, nandi->base + NANDBCH_SEQ_PTR_REG);
+}
+
+/* Wait for a chain to complete, and save the ECC score of each page */
+static void bch_chain_finish(struct nandi_controller *nandi,
+			     struct bch_chain *chain)
+{
+	uint32_t page_size = nandi->info.mtd.writesize;
+	uint32_t score[2];
+	int i;
+
+	bch_wait_seq(nandi);
+
+	score[0] = readl(nandi->base + NANDBCH_ECC_SCORE_REG_A);
+	score[1] = readl(nandi->base + NANDBCH_ECC_SCORE_REG_B);
+
+	for (i = 0; i < chain->pages; i++)
+		chain->ecc[i] = (score[i / 4] >> (8 * (i % 4))) & 0xff;
+
+	dma_unmap_single(NULL, chain->nodes_phys,
+			 chain->pages * sizeof(struct bch_prog),
+			 DMA_TO_DEVICE);
+	dma_unmap_single(NULL, chain->list_phys, NANDI_BCH_BUF_LIST_SIZE,
+			 DMA_TO_DEVICE);
+	dma_unmap_single(NULL, chain->buf_phys, chain->pages * page_size,
+			 DMA_FROM_DEVICE);
 }
 
 /* Returns the status of the NAND device following the write operation */
@@ -519,6 +631,96 @@ static uint8_t bch_write_page(struct nandi_controller *nandi,
 	return status;
 }
 
+/* Update ECC stats following a page read */
+static void bch_read_stats(struct nandi_controller *nandi, loff_t page_offs,
+			   int ecc_errs, int *max_ecc_errs)
+{
+	if (ecc_errs < 0) {
+		dev_err(nandi->dev, "%s: uncorrectable error at 0x%012llx\n",
+			__func__, page_offs);
+		nandi->info.mtd.ecc_stats.failed++;
+	} else if (ecc_errs) {
+		dev_info(nandi->dev, "%s: corrected %u error(s) at 0x%012llx\n",
+			 __func__, ecc_errs, page_offs);
+		nandi->info.mtd.ecc_stats.corrected += ecc_errs;
+
+		if (ecc_errs > *max_ecc_errs)
+			*max_ecc_errs = ecc_errs;
+	}
+}
+
+/* Number of whole pages at 'buf' that can be read ahead, straight into 'buf' */
+static int bch_read_ahead_pages(struct nandi_controller *nandi,
+				uint8_t *buf, size_t len)
+{
+	uint32_t page_size = nandi->info.mtd.writesize;
+	int pages = 0;
+
+	if (nandi->read_ahead < 2)
+		return 0;
+
+	while (len >= page_size && virt_addr_valid(buf)) {
+		buf += page_size;
+		len -= page_size;
+		pages++;
+	}
+
+	return pages;
+}
+
+/*
+ * Read 'pages' whole pages using two chains in turn: while the controller
+ * transfers one chain, the CPU checks the ECC results of the previous one
+ * (including the scan of pages reported as uncorrectable, to detect erased
+ * pages).
+ */
+static void bch_read_pages(struct nandi_controller *nandi,
+			   loff_t offs, uint8_t *buf, int pages,
+			   int *max_ecc_errs)
+{
+	uint32_t page_size = nandi->info.mtd.writesize;
+	struct bch_chain *chain, *next;
+	int ecc_errs;
+	int n, i;
+
+	nandi_select(STM_NANDI_BCH);
+
+	nandi_enable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
+
+	chain = &nandi->chain[0];
+	n = min(pages, nandi->read_ahead);
+	bch_chain_start(nandi, chain, offs, buf, n);
+	pages -= n;
+
+	while (chain) {
+		bch_chain_finish(nandi, chain);
+
+		next = NULL;
+		if (pages) {
+			next = (chain == &nandi->chain[0]) ?
+				&nandi->chain[1] : &nandi->chain[0];
+			n = min(pages, nandi->read_ahead);
+			bch_chain_start(nandi, next,
+					chain->offs + chain->pages * page_size,
+					chain->buf + chain->pages * page_size,
+					n);
+			pages -= n;
+		}
+
+		for (i = 0; i < chain->pages; i++) {
+			ecc_errs = bch_page_ecc_errs(nandi,
+						     chain->buf + i * page_size,
+						     chain->ecc[i]);
+			bch_read_stats(nandi, chain->offs + i * page_size,
+				       ecc_errs, max_ecc_errs);
+		}
+
+		chain = next;
+	}
+
+	nandi_disable_interrupts(nandi, NANDBCH_INT_SEQNODESOVER);
+}
+
 /* Helper function for bch_mtd_read, to handle multi-page or non-aligned reads */
 static int bch_read(struct nandi_controller *nandi,
 		    loff_t from, size_t len,
@@ -532,6 +734,7 @@ static int bch_read(struct nandi_controller *nandi,
 	uint32_t col_offs;
 	int ecc_errs, max_ecc_errs = 0;
 	size_t bytes;
+	int pages;
 	uint8_t *p;
 
 	int bounce;
@@ -550,6 +753,7 @@ static int bch_read(struct nandi_controller *nandi,
 
 	while (len > 0) {
 		bytes = min((page_size - col_offs), len);
+		pages = 1;
 
 		if ((bytes != page_size) ||
 		    ((unsigned int)buf & (NANDI_BCH_DMA_ALIGNMENT - 1)) ||
@@ -560,35 +764,26 @@ static int bch_read(struct nandi_controller *nandi,
 
 		if (page_num == nandi->cached_page) {
 			memcpy(buf, nandi->page_buf + col_offs, bytes);
+		} else if (!bounce &&
+			   (pages = bch_read_ahead_pages(nandi, buf, len)) > 1) {
+			bch_read_pages(nandi, page_offs, buf, pages,
+				       &max_ecc_errs);
+			bytes = pages * page_size;
 		} else {
+			pages = 1;
 			p = bounce ? nandi->page_buf : buf;
 
 			ecc_errs = bch_read_page(nandi, page_offs, p);
 			if (bounce)
 				memcpy(buf, p + col_offs, bytes);
 
-			if (ecc_errs < 0) {
-				dev_err(nandi->dev, "%s: uncorrectable error at 0x%012llx\n",
-					__func__, page_offs);
-				nandi->info.mtd.ecc_stats.failed++;
+			bch_read_stats(nandi, page_offs, ecc_errs,
+				       &max_ecc_errs);
 
-				/* Do not cache uncorrectable pages */
-				if (bounce)
-					nandi->cached_page = -1;
-			} else {
-				if (ecc_errs) {
-					dev_info(nandi->dev, "%s: corrected %u error(s) at 0x%012llx\n",
-						 __func__, ecc_errs, page_offs);
-					nandi->info.mtd.ecc_stats.corrected +=
-						ecc_errs;
-
-					if (ecc_errs > max_ecc_errs)
-						max_ecc_errs = ecc_errs;
-				}
-
-				if (bounce)
-					nandi->cached_page = page_num;
-			}
+			/* Do not cache uncorrectable pages */
+			if (bounce)
+				nandi->cached_page = (ecc_errs < 0) ? -1 :
+					page_num;
 		}
 
 		buf += bytes;
@@ -598,8 +793,8 @@ static int bch_read(struct nandi_controller *nandi,
 			*retlen += bytes;
 
 		/* We are now page-aligned */
-		page_offs += page_size;
-		page_num++;
+		page_offs += pages * page_size;
+		page_num += pages;
 		col_offs = 0;
 	}
 
@@ -2850,6 +3045,7 @@ static void *stm_bch_dt_get_pdata(struct platform_device *pdev)
 
 	of_property_read_u32(np, "st,bch-bitflip-threshold",
 			     &data->bch_bitflip_threshold);
+	of_property_read_u32(np, "st,bch-read-ahead", &data->bch_read_ahead);
 
 	return data;
 }
@@ -3012,6 +3208,14 @@ static int __devinit stm_nand_bch_probe(struct platform_device *pdev)
 	/*	- BCH BUF list */
 	buf_size += NANDI_BCH_BUF_LIST_SIZE + NANDI_BCH_DMA_ALIGNMENT;
 
+	/*	- Read-ahead chains */
+	nandi->read_ahead = min_t(int, pdata->bch_read_ahead,
+				  NANDI_BCH_CHAIN_NODES);
+	if (nandi->read_ahead > 1)
+		buf_size += 2 * NANDI_BCH_CHAIN_SIZE + NANDI_BCH_DMA_ALIGNMENT;
+	else
+		nandi->read_ahead = 0;
+
 	/* Allocate bufffer */
 	nandi->buf = devm_kzalloc(&pdev->dev, buf_size, GFP_KERNEL);
 	if (!nandi->buf) {
@@ -3026,6 +3230,20 @@ static int __devinit stm_nand_bch_probe(struct platform_device *pdev)
 				  NANDI_BCH_DMA_ALIGNMENT);
 	nandi->buf_list = (uint32_t *) PTR_ALIGN(bbt_info->bbt + bbt_buf_size,
 						 NANDI_BCH_DMA_ALIGNMENT);
+	if (nandi->read_ahead) {
+		struct bch_chain *chain = nandi->chain;
+
+		chain[0].nodes = PTR_ALIGN((struct bch_prog *)(nandi->buf_list +
+					   NANDI_BCH_MAX_BUF_LIST),
+					   NANDI_BCH_DMA_ALIGNMENT);
+		chain[1].nodes = chain[0].nodes + NANDI_BCH_CHAIN_NODES;
+		chain[0].buf_list = (uint32_t *)(chain[1].nodes +
+						 NANDI_BCH_CHAIN_NODES);
+		chain[1].buf_list = chain[0].buf_list + NANDI_BCH_MAX_BUF_LIST;
+
+		dev_info(nandi->dev, "Read-ahead of up to %d pages\n",
+			 nandi->read_ahead);
+	}
 	nandi->cached_page = -1;
 	if (nandi_examine_bbts(nandi, mtd) != 0) {
 		dev_err(nandi->dev, "incompatible BBTs detected\n");
@@ -22,6 +22,7 @@
 #include <linux/types.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
+#include <linux/mtd/nand.h>
 #include "stm_nand_ecc.h"
 
 static const uint8_t byte_parity_table[] =   /* Parity look up table */
@@ -571,7 +572,7 @@ int stmnand_test_empty_page(uint8_t *ecc_stored, uint8_t *ecc_calc,
 			    int pagesize, int oobsize, int max_bit_errors)
 {
 	int i, j;
-	int e = 0;
+	int e;
 	uint8_t *e1, *e2;
 
 	/* Is ECC data consistent with empty page */
@@ -586,18 +587,14 @@ int stmnand_test_empty_page(uint8_t *ecc_stored, uint8_t *ecc_calc,
 	}
 
 	/* Check page area is emtpy */
-	while (pagesize--) {
-		e += hweight8(~*buf++);
-		if (e > max_bit_errors)
-			return 0;
-	}
+	e = nand_check_erased_buf(buf, pagesize, max_bit_errors);
+	if (e < 0)
+		return 0;
 
 	/* Check OOB area is emtpy */
-	while (oobsize--) {
-		e += hweight8(~*oob++);
-		if (e > max_bit_errors)
-			return 0;
-	}
+	if (oobsize &&
+	    nand_check_erased_buf(oob, oobsize, max_bit_errors - e) < 0)
+		return 0;
 
 	return 1;
 }
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2013 STMicroelectronics Limited
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * Check and benchmark the NAND erased page detection.
+ *
+ * The word-wide nand_check_erased_buf() is first checked against a plain
+ * bytewise reference on buffers of random length and alignment, with random
+ * bits at '0', and both are timed on an erased page. If an MTD device is
+ * given (typically nandsim, loaded with bitflips=1), an eraseblock is then
+ * erased and read back, both through ECC and raw, and every page must be
+ * reported as erased.
+ *
+ * WARNING: the eraseblock 'eb' of the MTD device 'dev' is erased.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/err.h>
+#include <linux/mtd/mtd.h>
+#include <linux/mtd/nand.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/random.h>
+#include <linux/bitops.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+
+#define PRINT_PREF KERN_INFO "mtd_erasedtest: "
+
+/* Synthetic buffers: up to a 4KiB page + OOB, at any alignment */
+#define ERASED_TEST_BUF_SIZE	(4096 + 256)
+#define ERASED_TEST_ALIGN	8
+
+static int dev = -EINVAL;
+module_param(dev, int, S_IRUGO);
+MODULE_PARM_DESC(dev, "MTD device number to use (none by default)");
+
+static int eb;
+module_param(eb, int, S_IRUGO);
+MODULE_PARM_DESC(eb, "Eraseblock to erase and read back (0 by default)");
+
+static unsigned int iterations = 10000;
+module_param(iterations, uint, S_IRUGO);
+MODULE_PARM_DESC(iterations, "Number of checks to be timed or tested");
+
+static unsigned int max_flips = 8;
+module_param(max_flips, uint, S_IRUGO);
+MODULE_PARM_DESC(max_flips, "Maximum number of bits at '0' injected");
+
+static struct mtd_info *mtd;
+static unsigned char *buf;
+static unsigned char *ref;
+
+/* The bytewise check the STM NAND drivers used to open-code */
+static int check_erased_bytewise(const unsigned char *p, int len,
+				 int threshold)
+{
+	int bitflips = 0;
+
+	while (len--) {
+		bitflips += hweight8((unsigned char)~*p++);
+		if (bitflips > threshold)
+			return -EBADMSG;
+	}
+
+	return bitflips;
+}
+
+static int test_check_erased(void)
+{
+	unsigned int i, j;
+	int errors = 0;
+
+	printk(PRINT_PREF "testing nand_check_erased_buf()\n");
+
+	for (i = 0; i < iterations; i++) {
+		int offs = random32() % ERASED_TEST_ALIGN;
+		int len = 1 + random32() % (ERASED_TEST_BUF_SIZE - offs);
+		int threshold = random32() % (max_flips + 1);
+		int flips = random32() % (2 * max_flips + 1);
+		unsigned char *p = buf + offs;
+		int expected, ret;
+
+		memset(buf, 0xff, ERASED_TEST_BUF_SIZE);
+		for (j = 0; j < flips; j++) {
+			int bit = random32() % (len * BITS_PER_BYTE);
+
+			p[bit / BITS_PER_BYTE] &= ~(1 << (bit % BITS_PER_BYTE));
+		}
+		memcpy(ref, buf, ERASED_TEST_BUF_SIZE);
+
+		expected = check_erased_bytewise(p, len, threshold);
+
+		ret = nand_check_erased_buf(p, len, threshold);
+		if (ret != expected) {
+			printk(PRINT_PREF "error: offs %d, len %d, threshold "
+			       "%d: got %d, expected %d\n", offs, len,
+			       threshold, ret, expected);
+			errors++;
+		}
+
+		/* Within threshold the chunk is restored, else untouched */
+		ret = nand_check_erased_ecc_chunk(p, len, NULL, 0, NULL, 0,
+						  threshold);
+		if (ret != expected ||
+		    (ret >= 0 && check_erased_bytewise(p, len, 0) != 0) ||
+		    (ret < 0 && memcmp(buf, ref, ERASED_TEST_BUF_SIZE))) {
+			printk(PRINT_PREF "error: offs %d, len %d, threshold "
+			       "%d: bad erased chunk fixup (%d)\n", offs,
+			       len, threshold, ret);
+			errors++;
+		}
+
+		if ((i & 0xff) == 0)
+			cond_resched();
+	}
+
+	printk(PRINT_PREF "%u checks, %d errors\n", i, errors);
+
+	return errors ? -EINVAL : 0;
+}
+
+static void bench_check_erased(int len)
+{
+	u64 word_ns, byte_ns;
+	ktime_t start;
+	unsigned int i;
+	int sink = 0;
+
+	memset(buf, 0xff, len);
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		sink |= check_erased_bytewise(buf, len, 0);
+	byte_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		sink |= nand_check_erased_buf(buf, len, 0);
+	word_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (sink)
+		printk(PRINT_PREF "error: erased buffer not detected\n");
+
+	do_div(byte_ns, iterations);
+	do_div(word_ns, iterations);
+	printk(PRINT_PREF "%d byte erased page: bytewise %llu ns, "
+	       "word-wide %llu ns\n", len, byte_ns, word_ns);
+}
+
+static int erase_eraseblock(int ebnum)
+{
+	int err;
+	struct erase_info ei;
+	loff_t addr = (loff_t)ebnum * mtd->erasesize;
+
+	memset(&ei, 0, sizeof(struct erase_info));
+	ei.mtd  = mtd;
+	ei.addr = addr;
+	ei.len  = mtd->erasesize;
+
+	err = mtd_erase(mtd, &ei);
+	if (err) {
+		printk(PRINT_PREF "error %d while erasing EB %d\n", err, ebnum);
+		return err;
+	}
+
+	if (ei.state == MTD_ERASE_FAILED) {
+		printk(PRINT_PREF "some erase error occurred at EB %d\n",
+		       ebnum);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int test_erased_eraseblock(void)
+{
+	struct mtd_ecc_stats stats = mtd->ecc_stats;
+	loff_t addr = (loff_t)eb * mtd->erasesize;
+	int pgcnt = mtd->erasesize / mtd->writesize;
+	int i, ret, err = 0;
+	int raw_flips = 0;
+	size_t read;
+
+	if (mtd_block_isbad(mtd, addr)) {
+		printk(PRINT_PREF "block %d is bad\n", eb);
+		return -EINVAL;
+	}
+
+	err = erase_eraseblock(eb);
+	if (err)
+		return err;
+
+	printk(PRINT_PREF "reading back erased eraseblock %d\n", eb);
+
+	for (i = 0; i < pgcnt; i++, addr += mtd->writesize) {
+		struct mtd_oob_ops ops;
+
+		ret = mtd_read(mtd, addr, mtd->writesize, &read, buf);
+		if (mtd_is_bitflip(ret))
+			ret = 0;
+		if (ret || read != mtd->writesize) {
+			printk(PRINT_PREF "error: read failed at %#llx\n",
+			       (long long)addr);
+			err = ret ? ret : -EINVAL;
+			continue;
+		}
+
+		/* Through ECC, any bit at '0' must have been corrected */
+		if (nand_check_erased_buf(buf, mtd->writesize, 0) != 0) {
+			printk(PRINT_PREF "error: page at %#llx not erased\n",
+			       (long long)addr);
+			err = -EINVAL;
+		}
+
+		ops.mode      = MTD_OPS_RAW;
+		ops.len       = mtd->writesize;
+		ops.retlen    = 0;
+		ops.ooblen    = mtd->oobsize;
+		ops.oobretlen = 0;
+		ops.ooboffs   = 0;
+		ops.datbuf    = buf;
+		ops.oobbuf    = buf + mtd->writesize;
+		ret = mtd_read_oob(mtd, addr, &ops);
+		if (ret || ops.retlen != mtd->writesize ||
+		    ops.oobretlen != mtd->oobsize) {
+			printk(PRINT_PREF "error: raw read failed at %#llx\n",
+			       (long long)addr);
+			err = ret ? ret : -EINVAL;
+			continue;
+		}
+
+		/* Raw, the checker must agree with the bytewise count */
+		ret = nand_check_erased_buf(buf, mtd->writesize + mtd->oobsize,
+					    INT_MAX);
+		if (ret != check_erased_bytewise(buf,
+				mtd->writesize + mtd->oobsize, INT_MAX)) {
+			printk(PRINT_PREF "error: raw page at %#llx: bad "
+			       "count of bits at '0' (%d)\n",
+			       (long long)addr, ret);
+			err = -EINVAL;
+		} else {
+			raw_flips += ret;
+		}
+
+		cond_resched();
+	}
+
+	if (mtd->ecc_stats.failed != stats.failed) {
+		printk(PRINT_PREF "error: %u ECC failures on erased pages\n",
+		       mtd->ecc_stats.failed - stats.failed);
+		err = -EBADMSG;
+	}
+
+	printk(PRINT_PREF "%d pages: %d raw bits at '0', %u corrected\n",
+	       pgcnt, raw_flips, mtd->ecc_stats.corrected - stats.corrected);
+
+	return err;
+}
+
+static int __init mtd_erasedtest_init(void)
+{
+	int err;
+
+	printk(KERN_INFO "\n");
+	printk(KERN_INFO "=================================================\n");
+
+	if (!iterations) {
+		printk(PRINT_PREF "iterations must be non zero\n");
+		return -EINVAL;
+	}
+
+	srandom32(jiffies);
+
+	err = -ENOMEM;
+	buf = kmalloc(ERASED_TEST_BUF_SIZE, GFP_KERNEL);
+	ref = kmalloc(ERASED_TEST_BUF_SIZE, GFP_KERNEL);
+	if (!buf || !ref) {
+		printk(PRINT_PREF "error: cannot allocate memory\n");
+		goto out;
+	}
+
+	err = test_check_erased();
+	if (err)
+		goto out;
+
+	bench_check_erased(512);
+	bench_check_erased(2048);
+	bench_check_erased(4096);
+
+	if (dev < 0)
+		goto out;
+
+	printk(PRINT_PREF "MTD device: %d\n", dev);
+
+	mtd = get_mtd_device(NULL, dev);
+	if (IS_ERR(mtd)) {
+		err = PTR_ERR(mtd);
+		printk(PRINT_PREF "error: Cannot get MTD device\n");
+		goto out;
+	}
+
+	if (mtd->type != MTD_NANDFLASH ||
+	    mtd->writesize + mtd->oobsize > ERASED_TEST_BUF_SIZE ||
+	    eb < 0 || (uint64_t)eb * mtd->erasesize >= mtd->size) {
+		printk(PRINT_PREF "error: unsuitable MTD device or "
+		       "eraseblock\n");
+		err = -EINVAL;
+	} else {
+		err = test_erased_eraseblock();
+	}
+
+	put_mtd_device(mtd);
+
+out:
+	if (err)
+		printk(PRINT_PREF "error %d occurred\n", err);
+	else
+		printk(PRINT_PREF "finished\n");
+	kfree(buf);
+	kfree(ref);
+	printk(KERN_INFO "=================================================\n");
+	return err;
+}
+module_init(mtd_erasedtest_init);
+
+static void __exit mtd_erasedtest_exit(void)
+{
+	return;
+}
+module_exit(mtd_erasedtest_exit);
+
+MODULE_DESCRIPTION("NAND erased page detection test module");
+MODULE_AUTHOR("STMicroelectronics Limited");
+MODULE_LICENSE("GPL");
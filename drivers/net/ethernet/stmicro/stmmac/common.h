@@ -93,10 +93,19 @@ struct stmmac_extra_stats {
 	unsigned long normal_irq_n;
 	unsigned long rx_normal_irq_n;
 	unsigned long napi_poll;
+	unsigned long napi_poll_tx;
+	unsigned long rx_adapt_changes;
+	unsigned long tx_adapt_changes;
 	unsigned long tx_normal_irq_n;
 	unsigned long tx_clean;
 	unsigned long tx_reset_ic_bit;
 	unsigned long irq_receive_pmt_irq_n;
+	/* TSO */
+	unsigned long tx_tso_frames;
+	unsigned long tx_tso_segs;
+	/* RX page pool */
+	unsigned long rx_page_recycled;
+	unsigned long rx_page_alloc;
 	/* MMC info */
 	unsigned long mmc_tx_irq_n;
 	unsigned long mmc_rx_irq_n;
@@ -205,6 +214,14 @@ struct stmmac_extra_stats {
 #define STMMAC_MAX_COAL_TX_TICK	100000
 #define STMMAC_TX_MAX_FRAMES	256
 #define STMMAC_TX_FRAMES	64
+/* Adaptive coalescing: sampling period (ms) and packet rate (pps) limits of
+ * the low latency and bulk profiles; frames with an average size of at
+ * least STMMAC_ADAPT_BULK_SIZE are treated as bulk above the low rate.
+ */
+#define STMMAC_ADAPT_PERIOD	50
+#define STMMAC_ADAPT_LOW_RATE	10000
+#define STMMAC_ADAPT_HIGH_RATE	40000
+#define STMMAC_ADAPT_BULK_SIZE	1024
 
 /* Rx IPC status */
 enum rx_frame_status {
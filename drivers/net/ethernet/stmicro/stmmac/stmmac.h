@@ -38,6 +38,26 @@ struct stmmac_tx_info {
 	bool map_as_page;
 };
 
+/* RX buffer of the page pool: a DMA mapped page used one half at a time */
+struct stmmac_rx_page {
+	struct page *page;
+	dma_addr_t dma;
+	unsigned int offset;
+	unsigned int sync_len[2];
+};
+
+/* NAPI contexts sharing the DMA irq (bits of stmmac_priv.napi_pending) */
+#define STMMAC_NAPI_RX	0
+#define STMMAC_NAPI_TX	1
+
+/* Traffic estimator of the adaptive interrupt coalescing */
+struct stmmac_coal_est {
+	unsigned long stamp;
+	unsigned long packets;
+	unsigned long bytes;
+	int level;
+};
+
 struct stmmac_priv {
 	/* Frequently used values are kept adjacent for cache effect */
 	struct dma_extended_desc *dma_etx ____cacheline_aligned_in_smp;
@@ -56,6 +76,8 @@ struct stmmac_priv {
 	spinlock_t tx_lock;
 	bool tx_path_in_lpi_mode;
 	struct timer_list txtimer;
+	u8 *tso_hdr;
+	dma_addr_t tso_hdr_dma;
 
 	struct dma_desc *dma_rx	____cacheline_aligned_in_smp;
 	struct dma_extended_desc *dma_erx;
@@ -68,8 +90,12 @@ struct stmmac_priv {
 	int hwts_rx_en;
 	dma_addr_t *rx_skbuff_dma;
 	dma_addr_t dma_rx_phy;
+	struct stmmac_rx_page *rx_page;
+	int rx_page_mode;
 
 	struct napi_struct napi ____cacheline_aligned_in_smp;
+	struct napi_struct napi_tx;
+	unsigned long napi_pending;
 
 	void __iomem *ioaddr;
 	struct net_device *dev;
@@ -111,6 +137,10 @@ struct stmmac_priv {
 	unsigned int default_addend;
 	u32 adv_ts;
 	int use_riwt;
+	int use_adaptive_rx;
+	int use_adaptive_tx;
+	struct stmmac_coal_est rx_est;
+	struct stmmac_coal_est tx_est;
 	spinlock_t ptp_lock;
 };
 
@@ -133,6 +163,8 @@ struct stmmac_priv *stmmac_dvr_probe(struct device *device,
 				     struct plat_stmmacenet_data *plat_dat,
 				     void __iomem *addr);
 void stmmac_disable_eee_mode(struct stmmac_priv *priv);
+void stmmac_coal_reset(struct stmmac_coal_est *est, unsigned long packets,
+		       unsigned long bytes);
 bool stmmac_eee_init(struct stmmac_priv *priv);
 
 #ifdef CONFIG_STMMAC_PLATFORM
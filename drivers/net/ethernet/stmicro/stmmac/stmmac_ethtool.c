@@ -95,10 +95,19 @@ static const struct stmmac_stats stmmac_gstrings_stats[] = {
 	STMMAC_STAT(normal_irq_n),
 	STMMAC_STAT(rx_normal_irq_n),
 	STMMAC_STAT(napi_poll),
+	STMMAC_STAT(napi_poll_tx),
+	STMMAC_STAT(rx_adapt_changes),
+	STMMAC_STAT(tx_adapt_changes),
 	STMMAC_STAT(tx_normal_irq_n),
 	STMMAC_STAT(tx_clean),
 	STMMAC_STAT(tx_reset_ic_bit),
 	STMMAC_STAT(irq_receive_pmt_irq_n),
+	/* TSO */
+	STMMAC_STAT(tx_tso_frames),
+	STMMAC_STAT(tx_tso_segs),
+	/* RX page pool */
+	STMMAC_STAT(rx_page_recycled),
+	STMMAC_STAT(rx_page_alloc),
 	/* MMC info */
 	STMMAC_STAT(mmc_tx_irq_n),
 	STMMAC_STAT(mmc_rx_irq_n),
@@ -689,6 +698,9 @@ static int stmmac_get_coalesce(struct net_device *dev,
 	if (priv->use_riwt)
 		ec->rx_coalesce_usecs = stmmac_riwt2usec(priv->rx_riwt, priv);
 
+	ec->use_adaptive_rx_coalesce = priv->use_adaptive_rx;
+	ec->use_adaptive_tx_coalesce = priv->use_adaptive_tx;
+
 	return 0;
 }
 
@@ -701,7 +713,6 @@ static int stmmac_set_coalesce(struct net_device *dev,
 	/* Check not supported parameters  */
 	if ((ec->rx_max_coalesced_frames) || (ec->rx_coalesce_usecs_irq) ||
 	    (ec->rx_max_coalesced_frames_irq) || (ec->tx_coalesce_usecs_irq) ||
-	    (ec->use_adaptive_rx_coalesce) || (ec->use_adaptive_tx_coalesce) ||
 	    (ec->pkt_rate_low) || (ec->rx_coalesce_usecs_low) ||
 	    (ec->rx_max_coalesced_frames_low) || (ec->tx_coalesce_usecs_high) ||
 	    (ec->tx_max_coalesced_frames_low) || (ec->pkt_rate_high) ||
@@ -736,6 +747,18 @@ static int stmmac_set_coalesce(struct net_device *dev,
 	priv->rx_riwt = rx_riwt;
 	priv->hw->dma->rx_watchdog(priv->ioaddr, priv->rx_riwt);
 
+	/* The adaptive mode starts from the values above and replaces them
+	 * at the end of its first sample.
+	 */
+	if (ec->use_adaptive_rx_coalesce && !priv->use_adaptive_rx)
+		stmmac_coal_reset(&priv->rx_est, dev->stats.rx_packets,
+				  dev->stats.rx_bytes);
+	if (ec->use_adaptive_tx_coalesce && !priv->use_adaptive_tx)
+		stmmac_coal_reset(&priv->tx_est, dev->stats.tx_packets,
+				  dev->stats.tx_bytes);
+	priv->use_adaptive_rx = !!ec->use_adaptive_rx_coalesce;
+	priv->use_adaptive_tx = !!ec->use_adaptive_tx_coalesce;
+
 	return 0;
 }
 
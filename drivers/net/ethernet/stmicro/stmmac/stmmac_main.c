@@ -32,6 +32,7 @@
 #include <linux/kernel.h>
 #include <linux/interrupt.h>
 #include <linux/ip.h>
+#include <linux/ipv6.h>
 #include <linux/tcp.h>
 #include <linux/skbuff.h>
 #include <linux/ethtool.h>
@@ -48,6 +49,7 @@
 #include <linux/seq_file.h>
 #endif /* CONFIG_STMMAC_DEBUG_FS */
 #include <linux/net_tstamp.h>
+#include <net/ip6_checksum.h>
 #include "stmmac_ptp.h"
 #include "stmmac.h"
 
@@ -123,6 +125,18 @@ MODULE_PARM_DESC(chain_mode, "To use chain instead of ring mode");
 static int wol_plus_en;
 module_param(wol_plus_en, int, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(wol_plus_en, "Driver can use the WoL+ feature");
+
+/* When enabled (and the MTU allows it), the RX ring is filled with DMA mapped
+ * half pages that are recycled once the stack has released them, instead of
+ * allocating and mapping a new skb for every received frame.
+ */
+static int rx_page_pool;
+module_param(rx_page_pool, int, S_IRUGO);
+MODULE_PARM_DESC(rx_page_pool, "Use recycled pages for the RX buffers");
+
+#define STMMAC_RX_PAGE_BUF	(PAGE_SIZE / 2)
+#define STMMAC_RX_COPYBREAK	256
+#define STMMAC_RX_HDR_SIZE	128
 static irqreturn_t stmmac_interrupt(int irq, void *dev_id);
 
 #ifdef CONFIG_STMMAC_DEBUG_FS
@@ -213,6 +227,14 @@ static void print_pkt(unsigned char *buf, int len)
 /* minimum number of free TX descriptors required to wake up TX process */
 #define STMMAC_TX_THRESH(x)	(x->dma_tx_size/4)
 
+/* TSO: size of the per-descriptor slot in the coherent header area and worst
+ * case number of descriptors used by a GSO frame of segs segments (a header
+ * and a payload descriptor per segment plus one more each time a payload
+ * crosses the end of the linear part or of a fragment).
+ */
+#define STMMAC_TSO_HDR_SIZE	256
+#define STMMAC_TSO_DESC(segs)	(2 * (segs) + MAX_SKB_FRAGS + 1)
+
 static inline u32 stmmac_tx_avail(struct stmmac_priv *priv)
 {
 	return priv->dirty_tx + priv->dma_tx_size - priv->cur_tx - 1;
@@ -971,11 +993,69 @@ static void stmmac_clear_descriptors(struct stmmac_priv *priv)
 						     (i == txsize - 1));
 }
 
+/**
+ * stmmac_rx_page_alloc - allocate and map a new RX page
+ * @priv: driver private structure
+ * @rxp: RX page slot to be filled
+ * @gfp: allocation flags
+ * Description: the whole page is mapped once and its two halves are used in
+ * turn as RX buffers; the mapping is only released when the page cannot be
+ * recycled.
+ */
+static int stmmac_rx_page_alloc(struct stmmac_priv *priv,
+				struct stmmac_rx_page *rxp, gfp_t gfp)
+{
+	struct page *page;
+	dma_addr_t dma;
+
+	page = alloc_page(gfp | __GFP_COLD);
+	if (unlikely(!page))
+		return -ENOMEM;
+
+	dma = dma_map_page(priv->device, page, 0, PAGE_SIZE, DMA_FROM_DEVICE);
+	if (unlikely(dma_mapping_error(priv->device, dma))) {
+		__free_page(page);
+		return -EINVAL;
+	}
+
+	rxp->page = page;
+	rxp->dma = dma;
+	rxp->offset = 0;
+	rxp->sync_len[0] = 0;
+	rxp->sync_len[1] = 0;
+
+	return 0;
+}
+
+static void stmmac_rx_page_free(struct stmmac_priv *priv,
+				struct stmmac_rx_page *rxp)
+{
+	if (rxp->page) {
+		dma_unmap_page(priv->device, rxp->dma, PAGE_SIZE,
+			       DMA_FROM_DEVICE);
+		put_page(rxp->page);
+	}
+	rxp->page = NULL;
+}
+
 static int stmmac_init_rx_buffers(struct stmmac_priv *priv, struct dma_desc *p,
 				  int i)
 {
 	struct sk_buff *skb;
 
+	if (priv->rx_page_mode) {
+		struct stmmac_rx_page *rxp = &priv->rx_page[i];
+
+		if (stmmac_rx_page_alloc(priv, rxp, GFP_KERNEL)) {
+			pr_err("%s: Rx init fails; no RX page\n", __func__);
+			return -ENOMEM;
+		}
+		priv->rx_skbuff[i] = NULL;
+		p->des2 = rxp->dma;
+
+		return 0;
+	}
+
 	skb = __netdev_alloc_skb(priv->dev, priv->dma_buf_sz + NET_IP_ALIGN,
 				 GFP_KERNEL);
 	if (!skb) {
@@ -1004,6 +1084,9 @@ static int stmmac_init_rx_buffers(struct stmmac_priv *priv, struct dma_desc *p,
 
 static void stmmac_free_rx_buffers(struct stmmac_priv *priv, int i)
 {
+	if (priv->rx_page_mode)
+		stmmac_rx_page_free(priv, &priv->rx_page[i]);
+
 	if (priv->rx_skbuff[i]) {
 		dma_unmap_single(priv->device, priv->rx_skbuff_dma[i],
 				 priv->dma_buf_sz, DMA_FROM_DEVICE);
@@ -1040,6 +1123,12 @@ static int init_dma_desc_rings(struct net_device *dev)
 	priv->dma_buf_sz = bfsize;
 	buf_sz = bfsize;
 
+	/* The page pool uses half a page per buffer, so it is only used when
+	 * the largest frame the GMAC can write fits in it.
+	 */
+	priv->rx_page_mode = rx_page_pool && (bfsize <= BUF_SIZE_2KiB) &&
+			     (STMMAC_RX_PAGE_BUF >= BUF_SIZE_2KiB);
+
 	if (netif_msg_probe(priv))
 		pr_debug("%s: txsize %d, rxsize %d, bfsize %d\n", __func__,
 			 txsize, rxsize, bfsize);
@@ -1094,6 +1183,13 @@ static int init_dma_desc_rings(struct net_device *dev)
 	if (!priv->rx_skbuff)
 		goto err_rx_skbuff;
 
+	if (priv->rx_page_mode) {
+		priv->rx_page = kcalloc(rxsize, sizeof(*priv->rx_page),
+					GFP_KERNEL);
+		if (!priv->rx_page)
+			goto err_rx_page;
+	}
+
 	priv->tx_skbuff_dma = kmalloc_array(txsize,
 					    sizeof(*priv->tx_skbuff_dma),
 					    GFP_KERNEL);
@@ -1105,6 +1201,22 @@ static int init_dma_desc_rings(struct net_device *dev)
 	if (!priv->tx_skbuff)
 		goto err_tx_skbuff;
 
+	/* The TSO headers of each segment are built in a coherent area with
+	 * a slot per TX descriptor; the number of segments of a GSO frame is
+	 * limited so that the worst case always fits in the wake threshold.
+	 */
+	if (dev->hw_features & NETIF_F_TSO) {
+		priv->tso_hdr = dma_alloc_coherent(priv->device, txsize *
+						   STMMAC_TSO_HDR_SIZE,
+						   &priv->tso_hdr_dma,
+						   GFP_KERNEL);
+		if (!priv->tso_hdr)
+			goto err_tso_hdr;
+
+		dev->gso_max_segs = max_t(int, 1, (STMMAC_TX_THRESH(priv) -
+						   MAX_SKB_FRAGS - 1) / 2);
+	}
+
 	if (netif_msg_probe(priv)) {
 		pr_debug("(%s) dma_rx_phy=0x%08x dma_tx_phy=0x%08x\n", __func__,
 			 (u32) priv->dma_rx_phy, (u32) priv->dma_tx_phy);
@@ -1123,7 +1235,7 @@ static int init_dma_desc_rings(struct net_device *dev)
 		if (ret)
 			goto err_init_rx_buffers;
 
-		if (netif_msg_probe(priv))
+		if (netif_msg_probe(priv) && !priv->rx_page_mode)
 			pr_debug("[%p]\t[%p]\t[%x]\n", priv->rx_skbuff[i],
 				 priv->rx_skbuff[i]->data,
 				 (unsigned int)priv->rx_skbuff_dma[i]);
@@ -1161,6 +1273,7 @@ static int init_dma_desc_rings(struct net_device *dev)
 
 	priv->dirty_tx = 0;
 	priv->cur_tx = 0;
+	netdev_reset_queue(dev);
 
 	stmmac_clear_descriptors(priv);
 
@@ -1171,10 +1284,19 @@ static int init_dma_desc_rings(struct net_device *dev)
 err_init_rx_buffers:
 	while (--i >= 0)
 		stmmac_free_rx_buffers(priv, i);
+	if (priv->tso_hdr) {
+		dma_free_coherent(priv->device, txsize * STMMAC_TSO_HDR_SIZE,
+				  priv->tso_hdr, priv->tso_hdr_dma);
+		priv->tso_hdr = NULL;
+	}
+err_tso_hdr:
 	kfree(priv->tx_skbuff);
 err_tx_skbuff:
 	kfree(priv->tx_skbuff_dma);
 err_tx_skbuff_dma:
+	kfree(priv->rx_page);
+	priv->rx_page = NULL;
+err_rx_page:
 	kfree(priv->rx_skbuff);
 err_rx_skbuff:
 	kfree(priv->rx_skbuff_dma);
@@ -1262,8 +1384,17 @@ static void free_dma_desc_resources(struct stmmac_priv *priv)
 	}
 	kfree(priv->rx_skbuff_dma);
 	kfree(priv->rx_skbuff);
+	kfree(priv->rx_page);
+	priv->rx_page = NULL;
 	kfree(priv->tx_skbuff_dma);
 	kfree(priv->tx_skbuff);
+
+	if (priv->tso_hdr) {
+		dma_free_coherent(priv->device, priv->dma_tx_size *
+				  STMMAC_TSO_HDR_SIZE, priv->tso_hdr,
+				  priv->tso_hdr_dma);
+		priv->tso_hdr = NULL;
+	}
 }
 
 /**
@@ -1298,6 +1429,7 @@ static void stmmac_dma_operation_mode(struct stmmac_priv *priv)
 static void stmmac_tx_clean(struct stmmac_priv *priv)
 {
 	unsigned int txsize = priv->dma_tx_size;
+	unsigned int pkts_compl = 0, bytes_compl = 0;
 
 	spin_lock(&priv->tx_lock);
 
@@ -1354,6 +1486,8 @@ static void stmmac_tx_clean(struct stmmac_priv *priv)
 		priv->hw->ring->clean_desc3(priv, p);
 
 		if (likely(skb != NULL)) {
+			pkts_compl++;
+			bytes_compl += skb->len;
 			dev_kfree_skb(skb);
 			priv->tx_skbuff[entry] = NULL;
 		}
@@ -1362,6 +1496,9 @@ static void stmmac_tx_clean(struct stmmac_priv *priv)
 
 		priv->dirty_tx++;
 	}
+
+	netdev_completed_queue(priv->dev, pkts_compl, bytes_compl);
+
 	if (unlikely(netif_queue_stopped(priv->dev) &&
 		     stmmac_tx_avail(priv) > STMMAC_TX_THRESH(priv))) {
 		netif_tx_lock(priv->dev);
@@ -1416,30 +1553,53 @@ static void stmmac_tx_err(struct stmmac_priv *priv)
 						     (i == txsize - 1));
 	priv->dirty_tx = 0;
 	priv->cur_tx = 0;
+	netdev_reset_queue(priv->dev);
 	priv->hw->dma->start_tx(priv->ioaddr);
 
 	priv->dev->stats.tx_errors++;
 	netif_wake_queue(priv->dev);
 }
 
+/**
+ * stmmac_napi_done: re-enable the DMA irq once no NAPI context needs it off
+ * @priv: driver private structure
+ * @ctx: STMMAC_NAPI_RX or STMMAC_NAPI_TX
+ * Description: RX and TX completion have their own NAPI context but share
+ * the DMA irq, that is masked when either of them is scheduled from the ISR
+ * and unmasked by the last one to complete.
+ */
+static void stmmac_napi_done(struct stmmac_priv *priv, int ctx)
+{
+	if (!test_and_clear_bit(ctx, &priv->napi_pending))
+		return;
+
+	smp_mb__after_clear_bit();
+	if (!priv->napi_pending)
+		stmmac_enable_dma_irq(priv);
+}
+
 /**
  * stmmac_dma_interrupt: DMA ISR
  * @priv: driver private structure
  * Description: this is the DMA ISR. It is called by the main ISR.
  * It calls the dwmac dma routine to understand which type of interrupt
  * happened. In case of there is a Normal interrupt and either TX or RX
- * interrupt happened so the NAPI is scheduled.
+ * interrupt happened so the RX and/or the TX NAPI is scheduled.
  */
 static void stmmac_dma_interrupt(struct stmmac_priv *priv)
 {
 	int status;
 
 	status = priv->hw->dma->dma_interrupt(priv->ioaddr, &priv->xstats);
-	if (likely((status & handle_rx)) || (status & handle_tx)) {
-		if (likely(napi_schedule_prep(&priv->napi))) {
-			stmmac_disable_dma_irq(priv);
-			__napi_schedule(&priv->napi);
-		}
+	if (likely(status & handle_rx) && napi_schedule_prep(&priv->napi)) {
+		set_bit(STMMAC_NAPI_RX, &priv->napi_pending);
+		stmmac_disable_dma_irq(priv);
+		__napi_schedule(&priv->napi);
+	}
+	if ((status & handle_tx) && napi_schedule_prep(&priv->napi_tx)) {
+		set_bit(STMMAC_NAPI_TX, &priv->napi_pending);
+		stmmac_disable_dma_irq(priv);
+		__napi_schedule(&priv->napi_tx);
 	}
 	if (unlikely(status & tx_hard_error_bump_tc)) {
 		/* Try to bump up the dma threshold on this failure */
@@ -1625,13 +1785,13 @@ static int stmmac_init_dma_engine(struct stmmac_priv *priv)
  * stmmac_tx_timer: mitigation sw timer for tx.
  * @data: data pointer
  * Description:
- * This is the timer handler to directly invoke the stmmac_tx_clean.
+ * This is the timer handler to schedule the TX NAPI that runs stmmac_tx_clean.
  */
 static void stmmac_tx_timer(unsigned long data)
 {
 	struct stmmac_priv *priv = (struct stmmac_priv *)data;
 
-	stmmac_tx_clean(priv);
+	napi_schedule(&priv->napi_tx);
 }
 
 /**
@@ -1776,6 +1936,10 @@ static int stmmac_open(struct net_device *dev)
 	priv->eee_enabled = stmmac_eee_init(priv);
 
 	stmmac_init_tx_coalesce(priv);
+	stmmac_coal_reset(&priv->rx_est, dev->stats.rx_packets,
+			  dev->stats.rx_bytes);
+	stmmac_coal_reset(&priv->tx_est, dev->stats.tx_packets,
+			  dev->stats.tx_bytes);
 
 	if ((priv->use_riwt) && (priv->hw->dma->rx_watchdog)) {
 		priv->rx_riwt = MAX_DMA_RIWT;
@@ -1785,7 +1949,9 @@ static int stmmac_open(struct net_device *dev)
 	if (priv->pcs && priv->hw->mac->ctrl_ane)
 		priv->hw->mac->ctrl_ane(priv->ioaddr, 0);
 
+	priv->napi_pending = 0;
 	napi_enable(&priv->napi);
+	napi_enable(&priv->napi_tx);
 	netif_start_queue(dev);
 	netif_carrier_off(dev);
 
@@ -1831,6 +1997,7 @@ static int stmmac_release(struct net_device *dev)
 	netif_stop_queue(dev);
 
 	napi_disable(&priv->napi);
+	napi_disable(&priv->napi_tx);
 
 	del_timer_sync(&priv->txtimer);
 
@@ -1863,6 +2030,238 @@ static int stmmac_release(struct net_device *dev)
 	return 0;
 }
 
+static inline struct dma_desc *stmmac_tx_desc(struct stmmac_priv *priv,
+					      unsigned int entry)
+{
+	if (priv->extend_desc)
+		return (struct dma_desc *)(priv->dma_etx + entry);
+
+	return priv->dma_tx + entry;
+}
+
+/**
+ * stmmac_tso_build_hdr: build the headers of a TSO segment
+ * @skb: the GSO socket buffer
+ * @hdr: header slot in the coherent area
+ * @hdr_len: length of the MAC, IP and TCP headers
+ * @len: payload length of the segment
+ * @seq: TCP sequence number of the segment
+ * @seg: segment index
+ * @last: true for the last segment of the frame
+ * Description: the headers are copied from the skb and the length, IP id,
+ * sequence number and flags are adjusted as done by the stack when it
+ * segments the frame. The TCP checksum is seeded with the pseudo header,
+ * as for any CHECKSUM_PARTIAL frame, and completed by the TX COE.
+ */
+static void stmmac_tso_build_hdr(struct sk_buff *skb, u8 *hdr,
+				 unsigned int hdr_len, unsigned int len,
+				 u32 seq, unsigned int seg, bool last)
+{
+	unsigned int ip_off = skb_network_offset(skb);
+	unsigned int tcp_len = hdr_len - skb_transport_offset(skb) + len;
+	struct tcphdr *th = (struct tcphdr *)(hdr + skb_transport_offset(skb));
+
+	memcpy(hdr, skb->data, hdr_len);
+
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_TCPV4) {
+		struct iphdr *iph = (struct iphdr *)(hdr + ip_off);
+
+		iph->tot_len = htons(hdr_len - ip_off + len);
+		iph->id = htons(ntohs(ip_hdr(skb)->id) + seg);
+		iph->check = 0;
+		iph->check = ip_fast_csum((u8 *)iph, iph->ihl);
+		th->check = ~csum_tcpudp_magic(iph->saddr, iph->daddr, tcp_len,
+					       IPPROTO_TCP, 0);
+	} else {
+		struct ipv6hdr *ip6h = (struct ipv6hdr *)(hdr + ip_off);
+
+		ip6h->payload_len = htons(hdr_len - ip_off - sizeof(*ip6h) +
+					  len);
+		th->check = ~csum_ipv6_magic(&ip6h->saddr, &ip6h->daddr,
+					     tcp_len, IPPROTO_TCP, 0);
+	}
+
+	th->seq = htonl(seq);
+	if (seg)
+		th->cwr = 0;
+	if (!last) {
+		th->fin = 0;
+		th->psh = 0;
+	}
+}
+
+/**
+ *  stmmac_tso_xmit: Tx entry point for GSO frames
+ *  @skb : the socket buffer
+ *  @dev : device pointer
+ *  Description : the frame is segmented in software without copying the
+ *  payload: each segment is made of a descriptor pointing to its headers,
+ *  built in the coherent TSO header area, followed by the descriptors of
+ *  its payload that point directly to the linear part and to the fragments
+ *  of the skb.
+ */
+static netdev_tx_t stmmac_tso_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	struct stmmac_priv *priv = netdev_priv(dev);
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	unsigned int txsize = priv->dma_tx_size;
+	unsigned int headlen = skb_headlen(skb);
+	unsigned int mss = shinfo->gso_size;
+	unsigned int hdr_len, payload, src_off, segs, seg, ndesc = 0;
+	struct dma_desc *desc = NULL, *first = NULL;
+	unsigned int entry = 0;
+	int src_frag = -1;
+	u32 seq;
+
+	hdr_len = skb_transport_offset(skb) + tcp_hdrlen(skb);
+	if (unlikely(hdr_len > STMMAC_TSO_HDR_SIZE || hdr_len > headlen)) {
+		pr_err("%s: TSO headers too long (%d bytes)\n", __func__,
+		       hdr_len);
+		dev_kfree_skb_any(skb);
+		dev->stats.tx_dropped++;
+		return NETDEV_TX_OK;
+	}
+
+	payload = skb->len - hdr_len;
+	segs = DIV_ROUND_UP(payload, mss);
+
+	if (unlikely(stmmac_tx_avail(priv) < STMMAC_TSO_DESC(segs))) {
+		netif_stop_queue(dev);
+		return NETDEV_TX_BUSY;
+	}
+
+	spin_lock(&priv->tx_lock);
+
+	if (priv->tx_path_in_lpi_mode)
+		stmmac_disable_eee_mode(priv);
+
+	seq = ntohl(tcp_hdr(skb)->seq);
+	src_off = hdr_len;
+
+	for (seg = 0; seg < segs; seg++) {
+		unsigned int seg_len = min(mss, payload);
+		unsigned int hdr_off;
+
+		/* Header descriptor */
+		entry = priv->cur_tx % txsize;
+		desc = stmmac_tx_desc(priv, entry);
+		hdr_off = entry * STMMAC_TSO_HDR_SIZE;
+
+		stmmac_tso_build_hdr(skb, priv->tso_hdr + hdr_off, hdr_len,
+				     seg_len, seq, seg, seg == segs - 1);
+
+		desc->des2 = priv->tso_hdr_dma + hdr_off;
+		priv->tx_skbuff_dma[entry].buf = 0;
+		priv->tx_skbuff_dma[entry].map_as_page = false;
+		priv->tx_skbuff[entry] = NULL;
+		priv->hw->desc->prepare_tx_desc(desc, 1, hdr_len, 1,
+						priv->mode);
+		if (!first)
+			first = desc;
+		else {
+			wmb();
+			priv->hw->desc->set_tx_owner(desc);
+		}
+		priv->cur_tx++;
+		ndesc++;
+
+		seq += seg_len;
+		payload -= seg_len;
+
+		/* Payload descriptors */
+		while (seg_len) {
+			unsigned int size, len;
+			dma_addr_t dma;
+
+			if (src_frag < 0)
+				size = headlen;
+			else
+				size = skb_frag_size(&shinfo->frags[src_frag]);
+			if (src_off == size) {
+				src_frag++;
+				src_off = 0;
+				continue;
+			}
+			len = min(seg_len, size - src_off);
+
+			entry = priv->cur_tx % txsize;
+			desc = stmmac_tx_desc(priv, entry);
+
+			if (src_frag < 0) {
+				dma = dma_map_single(priv->device,
+						     skb->data + src_off, len,
+						     DMA_TO_DEVICE);
+				priv->tx_skbuff_dma[entry].map_as_page = false;
+			} else {
+				dma = skb_frag_dma_map(priv->device,
+						       &shinfo->frags[src_frag],
+						       src_off, len,
+						       DMA_TO_DEVICE);
+				priv->tx_skbuff_dma[entry].map_as_page = true;
+			}
+			desc->des2 = dma;
+			priv->tx_skbuff_dma[entry].buf = dma;
+			priv->tx_skbuff[entry] = NULL;
+			priv->hw->desc->prepare_tx_desc(desc, 0, len, 1,
+							priv->mode);
+			wmb();
+			priv->hw->desc->set_tx_owner(desc);
+			priv->cur_tx++;
+			ndesc++;
+
+			src_off += len;
+			seg_len -= len;
+		}
+
+		/* Only the last segment can raise the TX interrupt */
+		priv->hw->desc->close_tx_desc(desc);
+		if (seg != segs - 1)
+			priv->hw->desc->clear_tx_ic(desc);
+	}
+
+	/* The skb is released once its last descriptor has been sent */
+	priv->tx_skbuff[entry] = skb;
+
+	wmb();
+	priv->tx_count_frames += ndesc;
+	if (priv->tx_coal_frames > priv->tx_count_frames) {
+		priv->hw->desc->clear_tx_ic(desc);
+		priv->xstats.tx_reset_ic_bit++;
+		mod_timer(&priv->txtimer,
+			  STMMAC_COAL_TIMER(priv->tx_coal_timer));
+	} else
+		priv->tx_count_frames = 0;
+
+	/* To avoid raise condition */
+	priv->hw->desc->set_tx_owner(first);
+	wmb();
+
+	if (netif_msg_pktdata(priv))
+		pr_debug("%s: curr %d dirty=%d segs=%d, descs=%d\n", __func__,
+			 (priv->cur_tx % txsize), (priv->dirty_tx % txsize),
+			 segs, ndesc);
+
+	if (unlikely(stmmac_tx_avail(priv) <
+		     STMMAC_TSO_DESC(dev->gso_max_segs))) {
+		if (netif_msg_hw(priv))
+			pr_debug("%s: stop transmitted packets\n", __func__);
+		netif_stop_queue(dev);
+	}
+
+	priv->xstats.tx_tso_frames++;
+	priv->xstats.tx_tso_segs += segs;
+	dev->stats.tx_bytes += skb->len + (segs - 1) * hdr_len;
+	netdev_sent_queue(dev, skb->len);
+
+	skb_tx_timestamp(skb);
+
+	priv->hw->dma->enable_dma_transmission(priv->ioaddr);
+
+	spin_unlock(&priv->tx_lock);
+
+	return NETDEV_TX_OK;
+}
+
 /**
  *  stmmac_xmit: Tx entry point of the driver
  *  @skb : the socket buffer
@@ -1881,6 +2280,9 @@ static netdev_tx_t stmmac_xmit(struct sk_buff *skb, struct net_device *dev)
 	struct dma_desc *desc, *first;
 	unsigned int nopaged_len = skb_headlen(skb);
 
+	if (skb_is_gso(skb))
+		return stmmac_tso_xmit(skb, dev);
+
 	if (unlikely(stmmac_tx_avail(priv) < nfrags + 1)) {
 		if (!netif_queue_stopped(dev)) {
 			netif_stop_queue(dev);
@@ -1996,6 +2398,7 @@ static netdev_tx_t stmmac_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 
 	dev->stats.tx_bytes += skb->len;
+	netdev_sent_queue(dev, skb->len);
 
 	if (unlikely((skb_shinfo(skb)->tx_flags & SKBTX_HW_TSTAMP) &&
 		     priv->hwts_tx_en)) {
@@ -2014,6 +2417,106 @@ static netdev_tx_t stmmac_xmit(struct sk_buff *skb, struct net_device *dev)
 	return NETDEV_TX_OK;
 }
 
+/**
+ * stmmac_rx_page_refill: give a page pool buffer back to the device
+ * @priv: driver private structure
+ * @p: RX descriptor
+ * @entry: ring entry
+ * Description : a new page is only allocated when the previous one could not
+ * be recycled; otherwise only the part of the buffer that the CPU may have
+ * cached since it was last synchronized is given back to the device.
+ */
+static inline int stmmac_rx_page_refill(struct stmmac_priv *priv,
+					struct dma_desc *p, unsigned int entry)
+{
+	struct stmmac_rx_page *rxp = &priv->rx_page[entry];
+	unsigned int half;
+
+	if (unlikely(!rxp->page)) {
+		if (stmmac_rx_page_alloc(priv, rxp, GFP_ATOMIC))
+			return -ENOMEM;
+		priv->xstats.rx_page_alloc++;
+
+		if (netif_msg_rx_status(priv))
+			pr_debug("\trefill entry #%d\n", entry);
+	}
+
+	half = rxp->offset / STMMAC_RX_PAGE_BUF;
+	if (rxp->sync_len[half]) {
+		dma_sync_single_range_for_device(priv->device, rxp->dma,
+						 rxp->offset,
+						 rxp->sync_len[half],
+						 DMA_FROM_DEVICE);
+		rxp->sync_len[half] = 0;
+	}
+
+	/* DESC2 (and DESC3 in chain mode) can have been overwritten by the
+	 * timestamp so they are always reinitialized.
+	 */
+	p->des2 = rxp->dma + rxp->offset;
+	priv->hw->ring->refill_desc3(priv, p);
+
+	return 0;
+}
+
+/**
+ * stmmac_rx_page_skb: build the skb for a frame received in the page pool
+ * @priv: driver private structure
+ * @entry: ring entry
+ * @frame_len: length of the received frame
+ * Description : only the received bytes are synchronized for the CPU. Small
+ * frames are copied and the buffer is reused in place; for larger ones the
+ * headers are copied into the skb linear area and the payload is attached as
+ * a page fragment. The page is then recycled by flipping to its other half if
+ * the stack has already released it, otherwise it is unmapped and left to the
+ * stack and a new one is allocated at refill time.
+ */
+static struct sk_buff *stmmac_rx_page_skb(struct stmmac_priv *priv,
+					  unsigned int entry, int frame_len)
+{
+	struct stmmac_rx_page *rxp = &priv->rx_page[entry];
+	struct page *page = rxp->page;
+	unsigned int half = rxp->offset / STMMAC_RX_PAGE_BUF;
+	void *va = page_address(page) + rxp->offset;
+	unsigned int hlen;
+	struct sk_buff *skb;
+
+	dma_sync_single_range_for_cpu(priv->device, rxp->dma, rxp->offset,
+				      frame_len, DMA_FROM_DEVICE);
+	rxp->sync_len[half] = frame_len;
+	prefetch(va);
+
+	skb = netdev_alloc_skb_ip_align(priv->dev, STMMAC_RX_COPYBREAK);
+	if (unlikely(!skb))
+		return NULL;
+
+	if (frame_len <= STMMAC_RX_COPYBREAK) {
+		memcpy(skb_put(skb, frame_len), va, frame_len);
+		priv->xstats.rx_page_recycled++;
+		return skb;
+	}
+
+	hlen = STMMAC_RX_HDR_SIZE;
+	memcpy(skb_put(skb, hlen), va, hlen);
+	skb_add_rx_frag(skb, 0, page, rxp->offset + hlen, frame_len - hlen,
+			STMMAC_RX_PAGE_BUF);
+
+	if ((page_count(page) == 1) && (page_to_nid(page) == numa_node_id())) {
+		/* The other half is free again: keep a reference for the
+		 * ring and hand it to the device.
+		 */
+		get_page(page);
+		rxp->offset ^= STMMAC_RX_PAGE_BUF;
+		priv->xstats.rx_page_recycled++;
+	} else {
+		dma_unmap_page(priv->device, rxp->dma, PAGE_SIZE,
+			       DMA_FROM_DEVICE);
+		rxp->page = NULL;
+	}
+
+	return skb;
+}
+
 /**
  * stmmac_rx_refill: refill used skb preallocated buffers
  * @priv: driver private structure
@@ -2034,7 +2537,10 @@ static inline void stmmac_rx_refill(struct stmmac_priv *priv)
 		else
 			p = priv->dma_rx + entry;
 
-		if (likely(priv->rx_skbuff[entry] == NULL)) {
+		if (priv->rx_page_mode) {
+			if (stmmac_rx_page_refill(priv, p, entry))
+				break;
+		} else if (likely(priv->rx_skbuff[entry] == NULL)) {
 			struct sk_buff *skb;
 
 			skb = netdev_alloc_skb_ip_align(priv->dev, bfsize);
@@ -2112,7 +2618,8 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit)
 							   entry);
 		if (unlikely(status == discard_frame)) {
 			priv->dev->stats.rx_errors++;
-			if (priv->hwts_rx_en && !priv->extend_desc) {
+			if (priv->hwts_rx_en && !priv->extend_desc &&
+			    !priv->rx_page_mode) {
 				/* DESC2 & DESC3 will be overwitten by device
 				 * with timestamp value, hence reinitialize
 				 * them in stmmac_rx_refill() function so that
@@ -2143,22 +2650,34 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit)
 					pr_debug("\tframe size %d, COE: %d\n",
 						 frame_len, status);
 			}
-			skb = priv->rx_skbuff[entry];
-			if (unlikely(!skb)) {
-				pr_err("%s: Inconsistent Rx descriptor chain\n",
-				       priv->dev->name);
-				priv->dev->stats.rx_dropped++;
-				break;
-			}
-			prefetch(skb->data - NET_IP_ALIGN);
-			priv->rx_skbuff[entry] = NULL;
+			if (priv->rx_page_mode) {
+				skb = stmmac_rx_page_skb(priv, entry,
+							 frame_len);
+				if (unlikely(!skb)) {
+					priv->dev->stats.rx_dropped++;
+					entry = next_entry;
+					continue;
+				}
+				stmmac_get_rx_hwtstamp(priv, entry, skb);
+			} else {
+				skb = priv->rx_skbuff[entry];
+				if (unlikely(!skb)) {
+					pr_err("%s: Inconsistent Rx descriptor chain\n",
+					       priv->dev->name);
+					priv->dev->stats.rx_dropped++;
+					break;
+				}
+				prefetch(skb->data - NET_IP_ALIGN);
+				priv->rx_skbuff[entry] = NULL;
 
-			stmmac_get_rx_hwtstamp(priv, entry, skb);
+				stmmac_get_rx_hwtstamp(priv, entry, skb);
 
-			skb_put(skb, frame_len);
-			dma_unmap_single(priv->device,
-					 priv->rx_skbuff_dma[entry],
-					 priv->dma_buf_sz, DMA_FROM_DEVICE);
+				skb_put(skb, frame_len);
+				dma_unmap_single(priv->device,
+						 priv->rx_skbuff_dma[entry],
+						 priv->dma_buf_sz,
+						 DMA_FROM_DEVICE);
+			}
 
 			if (netif_msg_pktdata(priv)) {
 				pr_debug("frame received (%dbytes)", frame_len);
@@ -2187,13 +2706,112 @@ static int stmmac_rx(struct stmmac_priv *priv, int limit)
 	return count;
 }
 
+/* Adaptive coalescing profiles, from the lowest latency to bulk traffic */
+static const struct stmmac_coal_profile {
+	u32 rx_riwt;
+	u32 tx_frames;
+	u32 tx_timer;
+} stmmac_coal_profiles[] = {
+	{ MIN_DMA_RIWT, 1, 1000 },
+	{ (MIN_DMA_RIWT + MAX_DMA_RIWT) / 2, STMMAC_TX_FRAMES / 4,
+	  STMMAC_COAL_TX_TIMER / 4 },
+	{ MAX_DMA_RIWT, STMMAC_TX_FRAMES, STMMAC_COAL_TX_TIMER },
+};
+
+/**
+ * stmmac_coal_estimate - sample the traffic of one direction
+ * @est: estimator state
+ * @packets: packet counter of the direction
+ * @bytes: byte counter of the direction
+ * Description: at most every STMMAC_ADAPT_PERIOD ms, the packet rate and the
+ * average frame size since the previous sample are used to select one of
+ * the stmmac_coal_profiles. It returns the new profile when it changed,
+ * -1 otherwise.
+ */
+static int stmmac_coal_estimate(struct stmmac_coal_est *est,
+				unsigned long packets, unsigned long bytes)
+{
+	unsigned long elapsed = jiffies - est->stamp;
+	unsigned long pkts, rate;
+	int level;
+
+	if (elapsed < msecs_to_jiffies(STMMAC_ADAPT_PERIOD))
+		return -1;
+
+	pkts = packets - est->packets;
+	rate = pkts * HZ / elapsed;
+
+	if (rate < STMMAC_ADAPT_LOW_RATE)
+		level = 0;
+	else if ((rate > STMMAC_ADAPT_HIGH_RATE) ||
+		 ((bytes - est->bytes) >= pkts * STMMAC_ADAPT_BULK_SIZE))
+		level = 2;
+	else
+		level = 1;
+
+	est->stamp = jiffies;
+	est->packets = packets;
+	est->bytes = bytes;
+
+	if (level == est->level)
+		return -1;
+
+	est->level = level;
+
+	return level;
+}
+
+/**
+ * stmmac_coal_reset - restart the estimation of one direction
+ * @est: estimator state
+ * @packets: current packet counter of the direction
+ * @bytes: current byte counter of the direction
+ * Description: the profile is applied again at the end of the next sample.
+ */
+void stmmac_coal_reset(struct stmmac_coal_est *est, unsigned long packets,
+		       unsigned long bytes)
+{
+	est->stamp = jiffies;
+	est->packets = packets;
+	est->bytes = bytes;
+	est->level = -1;
+}
+
+static void stmmac_adapt_rx_coal(struct stmmac_priv *priv)
+{
+	int level = stmmac_coal_estimate(&priv->rx_est,
+					 priv->dev->stats.rx_packets,
+					 priv->dev->stats.rx_bytes);
+
+	if (level < 0)
+		return;
+
+	priv->rx_riwt = stmmac_coal_profiles[level].rx_riwt;
+	priv->hw->dma->rx_watchdog(priv->ioaddr, priv->rx_riwt);
+	priv->xstats.rx_adapt_changes++;
+}
+
+static void stmmac_adapt_tx_coal(struct stmmac_priv *priv)
+{
+	int level = stmmac_coal_estimate(&priv->tx_est,
+					 priv->dev->stats.tx_packets,
+					 priv->dev->stats.tx_bytes);
+
+	if (level < 0)
+		return;
+
+	priv->tx_coal_frames = stmmac_coal_profiles[level].tx_frames;
+	priv->tx_coal_timer = stmmac_coal_profiles[level].tx_timer;
+	priv->xstats.tx_adapt_changes++;
+}
+
 /**
- *  stmmac_poll - stmmac poll method (NAPI)
+ *  stmmac_poll - stmmac RX poll method (NAPI)
  *  @napi : pointer to the napi structure.
  *  @budget : maximum number of packets that the current CPU can receive from
  *	      all interfaces.
  *  Description :
- *  To look at the incoming frames and clear the tx resources.
+ *  To look at the incoming frames.
  */
 static int stmmac_poll(struct napi_struct *napi, int budget)
 {
@@ -2201,16 +2819,41 @@ static int stmmac_poll(struct napi_struct *napi, int budget)
 	int work_done = 0;
 
 	priv->xstats.napi_poll++;
-	stmmac_tx_clean(priv);
 
 	work_done = stmmac_rx(priv, budget);
+	if (priv->use_adaptive_rx)
+		stmmac_adapt_rx_coal(priv);
+
 	if (work_done < budget) {
 		napi_complete(napi);
-		stmmac_enable_dma_irq(priv);
+		stmmac_napi_done(priv, STMMAC_NAPI_RX);
 	}
 	return work_done;
 }
 
+/**
+ *  stmmac_poll_tx - stmmac TX poll method (NAPI)
+ *  @napi : pointer to the napi structure.
+ *  @budget : unused, the whole TX ring is always reclaimed.
+ *  Description :
+ *  To clear the tx resources, out of the RX budget.
+ */
+static int stmmac_poll_tx(struct napi_struct *napi, int budget)
+{
+	struct stmmac_priv *priv = container_of(napi, struct stmmac_priv,
+						napi_tx);
+
+	priv->xstats.napi_poll_tx++;
+	stmmac_tx_clean(priv);
+	if (priv->use_adaptive_tx)
+		stmmac_adapt_tx_coal(priv);
+
+	napi_complete(napi);
+	stmmac_napi_done(priv, STMMAC_NAPI_TX);
+
+	return 0;
+}
+
 /**
  *  stmmac_tx_timeout
  *  @dev : Pointer to net device structure
@@ -2325,6 +2968,12 @@ static netdev_features_t stmmac_fix_features(struct net_device *dev,
 	if (priv->plat->bugged_sg)
 		features &= ~NETIF_F_SG;
 
+	/* The TSO path maps each segment payload with descriptors of at most
+	 * an MSS, which must fit in a single buffer.
+	 */
+	if (dev->mtu > ETH_DATA_LEN)
+		features &= ~(NETIF_F_TSO | NETIF_F_TSO6);
+
 	return features;
 }
 
@@ -2755,6 +3404,12 @@ struct stmmac_priv *stmmac_dvr_probe(struct device *device,
 	ndev->hw_features = NETIF_F_SG | NETIF_F_IP_CSUM | NETIF_F_IPV6_CSUM |
 			    NETIF_F_RXCSUM;
 
+	/* TSO is done by the driver and relies on the TX COE to complete the
+	 * checksums of each segment.
+	 */
+	if (priv->plat->tx_coe)
+		ndev->hw_features |= NETIF_F_TSO | NETIF_F_TSO6;
+
 	ndev->features |= ndev->hw_features | NETIF_F_HIGHDMA;
 	ndev->watchdog_timeo = msecs_to_jiffies(watchdog);
 #ifdef STMMAC_VLAN_TAG_USED
@@ -2777,6 +3432,7 @@ struct stmmac_priv *stmmac_dvr_probe(struct device *device,
 	}
 
 	netif_napi_add(ndev, &priv->napi, stmmac_poll, 64);
+	netif_napi_add(ndev, &priv->napi_tx, stmmac_poll_tx, 64);
 
 	spin_lock_init(&priv->lock);
 	spin_lock_init(&priv->tx_lock);
@@ -2834,6 +3490,7 @@ error_clk_get:
 	unregister_netdev(ndev);
 error_netdev_register:
 	netif_napi_del(&priv->napi);
+	netif_napi_del(&priv->napi_tx);
 error_free_netdev:
 	free_netdev(ndev);
 
@@ -2884,6 +3541,7 @@ int stmmac_suspend(struct net_device *ndev)
 	netif_stop_queue(ndev);
 
 	napi_disable(&priv->napi);
+	napi_disable(&priv->napi_tx);
 
 	/* Stop TX/RX DMA */
 	priv->hw->dma->stop_tx(priv->ioaddr);
@@ -2939,6 +3597,7 @@ int stmmac_resume(struct net_device *ndev)
 	priv->plat->bus_data = priv->plat->bus_setup(priv->ioaddr, priv->device,
 						     priv->plat->bus_data);
 	napi_enable(&priv->napi);
+	napi_enable(&priv->napi_tx);
 
 	netif_start_queue(ndev);
 
@@ -3045,6 +3704,9 @@ static int __init stmmac_cmdline_opt(char *str)
 		} else if (!strncmp(opt, "wol_plus_en:", 12)) {
 			if (kstrtoint(opt + 12, 0, &wol_plus_en))
 				goto err;
+		} else if (!strncmp(opt, "rx_page_pool:", 13)) {
+			if (kstrtoint(opt + 13, 0, &rx_page_pool))
+				goto err;
 		}
 	}
 	return 0;
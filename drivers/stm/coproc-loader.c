@@ -0,0 +1,1296 @@
+/*
+ * Copyright (C) 2013 STMicroelectronics
+ *
+ * May be copied or modified under the terms of the GNU General Public
+ * License.  See linux/COPYING for more information.
+ *
+ * Streaming ELF loader for the coprocessor firmware.
+ *
+ * The firmware is read straight from the file system in small chunks: the
+ * program headers are parsed first, then each PT_LOAD segment is copied into
+ * the coprocessor RAM as it goes by, by the CPU or by a DMA memcpy channel
+ * while the next chunk is being read. Images compressed as a whole with xz
+ * or lzop are decompressed on the fly the same way, so the firmware never
+ * has to be held in memory. Only when the file cannot be opened is the
+ * whole image requested through the firmware loader, as it used to be.
+ */
+
+#include <linux/device.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/io.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/sort.h>
+#include <linux/hrtimer.h>
+#include <linux/firmware.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/libelf.h>
+#ifdef CONFIG_STM_COPROCESSOR_COMPRESSED_FW
+#include <linux/xz.h>
+#include <linux/lzo.h>
+#endif
+#include <asm/unaligned.h>
+#include <asm/cacheflush.h>
+
+#include "coprocessor.h"
+
+/* Granule in which the segments are read and copied */
+#define COPROC_FW_CHUNK		(64 * 1024)
+/* Data kept ahead of the section headers when the image is not seekable */
+#define COPROC_FW_WINDOW	(64 * 1024)
+#define COPROC_FW_MAX_PHDRS	64
+#define COPROC_FW_MAX_SHDRS	4096
+
+/* Compressed input buffer */
+#define COPROC_FW_XZ_IN		(16 * 1024)
+/* Largest xz dictionary accepted (xz --lzma2=dict=1MiB) */
+#define COPROC_FW_XZ_DICT_MAX	(1024 * 1024)
+/* lzop blocks are at most 256KiB */
+#define COPROC_FW_LZO_BLOCK	(256 * 1024)
+
+#define LZOP_F_ADLER32_D	0x00000001
+#define LZOP_F_ADLER32_C	0x00000002
+#define LZOP_F_H_EXTRA_FIELD	0x00000040
+#define LZOP_F_CRC32_D		0x00000100
+#define LZOP_F_CRC32_C		0x00000200
+#define LZOP_F_H_FILTER		0x00000800
+
+static char *fw_path = "/lib/firmware";
+module_param(fw_path, charp, S_IRUGO);
+MODULE_PARM_DESC(fw_path, "Directory the coprocessor firmware is read from");
+
+static bool fw_dma = 1;
+module_param(fw_dma, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(fw_dma, "Copy the firmware segments with a DMA channel");
+
+struct coproc_fw_loader;
+
+/*
+ * A firmware image being read, possibly through a decompressor. Only the
+ * raw sources can be repositioned, by setting pos.
+ */
+struct coproc_fw_stream {
+	ssize_t (*read)(struct coproc_fw_stream *s, void *buf, size_t len);
+	void (*close)(struct coproc_fw_stream *s);
+	struct coproc_fw_loader *ld;
+	int seekable;
+	loff_t pos;
+
+	/* Raw sources */
+	struct file *filp;
+	const struct firmware *fw;
+
+	/* Decompressors */
+	struct coproc_fw_stream *lower;
+	u8 *in, *out;
+	size_t out_pos, out_len;
+	int eof;
+#ifdef CONFIG_STM_COPROCESSOR_COMPRESSED_FW
+	struct xz_dec *xz;
+	struct xz_buf xz_buf;
+	u32 lzo_flags;
+#endif
+};
+
+struct coproc_fw_seg {
+	unsigned long paddr;
+	u32 offset;
+	u32 filesz;
+	u32 memsz;
+	int cpu;		/* Written (in part) through the CPU cache */
+};
+
+struct coproc_fw_loader {
+	struct coproc *cop;
+	struct coproc_fw_stream *stream;
+	const char *source;
+	const char *format;
+	void __iomem *ram;
+
+	/* Segment data, double buffered when a DMA channel is used */
+	struct dma_chan *chan;
+	void *chunk[2];
+	dma_addr_t chunk_dma[2];
+	size_t chunk_len[2];
+	dma_cookie_t cookie[2];
+	int cur;
+
+	size_t read;		/* Bytes read from the source */
+	size_t loaded;		/* Bytes written to the coprocessor RAM */
+	size_t mem;		/* Memory currently allocated */
+	size_t peak_mem;
+};
+
+static void coproc_fw_account(struct coproc_fw_loader *ld, long size)
+{
+	ld->mem += size;
+	if (ld->mem > ld->peak_mem)
+		ld->peak_mem = ld->mem;
+}
+
+static void *coproc_fw_alloc(struct coproc_fw_loader *ld, size_t size)
+{
+	void *p;
+
+	if (size > PAGE_SIZE)
+		p = vmalloc(size);
+	else
+		p = kmalloc(size, GFP_KERNEL);
+	if (p)
+		coproc_fw_account(ld, size);
+
+	return p;
+}
+
+static void coproc_fw_free(struct coproc_fw_loader *ld, void *p, size_t size)
+{
+	if (!p)
+		return;
+
+	if (size > PAGE_SIZE)
+		vfree(p);
+	else
+		kfree(p);
+	coproc_fw_account(ld, -(long)size);
+}
+
+/* Read exactly len bytes, a short image being an error */
+static int coproc_fw_read(struct coproc_fw_stream *s, void *buf, size_t len)
+{
+	while (len) {
+		ssize_t n = s->read(s, buf, len);
+
+		if (n < 0)
+			return n;
+		if (n == 0) {
+			coproc_err(s->ld->cop, "Truncated firmware image\n");
+			return -EINVAL;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* Move to pos, reading through scratch if the stream cannot be seeked */
+static int coproc_fw_seek(struct coproc_fw_stream *s, loff_t pos,
+			  void *scratch, size_t scratch_len)
+{
+	int ret;
+
+	if (s->seekable) {
+		s->pos = pos;
+		return 0;
+	}
+
+	if (pos < s->pos) {
+		coproc_err(s->ld->cop, "Compressed firmware is not laid out "
+			   "in file order\n");
+		return -ESPIPE;
+	}
+
+	while (s->pos < pos) {
+		ret = coproc_fw_read(s, scratch,
+				     min_t(loff_t, pos - s->pos, scratch_len));
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static struct coproc_fw_stream *coproc_fw_stream_alloc(
+		struct coproc_fw_loader *ld)
+{
+	struct coproc_fw_stream *s;
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (s) {
+		s->ld = ld;
+		coproc_fw_account(ld, sizeof(*s));
+	}
+
+	return s;
+}
+
+static void coproc_fw_stream_close(struct coproc_fw_stream *s)
+{
+	if (!s)
+		return;
+
+	s->close(s);
+	coproc_fw_account(s->ld, -(long)sizeof(*s));
+	kfree(s);
+}
+
+/* Raw sources: a file, or a firmware image already in memory */
+
+static ssize_t coproc_fw_file_read(struct coproc_fw_stream *s, void *buf,
+				   size_t len)
+{
+	int n = kernel_read(s->filp, s->pos, buf, len);
+
+	if (n > 0) {
+		s->pos += n;
+		s->ld->read += n;
+	}
+
+	return n;
+}
+
+static void coproc_fw_file_close(struct coproc_fw_stream *s)
+{
+	filp_close(s->filp, NULL);
+}
+
+static ssize_t coproc_fw_mem_read(struct coproc_fw_stream *s, void *buf,
+				  size_t len)
+{
+	size_t n;
+
+	if (s->pos >= s->fw->size)
+		return 0;
+
+	n = min_t(size_t, len, s->fw->size - s->pos);
+	memcpy(buf, s->fw->data + s->pos, n);
+	s->pos += n;
+	s->ld->read += n;
+
+	return n;
+}
+
+static void coproc_fw_mem_close(struct coproc_fw_stream *s)
+{
+	coproc_fw_account(s->ld, -(long)s->fw->size);
+	release_firmware(s->fw);
+}
+
+static struct coproc_fw_stream *coproc_fw_open_file(
+		struct coproc_fw_loader *ld, const char *name)
+{
+	static const char * const suffixes[] = {
+		"",
+#ifdef CONFIG_STM_COPROCESSOR_COMPRESSED_FW
+		".xz",
+		".lzo",
+#endif
+	};
+	struct coproc_fw_stream *s;
+	struct file *filp = ERR_PTR(-ENOENT);
+	char *path;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(suffixes) && IS_ERR(filp); i++) {
+		path = kasprintf(GFP_KERNEL, "%s/%s%s", fw_path, name,
+				 suffixes[i]);
+		if (!path)
+			return ERR_PTR(-ENOMEM);
+		filp = filp_open(path, O_RDONLY, 0);
+		if (!IS_ERR(filp))
+			coproc_dbg(ld->cop, "Reading %s\n", path);
+		kfree(path);
+	}
+	if (IS_ERR(filp))
+		return ERR_CAST(filp);
+
+	s = coproc_fw_stream_alloc(ld);
+	if (!s) {
+		filp_close(filp, NULL);
+		return ERR_PTR(-ENOMEM);
+	}
+	s->filp = filp;
+	s->read = coproc_fw_file_read;
+	s->close = coproc_fw_file_close;
+	s->seekable = 1;
+	ld->source = "file";
+
+	return s;
+}
+
+static struct coproc_fw_stream *coproc_fw_open_firmware(
+		struct coproc_fw_loader *ld, const char *name)
+{
+	struct coproc_fw_stream *s;
+	const struct firmware *fw;
+	int ret;
+
+	coproc_dbg(ld->cop, "Requesting the file %s\n", name);
+	ret = request_firmware(&fw, name, ld->cop->dev);
+	if (ret)
+		return ERR_PTR(ret);
+
+	s = coproc_fw_stream_alloc(ld);
+	if (!s) {
+		release_firmware(fw);
+		return ERR_PTR(-ENOMEM);
+	}
+	coproc_fw_account(ld, fw->size);
+	s->fw = fw;
+	s->read = coproc_fw_mem_read;
+	s->close = coproc_fw_mem_close;
+	s->seekable = 1;
+	ld->source = "firmware";
+
+	return s;
+}
+
+#ifdef CONFIG_STM_COPROCESSOR_COMPRESSED_FW
+
+static const u8 coproc_fw_xz_magic[] = {
+	0xfd, '7', 'z', 'X', 'Z', 0x00
+};
+static const u8 coproc_fw_lzo_magic[] = {
+	0x89, 'L', 'Z', 'O', 0x00, 0x0d, 0x0a, 0x1a, 0x0a
+};
+
+/* xz (single stream, CRC32 or no check, as for the kernel itself) */
+
+static ssize_t coproc_fw_xz_read(struct coproc_fw_stream *s, void *buf,
+				 size_t len)
+{
+	struct xz_buf *b = &s->xz_buf;
+	enum xz_ret xz_ret;
+	ssize_t n;
+
+	if (s->eof)
+		return 0;
+
+	b->out = buf;
+	b->out_pos = 0;
+	b->out_size = len;
+
+	do {
+		if (b->in_pos == b->in_size) {
+			n = s->lower->read(s->lower, s->in, COPROC_FW_XZ_IN);
+			if (n < 0)
+				return n;
+			b->in_pos = 0;
+			b->in_size = n;
+		}
+
+		xz_ret = xz_dec_run(s->xz, b);
+		if (xz_ret == XZ_STREAM_END) {
+			s->eof = 1;
+			break;
+		}
+		if (xz_ret != XZ_OK) {
+			coproc_err(s->ld->cop, "xz decompression failed (%d)\n",
+				   xz_ret);
+			return -EINVAL;
+		}
+		if (b->in_size == 0) {
+			coproc_err(s->ld->cop, "Truncated xz firmware\n");
+			return -EINVAL;
+		}
+	} while (b->out_pos < b->out_size);
+
+	s->pos += b->out_pos;
+	return b->out_pos;
+}
+
+static void coproc_fw_xz_close(struct coproc_fw_stream *s)
+{
+	struct coproc_fw_loader *ld = s->ld;
+
+	if (s->xz) {
+		xz_dec_end(s->xz);
+		coproc_fw_account(ld, -COPROC_FW_XZ_DICT_MAX);
+	}
+	coproc_fw_free(ld, s->in, COPROC_FW_XZ_IN);
+	coproc_fw_stream_close(s->lower);
+}
+
+static int coproc_fw_xz_init(struct coproc_fw_stream *s)
+{
+	s->in = coproc_fw_alloc(s->ld, COPROC_FW_XZ_IN);
+	if (!s->in)
+		return -ENOMEM;
+
+	/* The dictionary grows as needed; count it at its largest */
+	s->xz = xz_dec_init(XZ_DYNALLOC, COPROC_FW_XZ_DICT_MAX);
+	if (!s->xz)
+		return -ENOMEM;
+	coproc_fw_account(s->ld, COPROC_FW_XZ_DICT_MAX);
+
+	s->read = coproc_fw_xz_read;
+	s->close = coproc_fw_xz_close;
+	s->ld->format = "xz";
+
+	return 0;
+}
+
+/* lzop (LZO1X methods, header and block checksums are not verified) */
+
+static int coproc_fw_lzo_header(struct coproc_fw_stream *s)
+{
+	struct coproc_fw_stream *lower = s->lower;
+	struct coproc *cop = s->ld->cop;
+	u8 buf[255 + 4];
+	int new_format, len, ret;
+	u16 version;
+
+	/* Magic, version and library version */
+	ret = coproc_fw_read(lower, buf, sizeof(coproc_fw_lzo_magic) + 4);
+	if (ret)
+		return ret;
+	version = get_unaligned_be16(buf + sizeof(coproc_fw_lzo_magic));
+	new_format = version >= 0x0940;
+
+	/* Version needed to extract, method, level and flags */
+	len = new_format ? 2 + 1 + 1 + 4 : 1 + 4;
+	ret = coproc_fw_read(lower, buf, len);
+	if (ret)
+		return ret;
+	if (buf[new_format ? 2 : 0] > 3 || buf[new_format ? 2 : 0] < 1) {
+		coproc_err(cop, "Unsupported lzop method %d\n",
+			   buf[new_format ? 2 : 0]);
+		return -EINVAL;
+	}
+	s->lzo_flags = get_unaligned_be32(buf + len - 4);
+	if (s->lzo_flags & LZOP_F_H_EXTRA_FIELD) {
+		coproc_err(cop, "Unsupported lzop extra field\n");
+		return -EINVAL;
+	}
+
+	/* Filter, mode, mtime and the file name length */
+	len = (s->lzo_flags & LZOP_F_H_FILTER ? 4 : 0) + 4 + 4 +
+		(new_format ? 4 : 0) + 1;
+	ret = coproc_fw_read(lower, buf, len);
+	if (ret)
+		return ret;
+
+	/* File name and header checksum */
+	return coproc_fw_read(lower, buf, buf[len - 1] + 4);
+}
+
+static int coproc_fw_lzo_block(struct coproc_fw_stream *s)
+{
+	struct coproc_fw_stream *lower = s->lower;
+	struct coproc *cop = s->ld->cop;
+	u32 dst_len, src_len, flags = s->lzo_flags;
+	size_t out_len;
+	u8 buf[4];
+	int skip, ret;
+
+	ret = coproc_fw_read(lower, buf, 4);
+	if (ret)
+		return ret;
+	dst_len = get_unaligned_be32(buf);
+	if (dst_len == 0) {
+		s->eof = 1;
+		return 0;
+	}
+
+	ret = coproc_fw_read(lower, buf, 4);
+	if (ret)
+		return ret;
+	src_len = get_unaligned_be32(buf);
+	if (dst_len > COPROC_FW_LZO_BLOCK || !src_len || src_len > dst_len) {
+		coproc_err(cop, "Bad lzop block (%u/%u)\n", src_len, dst_len);
+		return -EINVAL;
+	}
+
+	skip = (!!(flags & LZOP_F_ADLER32_D) + !!(flags & LZOP_F_CRC32_D)) * 4;
+	if (src_len < dst_len)
+		skip += (!!(flags & LZOP_F_ADLER32_C) +
+			 !!(flags & LZOP_F_CRC32_C)) * 4;
+	ret = coproc_fw_read(lower, s->in, skip);
+	if (ret)
+		return ret;
+
+	if (src_len == dst_len)
+		/* Stored uncompressed */
+		ret = coproc_fw_read(lower, s->out, dst_len);
+	else
+		ret = coproc_fw_read(lower, s->in, src_len);
+	if (ret)
+		return ret;
+
+	if (src_len < dst_len) {
+		out_len = dst_len;
+		ret = lzo1x_decompress_safe(s->in, src_len, s->out, &out_len);
+		if (ret != LZO_E_OK || out_len != dst_len) {
+			coproc_err(cop, "lzo decompression failed (%d)\n", ret);
+			return -EINVAL;
+		}
+	}
+
+	s->out_pos = 0;
+	s->out_len = dst_len;
+
+	return 0;
+}
+
+static ssize_t coproc_fw_lzo_read(struct coproc_fw_stream *s, void *buf,
+				  size_t len)
+{
+	size_t done = 0, n;
+	int ret;
+
+	while (done < len) {
+		if (s->out_pos == s->out_len) {
+			if (s->eof)
+				break;
+			ret = coproc_fw_lzo_block(s);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		n = min(len - done, s->out_len - s->out_pos);
+		memcpy(buf + done, s->out + s->out_pos, n);
+		s->out_pos += n;
+		done += n;
+	}
+
+	s->pos += done;
+	return done;
+}
+
+static void coproc_fw_lzo_close(struct coproc_fw_stream *s)
+{
+	coproc_fw_free(s->ld, s->in, COPROC_FW_LZO_BLOCK);
+	coproc_fw_free(s->ld, s->out, COPROC_FW_LZO_BLOCK);
+	coproc_fw_stream_close(s->lower);
+}
+
+static int coproc_fw_lzo_init(struct coproc_fw_stream *s)
+{
+	int ret;
+
+	s->in = coproc_fw_alloc(s->ld, COPROC_FW_LZO_BLOCK);
+	s->out = coproc_fw_alloc(s->ld, COPROC_FW_LZO_BLOCK);
+	s->close = coproc_fw_lzo_close;
+	if (!s->in || !s->out)
+		return -ENOMEM;
+
+	ret = coproc_fw_lzo_header(s);
+	if (ret)
+		return ret;
+
+	s->read = coproc_fw_lzo_read;
+	s->ld->format = "lzo";
+
+	return 0;
+}
+
+/*
+ * Put a decompressor over the raw source if its magic says so. On error,
+ * the raw source is closed.
+ */
+static struct coproc_fw_stream *coproc_fw_decompress(
+		struct coproc_fw_stream *raw)
+{
+	int (*init)(struct coproc_fw_stream *s);
+	struct coproc_fw_stream *s;
+	u8 magic[sizeof(coproc_fw_lzo_magic)];
+	ssize_t n;
+	int ret;
+
+	n = raw->read(raw, magic, sizeof(magic));
+	raw->pos = 0;
+	if (n < 0) {
+		coproc_fw_stream_close(raw);
+		return ERR_PTR(n);
+	}
+
+	if (n >= sizeof(coproc_fw_xz_magic) &&
+	    !memcmp(magic, coproc_fw_xz_magic, sizeof(coproc_fw_xz_magic)))
+		init = coproc_fw_xz_init;
+	else if (n == sizeof(coproc_fw_lzo_magic) &&
+		 !memcmp(magic, coproc_fw_lzo_magic, sizeof(magic)))
+		init = coproc_fw_lzo_init;
+	else
+		return raw;
+
+	s = coproc_fw_stream_alloc(raw->ld);
+	if (!s) {
+		coproc_fw_stream_close(raw);
+		return ERR_PTR(-ENOMEM);
+	}
+	s->lower = raw;
+	s->close = coproc_fw_xz_close;
+	ret = init(s);
+	if (ret) {
+		/* Closes the raw source too */
+		coproc_fw_stream_close(s);
+		return ERR_PTR(ret);
+	}
+
+	return s;
+}
+
+#else
+
+static struct coproc_fw_stream *coproc_fw_decompress(
+		struct coproc_fw_stream *raw)
+{
+	return raw;
+}
+
+#endif /* CONFIG_STM_COPROCESSOR_COMPRESSED_FW */
+
+static int coproc_fw_open(struct coproc_fw_loader *ld, const char *name)
+{
+	struct coproc_fw_stream *s;
+
+	ld->format = "elf";
+
+	s = coproc_fw_open_file(ld, name);
+	if (IS_ERR(s) && PTR_ERR(s) != -ENOMEM)
+		s = coproc_fw_open_firmware(ld, name);
+	if (IS_ERR(s))
+		return PTR_ERR(s);
+
+	s = coproc_fw_decompress(s);
+	if (IS_ERR(s))
+		return PTR_ERR(s);
+
+	ld->stream = s;
+	return 0;
+}
+
+/* Segment copy, by the CPU or by a DMA memcpy channel */
+
+static void coproc_fw_flush(struct coproc_fw_loader *ld, unsigned long paddr,
+			    size_t size)
+{
+	unsigned long offset = paddr - ld->cop->ram_phys;
+
+#ifdef CONFIG_SUPERH
+	flush_ioremap_region(ld->cop->ram_phys, ld->ram, offset, size);
+#else
+	(void)offset;
+	wmb();
+#endif
+}
+
+#ifdef CONFIG_DMA_ENGINE
+
+static int coproc_fw_dma_wait(struct coproc_fw_loader *ld, int i)
+{
+	enum dma_status status;
+
+	if (!ld->cookie[i])
+		return 0;
+
+	status = dma_sync_wait(ld->chan, ld->cookie[i]);
+	dma_unmap_single(ld->chan->device->dev, ld->chunk_dma[i],
+			 ld->chunk_len[i], DMA_TO_DEVICE);
+	ld->cookie[i] = 0;
+	if (status != DMA_SUCCESS) {
+		coproc_err(ld->cop, "Firmware DMA failed\n");
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int coproc_fw_dma_copy(struct coproc_fw_loader *ld,
+			      unsigned long paddr, size_t len)
+{
+	struct device *dev = ld->chan->device->dev;
+	struct dma_async_tx_descriptor *tx;
+	dma_cookie_t cookie;
+	int i = ld->cur;
+
+	ld->chunk_dma[i] = dma_map_single(dev, ld->chunk[i], len,
+					  DMA_TO_DEVICE);
+	if (dma_mapping_error(dev, ld->chunk_dma[i]))
+		return -ENOMEM;
+
+	tx = ld->chan->device->device_prep_dma_memcpy(ld->chan, paddr,
+			ld->chunk_dma[i], len, DMA_CTRL_ACK |
+			DMA_COMPL_SKIP_SRC_UNMAP | DMA_COMPL_SKIP_DEST_UNMAP);
+	if (!tx)
+		goto err_unmap;
+
+	cookie = dmaengine_submit(tx);
+	if (dma_submit_error(cookie))
+		goto err_unmap;
+	dma_async_issue_pending(ld->chan);
+
+	ld->cookie[i] = cookie;
+	ld->chunk_len[i] = len;
+	ld->cur ^= 1;
+
+	return 0;
+
+err_unmap:
+	dma_unmap_single(dev, ld->chunk_dma[i], len, DMA_TO_DEVICE);
+	return -EBUSY;
+}
+
+static void coproc_fw_dma_init(struct coproc_fw_loader *ld)
+{
+	if (!fw_dma)
+		return;
+
+	dmaengine_get();
+	ld->chan = dma_find_channel(DMA_MEMCPY);
+	if (ld->chan) {
+		ld->chunk[1] = kmalloc(COPROC_FW_CHUNK, GFP_KERNEL);
+		if (ld->chunk[1]) {
+			coproc_fw_account(ld, COPROC_FW_CHUNK);
+			return;
+		}
+		ld->chan = NULL;
+	}
+	dmaengine_put();
+}
+
+static void coproc_fw_dma_exit(struct coproc_fw_loader *ld)
+{
+	if (!ld->chan)
+		return;
+
+	coproc_fw_dma_wait(ld, 0);
+	coproc_fw_dma_wait(ld, 1);
+	kfree(ld->chunk[1]);
+	coproc_fw_account(ld, -COPROC_FW_CHUNK);
+	ld->chan = NULL;
+	dmaengine_put();
+}
+
+#else
+
+static int coproc_fw_dma_wait(struct coproc_fw_loader *ld, int i)
+{
+	return 0;
+}
+
+static int coproc_fw_dma_copy(struct coproc_fw_loader *ld,
+			      unsigned long paddr, size_t len)
+{
+	return -ENODEV;
+}
+
+static void coproc_fw_dma_init(struct coproc_fw_loader *ld) { }
+static void coproc_fw_dma_exit(struct coproc_fw_loader *ld) { }
+
+#endif /* CONFIG_DMA_ENGINE */
+
+static int coproc_fw_dma_wait_all(struct coproc_fw_loader *ld)
+{
+	int ret = coproc_fw_dma_wait(ld, 0);
+
+	return coproc_fw_dma_wait(ld, 1) ? : ret;
+}
+
+/* The buffer the next chunk is read into, once its DMA is over */
+static void *coproc_fw_chunk(struct coproc_fw_loader *ld)
+{
+	int ret = coproc_fw_dma_wait(ld, ld->cur);
+
+	return ret ? ERR_PTR(ret) : ld->chunk[ld->cur];
+}
+
+static int coproc_fw_write(struct coproc_fw_loader *ld,
+			   struct coproc_fw_seg *seg, unsigned long paddr,
+			   size_t len)
+{
+	int ret;
+
+	/*
+	 * Once the CPU has written part of a segment, it writes the rest too:
+	 * the cache lines it left dirty would otherwise be written back over
+	 * what the DMA copies next, when the segment is purged.
+	 */
+	if (ld->chan && !seg->cpu && coproc_fw_dma_copy(ld, paddr, len) == 0)
+		return 0;
+
+	/*
+	 * Let any DMA in flight complete first: the CPU may allocate
+	 * a cache line the DMA is still writing.
+	 */
+	ret = coproc_fw_dma_wait_all(ld);
+	if (ret)
+		return ret;
+
+	memcpy_toio(ld->ram + (paddr - ld->cop->ram_phys),
+		    ld->chunk[ld->cur], len);
+	seg->cpu = 1;
+
+	return 0;
+}
+
+static int coproc_fw_load_seg(struct coproc_fw_loader *ld,
+			      struct coproc_fw_seg *seg)
+{
+	unsigned long paddr = seg->paddr;
+	size_t left = seg->filesz;
+	void *chunk;
+	int ret;
+
+	chunk = coproc_fw_chunk(ld);
+	if (IS_ERR(chunk))
+		return PTR_ERR(chunk);
+	ret = coproc_fw_seek(ld->stream, seg->offset, chunk, COPROC_FW_CHUNK);
+	if (ret)
+		return ret;
+
+	/* Nothing may be left in the cache over what the DMA writes */
+	if (ld->chan)
+		coproc_fw_flush(ld, seg->paddr, seg->filesz);
+
+	while (left) {
+		size_t len = min_t(size_t, left, COPROC_FW_CHUNK);
+
+		chunk = coproc_fw_chunk(ld);
+		if (IS_ERR(chunk))
+			return PTR_ERR(chunk);
+
+		ret = coproc_fw_read(ld->stream, chunk, len);
+		if (ret)
+			return ret;
+
+		ret = coproc_fw_write(ld, seg, paddr, len);
+		if (ret)
+			return ret;
+
+		paddr += len;
+		left -= len;
+	}
+
+	ld->loaded += seg->filesz;
+
+	return 0;
+}
+
+/* Zero the bss once the data is in, and push everything to memory */
+static int coproc_fw_finish(struct coproc_fw_loader *ld,
+			    struct coproc_fw_seg *segs, int nsegs)
+{
+	struct coproc_fw_seg *seg;
+	unsigned long start;
+	int ret, i;
+
+	ret = coproc_fw_dma_wait_all(ld);
+	if (ret)
+		return ret;
+
+	for (i = 0, seg = segs; i < nsegs; i++, seg++) {
+		/* What the DMA wrote is not in the cache */
+		start = seg->cpu ? seg->paddr : seg->paddr + seg->filesz;
+		if (seg->memsz > seg->filesz) {
+			memset_io(ld->ram + (seg->paddr + seg->filesz -
+					     ld->cop->ram_phys),
+				  0, seg->memsz - seg->filesz);
+			ld->loaded += seg->memsz - seg->filesz;
+		}
+		if (seg->paddr + seg->memsz > start)
+			coproc_fw_flush(ld, start,
+					seg->paddr + seg->memsz - start);
+	}
+
+	return 0;
+}
+
+/* Section headers and names, for the coprocessor specific checks */
+static int coproc_fw_check_elf(struct coproc_fw_loader *ld,
+			       Elf32_Ehdr *ehdr, Elf32_Phdr *phdrs)
+{
+	struct coproc_fw_stream *s = ld->stream;
+	struct coproc *cop = ld->cop;
+	struct ELF32_info info = {
+		.header = ehdr,
+		.progbase = phdrs,
+		.numpheaders = ehdr->e_phnum,
+	};
+	Elf32_Shdr *shdrs = NULL, *strsec;
+	size_t shsize = ehdr->e_shnum * sizeof(Elf32_Shdr);
+	size_t window_len = 0, strsize = 0;
+	loff_t window = ehdr->e_shoff;
+	u8 *window_buf = NULL;
+	char *strtab = NULL;
+	int ret;
+
+	if (!cop->fns->check_elf)
+		return 0;
+
+	if (!ehdr->e_shnum)
+		goto check;
+
+	if (ehdr->e_shnum > COPROC_FW_MAX_SHDRS ||
+	    ehdr->e_shstrndx >= ehdr->e_shnum) {
+		coproc_dbg(cop, "Unable to parse ELF section headers\n");
+		return -EINVAL;
+	}
+
+	/* Keep what precedes the headers: the names are usually there */
+	if (!s->seekable && ehdr->e_shoff > s->pos) {
+		window = max_t(loff_t, s->pos,
+			       ehdr->e_shoff - min_t(u32, ehdr->e_shoff,
+						     COPROC_FW_WINDOW));
+		window_len = ehdr->e_shoff - window;
+		window_buf = coproc_fw_alloc(ld, window_len);
+		if (!window_buf)
+			return -ENOMEM;
+		ret = coproc_fw_seek(s, window, window_buf, window_len);
+		if (!ret)
+			ret = coproc_fw_read(s, window_buf, window_len);
+		if (ret)
+			goto out;
+	}
+
+	shdrs = coproc_fw_alloc(ld, shsize);
+	if (!shdrs) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	ret = coproc_fw_seek(s, ehdr->e_shoff, shdrs, shsize);
+	if (!ret)
+		ret = coproc_fw_read(s, shdrs, shsize);
+	if (ret)
+		goto out;
+
+	strsec = &shdrs[ehdr->e_shstrndx];
+	if (strsec->sh_size > COPROC_FW_WINDOW) {
+		ret = -EINVAL;
+		goto out;
+	}
+	strsize = strsec->sh_size + 1;
+	strtab = coproc_fw_alloc(ld, strsize);
+	if (!strtab) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (s->seekable) {
+		s->pos = strsec->sh_offset;
+		ret = coproc_fw_read(s, strtab, strsec->sh_size);
+		if (ret)
+			goto out;
+	} else if (window_buf && strsec->sh_offset >= window &&
+		   strsec->sh_offset + strsec->sh_size <= ehdr->e_shoff) {
+		memcpy(strtab, window_buf + (strsec->sh_offset - window),
+		       strsec->sh_size);
+	} else {
+		coproc_err(cop, "Section names not found before the section "
+			   "headers\n");
+		ret = -EINVAL;
+		goto out;
+	}
+	strtab[strsec->sh_size] = '\0';
+
+	info.secbase = shdrs;
+	info.numsections = ehdr->e_shnum;
+	info.strsecindex = ehdr->e_shstrndx;
+	info.strtab = strtab;
+	info.strtabsize = strsec->sh_size;
+
+check:
+	ret = cop->fns->check_elf(cop, &info);
+out:
+	coproc_fw_free(ld, strtab, strsize);
+	coproc_fw_free(ld, shdrs, shsize);
+	coproc_fw_free(ld, window_buf, window_len);
+	return ret;
+}
+
+static int coproc_fw_cmp_seg(const void *a, const void *b)
+{
+	const struct coproc_fw_seg *sa = a, *sb = b;
+
+	return sa->offset < sb->offset ? -1 : sa->offset > sb->offset;
+}
+
+/*
+ * Returns -ENOEXEC for images using the ST ELF extensions (compressed
+ * segments, auxiliary information), which only the whole image loader
+ * knows about.
+ */
+static int coproc_fw_load_stream(struct coproc_fw_loader *ld,
+				 unsigned long *boot_addr)
+{
+	struct coproc_fw_stream *s = ld->stream;
+	struct coproc *cop = ld->cop;
+	struct coproc_fw_seg *segs = NULL;
+	size_t phsize = 0, segsize = 0;
+	Elf32_Phdr *phdrs = NULL, *phdr;
+	Elf32_Ehdr ehdr;
+	int nsegs = 0, ret, i;
+
+	ret = coproc_fw_read(s, &ehdr, sizeof(ehdr));
+	if (ret)
+		return ret;
+
+	if (ELF32_checkIdent(&ehdr) ||
+	    ehdr.e_ident[EI_CLASS] != ELFCLASS32 ||
+	    ehdr.e_ident[EI_DATA] != ELFDATA2LSB ||
+	    ehdr.e_ident[EI_VERSION] != EV_CURRENT ||
+	    ehdr.e_ehsize != sizeof(Elf32_Ehdr) ||
+	    ehdr.e_phentsize != sizeof(Elf32_Phdr) ||
+	    (ehdr.e_shnum && ehdr.e_shentsize != sizeof(Elf32_Shdr)) ||
+	    !ehdr.e_phnum || ehdr.e_phnum > COPROC_FW_MAX_PHDRS) {
+		coproc_dbg(cop, "Unable to parse ELF file\n");
+		return -EINVAL;
+	}
+
+	if (ehdr.e_type != ET_EXEC) {
+		coproc_dbg(cop, "ELF file is not an executable\n");
+		return -EINVAL;
+	}
+
+	if (ehdr.e_machine != cop->fns->machine) {
+		coproc_dbg(cop, "Unexpected machine flag %d\n",
+				ehdr.e_machine);
+		return -EINVAL;
+	}
+
+	phsize = ehdr.e_phnum * sizeof(*phdrs);
+	segsize = ehdr.e_phnum * sizeof(*segs);
+	phdrs = coproc_fw_alloc(ld, phsize);
+	segs = coproc_fw_alloc(ld, segsize);
+	if (!phdrs || !segs) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = coproc_fw_seek(s, ehdr.e_phoff, phdrs, phsize);
+	if (!ret)
+		ret = coproc_fw_read(s, phdrs, phsize);
+	if (ret)
+		goto out;
+
+	for (i = 0, phdr = phdrs; i < ehdr.e_phnum; i++, phdr++) {
+#ifdef CONFIG_STM_ELF_EXTENSIONS
+		if (phdr->p_type == PT_ST_INFO ||
+		    (phdr->p_flags & (PF_ZLIB | PF_AUX))) {
+			ret = -ENOEXEC;
+			goto out;
+		}
+#endif
+		if (phdr->p_type != PT_LOAD || !phdr->p_memsz)
+			continue;
+
+		if (phdr->p_filesz > phdr->p_memsz ||
+		    phdr->p_paddr < cop->ram_phys ||
+		    phdr->p_paddr + phdr->p_memsz < phdr->p_paddr ||
+		    phdr->p_paddr + phdr->p_memsz >
+				cop->ram_phys + cop->ram_size) {
+			coproc_err(cop, "Segment %d outside allowed limits\n",
+				   i);
+			ret = -EINVAL;
+			goto out;
+		}
+
+		segs[nsegs].paddr = phdr->p_paddr;
+		segs[nsegs].offset = phdr->p_offset;
+		segs[nsegs].filesz = phdr->p_filesz;
+		segs[nsegs].memsz = phdr->p_memsz;
+		segs[nsegs].cpu = 0;
+		nsegs++;
+	}
+
+	/* Read the image front to back */
+	sort(segs, nsegs, sizeof(*segs), coproc_fw_cmp_seg, NULL);
+
+	for (i = 0; i < nsegs; i++) {
+		ret = coproc_fw_load_seg(ld, &segs[i]);
+		if (ret)
+			goto out;
+	}
+
+	ret = coproc_fw_finish(ld, segs, nsegs);
+	if (ret)
+		goto out;
+
+	ret = coproc_fw_check_elf(ld, &ehdr, phdrs);
+	if (ret)
+		goto out;
+
+	*boot_addr = ehdr.e_entry;
+out:
+	coproc_fw_free(ld, segs, segsize);
+	coproc_fw_free(ld, phdrs, phsize);
+	return ret;
+}
+
+#ifdef CONFIG_STM_ELF_EXTENSIONS
+
+/* Whole image load through libelf, for the ST ELF extensions */
+static int coproc_fw_load_image(struct coproc_fw_loader *ld,
+				const char *name, unsigned long *boot_addr)
+{
+	struct ELF32_LoadParams load_params = ELF_LOADPARAMS_INIT;
+	struct coproc *cop = ld->cop;
+	struct ELF32_info *elfinfo;
+	const struct firmware *fw;
+	u8 *image = NULL;
+	size_t size = 0, alloc = 0;
+	int ret;
+
+	/* Nothing was written to the RAM yet, start over */
+	coproc_fw_stream_close(ld->stream);
+	ld->stream = NULL;
+	ret = coproc_fw_open(ld, name);
+	if (ret)
+		return ret;
+
+	fw = ld->stream->fw;
+	if (fw) {
+		image = (u8 *)fw->data;
+		size = fw->size;
+	} else {
+		/* Compressed images are read until the end of the stream */
+		loff_t end = ld->stream->lower ? 0 :
+			i_size_read(ld->stream->filp->f_path.dentry->d_inode);
+		ssize_t n;
+		u8 *p;
+
+		for (;;) {
+			if (size == alloc) {
+				if (end && size >= end)
+					break;
+				alloc = end ? end :
+					max_t(size_t, 2 * alloc,
+					      COPROC_FW_CHUNK);
+				p = coproc_fw_alloc(ld, alloc);
+				if (!p) {
+					ret = -ENOMEM;
+					goto out;
+				}
+				if (image)
+					memcpy(p, image, size);
+				coproc_fw_free(ld, image, size);
+				image = p;
+			}
+			n = ld->stream->read(ld->stream, image + size,
+					     alloc - size);
+			if (n < 0) {
+				ret = n;
+				goto out;
+			}
+			if (!n)
+				break;
+			size += n;
+		}
+	}
+
+	elfinfo = ELF32_initFromMem(image, size, 0);
+	if (!elfinfo) {
+		coproc_dbg(cop, "Unable to parse ELF file\n");
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (cop->fns->check_elf) {
+		ret = cop->fns->check_elf(cop, elfinfo);
+		if (ret)
+			goto out_free;
+	}
+
+	load_params.numAllowedRanges = 1;
+	load_params.allowedRanges = kmalloc(sizeof(struct ELF32_MemRange),
+					   GFP_KERNEL);
+	if (!load_params.allowedRanges) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+	load_params.allowedRanges[0].base = (Elf32_Addr)cop->ram_phys;
+	load_params.allowedRanges[0].top = (Elf32_Addr)cop->ram_phys +
+								cop->ram_size;
+	ret = ELF32_physLoad(elfinfo, &load_params, (Elf32_Addr *)boot_addr);
+	ELF_LOADPARAMS_FREE(&load_params);
+	if (!ret)
+		ld->loaded = ELF32_checkPhMemSize(elfinfo);
+
+out_free:
+	ELF32_free(elfinfo);
+out:
+	if (!fw)
+		coproc_fw_free(ld, image, alloc);
+	return ret;
+}
+
+#endif /* CONFIG_STM_ELF_EXTENSIONS */
+
+/**
+ * coproc_load_firmware - load the firmware into the coprocessor RAM
+ * @cop: coprocessor, with its RAM (ram_phys/ram_size) allocated
+ * @name: firmware file name
+ * @boot_addr: where the entry point is returned
+ *
+ * Looks for @name (or @name.xz, @name.lzo) in the fw_path directory first,
+ * then asks the firmware loader. Figures are kept in cop->load_stats.
+ */
+int coproc_load_firmware(struct coproc *cop, const char *name,
+			 unsigned long *boot_addr)
+{
+	struct coproc_load_stats *stats = &cop->load_stats;
+	struct coproc_fw_loader *ld;
+	ktime_t start = ktime_get();
+	int ret;
+
+	ld = kzalloc(sizeof(*ld), GFP_KERNEL);
+	if (!ld)
+		return -ENOMEM;
+	ld->cop = cop;
+
+	ret = coproc_fw_open(ld, name);
+	if (ret) {
+		coproc_err(cop, "Unable to open firmware %s (%d)\n", name, ret);
+		goto err_open;
+	}
+
+#ifdef CONFIG_SUPERH
+	ld->ram = ioremap_cache(cop->ram_phys, cop->ram_size);
+#else
+	ld->ram = ioremap_wc(cop->ram_phys, cop->ram_size);
+#endif
+	if (!ld->ram) {
+		ret = -ENOMEM;
+		goto err_ioremap;
+	}
+
+	ld->chunk[0] = kmalloc(COPROC_FW_CHUNK, GFP_KERNEL);
+	if (!ld->chunk[0]) {
+		ret = -ENOMEM;
+		goto err_chunk;
+	}
+	coproc_fw_account(ld, COPROC_FW_CHUNK);
+
+	coproc_fw_dma_init(ld);
+	stats->dma = ld->chan != NULL;
+
+	ret = coproc_fw_load_stream(ld, boot_addr);
+#ifdef CONFIG_STM_ELF_EXTENSIONS
+	if (ret == -ENOEXEC) {
+		coproc_fw_dma_exit(ld);
+		stats->dma = 0;
+		ret = coproc_fw_load_image(ld, name, boot_addr);
+	}
+#endif
+	coproc_fw_dma_exit(ld);
+	if (ret)
+		goto err_load;
+
+	stats->source = ld->source;
+	stats->format = ld->format;
+	stats->read = ld->read;
+	stats->loaded = ld->loaded;
+	stats->peak_mem = ld->peak_mem;
+	stats->time_us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	coproc_info(cop, "%s: %zu bytes loaded from %zu bytes of %s %s "
+		    "in %lu us (%s copy, %zu KiB peak memory)\n", name,
+		    stats->loaded, stats->read, stats->format, stats->source,
+		    stats->time_us, stats->dma ? "DMA" : "CPU",
+		    DIV_ROUND_UP(stats->peak_mem, 1024));
+
+err_load:
+	kfree(ld->chunk[0]);
+err_chunk:
+	iounmap(ld->ram);
+err_ioremap:
+	coproc_fw_stream_close(ld->stream);
+err_open:
+	kfree(ld);
+	return ret;
+}
+EXPORT_SYMBOL(coproc_load_firmware);
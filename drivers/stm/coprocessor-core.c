@@ -50,38 +50,17 @@ static struct bpa2_part *coproc_get_bpa2_area(struct coproc *cop)
 	return bpa2_find_part(coproc_bpa2_name);
 }
 
-static int coproc_load_elf(const struct firmware *fw, struct coproc *cop)
+static int coproc_open(struct coproc *cop)
 {
-	int ret;
-	struct ELF32_info *elfinfo = NULL;
+	char firm_loaded[COPROC_FIRMWARE_NAME_LEN];
 	unsigned long boot_address;
 	unsigned long n_pages;
-	struct ELF32_LoadParams load_params = ELF_LOADPARAMS_INIT;
-
-	elfinfo = ELF32_initFromMem((uint8_t *)fw->data, fw->size, 0);
-	if (elfinfo == NULL) {
-		coproc_dbg(cop, "Unable to parse ELF file\n");
-		ret = -ENOMEM;
-		goto err_elf;
-	}
-
-	if (elfinfo->header->e_type != ET_EXEC) {
-		coproc_dbg(cop, "ELF file is not an executable\n");
-		ret = -EINVAL;
-		goto err_machine;
-	}
-
-	if (elfinfo->header->e_machine != cop->fns->machine) {
-		coproc_dbg(cop, "Unexpected machine flag %d\n",
-				elfinfo->header->e_machine);
-		ret = -EINVAL;
-		goto err_machine;
-	}
+	int result;
 
 	cop->bpa2_partition = coproc_get_bpa2_area(cop);
 	if (!cop->bpa2_partition) {
 		coproc_dbg(cop, "Unable to find BPA2 partition\n");
-		ret = -ENOMEM;
+		result = -ENOMEM;
 		goto err_bpa2_get;
 	}
 
@@ -91,83 +70,37 @@ static int coproc_load_elf(const struct firmware *fw, struct coproc *cop)
 							GFP_KERNEL);
 	if (!cop->bpa2_alloc) {
 		coproc_dbg(cop, "Unable to allocate memory from BPA2\n");
-		ret = -ENOMEM;
+		result = -ENOMEM;
 		goto err_bpa2_alloc;
 	}
 
-	if (cop->fns->check_elf) {
-		ret = cop->fns->check_elf(cop, elfinfo);
-		if (ret)
-			goto err_check_elf;
-	}
-
-	load_params.numAllowedRanges = 1;
-	load_params.allowedRanges = kmalloc(sizeof(struct ELF32_MemRange),
-					   GFP_KERNEL);
-	if (!load_params.allowedRanges)
-		goto err_load;
-	load_params.allowedRanges[0].base = (Elf32_Addr)cop->ram_phys;
-	load_params.allowedRanges[0].top = (Elf32_Addr)cop->ram_phys +
-								cop->ram_size;
-	ret = ELF32_physLoad(elfinfo, &load_params,
-			     (Elf32_Addr *)&boot_address);
-	ELF_LOADPARAMS_FREE(&load_params);
-	if (ret)
-		goto err_load;
-
-	coproc_dbg(cop, "Received firmware size %d bytes\n", fw->size);
-	coproc_dbg(cop, "cop->ram_size    = 0x%lx\n", cop->ram_size);
-	coproc_dbg(cop, "cop->ram_phys  = 0x%lx\n", cop->ram_phys);
-	coproc_dbg(cop, "boot address	= 0x%lx\n", boot_address);
-	coproc_dbg(cop, "Run the Firmware code\n");
-
-	ELF32_free(elfinfo);
-	cop->fns->cpu_grant(cop, boot_address);
-	return 0;
-
-err_load:
-err_check_elf:
-	bpa2_free_pages(cop->bpa2_partition, cop->bpa2_alloc);
-err_bpa2_alloc:
-err_bpa2_get:
-err_machine:
-	ELF32_free(elfinfo);
-err_elf:
-	return ret;
-}
-
-static int coproc_open(struct coproc *cop)
-{
-	char firm_loaded[COPROC_FIRMWARE_NAME_LEN];
-	const struct firmware *fw = NULL;
-	int result;
-
 	/*
 	 * Build the firmware file name.
 	 * We use the standard name: "st_firmware_<SoC>_<cop_name>.elf"
 	 * to specify the video/audio device number
 	 */
-	result = scnprintf(firm_loaded, sizeof(firm_loaded),
+	scnprintf(firm_loaded, sizeof(firm_loaded),
 			"%s_%s_%s%d.elf", COPROC_FIRMWARE_NAME,
 			stm_soc(), cop->name, cop->id);
 
-	coproc_dbg(cop, "Requesting the file %s\n", firm_loaded);
-	result = request_firmware(&fw, firm_loaded, cop->dev);
+	result = coproc_load_firmware(cop, firm_loaded, &boot_address);
 	if (result) {
 		coproc_err(cop, "Error on Firmware Download\n");
-		goto err_request_fw;
+		goto err_load;
 	}
 
-	result = coproc_load_elf(fw, cop);
-	if (result)
-		goto err_load;
+	coproc_dbg(cop, "cop->ram_size    = 0x%lx\n", cop->ram_size);
+	coproc_dbg(cop, "cop->ram_phys  = 0x%lx\n", cop->ram_phys);
+	coproc_dbg(cop, "boot address	= 0x%lx\n", boot_address);
+	coproc_dbg(cop, "Run the Firmware code\n");
 
-	release_firmware(fw);
+	cop->fns->cpu_grant(cop, boot_address);
 	return 0;
 
 err_load:
-	release_firmware(fw);
-err_request_fw:
+	bpa2_free_pages(cop->bpa2_partition, cop->bpa2_alloc);
+err_bpa2_alloc:
+err_bpa2_get:
 	return result;
 }
 
@@ -283,6 +216,24 @@ static ssize_t coproc_show_mem_base(struct device *dev,
 }
 
 static DEVICE_ATTR(mem_base, S_IRUGO, coproc_show_mem_base, NULL);
+
+static ssize_t coproc_show_load_stats(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct coproc *cop = dev_get_drvdata(dev);
+	struct coproc_load_stats *stats = &cop->load_stats;
+
+	if (!stats->source)
+		return snprintf(buf, PAGE_SIZE, "none\n");
+
+	return snprintf(buf, PAGE_SIZE, "source=%s format=%s copy=%s "
+			"read=%zu loaded=%zu peak_mem=%zu time_us=%lu\n",
+			stats->source, stats->format,
+			stats->dma ? "dma" : "cpu", stats->read,
+			stats->loaded, stats->peak_mem, stats->time_us);
+}
+
+static DEVICE_ATTR(load_stats, S_IRUGO, coproc_show_load_stats, NULL);
 /* End: ST-Coprocessor Device Attribute SysFs*/
 
 int coproc_device_add(struct coproc *cop)
@@ -310,10 +261,15 @@ int coproc_device_add(struct coproc *cop)
 	ret = device_create_file(cop->dev, &dev_attr_mem_base);
 	if (ret)
 		goto err_attr_base;
+	ret = device_create_file(cop->dev, &dev_attr_load_stats);
+	if (ret)
+		goto err_attr_stats;
 
 	coproc_info(cop, "coprocessor initialized\n");
 	return 0;
 
+err_attr_stats:
+	device_remove_file(cop->dev, &dev_attr_mem_base);
 err_attr_base:
 	device_remove_file(cop->dev, &dev_attr_mem_size);
 err_attr_size:
@@ -332,6 +288,7 @@ int coproc_device_remove(struct coproc *cop)
 	device_remove_file(cop->dev, &dev_attr_state);
 	device_remove_file(cop->dev, &dev_attr_mem_size);
 	device_remove_file(cop->dev, &dev_attr_mem_base);
+	device_remove_file(cop->dev, &dev_attr_load_stats);
 	device_unregister(cop->dev);
 	return 0;
 }
@@ -17,6 +17,17 @@
 
 struct coproc_fns;
 
+/* Figures of the last firmware load */
+struct coproc_load_stats {
+	const char *source;	/* "file" or "firmware" */
+	const char *format;	/* "elf", "xz" or "lzo" */
+	int dma;		/* Segments copied by DMA */
+	size_t read;		/* Bytes read from the source */
+	size_t loaded;		/* Bytes written to the coprocessor RAM */
+	size_t peak_mem;	/* Peak memory used by the loader */
+	unsigned long time_us;	/* Time taken by the load */
+};
+
 enum coproc_state {
 	coproc_state_idle,
 	coproc_state_running,
@@ -32,6 +43,7 @@ struct coproc {
 	u_long	    ram_phys;		/* Coprocessor RAM physical address */
 	u_long	    ram_size;		/* Coprocessor RAM size (in bytes)  */
 	unsigned long bpa2_alloc;	/* Start of allocated BPS2 memory */
+	struct coproc_load_stats load_stats;
 
 	struct device *parent;
 	struct device *dev;
@@ -65,6 +77,10 @@ struct coproc_fns {
 int coproc_device_remove(struct coproc *cop);
 int coproc_device_add(struct coproc *cop);
 
+/* coprocessor firmware loader */
+int coproc_load_firmware(struct coproc *cop, const char *name,
+			 unsigned long *boot_addr);
+
 /* coprocessor reset bypass controller interface */
 void coproc_reset_bypass_pre(void);
 void coproc_reset_bypass_post(void);
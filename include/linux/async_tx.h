@@ -182,6 +182,16 @@ async_memcpy(struct page *dest, struct page *src, unsigned int dest_offset,
 	     unsigned int src_offset, size_t len,
 	     struct async_submit_ctl *submit);
 
+#ifdef CONFIG_ASYNC_TX_DMA_COPY
+int async_copy_pages(struct page *dest, struct page *src, size_t len);
+#else
+static inline int
+async_copy_pages(struct page *dest, struct page *src, size_t len)
+{
+	return -ENODEV;
+}
+#endif
+
 struct dma_async_tx_descriptor *
 async_memset(struct page *dest, int val, unsigned int offset,
 	     size_t len, struct async_submit_ctl *submit);
@@ -29,6 +29,13 @@
 
 #define BPA2_NORMAL    0x00000001
 
+/* Placement policies (default is first-fit) */
+#define BPA2_POLICY_MASK 0x000000f0
+#define BPA2_FIRST_FIT   0x00000000
+#define BPA2_BEST_FIT    0x00000010
+#define BPA2_NEXT_FIT    0x00000020
+#define BPA2_SEGREGATED  0x00000030 /* small from top, large from bottom */
+
 struct bpa2_partition_desc {
 	const char *name;
 	unsigned long start;
@@ -43,6 +50,10 @@ void bpa2_init(struct bpa2_partition_desc *partdescs, int nparts);
 
 struct bpa2_part *bpa2_find_part(const char *name);
 int bpa2_low_part(struct bpa2_part *part);
+int bpa2_set_policy(struct bpa2_part *part, unsigned long policy);
+unsigned long bpa2_get_policy(struct bpa2_part *part);
+int bpa2_fragmentation(struct bpa2_part *part, unsigned long *free_total,
+		unsigned long *free_max);
 struct bpa2_part *bpa2_find_part_addr(unsigned long base, unsigned long size);
 
 #if defined(CONFIG_BPA2_ALLOC_TRACE)
@@ -60,6 +71,19 @@ void bpa2_free_pages(struct bpa2_part *part, unsigned long base);
 void bpa2_memory(struct bpa2_part *part, unsigned long *base,
 		 unsigned long *size);
 
+/*
+ * Object caches (fixed size blocks recycled through per-CPU magazines)
+ */
+
+struct bpa2_cache;
+
+struct bpa2_cache *bpa2_cache_create(struct bpa2_part *part,
+		unsigned long size, int align);
+void bpa2_cache_destroy(struct bpa2_cache *cache);
+void bpa2_cache_shrink(struct bpa2_cache *cache);
+unsigned long bpa2_cache_alloc(struct bpa2_cache *cache);
+void bpa2_cache_free(struct bpa2_cache *cache, unsigned long base);
+
 /*
  * Backward compatibility interface (bigphysarea)
  */
@@ -114,6 +114,8 @@ struct nand_ecclayout {
 
 struct module;	/* only needed for owner field in mtd_info */
 
+struct mtd_rcache;
+
 struct mtd_info {
 	u_char type;
 	uint32_t flags;
@@ -237,6 +239,10 @@ struct mtd_info {
 	int subpage_sft;
 
 	void *priv;
+#ifdef CONFIG_MTD_READ_CACHE
+	/* Read cache, see mtd_rcache_attach() */
+	struct mtd_rcache *rcache;
+#endif
 
 	struct module *owner;
 	struct device dev;
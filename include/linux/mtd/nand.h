@@ -669,6 +669,12 @@ extern void nand_sync(struct mtd_info *mtd);
 extern uint8_t *nand_transfer_oob(struct nand_chip *chip, uint8_t *oob,
 				  struct mtd_oob_ops *ops, size_t len);
 extern int nand_check_wp(struct mtd_info *mtd);
+extern int nand_check_erased_buf(const void *buf, int len,
+				 int bitflips_threshold);
+extern int nand_check_erased_ecc_chunk(void *data, int datalen,
+				       void *ecc, int ecclen,
+				       void *extraoob, int extraooblen,
+				       int bitflips_threshold);
 extern uint8_t *nand_fill_oob(struct mtd_info *mtd, uint8_t *oob, size_t len,
 			      struct mtd_oob_ops *ops);
 extern int nand_do_write_oob(struct mtd_info *mtd, loff_t to,
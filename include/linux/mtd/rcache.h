@@ -0,0 +1,34 @@
+/*
+ * MTD read cache and read-ahead layer definitions
+ *
+ * Copyright (C) 2013 STMicroelectronics Limited
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef MTD_RCACHE_H
+#define MTD_RCACHE_H
+
+struct mtd_info;
+
+#ifdef CONFIG_MTD_READ_CACHE
+int mtd_rcache_attach(struct mtd_info *mtd, unsigned int block_size,
+		      unsigned int nr_blocks);
+void mtd_rcache_detach(struct mtd_info *mtd);
+#else
+static inline int mtd_rcache_attach(struct mtd_info *mtd,
+				    unsigned int block_size,
+				    unsigned int nr_blocks)
+{
+	return 0;
+}
+
+static inline void mtd_rcache_detach(struct mtd_info *mtd)
+{
+}
+#endif
+
+#endif
@@ -45,6 +45,14 @@ void mtt_kptrace_stop(void);
 int mtt_kptrace_comp_alloc(void);
 
 /* KPTrace defs */
+struct kp_tracepoint;
+
+/* Static kernel tracepoint (TRACE_EVENT), used instead of the kprobes */
+struct kp_static_event {
+	int (*reg)(struct kp_tracepoint *tp);
+	void (*unreg)(struct kp_tracepoint *tp);
+};
+
 struct kp_tracepoint {
 	struct kprobe kp;
 	struct kretprobe rp;
@@ -56,6 +64,9 @@ struct kp_tracepoint {
 	int starton;
 	int user_tracepoint;
 	int late_tracepoint;
+	const struct kp_static_event *event;
+	unsigned long event_arg;	/* Softirq number, irq flow handler */
+	uint32_t event_loc;		/* Trace ID of the records */
 	const struct file_operations *ops;
 	struct list_head list;
 };
@@ -74,6 +85,13 @@ struct kp_tracepoint *kptrace_create_tracepoint(
 	int (*return_handler)(struct kretprobe_instance *, struct pt_regs *)
 );
 
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+struct kp_tracepoint *kptrace_create_sched_switch_tracepoint(
+	struct kp_tracepoint_set *set,
+	const char *name
+);
+#endif
+
 /* Per-architecture hooks. */
 extern void arch_init_syscall_logging(struct kp_tracepoint_set *set);
 extern void arch_init_core_event_logging(struct kp_tracepoint_set *set);
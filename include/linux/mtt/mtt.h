@@ -175,6 +175,8 @@ struct mtt_output_driver {
 			 null-terminated string too look at KPT_GUID_DFS */
 	void *private;
 	mtt_return_t last_error;
+	int lockless;	/* write_func does its own (per-cpu) locking,
+			   don't serialize the callers on mttlib_lock */
 };
 
 /* Register/unregister alternative drivers. */
@@ -190,6 +192,14 @@ void mtt_pkt_put(mtt_packet_t *p);
 
 void mtt_relay_cleanup(void);
 
+#ifdef CONFIG_MTT_RING
+int __init mtt_ring_init(void);
+void mtt_ring_cleanup(void);
+#else
+static inline int mtt_ring_init(void) { return 0; }
+static inline void mtt_ring_cleanup(void) { }
+#endif
+
 int __init mtt_stm_init(void *);
 void __exit mtt_stm_cleanup(void);
 
@@ -42,6 +42,39 @@
 #define  MTT_DRV_GUID_STM \
 	(('s' << 0) + ('t' << 8) + ('m' << 16) + ('\0' << 24))
 
+/* Data leaves the kernel through per-cpu rings (mmaped from debugfs)*/
+#define MTT_DRV_GUID_RNG \
+	(('r' << 0) + ('n' << 8) + ('g' << 16) + ('\0' << 24))
+
+/* Control page at the start of each ring, the data area follows
+ * at offset PAGE_SIZE. head/tail are free running byte counters:
+ * the consumer reads up to head, then stores the new tail after
+ * a full memory barrier, so that its reads of the data area are
+ * complete before the kernel may overwrite it. */
+#define MTT_RING_MAGIC 0x4d545452 /* 'MTTR' */
+
+struct mtt_ring_ctrl {
+	uint32_t magic;
+	uint32_t size;		/* Size of the data area (power of 2) */
+	uint32_t head;		/* Committed by the kernel */
+	uint32_t tail;		/* Consumed by the reader */
+	uint32_t dropped;	/* Records lost because the ring was full */
+	uint32_t cpu;
+};
+
+/* Ring records: a 32 bits header (type, length in bytes including the
+ * header, multiple of 4), then
+ *  MTT_RING_DATA:    u32 nanoseconds since previous record, MTT frame.
+ *  MTT_RING_TIME:    u64 nanoseconds local_clock() timestamp.
+ *  MTT_RING_PADDING: nothing, skip to the start of the data area. */
+#define MTT_RING_DATA 0
+#define MTT_RING_TIME 1
+#define MTT_RING_PADDING 2
+
+#define MTT_RING_HDR(type, len) (((type) << 16) | (len))
+#define MTT_RING_HDR_TYPE(hdr) ((hdr) >> 16)
+#define MTT_RING_HDR_LEN(hdr) ((hdr) & 0xffff)
+
 /* Linux trace session parameters (from GUI FRONTEND)*/
 struct mtt_linux_cfg {
 	uint32_t verbose;
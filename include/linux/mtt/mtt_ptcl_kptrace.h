@@ -132,7 +132,11 @@ enum kpt_key_indexes {
 	KEY_MH = 0x00490000,
 	KEY_Mh = 0x004a0000,
 	KEY_MI = 0x004b0000,
-	KEY_C = 0x004c0000
+	KEY_C = 0x004c0000,
+	KEY_KF = 0x004d0000,	/*kpprintf format string definition */
+	KEY_KA = 0x004e0000,	/*kpprintf binary arguments */
+	KEY_YE = 0x004f0000,	/*sys_enter, syscall number in trace id */
+	KEY_Yx = 0x00500000	/*sys_exit, syscall number in trace id */
 };
 
 /* argument types, in the case of syscall
@@ -411,6 +411,12 @@ struct stm_plat_nand_bch_data {
 	 * <ecc-strength>.
 	 */
 	unsigned int bch_bitflip_threshold;
+
+	/* Maximum number of pages read by a single chain of BCH sequences
+	 * when reading several whole pages (0 or 1 disables read-ahead, at
+	 * most 8).
+	 */
+	unsigned int bch_read_ahead;
 	bool flashss;
 };
 
@@ -475,6 +481,13 @@ struct stm_plat_spifsm_data {
 	unsigned int		max_freq;
 	struct stm_pad_config	*pads;
 	struct stm_spifsm_caps	capabilities;
+
+	/* Reads through the "spi-fsm-mmap" memory-mapped window resource, by
+	 * the CPU and/or by DMA (for transfers of at least dma_threshold
+	 * bytes, 0 for the default), instead of the FSM FIFO */
+	unsigned int		mmap_read;
+	unsigned int		dma_read;
+	unsigned int		dma_threshold;
 };
 
 
@@ -530,6 +543,7 @@ struct stm_plat_fdma_data {
 	struct stm_plat_fdma_hw *hw;
 	struct stm_plat_fdma_fw_regs *fw;
 	u8 xbar;
+	u8 memcpy_channels;	/* Last channels published for memcpy */
 };
 
 struct stm_plat_fdma_xbar_data {
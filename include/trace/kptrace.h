@@ -38,7 +38,10 @@ void kptrace_mark(void);
 void kptrace_write_record(const char *buf);
 
 /* Allow printf-style records to be added. Note that kptrace_write_record
- * is a lighter alternative when no formatting is required. */
+ * is a lighter alternative when no formatting is required.
+ * With CONFIG_KPTRACE_BINARY_PRINTF the formatting is deferred to the
+ * decoder: fmt must then stay valid for the whole trace session, which
+ * is the case for string literals. */
 void kpprintf(char *fmt, ...);
 
 /* Stop logging trace records until kptrace_restart() is called */
@@ -619,6 +619,7 @@ static int __init mtt_core_init(void)
 
 	/* Init the builtin drivers. */
 	mtt_relay_init();
+	mtt_ring_init();
 
 	/* Set the output driver to the default one. */
 	mtt_core_reset_cfg();
@@ -642,6 +643,7 @@ static void __exit mtt_core_cleanup(void)
 	mtt_stop_tracing();
 
 	/* Unregister builtin output drivers */
+	mtt_ring_cleanup();
 	mtt_relay_cleanup();
 
 	mtt_pkt_cleanup();
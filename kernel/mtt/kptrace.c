@@ -29,6 +29,19 @@
 #include <net/sock.h>
 #include <asm/sections.h>
 #include <linux/relay.h>
+#include <linux/hash.h>
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/tracepoint.h>
+#include <trace/events/irq.h>
+#include <trace/events/kmem.h>
+#include <trace/events/sched.h>
+#ifdef CONFIG_HAVE_SYSCALL_TRACEPOINTS
+#include <trace/events/syscalls.h>
+#include <asm/syscall.h>
+#endif
+#endif
 
 #include <linux/mtt/kptrace.h>
 #include <asm/mtt-kptrace.h>
@@ -58,6 +71,12 @@ static int logging;
 #define MAX_SYMBOL_SIZE 512	/*fixme */
 #define MAX_STRING_SIZE 512
 
+#ifdef CONFIG_KPTRACE_BINARY_PRINTF
+/* Format strings already defined in this session, by hash of address */
+#define KPPRINTF_FMT_BITS 8
+static const char *kpprintf_fmts[1 << KPPRINTF_FMT_BITS];
+#endif
+
 static char user_new_symbol[MAX_SYMBOL_SIZE];
 static int user_pre_handler(struct kprobe *p, struct pt_regs *regs);
 static int user_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs);
@@ -553,6 +572,46 @@ struct kp_tracepoint *kptrace_create_late_aliased_tracepoint(struct
 }
 #endif
 
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+/*
+ * Creates a tracepoint hooked on a static kernel tracepoint rather than
+ * on kprobes. It is exposed in sysfs as "name", the function it replaces,
+ * and its records use the address of this function as trace ID, so that
+ * they are identical to the ones of the kprobe version.
+ */
+static struct kp_tracepoint *kptrace_create_static_tracepoint(
+				struct kp_tracepoint_set *set,
+				const char *name,
+				const struct kp_static_event *event,
+				unsigned long event_arg)
+{
+	struct kp_tracepoint *tp;
+	tp = kzalloc(sizeof(*tp), GFP_KERNEL);
+	if (!tp) {
+		printk(KERN_WARNING
+		       "kptrace: Failed to allocate memory for tracepoint %s\n",
+		       name);
+		return NULL;
+	}
+
+	tp->inserted = TP_UNUSED;
+	tp->event = event;
+	tp->event_arg = event_arg;
+	tp->event_loc = (uint32_t)kallsyms_lookup_name(name);
+
+	list_add(&tp->list, &tracepoints);
+
+	if (kobject_init_and_add(&tp->kobj, &kp_tracepointype, &set->kobj,
+				 name) < 0) {
+		printk(KERN_WARNING "kptrace: Failed add to add kobject %s\n",
+		       name);
+		return NULL;
+	}
+
+	return tp;
+}
+#endif
+
 /*
  * Registers the kprobes for the tracepoint, so that it will start to
  * be logged.
@@ -565,6 +624,15 @@ struct kp_tracepoint *kptrace_create_late_aliased_tracepoint(struct
 static int insert_tracepoint(struct kp_tracepoint *tp)
 {
 	int r = 0;
+	if (tp->event) {
+		if (tp->inserted != TP_INUSE) {
+			r = tp->event->reg(tp);
+			if (!r)
+				tp->inserted = TP_INUSE;
+		}
+		return r;
+	}
+
 	if (tp->inserted != TP_INUSE) {
 		if (tp->kp.addr != NULL)
 			r += register_kprobe(&tp->kp);
@@ -606,6 +674,12 @@ static int insert_tracepoints_in_set(struct kp_tracepoint_set *set)
  */
 int unregister_tracepoint(struct kp_tracepoint *tp)
 {
+	if (tp->event) {
+		tp->event->unreg(tp);
+		tp->inserted = TP_USED;
+		return 0;
+	}
+
 	if (tp->kp.addr != NULL) {
 		if (tp->late_tracepoint)
 			arch_disarm_kprobe(&tp->kp);
@@ -681,6 +755,11 @@ int mtt_kptrace_start(void)
 		}
 	}
 
+#ifdef CONFIG_KPTRACE_BINARY_PRINTF
+	/* Each session must carry its own format definitions. */
+	memset(kpprintf_fmts, 0, sizeof(kpprintf_fmts));
+#endif
+
 	logging = 1;
 	return 0;
 }
@@ -813,6 +892,90 @@ void kptrace_write_record(const char *buf)
 }
 EXPORT_SYMBOL(kptrace_write_record);
 
+#ifdef CONFIG_KPTRACE_BINARY_PRINTF
+/*
+ * Send the format string once, so that the decoder can map its
+ * address to the text. Collisions in the table only cause the
+ * definition to be sent again.
+ */
+static void kpprintf_define(const char *fmt, uint32_t loc)
+{
+	mtt_packet_t *pkt;
+	uint32_t h = hash_ptr((void *)fmt, KPPRINTF_FMT_BITS);
+	uint32_t size;
+	uint32_t *data;
+
+	if (likely(ACCESS_ONCE(kpprintf_fmts[h]) == fmt))
+		return;
+
+	kpprintf_fmts[h] = fmt;
+
+	data = mtt_kptrace_pkt_get(0, &pkt, loc);
+
+	data[0] = KEY_KF | KEY_ARGH(0) | KEY_ARGS(1);
+	data[1] = (uint32_t)fmt;
+
+	size = strnlen(fmt, MAX_STRING_SIZE - 1);
+	memcpy((char *)(&data[2]), fmt, size);
+	((char *)(&data[2]))[size] = '\0';
+
+	/* Add key and address size to string size */
+	size += 1 + 4 * 2;
+
+	mtt_pkt_update_align32(pkt->length, size);
+
+	pkt->u.preamble->type_info = MTT_TRACEITEM_BLOB(size);
+
+	mtt_kptrace_pkt_put(pkt);
+}
+
+/*
+ * Binary kpprintf: the record holds the format address and the
+ * arguments as laid out by vbin_printf(), to be formatted with
+ * bstr_printf() (or equivalent) by the decoder.
+ */
+void kpprintf(char *fmt, ...)
+{
+	va_list ap;
+	mtt_packet_t *pkt;
+	uint32_t loc = (uint32_t) __builtin_return_address(0);
+	uint32_t size;
+	uint32_t *data;
+	int words;
+
+	if (unlikely(!logging))
+		return;
+
+	kpprintf_define(fmt, loc);
+
+	data = mtt_kptrace_pkt_get(0, &pkt, loc);
+
+	data[0] = KEY_KA | KEY_ARGH(0);
+	data[1] = (uint32_t)fmt;
+
+	va_start(ap, fmt);
+	words = vbin_printf(&data[2], MAX_STRING_SIZE / 4, fmt, ap);
+	va_end(ap);
+
+	if (likely(words <= MAX_STRING_SIZE / 4)) {
+		size = 4 * (2 + words);
+	} else {
+		/* Arguments too big (long %s), fall back to text. */
+		data[0] = KEY_K | KEY_ARGS(0);
+		va_start(ap, fmt);
+		size = 1 + vsnprintf((char *)(&data[1]), MAX_STRING_SIZE,
+				     fmt, ap);
+		va_end(ap);
+		size = min_t(uint32_t, size, MAX_STRING_SIZE) + 4 * 1;
+	}
+
+	mtt_pkt_update_align32(pkt->length, size);
+
+	pkt->u.preamble->type_info = MTT_TRACEITEM_BLOB(size);
+
+	mtt_kptrace_pkt_put(pkt);
+}
+#else
 void kpprintf(char *fmt, ...)
 {
 	va_list ap;
@@ -846,6 +1009,7 @@ void kpprintf(char *fmt, ...)
 
 	mtt_kptrace_pkt_put(pkt);
 }
+#endif
 EXPORT_SYMBOL(kpprintf);
 
 /*
@@ -899,22 +1063,26 @@ vmalloc_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
 	return _gen_ret_handler(ri, regs, KEY_Mv | KEY_ARGI(0));
 }
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 static int
 get_free_pages_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
 {
 	return _gen_ret_handler(ri, regs, KEY_Mg | KEY_ARGI(0));
 }
+#endif
 
 int alloc_pages_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
 {
 	return _gen_ret_handler(ri, regs, KEY_Ma | KEY_ARGI(0));
 }
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 static int
 kmem_cache_alloc_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
 {
 	return _gen_ret_handler(ri, regs, KEY_Ms | KEY_ARGI(0));
 }
+#endif
 
 static int user_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
 {
@@ -926,11 +1094,13 @@ int syscall_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
 	return _gen_ret_handler(ri, regs, KEY_X | KEY_ARGI(0));
 }
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 static int
 kmalloc_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
 {
 	return _gen_ret_handler(ri, regs, KEY_Mm | KEY_ARGI(0));
 }
+#endif
 
 #ifdef CONFIG_KPTRACE_SYNC
 static int
@@ -1047,6 +1217,7 @@ static int vfree_pre_handler(struct kprobe *p, struct pt_regs *regs)
 	return mtt_kptrace_pkt_put(pkt);
 }
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 static int wake_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
 	mtt_packet_t *pkt;
@@ -1070,7 +1241,9 @@ static int wake_pre_handler(struct kprobe *p, struct pt_regs *regs)
 	mtt_sys_config.params = old_params;
 	return mtt_kptrace_pkt_put(pkt);
 }
+#endif
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 static int
 softirq_rp_handler(struct kretprobe_instance *ri, struct pt_regs *regs)
 {
@@ -1103,6 +1276,7 @@ static int irq_KEY_I_handler(struct kprobe *kp, struct pt_regs *regs)
 	}
 	return 0;
 }
+#endif
 
 #define def_irq_any_handler(EVENT_KEY)\
 static int irq_##EVENT_KEY##_handler(struct kretprobe_instance *ri, \
@@ -1131,7 +1305,9 @@ static int irq_##EVENT_KEY##_handler(struct kretprobe_instance *ri, \
 }
 
 def_irq_any_handler(KEY_Ix);
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 def_irq_any_handler(KEY_i);
+#endif
 
 /* ================ ENTRY HANDLERS =============*/
 
@@ -1198,10 +1374,12 @@ static int kernel_thread_pre_handler(struct kprobe *p, struct pt_regs *regs)
 	return _gen_pre1_handler(p, regs, KEY_KT | KEY_ARGH(0));
 }
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 static int kfree_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
 	return _gen_pre1_handler(p, regs, KEY_MF | KEY_ARGH(0));
 }
+#endif
 
 static int vmalloc_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
@@ -1521,6 +1699,7 @@ static int hash_futex_handler(struct kprobe *p, struct pt_regs *regs)
 	return mtt_kptrace_pkt_put(pkt);
 }
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 static int kmalloc_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
 	return _gen_pre2_handler(p, regs, KEY_MM);
@@ -1530,12 +1709,14 @@ static int get_free_pages_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
 	return _gen_pre2_handler(p, regs, KEY_MG);
 }
+#endif
 
 int alloc_pages_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
 	return _gen_pre2_handler(p, regs, KEY_MA);
 }
 
+#ifndef CONFIG_KPTRACE_STATIC_EVENTS
 static int free_pages_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
 	return _gen_pre2_handler(p, regs, KEY_MZ);
@@ -1550,6 +1731,7 @@ static int kmem_cache_free_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
 	return _gen_pre2_handler(p, regs, KEY_MX);
 }
+#endif
 
 #if defined(CONFIG_BPA2) || defined(CONFIG_BIGPHYS_AREA)
 static int bpa2_free_pages_pre_handler(struct kprobe *p, struct pt_regs *regs)
@@ -1790,6 +1972,436 @@ static int _gen_sem_activity_handler(struct kprobe *p, struct pt_regs *regs,
 }
 #endif /* CONFIG_KPTRACE_SYNC */
 
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+/* ================ STATIC TRACEPOINT PROBES =============
+ *
+ * These are called from the TRACE_EVENT hooks of the kernel, with the
+ * kp_tracepoint as data, and build the same records as the kprobe
+ * handlers they replace.
+ */
+
+static void kpt_event0(uint32_t loc, uint32_t key)
+{
+	mtt_packet_t *pkt;
+	uint32_t *data;
+
+	data = mtt_kptrace_pkt_get(MTT_TRACEITEM_PTR32, &pkt, loc);
+	*data = key;
+
+	mtt_kptrace_pkt_put(pkt);
+}
+
+static void kpt_event1(uint32_t loc, uint32_t key, uint32_t arg0)
+{
+	mtt_packet_t *pkt;
+	uint32_t *data;
+	uint32_t type_info =
+	    MTT_TYPE(MTT_TRACEITEM_INT32, MTT_TYPEP_VECTOR, sizeof(uint32_t),
+		     2);
+
+	data = mtt_kptrace_pkt_get(type_info, &pkt, loc);
+
+	data[0] = key;
+	data[1] = arg0;
+
+	mtt_kptrace_pkt_put(pkt);
+}
+
+static void kpt_event2(uint32_t loc, uint32_t key, uint32_t arg0,
+		       uint32_t arg1)
+{
+	mtt_packet_t *pkt;
+	uint32_t *data;
+	uint32_t type_info =
+	    MTT_TYPE(MTT_TRACEITEM_INT32, MTT_TYPEP_VECTOR, sizeof(uint32_t),
+		     3);
+
+	data = mtt_kptrace_pkt_get(type_info, &pkt, loc);
+
+	data[0] = key;
+	data[1] = arg0;
+	data[2] = arg1;
+
+	mtt_kptrace_pkt_put(pkt);
+}
+
+/* kmalloc, kmalloc_node: same records as __kmalloc entry/return,
+ * attributed to the caller. */
+static void kpt_kmalloc_probe(void *data, unsigned long call_site,
+			      const void *ptr, size_t bytes_req,
+			      size_t bytes_alloc, gfp_t gfp_flags)
+{
+	if (unlikely(!logging))
+		return;
+
+	kpt_event2(call_site, KEY_MM | KEY_ARGH(0) | KEY_ARGI(1),
+		   bytes_req, gfp_flags);
+	kpt_event1(call_site, KEY_Mm | KEY_ARGI(0), (uint32_t)ptr);
+}
+
+static void kpt_kmalloc_node_probe(void *data, unsigned long call_site,
+				   const void *ptr, size_t bytes_req,
+				   size_t bytes_alloc, gfp_t gfp_flags,
+				   int node)
+{
+	kpt_kmalloc_probe(data, call_site, ptr, bytes_req, bytes_alloc,
+			  gfp_flags);
+}
+
+/* The cache is not known here, it is identified by its object size. */
+static void kpt_kmem_cache_alloc_probe(void *data, unsigned long call_site,
+				       const void *ptr, size_t bytes_req,
+				       size_t bytes_alloc, gfp_t gfp_flags)
+{
+	if (unlikely(!logging))
+		return;
+
+	kpt_event2(call_site, KEY_MS | KEY_ARGH(0) | KEY_ARGI(1),
+		   bytes_alloc, gfp_flags);
+	kpt_event1(call_site, KEY_Ms | KEY_ARGI(0), (uint32_t)ptr);
+}
+
+static void kpt_kmem_cache_alloc_node_probe(void *data,
+					    unsigned long call_site,
+					    const void *ptr, size_t bytes_req,
+					    size_t bytes_alloc,
+					    gfp_t gfp_flags, int node)
+{
+	kpt_kmem_cache_alloc_probe(data, call_site, ptr, bytes_req,
+				   bytes_alloc, gfp_flags);
+}
+
+static void kpt_kfree_probe(void *data, unsigned long call_site,
+			    const void *ptr)
+{
+	if (unlikely(!logging))
+		return;
+
+	kpt_event1(call_site, KEY_MF | KEY_ARGH(0), (uint32_t)ptr);
+}
+
+static void kpt_kmem_cache_free_probe(void *data, unsigned long call_site,
+				      const void *ptr)
+{
+	if (unlikely(!logging))
+		return;
+
+	kpt_event2(call_site, KEY_MX | KEY_ARGH(0) | KEY_ARGI(1),
+		   0, (uint32_t)ptr);
+}
+
+/* All the page allocations, not only the __get_free_pages() ones. */
+static void kpt_mm_page_alloc_probe(void *data, struct page *page,
+				    unsigned int order, gfp_t gfp_flags,
+				    int migratetype)
+{
+	struct kp_tracepoint *tp = data;
+
+	if (unlikely(!logging))
+		return;
+
+	kpt_event2(tp->event_loc, KEY_MG | KEY_ARGH(0) | KEY_ARGI(1),
+		   gfp_flags, order);
+	kpt_event1(tp->event_loc, KEY_Mg | KEY_ARGI(0),
+		   page ? (uint32_t)page_address(page) : 0);
+}
+
+static void kpt_mm_page_free_probe(void *data, struct page *page,
+				   unsigned int order)
+{
+	struct kp_tracepoint *tp = data;
+
+	if (unlikely(!logging))
+		return;
+
+	kpt_event2(tp->event_loc, KEY_MZ | KEY_ARGH(0) | KEY_ARGI(1),
+		   (uint32_t)page_address(page), order);
+}
+
+/* Same as irq_KEY_I_handler, on the dedicated channel */
+static void kpt_irq_record(int irq, uint32_t key)
+{
+	long core;
+	mtt_packet_t *pkt;
+	uint32_t *data;
+
+	core = raw_smp_processor_id();
+
+	/* allocate or retrieve a preallocated TRACE frame */
+	pkt = &mtt_pkts_irqs[core];
+
+	/* the irq number is in traceid in that peculiar case. */
+	data = (uint32_t *) mtt_pkt_get(mtt_comp_irqs[core], pkt,
+					MTT_TRACEITEM_UINT32, irq);
+	data[0] = key;
+
+	/*tell the output driver to lock if she needs to. */
+	mtt_cur_out_drv->write_func(pkt, DRVLOCK);
+}
+
+/*
+ * One probe per flow handler tracepoint, filtering the irqs handled by
+ * its own flow handler, as the kprobe on that handler would.
+ */
+static inline int kpt_irq_selected(struct kp_tracepoint *tp, int irq)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+
+	return desc && desc->handle_irq == (irq_flow_handler_t)tp->event_arg;
+}
+
+static void kpt_irq_entry_probe(void *data, int irq,
+				struct irqaction *action)
+{
+	if (likely(logging) && kpt_irq_selected(data, irq))
+		kpt_irq_record(irq, KEY_I);
+}
+
+static void kpt_irq_exit_probe(void *data, int irq,
+			       struct irqaction *action, int ret)
+{
+	if (likely(logging) && kpt_irq_selected(data, irq))
+		kpt_irq_record(irq, KEY_i);
+}
+
+/* One probe per softirq tracepoint, filtering its own vector. */
+static void kpt_softirq_entry_probe(void *data, unsigned int vec_nr)
+{
+	struct kp_tracepoint *tp = data;
+
+	if (unlikely(!logging) || vec_nr != tp->event_arg)
+		return;
+
+	kpt_event0(tp->event_loc, KEY_S);
+}
+
+static void kpt_softirq_exit_probe(void *data, unsigned int vec_nr)
+{
+	struct kp_tracepoint *tp = data;
+
+	if (unlikely(!logging) || vec_nr != tp->event_arg)
+		return;
+
+	kpt_event0(tp->event_loc, KEY_s);
+}
+
+static void kpt_sched_switch_probe(void *data, struct task_struct *prev,
+				   struct task_struct *next)
+{
+	if (unlikely(!logging))
+		return;
+
+	mtt_cswitch(prev->pid, next->pid);
+}
+
+static void kpt_sched_wakeup_probe(void *data, struct task_struct *p,
+				   int success)
+{
+	struct kp_tracepoint *tp = data;
+	uint32_t old_params = mtt_sys_config.params;
+
+	if (unlikely(!logging))
+		return;
+
+	/* If we try and put a timestamp on this, we'll cause a deadlock */
+	mtt_sys_config.params &= ~(MTT_PARAM_TSTV | MTT_PARAM_TS64);
+
+	kpt_event1(tp->event_loc, KEY_W | KEY_ARGI(0), p->pid);
+
+	mtt_sys_config.params = old_params;
+}
+
+#ifdef CONFIG_HAVE_SYSCALL_TRACEPOINTS
+/* The syscall number is in traceid, as for the irqs. */
+static void kpt_sys_enter_probe(void *tp, struct pt_regs *regs, long id)
+{
+	mtt_packet_t *pkt;
+	unsigned long args[4];
+	uint32_t *data;
+	uint32_t type_info =
+	    MTT_TYPE(MTT_TRACEITEM_INT32, MTT_TYPEP_VECTOR, sizeof(uint32_t),
+		     5);
+
+	if (unlikely(!logging))
+		return;
+
+	syscall_get_arguments(current, regs, 0, 4, args);
+
+	data = mtt_kptrace_pkt_get(type_info, &pkt, id);
+
+	data[0] = KEY_YE | KEY_ARGS_HHHH;
+	data[1] = args[0];
+	data[2] = args[1];
+	data[3] = args[2];
+	data[4] = args[3];
+
+	mtt_kptrace_pkt_put(pkt);
+}
+
+static void kpt_sys_exit_probe(void *data, struct pt_regs *regs, long ret)
+{
+	if (unlikely(!logging))
+		return;
+
+	kpt_event1(syscall_get_nr(current, regs), KEY_Yx | KEY_ARGI(0), ret);
+}
+#endif
+
+static int kpt_irq_reg(struct kp_tracepoint *tp)
+{
+	int r = register_trace_irq_handler_entry(kpt_irq_entry_probe, tp);
+
+	if (r)
+		return r;
+	r = register_trace_irq_handler_exit(kpt_irq_exit_probe, tp);
+	if (r)
+		unregister_trace_irq_handler_entry(kpt_irq_entry_probe, tp);
+	return r;
+}
+
+static void kpt_irq_unreg(struct kp_tracepoint *tp)
+{
+	unregister_trace_irq_handler_entry(kpt_irq_entry_probe, tp);
+	unregister_trace_irq_handler_exit(kpt_irq_exit_probe, tp);
+}
+
+static int kpt_softirq_reg(struct kp_tracepoint *tp)
+{
+	int r = register_trace_softirq_entry(kpt_softirq_entry_probe, tp);
+
+	if (r)
+		return r;
+	r = register_trace_softirq_exit(kpt_softirq_exit_probe, tp);
+	if (r)
+		unregister_trace_softirq_entry(kpt_softirq_entry_probe, tp);
+	return r;
+}
+
+static void kpt_softirq_unreg(struct kp_tracepoint *tp)
+{
+	unregister_trace_softirq_entry(kpt_softirq_entry_probe, tp);
+	unregister_trace_softirq_exit(kpt_softirq_exit_probe, tp);
+}
+
+static int kpt_kmalloc_reg(struct kp_tracepoint *tp)
+{
+	int r = register_trace_kmalloc(kpt_kmalloc_probe, tp);
+
+	if (r)
+		return r;
+	r = register_trace_kmalloc_node(kpt_kmalloc_node_probe, tp);
+	if (r)
+		unregister_trace_kmalloc(kpt_kmalloc_probe, tp);
+	return r;
+}
+
+static void kpt_kmalloc_unreg(struct kp_tracepoint *tp)
+{
+	unregister_trace_kmalloc(kpt_kmalloc_probe, tp);
+	unregister_trace_kmalloc_node(kpt_kmalloc_node_probe, tp);
+}
+
+static int kpt_kmem_cache_alloc_reg(struct kp_tracepoint *tp)
+{
+	int r = register_trace_kmem_cache_alloc(kpt_kmem_cache_alloc_probe,
+						tp);
+
+	if (r)
+		return r;
+	r = register_trace_kmem_cache_alloc_node(
+			kpt_kmem_cache_alloc_node_probe, tp);
+	if (r)
+		unregister_trace_kmem_cache_alloc(kpt_kmem_cache_alloc_probe,
+						  tp);
+	return r;
+}
+
+static void kpt_kmem_cache_alloc_unreg(struct kp_tracepoint *tp)
+{
+	unregister_trace_kmem_cache_alloc(kpt_kmem_cache_alloc_probe, tp);
+	unregister_trace_kmem_cache_alloc_node(kpt_kmem_cache_alloc_node_probe,
+					       tp);
+}
+
+#ifdef CONFIG_HAVE_SYSCALL_TRACEPOINTS
+static int kpt_syscalls_reg(struct kp_tracepoint *tp)
+{
+	int r = register_trace_sys_enter(kpt_sys_enter_probe, tp);
+
+	if (r)
+		return r;
+	r = register_trace_sys_exit(kpt_sys_exit_probe, tp);
+	if (r)
+		unregister_trace_sys_enter(kpt_sys_enter_probe, tp);
+	return r;
+}
+
+static void kpt_syscalls_unreg(struct kp_tracepoint *tp)
+{
+	unregister_trace_sys_enter(kpt_sys_enter_probe, tp);
+	unregister_trace_sys_exit(kpt_sys_exit_probe, tp);
+}
+#endif
+
+/* Tracepoints with a single probe */
+#define def_static_event(NAME) \
+static int kpt_##NAME##_reg(struct kp_tracepoint *tp)\
+{\
+	return register_trace_##NAME(kpt_##NAME##_probe, tp);\
+} \
+\
+static void kpt_##NAME##_unreg(struct kp_tracepoint *tp)\
+{\
+	unregister_trace_##NAME(kpt_##NAME##_probe, tp);\
+}
+
+def_static_event(kfree);
+def_static_event(kmem_cache_free);
+def_static_event(mm_page_alloc);
+def_static_event(mm_page_free);
+def_static_event(sched_switch);
+def_static_event(sched_wakeup);
+
+#define KPT_STATIC_EVENT(NAME) \
+	{ .reg = kpt_##NAME##_reg, .unreg = kpt_##NAME##_unreg }
+
+static const struct kp_static_event kpt_irq_event = KPT_STATIC_EVENT(irq);
+static const struct kp_static_event kpt_softirq_event =
+	KPT_STATIC_EVENT(softirq);
+static const struct kp_static_event kpt_kmalloc_event =
+	KPT_STATIC_EVENT(kmalloc);
+static const struct kp_static_event kpt_kmem_cache_alloc_event =
+	KPT_STATIC_EVENT(kmem_cache_alloc);
+static const struct kp_static_event kpt_kfree_event =
+	KPT_STATIC_EVENT(kfree);
+static const struct kp_static_event kpt_kmem_cache_free_event =
+	KPT_STATIC_EVENT(kmem_cache_free);
+static const struct kp_static_event kpt_mm_page_alloc_event =
+	KPT_STATIC_EVENT(mm_page_alloc);
+static const struct kp_static_event kpt_mm_page_free_event =
+	KPT_STATIC_EVENT(mm_page_free);
+static const struct kp_static_event kpt_sched_switch_event =
+	KPT_STATIC_EVENT(sched_switch);
+static const struct kp_static_event kpt_sched_wakeup_event =
+	KPT_STATIC_EVENT(sched_wakeup);
+#ifdef CONFIG_HAVE_SYSCALL_TRACEPOINTS
+static const struct kp_static_event kpt_syscalls_event =
+	KPT_STATIC_EVENT(syscalls);
+#endif
+
+/*
+ * Context switches, for the architectures: exposed in sysfs as "name",
+ * the function they used to probe.
+ */
+struct kp_tracepoint *kptrace_create_sched_switch_tracepoint(
+				struct kp_tracepoint_set *set,
+				const char *name)
+{
+	return kptrace_create_static_tracepoint(set, name,
+						&kpt_sched_switch_event, 0);
+}
+#endif /* CONFIG_KPTRACE_STATIC_EVENTS */
+
 /* Add the main sysdev and the "user" tracepoint set */
 static int create_user_sysfs_tree(struct bus_type *m_subsys)
 {
@@ -1824,6 +2436,20 @@ static void init_core_event_logging(void)
 	/*install ARCH specific probes */
 	arch_init_core_event_logging(set);
 
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+	kptrace_create_static_tracepoint(set, "handle_simple_irq",
+					 &kpt_irq_event,
+					 (unsigned long)handle_simple_irq);
+	kptrace_create_static_tracepoint(set, "handle_level_irq",
+					 &kpt_irq_event,
+					 (unsigned long)handle_level_irq);
+	kptrace_create_static_tracepoint(set, "handle_fasteoi_irq",
+					 &kpt_irq_event,
+					 (unsigned long)handle_fasteoi_irq);
+	kptrace_create_static_tracepoint(set, "handle_edge_irq",
+					 &kpt_irq_event,
+					 (unsigned long)handle_edge_irq);
+#else
 	kptrace_create_tracepoint(set, "handle_simple_irq", irq_KEY_I_handler,
 				  irq_KEY_i_handler);
 	kptrace_create_tracepoint(set, "handle_level_irq", irq_KEY_I_handler,
@@ -1832,8 +2458,21 @@ static void init_core_event_logging(void)
 				  irq_KEY_i_handler);
 	kptrace_create_tracepoint(set, "handle_edge_irq", irq_KEY_I_handler,
 				  irq_KEY_i_handler);
+#endif
 	kptrace_create_tracepoint(set, "irq_exit", NULL, irq_KEY_Ix_handler);
 
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+	kptrace_create_static_tracepoint(set, "tasklet_hi_action",
+					 &kpt_softirq_event, HI_SOFTIRQ);
+	kptrace_create_static_tracepoint(set, "net_tx_action",
+					 &kpt_softirq_event, NET_TX_SOFTIRQ);
+	kptrace_create_static_tracepoint(set, "net_rx_action",
+					 &kpt_softirq_event, NET_RX_SOFTIRQ);
+	kptrace_create_static_tracepoint(set, "blk_done_softirq",
+					 &kpt_softirq_event, BLOCK_SOFTIRQ);
+	kptrace_create_static_tracepoint(set, "tasklet_action",
+					 &kpt_softirq_event, TASKLET_SOFTIRQ);
+#else
 	kptrace_create_tracepoint(set, "tasklet_hi_action", softirq_pre_handler,
 				  softirq_rp_handler);
 	kptrace_create_tracepoint(set, "net_tx_action", softirq_pre_handler,
@@ -1844,6 +2483,7 @@ static void init_core_event_logging(void)
 				  softirq_rp_handler);
 	kptrace_create_tracepoint(set, "tasklet_action", softirq_pre_handler,
 				  softirq_rp_handler);
+#endif
 
 	/* Since 2.6.38, kthread_create() is a macro. If the symbol exists,
 	 * we set the tracepoint on that, if it doesn't then we use
@@ -2158,6 +2798,13 @@ static void init_syscall_logging(void)
 
 	kptrace_create_tracepoint(set, "hash_futex", hash_futex_handler, NULL);
 
+#if defined(CONFIG_KPTRACE_STATIC_EVENTS) && \
+	defined(CONFIG_HAVE_SYSCALL_TRACEPOINTS)
+	/* All the syscalls, from the sys_enter/sys_exit tracepoints */
+	kptrace_create_static_tracepoint(set, "raw_syscalls",
+					 &kpt_syscalls_event, 0);
+#endif
+
 	/*install/override ARCH specific probes */
 	arch_init_syscall_logging(set);
 
@@ -2172,14 +2819,22 @@ static void init_memory_logging(void)
 		return;
 	}
 
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+	kptrace_create_static_tracepoint(set, "__kmalloc",
+					 &kpt_kmalloc_event, 0);
+	kptrace_create_static_tracepoint(set, "kfree", &kpt_kfree_event, 0);
+	kptrace_create_static_tracepoint(set, "__get_free_pages",
+					 &kpt_mm_page_alloc_event, 0);
+	kptrace_create_static_tracepoint(set, "free_pages",
+					 &kpt_mm_page_free_event, 0);
+	kptrace_create_static_tracepoint(set, "kmem_cache_alloc",
+					 &kpt_kmem_cache_alloc_event, 0);
+	kptrace_create_static_tracepoint(set, "kmem_cache_free",
+					 &kpt_kmem_cache_free_event, 0);
+#else
 	kptrace_create_tracepoint(set, "__kmalloc", kmalloc_pre_handler,
 				  kmalloc_rp_handler);
 	kptrace_create_tracepoint(set, "kfree", kfree_pre_handler, NULL);
-	kptrace_create_tracepoint(set, "do_page_fault",
-				  do_page_fault_pre_handler, NULL);
-	kptrace_create_tracepoint(set, "vmalloc", vmalloc_pre_handler,
-				  vmalloc_rp_handler);
-	kptrace_create_tracepoint(set, "vfree", vfree_pre_handler, NULL);
 	kptrace_create_tracepoint(set, "__get_free_pages",
 				  get_free_pages_pre_handler,
 				  get_free_pages_rp_handler);
@@ -2190,6 +2845,12 @@ static void init_memory_logging(void)
 				  kmem_cache_alloc_rp_handler);
 	kptrace_create_tracepoint(set, "kmem_cache_free",
 				  kmem_cache_free_pre_handler, NULL);
+#endif
+	kptrace_create_tracepoint(set, "do_page_fault",
+				  do_page_fault_pre_handler, NULL);
+	kptrace_create_tracepoint(set, "vmalloc", vmalloc_pre_handler,
+				  vmalloc_rp_handler);
+	kptrace_create_tracepoint(set, "vfree", vfree_pre_handler, NULL);
 #if defined(CONFIG_BPA2) || defined(CONFIG_BIGPHYS_AREA)
 	kptrace_create_tracepoint(set, "__bigphysarea_alloc_pages",
 				  bigphysarea_alloc_pages_pre_handler,
@@ -2241,10 +2902,17 @@ static void init_timer_logging(void)
 				  do_setitimer_rp_handler);
 	kptrace_create_tracepoint(set, "it_real_fn", it_real_fn_pre_handler,
 				  it_real_fn_rp_handler);
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+	kptrace_create_static_tracepoint(set, "run_timer_softirq",
+					 &kpt_softirq_event, TIMER_SOFTIRQ);
+	kptrace_create_static_tracepoint(set, "try_to_wake_up",
+					 &kpt_sched_wakeup_event, 0);
+#else
 	kptrace_create_tracepoint(set, "run_timer_softirq", softirq_pre_handler,
 				  softirq_rp_handler);
 	kptrace_create_tracepoint(set, "try_to_wake_up", wake_pre_handler,
 				  NULL);
+#endif
 }
 
 #ifdef CONFIG_KPTRACE_SYNC
@@ -2329,6 +2997,11 @@ void mtt_kptrace_cleanup(void)
 
 	mtt_printk(KERN_DEBUG "kptrace_cleanup\n");
 
+#ifdef CONFIG_KPTRACE_STATIC_EVENTS
+	/* Wait for the static tracepoint probes still running */
+	tracepoint_synchronize_unregister();
+#endif
+
 	list_for_each(p, &tracepoint_sets) {
 		set = list_entry(p, struct kp_tracepoint_set, list);
 		if (set != NULL) {
@@ -41,6 +41,27 @@
 */
 DEFINE_SPINLOCK(mttlib_lock);
 
+/* Send a trace frame to the current output driver. Lockless drivers
+ * (per-cpu buffers) are called directly, the others are serialized
+ * on mttlib_lock. */
+static inline void mtt_lib_write(mtt_packet_t *p)
+{
+	unsigned long flags;
+
+	if (mtt_cur_out_drv->lockless) {
+		mtt_cur_out_drv->write_func(p, DRVLOCK);
+		return;
+	}
+
+	spin_lock_irqsave(&mttlib_lock, flags);
+
+	/* send the frame packet
+	 * the output driver must take care of locking if needed */
+	mtt_cur_out_drv->write_func(p, APILOCK);
+
+	spin_unlock_irqrestore(&mttlib_lock, flags);
+}
+
 mtt_return_t mtt_initialize(const mtt_init_param_t *init_param)
 {
 	return MTT_ERR_NONE;
@@ -92,7 +113,6 @@ mtt_return_t
 mtt_print(const mtt_comp_handle_t co,
 	  const mtt_trace_level_t level, const char *format_string, ...)
 {
-	unsigned long flags;
 	va_list ap;
 	mtt_packet_t *p;
 	mtt_return_t err;
@@ -102,7 +122,6 @@ mtt_print(const mtt_comp_handle_t co,
 	int len;
 
 	err = MTT_ERR_NONE;
-	flags = 0;
 
 	if (unlikely(!co))
 		return MTT_ERR_PARAM;
@@ -136,13 +155,7 @@ mtt_print(const mtt_comp_handle_t co,
 
 	mtt_pkt_update_align32(p->length, len);
 
-	spin_lock_irqsave(&mttlib_lock, flags);
-
-	/* send the frame packet
-	 * the output driver must take care of locking if needed */
-	mtt_cur_out_drv->write_func(p, APILOCK);
-
-	spin_unlock_irqrestore(&mttlib_lock, flags);
+	mtt_lib_write(p);
 
 	return err;
 }
@@ -156,7 +169,6 @@ mtt_trace(const mtt_comp_handle_t co,
 	  const mtt_trace_level_t level,
 	  const uint32_t type_info, const void *data, const char *hint)
 {
-	unsigned long flags;
 	mtt_packet_t *p;
 	mtt_return_t err;
 	uint32_t *payload_ptr;
@@ -164,7 +176,6 @@ mtt_trace(const mtt_comp_handle_t co,
 	uint32_t target;
 
 	err = MTT_ERR_NONE;
-	flags = 0;
 
 	/* trap a call to mtt_trace while open was not done
 	 * or component handle is NULL.
@@ -207,13 +218,7 @@ mtt_trace(const mtt_comp_handle_t co,
 
 	memcpy(payload_ptr, data, payload_siz);
 
-	spin_lock_irqsave(&mttlib_lock, flags);
-
-	/* send the frame packet
-	 * the output driver must take care of locking if needed */
-	mtt_cur_out_drv->write_func(p, APILOCK);
-
-	spin_unlock_irqrestore(&mttlib_lock, flags);
+	mtt_lib_write(p);
 
 	return err;
 }
@@ -364,15 +369,7 @@ uint32_t *mtt_kptrace_pkt_get(uint32_t type_info, mtt_packet_t **p,
 /* Send the packet for output and release it. */
 int mtt_kptrace_pkt_put(mtt_packet_t *p)
 {
-	unsigned long flags = 0;
-
-	spin_lock_irqsave(&mttlib_lock, flags);
-
-	/* send the frame packet
-	* the output driver must take care of locking if needed */
-	mtt_cur_out_drv->write_func(p, APILOCK);
-
-	spin_unlock_irqrestore(&mttlib_lock, flags);
+	mtt_lib_write(p);
 	return 0;
 }
 
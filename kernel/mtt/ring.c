@@ -0,0 +1,426 @@
+/*
+ *  Multi-Target Trace solution
+ *
+ *  PER-CPU RING BUFFERS OUTPUT DRIVER.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * Copyright (C) STMicroelectronics, 2013
+ *
+ * Each CPU owns a ring, written only by this CPU with local interrupts
+ * disabled, so no lock is ever shared between the producers. A ring is
+ * a control page (struct mtt_ring_ctrl) followed by the data area, and
+ * the whole thing can be mmaped from /sys/kernel/debug/mtt/rng/ringN.
+ *
+ * The write position published to the consumer (ctrl->head) is only
+ * updated every 'commit_batch' records, from a per-CPU timer, or on
+ * request (writing to the 'flush' file), so that the consumer cache
+ * lines are not touched for every record.
+ *
+ * Records carry a 32 bits nanoseconds delta from the previous record
+ * of the same ring instead of a gettimeofday() timestamp. A time record
+ * with the full 64 bits value is inserted when the delta overflows.
+ */
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/timer.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/uaccess.h>
+
+#include <linux/mtt/mtt.h>
+
+/* Minimum/maximum size of a ring data area */
+#define MTT_RING_MIN_SIZE PAGE_SIZE
+#define MTT_RING_MAX_SIZE (16 * 1024 * 1024)
+
+/* Period of the commit timer */
+#define MTT_RING_FLUSH_PERIOD (HZ / 10)
+
+struct mtt_ring {
+	struct mtt_ring_ctrl *ctrl; /* Also the base of the vmalloc area */
+	char *data;
+	uint32_t size;
+	uint32_t write; /* Private write position */
+	uint32_t pending; /* Records written but not committed yet */
+	u64 last_ts;
+	int cpu;
+	struct timer_list timer;
+	struct dentry *file;
+};
+
+static DEFINE_PER_CPU(struct mtt_ring, mtt_rings);
+
+static uint32_t commit_batch = 32;
+static int rings_ok;
+
+static struct dentry *commit_batch_control;
+static struct dentry *dropped_control;
+static struct dentry *flush_control;
+
+static void mtt_drv_ring_write(mtt_packet_t *p, int lock);
+static mtt_return_t mtt_drv_ring_config(struct mtt_sys_kconfig *cfg);
+
+static struct mtt_output_driver ring_output_driver = {
+	.write_func = mtt_drv_ring_write,
+	.config_func = mtt_drv_ring_config,
+	.debugfs = NULL,
+	.guid = MTT_DRV_GUID_RNG,
+	.private = NULL,
+	.lockless = 1,
+	.last_error = MTT_ERR_OTHER
+};
+
+/* Make the records written so far visible to the consumer.
+ * Must be called on the ring's CPU with interrupts disabled. */
+static inline void mtt_ring_commit(struct mtt_ring *ring)
+{
+	smp_wmb();
+	ring->ctrl->head = ring->write;
+	ring->pending = 0;
+}
+
+static inline void mtt_ring_put_word(struct mtt_ring *ring, uint32_t val)
+{
+	*(uint32_t *)(ring->data + (ring->write & (ring->size - 1))) = val;
+	ring->write += 4;
+}
+
+static void mtt_drv_ring_write(mtt_packet_t *p, int lock)
+{
+	struct mtt_ring *ring;
+	unsigned long flags;
+	uint32_t len, need, offset, pad;
+	u64 now, delta;
+
+	local_irq_save(flags);
+
+	ring = &__get_cpu_var(mtt_rings);
+	if (unlikely(!ring->ctrl))
+		goto out;
+
+	len = ALIGN(p->length, 4);
+	now = local_clock();
+	/* The first record of a ring always carries the full time */
+	delta = ring->last_ts ? now - ring->last_ts : ~0ULL;
+
+	/* Record header + delta + frame, and optionally a time record */
+	need = 8 + len;
+	if (unlikely(delta > 0xffffffffULL))
+		need += 12;
+
+	/* Records never wrap, pad up to the end of the ring instead */
+	offset = ring->write & (ring->size - 1);
+	pad = (offset + need > ring->size) ? ring->size - offset : 0;
+
+	if (unlikely(len > 0xffff ||
+		     ring->write + pad + need - ACCESS_ONCE(ring->ctrl->tail) >
+		     ring->size)) {
+		ring->ctrl->dropped++;
+		goto out;
+	}
+
+	/* The space freed by the consumer (ctrl->tail) must not be written
+	 * before the consumer is done reading it. Pairs with the barrier
+	 * the consumer issues before updating ctrl->tail. */
+	smp_mb();
+
+	if (pad) {
+		*(uint32_t *)(ring->data + offset) =
+			MTT_RING_HDR(MTT_RING_PADDING, pad);
+		ring->write += pad;
+	}
+
+	if (unlikely(delta > 0xffffffffULL)) {
+		mtt_ring_put_word(ring, MTT_RING_HDR(MTT_RING_TIME, 12));
+		mtt_ring_put_word(ring, (uint32_t)now);
+		mtt_ring_put_word(ring, (uint32_t)(now >> 32));
+		delta = 0;
+	}
+
+	mtt_ring_put_word(ring, MTT_RING_HDR(MTT_RING_DATA, 8 + len));
+	mtt_ring_put_word(ring, (uint32_t)delta);
+	memcpy(ring->data + (ring->write & (ring->size - 1)), p->u.buf,
+	       p->length);
+	ring->write += len;
+	ring->last_ts = now;
+
+	if (++ring->pending >= commit_batch)
+		mtt_ring_commit(ring);
+
+out:
+	local_irq_restore(flags);
+}
+
+static void mtt_ring_timer(unsigned long data)
+{
+	struct mtt_ring *ring = (struct mtt_ring *)data;
+	unsigned long flags;
+
+	/* The timer may have been migrated by CPU hotplug. */
+	if (ring->cpu != smp_processor_id())
+		return;
+
+	local_irq_save(flags);
+	if (ring->pending)
+		mtt_ring_commit(ring);
+	local_irq_restore(flags);
+
+	mod_timer_pinned(&ring->timer, jiffies + MTT_RING_FLUSH_PERIOD);
+}
+
+static void mtt_ring_flush_cpu(void *unused)
+{
+	struct mtt_ring *ring = &__get_cpu_var(mtt_rings);
+
+	if (ring->ctrl && ring->pending)
+		mtt_ring_commit(ring);
+}
+
+/*
+ * ringN files: mmap the control page and the data area of a ring. They
+ * are writable, the collector stores its tail into the control page.
+ */
+static int mtt_ring_open(struct inode *inode, struct file *filp)
+{
+	filp->private_data = inode->i_private;
+
+	return 0;
+}
+
+static int mtt_ring_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct mtt_ring *ring = filp->private_data;
+
+	if (!ring->ctrl)
+		return -ENODEV;
+
+	return remap_vmalloc_range(vma, ring->ctrl, vma->vm_pgoff);
+}
+
+static const struct file_operations ring_fops = {
+	.owner = THIS_MODULE,
+	.open = mtt_ring_open,
+	.mmap = mtt_ring_mmap,
+};
+
+static ssize_t
+dropped_read(struct file *filp, char __user *buffer,
+	     size_t count, loff_t *ppos)
+{
+	char buf[16];
+	uint32_t dropped = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mtt_ring *ring = &per_cpu(mtt_rings, cpu);
+
+		if (ring->ctrl)
+			dropped += ring->ctrl->dropped;
+	}
+
+	snprintf(buf, sizeof(buf), "%u\n", dropped);
+
+	return simple_read_from_buffer(buffer, count, ppos, buf, strlen(buf));
+}
+
+/*
+ * 'dropped' file operations - r
+ *
+ *  gets the number of records lost on all the rings
+ */
+static const struct file_operations dropped_fops = {
+	.read = dropped_read,
+};
+
+static ssize_t
+flush_write(struct file *filp, const char __user *buffer,
+	    size_t count, loff_t *ppos)
+{
+	on_each_cpu(mtt_ring_flush_cpu, NULL, 1);
+
+	return count;
+}
+
+/*
+ * 'flush' file operations - w
+ *
+ *  commits the pending records of all the rings
+ */
+static const struct file_operations flush_fops = {
+	.write = flush_write,
+};
+
+static void mtt_ring_free(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mtt_ring *ring = &per_cpu(mtt_rings, cpu);
+		struct mtt_ring_ctrl *ctrl = ring->ctrl;
+
+		if (!ctrl)
+			continue;
+
+		del_timer_sync(&ring->timer);
+		if (ring->file)
+			debugfs_remove(ring->file);
+		ring->file = NULL;
+
+		/* Stop the producers before releasing the memory */
+		ring->ctrl = NULL;
+		synchronize_sched();
+		vfree(ctrl);
+	}
+}
+
+static int mtt_ring_alloc(uint32_t size)
+{
+	char name[16];
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mtt_ring *ring = &per_cpu(mtt_rings, cpu);
+		struct mtt_ring_ctrl *ctrl;
+
+		ctrl = vmalloc_user(PAGE_SIZE + size);
+		if (!ctrl)
+			goto fail;
+
+		ctrl->magic = MTT_RING_MAGIC;
+		ctrl->size = size;
+		ctrl->cpu = cpu;
+
+		ring->data = (char *)ctrl + PAGE_SIZE;
+		ring->size = size;
+		ring->write = 0;
+		ring->pending = 0;
+		ring->last_ts = 0;
+		ring->cpu = cpu;
+
+		snprintf(name, sizeof(name), "ring%d", cpu);
+		ring->file = debugfs_create_file(name, S_IRUSR | S_IWUSR,
+				ring_output_driver.debugfs, ring, &ring_fops);
+
+		/* Publish the ring to the producer last */
+		smp_wmb();
+		ring->ctrl = ctrl;
+
+		init_timer_deferrable(&ring->timer);
+		ring->timer.function = mtt_ring_timer;
+		ring->timer.data = (unsigned long)ring;
+		ring->timer.expires = jiffies + MTT_RING_FLUSH_PERIOD;
+		if (cpu_online(cpu))
+			add_timer_on(&ring->timer, cpu);
+	}
+
+	return 0;
+
+fail:
+	mtt_ring_free();
+	return -ENOMEM;
+}
+
+static void remove_controls(void)
+{
+	if (commit_batch_control)
+		debugfs_remove(commit_batch_control);
+
+	if (dropped_control)
+		debugfs_remove(dropped_control);
+
+	if (flush_control)
+		debugfs_remove(flush_control);
+
+	commit_batch_control = dropped_control = flush_control = NULL;
+}
+
+static int create_controls(struct dentry *debugfs)
+{
+	commit_batch_control = debugfs_create_u32("commit_batch",
+			S_IRUGO | S_IWUSR, debugfs, &commit_batch);
+	dropped_control = debugfs_create_file("dropped", S_IRUGO, debugfs,
+			NULL, &dropped_fops);
+	flush_control = debugfs_create_file("flush", S_IWUSR, debugfs,
+			NULL, &flush_fops);
+
+	if (!commit_batch_control || !dropped_control || !flush_control) {
+		printk(KERN_ERR "mtt_ring: couldn't create control files\n");
+		remove_controls();
+		return 0;
+	}
+
+	return 1;
+}
+
+static mtt_return_t
+mtt_drv_ring_config(struct mtt_sys_kconfig *cfg)
+{
+	struct mtt_dfs_drv_cfg *c = &cfg->media_cfg.dfs;
+	uint32_t size;
+
+	ring_output_driver.last_error = MTT_ERR_FERROR;
+
+	mtt_printk(KERN_DEBUG "mtt_drv_ring_config\n");
+
+	BUG_ON(!ring_output_driver.debugfs);
+
+	if (!commit_batch_control &&
+	    !create_controls(ring_output_driver.debugfs))
+		return MTT_ERR_FERROR;
+
+	/* Same sizing as the relay channel: n_subbufs x buf_size */
+	size = clamp_t(uint32_t, c->buf_size * c->n_subbufs,
+		       MTT_RING_MIN_SIZE, MTT_RING_MAX_SIZE);
+	size = roundup_pow_of_two(size);
+
+	/* Tracing is stopped by the caller, the rings can be replaced. */
+	if (rings_ok)
+		mtt_ring_free();
+	rings_ok = 0;
+
+	if (mtt_ring_alloc(size)) {
+		printk(KERN_ERR "mtt_ring: couldn't allocate %u B rings\n",
+		       size);
+		return MTT_ERR_FERROR;
+	}
+	rings_ok = 1;
+
+	/* The time is carried by the ring records, don't pay for
+	 * gettimeofday() in every frame. */
+	cfg->params &= ~MTT_PARAM_TSTV;
+
+	return ring_output_driver.last_error = 0;
+}
+
+int __init mtt_ring_init(void)
+{
+	mtt_printk(KERN_DEBUG "mtt_ring_init\n");
+
+	mtt_register_output_driver(&ring_output_driver);
+
+	return 0;
+}
+
+void mtt_ring_cleanup(void)
+{
+	mtt_printk(KERN_DEBUG "mtt_ring_cleanup\n");
+
+	mtt_unregister_output_driver(&ring_output_driver);
+	mtt_ring_free();
+	remove_controls();
+}
@@ -33,7 +33,9 @@
  * 	<size> := standard linux memory size (e.g. 4M or 0x400000)
  * 	<base physical address> := physical address the partition should
  * 	                            start from (e.g. 32M or 0x02000000)
- *      <flags> := currently unused
+ *      <flags> := placement policy: "firstfit" (default), "bestfit",
+ *                 "nextfit" or "segregated" (small blocks from the top
+ *                 of the partition, large ones from the bottom)
  *
  * Examples:
  *
@@ -43,6 +45,8 @@
  * 			LMI_SYS|audio:0x05000000:\
  * 			bigphyarea:5M
  *
+ * 	bpa2parts=video:32M::segregated,audio:1M
+ *
  *   This program is free software; you can redistribute it and/or modify
  *   it under the terms of the GNU General Public License as published by
  *   the Free Software Foundation; either version 2 of the License, or
@@ -73,6 +77,9 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/pfn.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
 #include <linux/bpa2.h>
 
 
@@ -103,10 +110,29 @@
 
 
 
+/* Free ranges smaller than this are allocated from the top of
+ * a partition using BPA2_SEGREGATED placement policy */
+#define BPA2_SMALL_SIZE (64 * 1024)
+
+/* Free extents histogram buckets (power of two pages, last one
+ * collects everything bigger) */
+#define BPA2_HIST_BUCKETS 14
+
+
+
+/*
+ * Free ranges live in an address-ordered rbtree, augmented with the
+ * size of the largest free range in each subtree, so that a first-fit
+ * search (and the coalescing on free) is O(log n). They are also kept
+ * in a size-ordered rbtree, used by the best-fit policy. Used ranges
+ * live in a third rbtree, keyed by the base address.
+ */
 struct bpa2_range {
-	struct bpa2_range *next;
+	struct rb_node node; /* in part->free_root or part->used_root */
+	struct rb_node size_node; /* in part->size_root (free ranges only) */
 	unsigned long base; /* base of allocated block */
 	unsigned long size; /* size in bytes */
+	unsigned long max_size; /* largest free range in subtree */
 #if defined(CONFIG_BPA2_ALLOC_TRACE)
 	const char *trace_file;
 	int trace_line;
@@ -115,9 +141,16 @@ struct bpa2_range {
 
 struct bpa2_part {
 	struct resource res;
-	struct bpa2_range initial_free_list;
-	struct bpa2_range *free_list;
-	struct bpa2_range *used_list;
+	spinlock_t lock; /* protects the trees and counters below */
+	struct bpa2_range initial_free_range;
+	struct rb_root free_root;
+	struct rb_root size_root;
+	struct rb_root used_root;
+	int free_count;
+	int used_count;
+	int failed_count;
+	unsigned long next_fit; /* BPA2_NEXT_FIT search start address */
+	struct list_head caches; /* object caches, protected by lock */
 	int flags;
 	int low_mem;
 	struct list_head list;
@@ -129,9 +162,46 @@ struct bpa2_part {
 
 
 
+/*
+ * Object caches keep recycled blocks of one size in per-CPU magazines
+ * (see "Magazines and Vmem" by Bonwick & Adams). Each CPU owns
+ * a loaded and a previous magazine, full and empty ones are exchanged
+ * with the cache depot. The blocks stay allocated from the partition
+ * point of view for all that time.
+ */
+#define BPA2_MAGAZINE_SIZE 15
+
+/* Magazines which can be kept in a depot, above two per CPU */
+#define BPA2_DEPOT_SIZE 8
+
+struct bpa2_magazine {
+	struct list_head list; /* in cache depot */
+	int rounds;
+	unsigned long objs[BPA2_MAGAZINE_SIZE];
+};
+
+struct bpa2_cache_cpu {
+	struct bpa2_magazine *loaded;
+	struct bpa2_magazine *previous;
+};
+
+struct bpa2_cache {
+	struct bpa2_part *part;
+	int count; /* size of a block in pages */
+	int align;
+	struct bpa2_cache_cpu __percpu *cpu;
+	spinlock_t lock; /* protects the depot */
+	struct list_head full;
+	struct list_head empty;
+	int magazines; /* number of magazines in depot */
+	struct list_head list; /* in part->caches */
+};
+
+
+
+/* The partitions list is only modified during early boot */
 static LIST_HEAD(bpa2_parts);
 static struct bpa2_part *bpa2_bigphysarea_part;
-static DEFINE_SPINLOCK(bpa2_lock);
 
 
 
@@ -167,6 +237,440 @@ static int bpa2_check_name(struct bpa2_part *part, const char *name)
 	return -1;
 }
 
+/*
+ * Free ranges tree
+ */
+
+static inline unsigned long bpa2_max_size(struct rb_node *node)
+{
+	return node ? rb_entry(node, struct bpa2_range, node)->max_size : 0;
+}
+
+/* Update 'max_size' for a node, based on node and its children */
+static void bpa2_free_augment_cb(struct rb_node *node, void *unused)
+{
+	struct bpa2_range *range;
+
+	if (!node)
+		return;
+
+	range = rb_entry(node, struct bpa2_range, node);
+	range->max_size = max3(range->size, bpa2_max_size(node->rb_left),
+			bpa2_max_size(node->rb_right));
+}
+
+/* Called when the range size has been changed in place */
+static void bpa2_free_propagate(struct bpa2_range *range)
+{
+	struct rb_node *node;
+
+	for (node = &range->node; node; node = rb_parent(node))
+		bpa2_free_augment_cb(node, NULL);
+}
+
+/* The size tree is ordered by size, then by address */
+static void bpa2_size_insert(struct bpa2_part *part, struct bpa2_range *range)
+{
+	struct rb_node **link = &part->size_root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*link) {
+		struct bpa2_range *entry;
+
+		parent = *link;
+		entry = rb_entry(parent, struct bpa2_range, size_node);
+		if (range->size < entry->size || (range->size == entry->size &&
+				range->base < entry->base))
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&range->size_node, parent, link);
+	rb_insert_color(&range->size_node, &part->size_root);
+}
+
+static void bpa2_free_insert(struct bpa2_part *part, struct bpa2_range *range)
+{
+	struct rb_node **link = &part->free_root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*link) {
+		parent = *link;
+		if (range->base < rb_entry(parent, struct bpa2_range,
+				node)->base)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	range->max_size = range->size;
+	rb_link_node(&range->node, parent, link);
+	rb_insert_color(&range->node, &part->free_root);
+	rb_augment_insert(&range->node, bpa2_free_augment_cb, NULL);
+
+	bpa2_size_insert(part, range);
+}
+
+static void bpa2_free_erase(struct bpa2_part *part, struct bpa2_range *range)
+{
+	struct rb_node *deepest = rb_augment_erase_begin(&range->node);
+
+	rb_erase(&range->node, &part->free_root);
+	rb_augment_erase_end(deepest, bpa2_free_augment_cb, NULL);
+
+	rb_erase(&range->size_node, &part->size_root);
+}
+
+/* Change a free range in place (it must not cross its neighbours) */
+static void bpa2_free_resize(struct bpa2_part *part, struct bpa2_range *range,
+		unsigned long base, unsigned long size)
+{
+	rb_erase(&range->size_node, &part->size_root);
+	range->base = base;
+	range->size = size;
+	bpa2_free_propagate(range);
+	bpa2_size_insert(part, range);
+}
+
+/* Lowest addressed range of at least `size' bytes in the subtree */
+static struct bpa2_range *bpa2_free_leftmost(struct rb_node *node,
+		unsigned long size)
+{
+	while (node) {
+		struct bpa2_range *range = rb_entry(node, struct bpa2_range,
+				node);
+
+		if (bpa2_max_size(node->rb_left) >= size)
+			node = node->rb_left;
+		else if (range->size >= size)
+			return range;
+		else if (bpa2_max_size(node->rb_right) >= size)
+			node = node->rb_right;
+		else
+			break;
+	}
+
+	return NULL;
+}
+
+static struct bpa2_range *bpa2_free_first(struct bpa2_part *part,
+		unsigned long size)
+{
+	return bpa2_free_leftmost(part->free_root.rb_node, size);
+}
+
+/* Next (by address) range of at least `size' bytes after `range' */
+static struct bpa2_range *bpa2_free_next(struct bpa2_range *range,
+		unsigned long size)
+{
+	struct rb_node *node = &range->node;
+	struct rb_node *parent;
+
+	if (bpa2_max_size(node->rb_right) >= size)
+		return bpa2_free_leftmost(node->rb_right, size);
+
+	while ((parent = rb_parent(node)) != NULL) {
+		if (node == parent->rb_left) {
+			range = rb_entry(parent, struct bpa2_range, node);
+			if (range->size >= size)
+				return range;
+			if (bpa2_max_size(parent->rb_right) >= size)
+				return bpa2_free_leftmost(parent->rb_right,
+						size);
+		}
+		node = parent;
+	}
+
+	return NULL;
+}
+
+/* Highest addressed range of at least `size' bytes in the subtree */
+static struct bpa2_range *bpa2_free_rightmost(struct rb_node *node,
+		unsigned long size)
+{
+	while (node) {
+		struct bpa2_range *range = rb_entry(node, struct bpa2_range,
+				node);
+
+		if (bpa2_max_size(node->rb_right) >= size)
+			node = node->rb_right;
+		else if (range->size >= size)
+			return range;
+		else if (bpa2_max_size(node->rb_left) >= size)
+			node = node->rb_left;
+		else
+			break;
+	}
+
+	return NULL;
+}
+
+static struct bpa2_range *bpa2_free_last(struct bpa2_part *part,
+		unsigned long size)
+{
+	return bpa2_free_rightmost(part->free_root.rb_node, size);
+}
+
+/* Previous (by address) range of at least `size' bytes before `range' */
+static struct bpa2_range *bpa2_free_prev(struct bpa2_range *range,
+		unsigned long size)
+{
+	struct rb_node *node = &range->node;
+	struct rb_node *parent;
+
+	if (bpa2_max_size(node->rb_left) >= size)
+		return bpa2_free_rightmost(node->rb_left, size);
+
+	while ((parent = rb_parent(node)) != NULL) {
+		if (node == parent->rb_right) {
+			range = rb_entry(parent, struct bpa2_range, node);
+			if (range->size >= size)
+				return range;
+			if (bpa2_max_size(parent->rb_left) >= size)
+				return bpa2_free_rightmost(parent->rb_left,
+						size);
+		}
+		node = parent;
+	}
+
+	return NULL;
+}
+
+/* Free ranges immediately below and above `base' */
+static void bpa2_free_neighbours(struct bpa2_part *part, unsigned long base,
+		struct bpa2_range **prev, struct bpa2_range **next)
+{
+	struct rb_node *node = part->free_root.rb_node;
+
+	*prev = NULL;
+	*next = NULL;
+
+	while (node) {
+		struct bpa2_range *range = rb_entry(node, struct bpa2_range,
+				node);
+
+		if (base < range->base) {
+			*next = range;
+			node = node->rb_left;
+		} else {
+			*prev = range;
+			node = node->rb_right;
+		}
+	}
+}
+
+/*
+ * Placement policies
+ *
+ * Each of them returns a free range in which a block of `size' bytes
+ * aligned to `align' can be placed, and the block address.
+ */
+
+static int bpa2_fit_low(struct bpa2_range *range, unsigned long size,
+		unsigned long align, unsigned long *aligned_base)
+{
+	unsigned long base = ((range->base + align - 1) / align) * align;
+
+	if (base + size > range->base + range->size)
+		return 0;
+
+	*aligned_base = base;
+
+	return 1;
+}
+
+static int bpa2_fit_high(struct bpa2_range *range, unsigned long size,
+		unsigned long align, unsigned long *aligned_base)
+{
+	unsigned long base = range->base + range->size - size;
+
+	base = (base / align) * align;
+	if (base < range->base)
+		return 0;
+
+	*aligned_base = base;
+
+	return 1;
+}
+
+/* Lowest addressed block. Blocks smaller than the request itself are
+ * skipped without being visited. */
+static struct bpa2_range *bpa2_first_fit(struct bpa2_part *part,
+		unsigned long size, unsigned long align,
+		unsigned long *aligned_base)
+{
+	struct bpa2_range *range;
+
+	for (range = bpa2_free_first(part, size); range != NULL;
+			range = bpa2_free_next(range, size))
+		if (bpa2_fit_low(range, size, align, aligned_base))
+			break;
+
+	return range;
+}
+
+/* Highest addressed block, allocated from its top */
+static struct bpa2_range *bpa2_last_fit(struct bpa2_part *part,
+		unsigned long size, unsigned long align,
+		unsigned long *aligned_base)
+{
+	struct bpa2_range *range;
+
+	for (range = bpa2_free_last(part, size); range != NULL;
+			range = bpa2_free_prev(range, size))
+		if (bpa2_fit_high(range, size, align, aligned_base))
+			break;
+
+	return range;
+}
+
+/* Smallest block, lowest addressed of the equally sized ones */
+static struct bpa2_range *bpa2_best_fit(struct bpa2_part *part,
+		unsigned long size, unsigned long align,
+		unsigned long *aligned_base)
+{
+	struct rb_node *node = part->size_root.rb_node;
+	struct rb_node *found = NULL;
+
+	while (node) {
+		if (rb_entry(node, struct bpa2_range, size_node)->size >= size) {
+			found = node;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+
+	for (node = found; node; node = rb_next(node)) {
+		struct bpa2_range *range = rb_entry(node, struct bpa2_range,
+				size_node);
+
+		if (bpa2_fit_low(range, size, align, aligned_base))
+			return range;
+	}
+
+	return NULL;
+}
+
+/* First-fit, starting where the previous search has finished */
+static struct bpa2_range *bpa2_next_fit(struct bpa2_part *part,
+		unsigned long size, unsigned long align,
+		unsigned long *aligned_base)
+{
+	struct bpa2_range *prev, *next, *range;
+
+	bpa2_free_neighbours(part, part->next_fit, &prev, &next);
+	if (prev && prev->base + prev->size > part->next_fit)
+		range = prev;
+	else
+		range = next;
+	if (range && range->size < size)
+		range = bpa2_free_next(range, size);
+
+	for (; range != NULL; range = bpa2_free_next(range, size))
+		if (bpa2_fit_low(range, size, align, aligned_base))
+			return range;
+
+	/* Wrap around */
+	for (range = bpa2_free_first(part, size);
+			range != NULL && range->base < part->next_fit;
+			range = bpa2_free_next(range, size))
+		if (bpa2_fit_low(range, size, align, aligned_base))
+			return range;
+
+	return NULL;
+}
+
+static struct bpa2_range *bpa2_free_find(struct bpa2_part *part,
+		unsigned long size, unsigned long align,
+		unsigned long *aligned_base)
+{
+	struct bpa2_range *range;
+
+	switch (part->flags & BPA2_POLICY_MASK) {
+	case BPA2_BEST_FIT:
+		return bpa2_best_fit(part, size, align, aligned_base);
+	case BPA2_NEXT_FIT:
+		range = bpa2_next_fit(part, size, align, aligned_base);
+		if (range)
+			part->next_fit = *aligned_base + size;
+		return range;
+	case BPA2_SEGREGATED:
+		/* Small blocks from the top, large ones from the bottom,
+		 * so they don't interleave */
+		if (size < BPA2_SMALL_SIZE)
+			return bpa2_last_fit(part, size, align, aligned_base);
+		return bpa2_first_fit(part, size, align, aligned_base);
+	case BPA2_FIRST_FIT:
+	default:
+		return bpa2_first_fit(part, size, align, aligned_base);
+	}
+}
+
+static const char *bpa2_policy_name(int flags)
+{
+	switch (flags & BPA2_POLICY_MASK) {
+	case BPA2_BEST_FIT:
+		return "best-fit";
+	case BPA2_NEXT_FIT:
+		return "next-fit";
+	case BPA2_SEGREGATED:
+		return "segregated";
+	default:
+		return "first-fit";
+	}
+}
+
+/*
+ * Used ranges tree
+ */
+
+static void bpa2_used_insert(struct bpa2_part *part, struct bpa2_range *range)
+{
+	struct rb_node **link = &part->used_root.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*link) {
+		parent = *link;
+		if (range->base < rb_entry(parent, struct bpa2_range,
+				node)->base)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&range->node, parent, link);
+	rb_insert_color(&range->node, &part->used_root);
+}
+
+/* Used range containing the `base' address */
+static struct bpa2_range *bpa2_used_lookup(struct bpa2_part *part,
+		unsigned long base)
+{
+	struct rb_node *node = part->used_root.rb_node;
+
+	while (node) {
+		struct bpa2_range *range = rb_entry(node, struct bpa2_range,
+				node);
+
+		if (base < range->base)
+			node = node->rb_left;
+		else if (base >= range->base + range->size)
+			node = node->rb_right;
+		else
+			return range;
+	}
+
+	return NULL;
+}
+
+static void bpa2_range_free(struct bpa2_part *part, struct bpa2_range *range)
+{
+	if (range && range != &part->initial_free_range)
+		kfree(range);
+}
+
 static int __init bpa2_alloc_low(struct bpa2_part *part, unsigned long size,
 		unsigned long *start)
 {
@@ -280,11 +784,18 @@ static int __init bpa2_add_part(const char **names, int names_cnt,
 	}
 
 	/* Initialize ranges */
-	part->initial_free_list.next = NULL;
-	part->initial_free_list.base = start;
-	part->initial_free_list.size = size;
-	part->free_list = &part->initial_free_list;
-	part->used_list = NULL;
+	spin_lock_init(&part->lock);
+	part->free_root = RB_ROOT;
+	part->size_root = RB_ROOT;
+	part->used_root = RB_ROOT;
+	part->initial_free_range.base = start;
+	part->initial_free_range.size = size;
+	bpa2_free_insert(part, &part->initial_free_range);
+	part->free_count = 1;
+	part->used_count = 0;
+	part->failed_count = 0;
+	part->next_fit = start;
+	INIT_LIST_HEAD(&part->caches);
 
 	/* And finally... */
 	list_add_tail(&part->list, &bpa2_parts);
@@ -375,6 +886,20 @@ static int __init bpa2_bigphys_setup(char *str)
 }
 __setup("bigphysarea=", bpa2_bigphys_setup);
 
+static int __init bpa2_parse_policy(const char *str)
+{
+	if (strcmp(str, "firstfit") == 0)
+		return BPA2_FIRST_FIT;
+	if (strcmp(str, "bestfit") == 0)
+		return BPA2_BEST_FIT;
+	if (strcmp(str, "nextfit") == 0)
+		return BPA2_NEXT_FIT;
+	if (strcmp(str, "segregated") == 0)
+		return BPA2_SEGREGATED;
+
+	return -EINVAL;
+}
+
 /*
  * Create "bpa2parts"-defined partitions
  */
@@ -388,6 +913,7 @@ static int __init bpa2_parts_setup(char *str)
 	while ((desc = strsep(&str, ",")) != NULL) {
 		unsigned long start = 0;
 		unsigned long size = 0;
+		int policy = BPA2_FIRST_FIT;
 		int names_cnt = 1;
 		const char **names;
 		char *token;
@@ -439,11 +965,20 @@ static int __init bpa2_parts_setup(char *str)
 			}
 		}
 
-		/* Get partition flags (not implemented yet) */
+		/* Get partition flags (placement policy) */
+		token = strsep(&desc, ":");
+		if (token && *token) {
+			policy = bpa2_parse_policy(token);
+			if (policy < 0) {
+				printk(KERN_ERR "bpa2: Invalid placement "
+						"policy '%s'!\n", token);
+				policy = BPA2_FIRST_FIT;
+			}
+		}
 
 		/* Finally add it to the list... */
 		if (bpa2_add_part(names, names_cnt, start, size,
-					BPA2_NORMAL) != 0)
+					BPA2_NORMAL | policy) != 0)
 			printk(KERN_ERR "bpa2: '%s' partition skipped\n",
 					*names);
 
@@ -493,6 +1028,82 @@ int bpa2_low_part(struct bpa2_part *part)
 }
 EXPORT_SYMBOL(bpa2_low_part);
 
+/**
+ * bpa2_set_policy - select partition placement policy
+ * @part: partition to modify
+ * @policy: one of BPA2_FIRST_FIT, BPA2_BEST_FIT, BPA2_NEXT_FIT or
+ *          BPA2_SEGREGATED
+ *
+ * Change the way free blocks are chosen for the following allocations
+ * from the partition. Existing allocations are not affected.
+ */
+int bpa2_set_policy(struct bpa2_part *part, unsigned long policy)
+{
+	if (policy & ~BPA2_POLICY_MASK)
+		return -EINVAL;
+
+	spin_lock(&part->lock);
+	part->flags = (part->flags & ~BPA2_POLICY_MASK) | policy;
+	spin_unlock(&part->lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(bpa2_set_policy);
+
+/**
+ * bpa2_get_policy - return partition placement policy
+ * @part: partition to query
+ *
+ * Return one of BPA2_FIRST_FIT, BPA2_BEST_FIT, BPA2_NEXT_FIT or
+ * BPA2_SEGREGATED, as set by bpa2_set_policy() or at boot time.
+ */
+unsigned long bpa2_get_policy(struct bpa2_part *part)
+{
+	return part->flags & BPA2_POLICY_MASK;
+}
+EXPORT_SYMBOL(bpa2_get_policy);
+
+/* Fragmentation index: 0 when all the free memory is available
+ * as a single block, approaching 1000 when it is scattered */
+static int bpa2_frag_index(unsigned long free_max, unsigned long free_total)
+{
+	if (!free_total)
+		return 0;
+
+	return 1000 - (free_max >> PAGE_SHIFT) * 1000 /
+			(free_total >> PAGE_SHIFT);
+}
+
+/**
+ * bpa2_fragmentation - return partition fragmentation statistics
+ * @part: partition to query
+ * @free_total: if not NULL, set to the amount of free memory in bytes
+ * @free_max: if not NULL, set to the size of the largest free block
+ *
+ * Return the fragmentation index of the partition, from 0 (all the free
+ * memory is a single block) to 1000, as shown in debugfs.
+ */
+int bpa2_fragmentation(struct bpa2_part *part, unsigned long *free_total,
+		unsigned long *free_max)
+{
+	struct rb_node *node;
+	unsigned long total = 0, max;
+
+	spin_lock(&part->lock);
+	max = bpa2_max_size(part->free_root.rb_node);
+	for (node = rb_first(&part->free_root); node; node = rb_next(node))
+		total += rb_entry(node, struct bpa2_range, node)->size;
+	spin_unlock(&part->lock);
+
+	if (free_total)
+		*free_total = total;
+	if (free_max)
+		*free_max = max;
+
+	return bpa2_frag_index(max, total);
+}
+EXPORT_SYMBOL(bpa2_fragmentation);
+
 /**
  * bpa2_find_part_addr - return the parent partition
  * @base: the physical address of a buffer
@@ -506,21 +1117,19 @@ struct bpa2_part *bpa2_find_part_addr(unsigned long base, unsigned long size)
 {
 	struct bpa2_part *part;
 
-	spin_lock(&bpa2_lock);
-
 	list_for_each_entry(part, &bpa2_parts, list) {
-		struct bpa2_range *range = part->used_list;
-		while (range) {
-			if (base >= range->base
-			    && (base + size) <= (range->base + range->size)) {
-				spin_unlock(&bpa2_lock);
-				return part;
-			}
-			range = range->next;
-		}
-	}
+		struct bpa2_range *range;
 
-	spin_unlock(&bpa2_lock);
+		if (base < part->res.start || base > part->res.end)
+			continue;
+
+		spin_lock(&part->lock);
+		range = bpa2_used_lookup(part, base);
+		spin_unlock(&part->lock);
+
+		if (range && (base + size) <= (range->base + range->size))
+			return part;
+	}
 
 	return NULL;
 }
@@ -543,9 +1152,11 @@ EXPORT_SYMBOL(bpa2_find_part_addr);
 unsigned long __bpa2_alloc_pages(struct bpa2_part *part, int count, int align,
 		int priority, const char *trace_file, int trace_line)
 {
-	struct bpa2_range *range, **range_ptr;
-	struct bpa2_range *new_range, *align_range, *used_range;
+	struct bpa2_range *range;
+	struct bpa2_range *new_range, *tail_range, *used_range;
+	unsigned long size = count * PAGE_SIZE;
 	unsigned long aligned_base = 0;
+	unsigned long tail_size;
 	unsigned long result = 0;
 
 	if (count == 0)
@@ -555,8 +1166,8 @@ unsigned long __bpa2_alloc_pages(struct bpa2_part *part, int count, int align,
 	 * don't have problems inside the spinlock.
 	 * Free at the end if not used. */
 	new_range = kmalloc(sizeof(*new_range), priority);
-	align_range = kmalloc(sizeof(*align_range), priority);
-	if ((new_range == NULL) || (align_range == NULL))
+	tail_range = kmalloc(sizeof(*tail_range), priority);
+	if ((new_range == NULL) || (tail_range == NULL))
 		goto fail;
 
 	if (align == 0)
@@ -564,66 +1175,66 @@ unsigned long __bpa2_alloc_pages(struct bpa2_part *part, int count, int align,
 	else
 		align = align * PAGE_SIZE;
 
-	spin_lock(&bpa2_lock);
+	spin_lock(&part->lock);
 
-	/* Search a free block which is large enough, even with alignment. */
-	range_ptr = &part->free_list;
-	while (*range_ptr != NULL) {
-		range = *range_ptr;
-		aligned_base = ((range->base + align - 1) / align) * align;
-		if (aligned_base + count * PAGE_SIZE <=
-				range->base + range->size)
-			break;
-		range_ptr = &range->next;
-	}
-	if (*range_ptr == NULL)
+	/* Search a free block which is large enough, even with
+	 * alignment, according to the partition placement policy. */
+	range = bpa2_free_find(part, size, align, &aligned_base);
+	if (range == NULL) {
+		part->failed_count++;
 		goto fail_unlock;
-	range = *range_ptr;
+	}
+
+	tail_size = range->base + range->size - (aligned_base + size);
 
-	/* When we have to align, the pages needed for alignment can
-	 * be put back to the free pool. */
 	if (aligned_base != range->base) {
-		align_range->base = range->base;
-		align_range->size = aligned_base - range->base;
-		range->base = aligned_base;
-		range->size -= align_range->size;
-		align_range->next = range;
-		*range_ptr = align_range;
-		range_ptr = &align_range->next;
-		align_range = NULL;
-	}
-
-	if (count * PAGE_SIZE < range->size) {
-		/* Range is larger than needed, create a new list element for
-		 * the used list and shrink the element in the free list. */
-		new_range->base = range->base;
-		new_range->size = count * PAGE_SIZE;
-		range->base = new_range->base + new_range->size;
-		range->size = range->size - new_range->size;
+		/* The pages needed for alignment stay in the free
+		 * tree, anything above the allocation is put back to
+		 * the free pool as a new block. */
+		bpa2_free_resize(part, range, range->base,
+				aligned_base - range->base);
+		if (tail_size) {
+			tail_range->base = aligned_base + size;
+			tail_range->size = tail_size;
+			bpa2_free_insert(part, tail_range);
+			part->free_count++;
+			tail_range = NULL;
+		}
+		used_range = new_range;
+		new_range = NULL;
+	} else if (tail_size) {
+		/* Range is larger than needed, create a new element for
+		 * the used tree and shrink the element in the free tree
+		 * (its position in the tree does not change). */
+		bpa2_free_resize(part, range, range->base + size, tail_size);
 		used_range = new_range;
 		new_range = NULL;
 	} else {
-		/* Range fits perfectly, remove it from free list. */
-		*range_ptr = range->next;
+		/* Range fits perfectly, remove it from free tree. */
+		bpa2_free_erase(part, range);
+		part->free_count--;
 		used_range = range;
 	}
+
+	used_range->base = aligned_base;
+	used_range->size = size;
 #if defined(CONFIG_BPA2_ALLOC_TRACE)
 	/* Save the caller data */
 	used_range->trace_file = trace_file;
 	used_range->trace_line = trace_line;
 #endif
-	/* Insert block into used list */
-	used_range->next = part->used_list;
-	part->used_list = used_range;
+	/* Insert block into used tree */
+	bpa2_used_insert(part, used_range);
+	part->used_count++;
 	result = used_range->base;
 
 fail_unlock:
-	spin_unlock(&bpa2_lock);
+	spin_unlock(&part->lock);
 fail:
 	if (new_range)
 		kfree(new_range);
-	if (align_range)
-		kfree(align_range);
+	if (tail_range)
+		kfree(tail_range);
 
 	return result;
 }
@@ -632,9 +1243,7 @@ EXPORT_SYMBOL(__bpa2_alloc_pages);
 /**
  * bpa2_free_pages - free pages allocated from a bpa2 partition
  * @part: partition to free pages back to
- * @base:
- * @align: required alinment
- * @priority: GFP_* flags to use
+ * @base: physical address of the block
  *
  * Free pages allocated with `bigphysarea_alloc_pages'. `base' must be an
  * address returned by `bigphysarea_alloc_pages'.
@@ -642,66 +1251,316 @@ EXPORT_SYMBOL(__bpa2_alloc_pages);
  */
 void bpa2_free_pages(struct bpa2_part *part, unsigned long base)
 {
-	struct bpa2_range *prev, *next, *range, **range_ptr;
+	struct bpa2_range *prev, *next, *range;
+	struct bpa2_range *unused[2] = { NULL, NULL };
 
-	spin_lock(&bpa2_lock);
+	spin_lock(&part->lock);
 
-	/* Search the block in the used list. */
-	for (range_ptr = &part->used_list;
-			*range_ptr != NULL;
-			range_ptr = &(*range_ptr)->next)
-		if ((*range_ptr)->base == base)
-			break;
-	if (*range_ptr == NULL) {
+	/* Search the block in the used tree. */
+	range = bpa2_used_lookup(part, base);
+	if (range == NULL || range->base != base) {
 		printk(KERN_ERR "%s: 0x%08lx not allocated!\n",
 				__func__, base);
-		spin_unlock(&bpa2_lock);
+		spin_unlock(&part->lock);
 		return;
 	}
-	range = *range_ptr;
-
-	/* Remove range from the used list: */
-	*range_ptr = (*range_ptr)->next;
 
-	/* The free-list is sorted by address, search insertion point
-	 * and insert block in free list. */
-	for (range_ptr = &part->free_list, prev = NULL;
-			*range_ptr != NULL;
-			prev = *range_ptr, range_ptr = &(*range_ptr)->next)
-		if ((*range_ptr)->base >= base)
-			break;
-	range->next  = *range_ptr;
-	*range_ptr   = range;
-
-	/* Concatenate free range with neighbors, if possible.
-	 * Try for upper neighbor (next in list) first, then
-	 * for lower neighbor (predecessor in list). */
-	next = NULL;
-	if (range->next != NULL &&
-			range->base + range->size == range->next->base) {
-		next = range->next;
-		range->size += next->size;
-		range->next = next->next;
-	}
-	if (prev != NULL &&
-			prev->base + prev->size == range->base) {
-		prev->size += range->size;
-		prev->next = range->next;
+	/* Remove range from the used tree: */
+	rb_erase(&range->node, &part->used_root);
+	part->used_count--;
+
+	/* Concatenate free range with neighbors, if possible,
+	 * otherwise insert the block in the free tree. */
+	bpa2_free_neighbours(part, base, &prev, &next);
+	if (prev && prev->base + prev->size != base)
+		prev = NULL;
+	if (next && base + range->size != next->base)
+		next = NULL;
+
+	if (prev && next) {
+		bpa2_free_erase(part, next);
+		part->free_count--;
+		bpa2_free_resize(part, prev, prev->base,
+				prev->size + range->size + next->size);
+		unused[0] = range;
+		unused[1] = next;
+	} else if (prev) {
+		bpa2_free_resize(part, prev, prev->base,
+				prev->size + range->size);
+		unused[0] = range;
+	} else if (next) {
+		bpa2_free_resize(part, next, range->base,
+				next->size + range->size);
+		unused[0] = range;
 	} else {
-		range = NULL;
+		bpa2_free_insert(part, range);
+		part->free_count++;
 	}
 
-	spin_unlock(&bpa2_lock);
+	spin_unlock(&part->lock);
 
-	if (next && (next != &part->initial_free_list))
-		kfree(next);
-	if (range && (range != &part->initial_free_list))
-		kfree(range);
+	bpa2_range_free(part, unused[0]);
+	bpa2_range_free(part, unused[1]);
 }
 EXPORT_SYMBOL(bpa2_free_pages);
 
 
 
+/**
+ * bpa2_cache_create - create a cache of equally sized blocks
+ * @part: partition to allocate the blocks from
+ * @size: size of a block in bytes
+ * @align: required alignment (in pages, as for bpa2_alloc_pages())
+ *
+ * Blocks freed to the cache are kept in per-CPU magazines and reused
+ * by the following allocations, so that in a steady state neither the
+ * partition lock nor kmalloc() are involved.
+ *
+ * Returns a cache handle or NULL on failure.
+ */
+struct bpa2_cache *bpa2_cache_create(struct bpa2_part *part,
+		unsigned long size, int align)
+{
+	struct bpa2_cache *cache;
+	int cpu;
+
+	if (!part || size == 0)
+		return NULL;
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return NULL;
+
+	cache->part = part;
+	cache->count = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	cache->align = align;
+	spin_lock_init(&cache->lock);
+	INIT_LIST_HEAD(&cache->full);
+	INIT_LIST_HEAD(&cache->empty);
+
+	cache->cpu = alloc_percpu(struct bpa2_cache_cpu);
+	if (!cache->cpu)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct bpa2_cache_cpu *cc = per_cpu_ptr(cache->cpu, cpu);
+
+		cc->loaded = kzalloc(sizeof(*cc->loaded), GFP_KERNEL);
+		cc->previous = kzalloc(sizeof(*cc->previous), GFP_KERNEL);
+		if (!cc->loaded || !cc->previous)
+			goto fail;
+	}
+
+	spin_lock(&part->lock);
+	list_add_tail(&cache->list, &part->caches);
+	spin_unlock(&part->lock);
+
+	return cache;
+
+fail:
+	if (cache->cpu) {
+		for_each_possible_cpu(cpu) {
+			struct bpa2_cache_cpu *cc = per_cpu_ptr(cache->cpu,
+					cpu);
+
+			kfree(cc->loaded);
+			kfree(cc->previous);
+		}
+		free_percpu(cache->cpu);
+	}
+	kfree(cache);
+
+	return NULL;
+}
+EXPORT_SYMBOL(bpa2_cache_create);
+
+static void bpa2_magazine_flush(struct bpa2_cache *cache,
+		struct bpa2_magazine *mag)
+{
+	while (mag->rounds)
+		bpa2_free_pages(cache->part, mag->objs[--mag->rounds]);
+}
+
+/**
+ * bpa2_cache_shrink - release cached blocks back to the partition
+ * @cache: cache to shrink
+ *
+ * Return blocks kept in the cache depot to the partition. Blocks
+ * cached in the per-CPU magazines are not affected.
+ */
+void bpa2_cache_shrink(struct bpa2_cache *cache)
+{
+	struct bpa2_magazine *mag, *tmp;
+	LIST_HEAD(full);
+	LIST_HEAD(empty);
+
+	spin_lock(&cache->lock);
+	list_splice_init(&cache->full, &full);
+	list_splice_init(&cache->empty, &empty);
+	cache->magazines = 0;
+	spin_unlock(&cache->lock);
+
+	list_for_each_entry_safe(mag, tmp, &full, list) {
+		bpa2_magazine_flush(cache, mag);
+		kfree(mag);
+	}
+	list_for_each_entry_safe(mag, tmp, &empty, list)
+		kfree(mag);
+}
+EXPORT_SYMBOL(bpa2_cache_shrink);
+
+/**
+ * bpa2_cache_destroy - destroy a cache
+ * @cache: cache to destroy
+ *
+ * All the cached blocks are released back to the partition. Blocks
+ * still in use must be freed with bpa2_free_pages().
+ */
+void bpa2_cache_destroy(struct bpa2_cache *cache)
+{
+	int cpu;
+
+	spin_lock(&cache->part->lock);
+	list_del(&cache->list);
+	spin_unlock(&cache->part->lock);
+
+	for_each_possible_cpu(cpu) {
+		struct bpa2_cache_cpu *cc = per_cpu_ptr(cache->cpu, cpu);
+
+		bpa2_magazine_flush(cache, cc->loaded);
+		bpa2_magazine_flush(cache, cc->previous);
+		kfree(cc->loaded);
+		kfree(cc->previous);
+	}
+	free_percpu(cache->cpu);
+
+	bpa2_cache_shrink(cache);
+	kfree(cache);
+}
+EXPORT_SYMBOL(bpa2_cache_destroy);
+
+/**
+ * bpa2_cache_alloc - allocate a block from a cache
+ * @cache: cache to allocate from
+ *
+ * Returns the physical address of the block or 0 on failure.
+ *
+ * This function may not be called from an interrupt.
+ */
+unsigned long bpa2_cache_alloc(struct bpa2_cache *cache)
+{
+	struct bpa2_cache_cpu *cc = get_cpu_ptr(cache->cpu);
+	unsigned long addr;
+
+	for (;;) {
+		struct bpa2_magazine *mag;
+
+		if (likely(cc->loaded->rounds)) {
+			addr = cc->loaded->objs[--cc->loaded->rounds];
+			put_cpu_ptr(cache->cpu);
+			return addr;
+		}
+
+		if (cc->previous->rounds) {
+			swap(cc->loaded, cc->previous);
+			continue;
+		}
+
+		/* Both magazines empty, exchange one with a full one */
+		spin_lock(&cache->lock);
+		if (list_empty(&cache->full)) {
+			spin_unlock(&cache->lock);
+			break;
+		}
+		mag = list_first_entry(&cache->full, struct bpa2_magazine,
+				list);
+		list_del(&mag->list);
+		list_add(&cc->previous->list, &cache->empty);
+		spin_unlock(&cache->lock);
+
+		cc->previous = cc->loaded;
+		cc->loaded = mag;
+	}
+
+	put_cpu_ptr(cache->cpu);
+
+	return bpa2_alloc_pages(cache->part, cache->count, cache->align,
+			GFP_KERNEL);
+}
+EXPORT_SYMBOL(bpa2_cache_alloc);
+
+/**
+ * bpa2_cache_free - return a block to a cache
+ * @cache: cache the block has been allocated from
+ * @base: physical address of the block
+ *
+ * This function may not be called from an interrupt.
+ */
+void bpa2_cache_free(struct bpa2_cache *cache, unsigned long base)
+{
+	struct bpa2_cache_cpu *cc;
+	struct bpa2_magazine *mag;
+
+	for (;;) {
+		int grow = 0;
+
+		cc = get_cpu_ptr(cache->cpu);
+
+		if (likely(cc->loaded->rounds < BPA2_MAGAZINE_SIZE)) {
+			cc->loaded->objs[cc->loaded->rounds++] = base;
+			put_cpu_ptr(cache->cpu);
+			return;
+		}
+
+		if (cc->previous->rounds == 0) {
+			swap(cc->loaded, cc->previous);
+			put_cpu_ptr(cache->cpu);
+			continue;
+		}
+
+		/* Both magazines full, exchange one with an empty one */
+		spin_lock(&cache->lock);
+		if (!list_empty(&cache->empty)) {
+			mag = list_first_entry(&cache->empty,
+					struct bpa2_magazine, list);
+			list_del(&mag->list);
+			list_add(&cc->previous->list, &cache->full);
+			spin_unlock(&cache->lock);
+
+			cc->previous = cc->loaded;
+			cc->loaded = mag;
+			put_cpu_ptr(cache->cpu);
+			continue;
+		}
+		if (cache->magazines < BPA2_DEPOT_SIZE) {
+			cache->magazines++;
+			grow = 1;
+		}
+		spin_unlock(&cache->lock);
+
+		put_cpu_ptr(cache->cpu);
+
+		if (!grow)
+			break;
+
+		/* Get a new empty magazine for the depot and try again */
+		mag = kzalloc(sizeof(*mag), GFP_KERNEL);
+		spin_lock(&cache->lock);
+		if (mag)
+			list_add(&mag->list, &cache->empty);
+		else
+			cache->magazines--;
+		spin_unlock(&cache->lock);
+		if (!mag)
+			break;
+	}
+
+	bpa2_free_pages(cache->part, base);
+}
+EXPORT_SYMBOL(bpa2_cache_free);
+
+
+
 caddr_t	__bigphysarea_alloc_pages(int count, int align, int priority,
 		const char *trace_file, int trace_line)
 {
@@ -732,10 +1591,29 @@ EXPORT_SYMBOL(bigphysarea_free_pages);
 
 #ifdef CONFIG_DEBUG_FS
 
-static void *bpa2_seq_start(struct seq_file *s, loff_t *pos)
+/* Number of blocks kept in a cache (per-CPU values are approximate) */
+static int bpa2_cache_cached(struct bpa2_cache *cache)
 {
-	spin_lock(&bpa2_lock);
+	struct bpa2_magazine *mag;
+	int cached = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct bpa2_cache_cpu *cc = per_cpu_ptr(cache->cpu, cpu);
+
+		cached += cc->loaded->rounds + cc->previous->rounds;
+	}
+
+	spin_lock(&cache->lock);
+	list_for_each_entry(mag, &cache->full, list)
+		cached += mag->rounds;
+	spin_unlock(&cache->lock);
 
+	return cached;
+}
+
+static void *bpa2_seq_start(struct seq_file *s, loff_t *pos)
+{
 	return seq_list_start(&bpa2_parts, *pos);
 }
 
@@ -746,32 +1624,40 @@ static void *bpa2_seq_next(struct seq_file *s, void *v, loff_t *pos)
 
 static void bpa2_seq_stop(struct seq_file *s, void *v)
 {
-	spin_unlock(&bpa2_lock);
 }
 
 static int bpa2_seq_show(struct seq_file *s, void *v)
 {
 	struct bpa2_part *part = list_entry(v, struct bpa2_part, list);
 	struct bpa2_range *range;
+	struct rb_node *node;
 	int free_count, free_total, free_max;
 	int used_count, used_total, used_max;
+	int hist[BPA2_HIST_BUCKETS];
+	int frag_index;
 	int i;
 
-	free_count = 0;
+	memset(hist, 0, sizeof(hist));
+
+	spin_lock(&part->lock);
+
+	free_count = part->free_count;
 	free_total = 0;
-	free_max = 0;
-	for (range = part->free_list; range != NULL; range = range->next) {
-		free_count++;
+	free_max = bpa2_max_size(part->free_root.rb_node);
+	for (node = rb_first(&part->free_root); node; node = rb_next(node)) {
+		range = rb_entry(node, struct bpa2_range, node);
 		free_total += range->size;
-		if (range->size > free_max)
-			free_max = range->size;
+		i = ilog2(range->size >> PAGE_SHIFT);
+		hist[min(i, BPA2_HIST_BUCKETS - 1)]++;
 	}
 
-	used_count = 0;
+	frag_index = bpa2_frag_index(free_max, free_total);
+
+	used_count = part->used_count;
 	used_total = 0;
 	used_max = 0;
-	for (range = part->used_list; range != NULL; range = range->next) {
-		used_count++;
+	for (node = rb_first(&part->used_root); node; node = rb_next(node)) {
+		range = rb_entry(node, struct bpa2_range, node);
 		used_total += range->size;
 		if (range->size > used_max)
 			used_max = range->size;
@@ -793,11 +1679,39 @@ static int bpa2_seq_show(struct seq_file *s, void *v)
 			free_max / 1024, used_max / 1024);
 	seq_printf(s, "- total:                 %8d kB    %8d kB\n",
 			free_total / 1024, used_total / 1024);
+	seq_printf(s, "Placement policy: %s\n", bpa2_policy_name(part->flags));
+	seq_printf(s, "- failed allocations:    %8d\n", part->failed_count);
+	seq_printf(s, "- fragmentation index:   %4d.%03d\n",
+			frag_index / 1000, frag_index % 1000);
+
+	if (free_count) {
+		seq_printf(s, "Free blocks by size:\n");
+		for (i = 0; i < BPA2_HIST_BUCKETS - 1; i++)
+			if (hist[i])
+				seq_printf(s, "- %8lu - %8lu kB: %8d\n",
+						(PAGE_SIZE << i) / 1024,
+						(PAGE_SIZE << (i + 1)) / 1024 - 1,
+						hist[i]);
+		if (hist[i])
+			seq_printf(s, "- %8lu kB and more:  %8d\n",
+					(PAGE_SIZE << i) / 1024, hist[i]);
+	}
+
+	if (!list_empty(&part->caches)) {
+		struct bpa2_cache *cache;
+
+		seq_printf(s, "Object caches:\n");
+		list_for_each_entry(cache, &part->caches, list)
+			seq_printf(s, "- %lu B blocks: %8d cached\n",
+					cache->count * PAGE_SIZE,
+					bpa2_cache_cached(cache));
+	}
 
 	if (used_count) {
 		seq_printf(s, "Allocations:\n");
-		for (range = part->used_list; range != NULL;
-				range = range->next) {
+		for (node = rb_first(&part->used_root); node;
+				node = rb_next(node)) {
+			range = rb_entry(node, struct bpa2_range, node);
 			seq_printf(s, "- %lu B at 0x%.8lx",
 					range->size, range->base);
 #if defined(CONFIG_BPA2_ALLOC_TRACE)
@@ -809,6 +1723,8 @@ static int bpa2_seq_show(struct seq_file *s, void *v)
 		}
 	}
 
+	spin_unlock(&part->lock);
+
 	seq_printf(s, "\n");
 
 	return 0;
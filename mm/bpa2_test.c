@@ -0,0 +1,243 @@
+/*
+ * BPA2 allocator stress test and benchmark
+ *
+ * Copyright (c) 2013 STMicroelectronics Limited
+ *
+ * Fragments a bpa2 partition with a large number of small live
+ * allocations and then measures the average cost of replacing them with
+ * blocks of random sizes, and the resulting fragmentation, under each
+ * placement policy in turn. The partition policy is restored afterwards.
+ * Finally measures the cost of recycling one page blocks through a bpa2
+ * object cache.
+ *
+ * Usage:
+ *	modprobe bpa2_test part=<name> blocks=<n> iterations=<n> \
+ *			[policy=firstfit|bestfit|nextfit|segregated]
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/bpa2.h>
+
+/* Number of blocks allocated at once from a cache */
+#define BPA2_TEST_BATCH 8
+
+static char *part_name = "bigphysarea";
+module_param_named(part, part_name, charp, S_IRUGO);
+MODULE_PARM_DESC(part, "Name of the bpa2 partition to be tested");
+
+static unsigned int blocks = 512;
+module_param(blocks, uint, S_IRUGO);
+MODULE_PARM_DESC(blocks, "Number of live blocks fragmenting the partition");
+
+static unsigned int iterations = 10000;
+module_param(iterations, uint, S_IRUGO);
+MODULE_PARM_DESC(iterations, "Number of alloc/free pairs to be timed");
+
+static unsigned int max_pages = 16;
+module_param(max_pages, uint, S_IRUGO);
+MODULE_PARM_DESC(max_pages, "Maximum size (in pages) of a random block");
+
+static char *policy;
+module_param(policy, charp, S_IRUGO);
+MODULE_PARM_DESC(policy, "Placement policy to be tested (default: all)");
+
+static const struct {
+	const char *name;
+	unsigned long policy;
+} bpa2_test_policies[] __initconst = {
+	{ "firstfit", BPA2_FIRST_FIT },
+	{ "bestfit", BPA2_BEST_FIT },
+	{ "nextfit", BPA2_NEXT_FIT },
+	{ "segregated", BPA2_SEGREGATED },
+};
+
+static void __init bpa2_test_report(struct bpa2_part *part, const char *what)
+{
+	unsigned long free_total, free_max;
+	int frag_index;
+
+	frag_index = bpa2_fragmentation(part, &free_total, &free_max);
+
+	printk(KERN_INFO "bpa2_test: %s: %lu kB free, largest block %lu kB, "
+			"fragmentation index %d.%03d\n", what,
+			free_total / 1024, free_max / 1024,
+			frag_index / 1000, frag_index % 1000);
+}
+
+static void __init bpa2_test_cache(struct bpa2_part *part)
+{
+	struct bpa2_cache *cache;
+	unsigned long addr[BPA2_TEST_BATCH];
+	u64 ns = 0;
+	unsigned int i, j;
+
+	cache = bpa2_cache_create(part, PAGE_SIZE, 1);
+	if (!cache) {
+		printk(KERN_ERR "bpa2_test: failed to create a cache\n");
+		return;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		ktime_t start = ktime_get();
+
+		for (j = 0; j < BPA2_TEST_BATCH; j++)
+			addr[j] = bpa2_cache_alloc(cache);
+		for (j = 0; j < BPA2_TEST_BATCH; j++)
+			if (addr[j])
+				bpa2_cache_free(cache, addr[j]);
+
+		ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		if ((i & 0xff) == 0)
+			cond_resched();
+	}
+
+	bpa2_cache_destroy(cache);
+
+	do_div(ns, iterations * BPA2_TEST_BATCH);
+	printk(KERN_INFO "bpa2_test: average cached alloc+free %llu ns\n", ns);
+}
+
+/* Fragment the partition, then replace random live blocks with blocks
+ * of random sizes, timing the allocations and the frees */
+static void __init bpa2_test_run(struct bpa2_part *part, unsigned long *live,
+		const char *name)
+{
+	unsigned int live_cnt = 0;
+	u64 alloc_ns = 0, free_ns = 0;
+	unsigned int allocs = 0, frees = 0, failures = 0;
+	unsigned int i;
+
+	/* Fill the partition with small blocks, then free every second
+	 * one, leaving a chessboard of small holes in front of any
+	 * larger free area */
+	for (i = 0; i < blocks; i++) {
+		unsigned long addr = bpa2_alloc_pages(part, 1, 1, GFP_KERNEL);
+
+		if (!addr)
+			break;
+		live[live_cnt++] = addr;
+	}
+	for (i = 0; i < live_cnt; i += 2) {
+		bpa2_free_pages(part, live[i]);
+		live[i] = 0;
+	}
+
+	for (i = 0; live_cnt && i < iterations; i++) {
+		unsigned int slot = random32() % live_cnt;
+		int count = 1 + random32() % max_pages;
+		ktime_t start;
+
+		if (live[slot]) {
+			start = ktime_get();
+			bpa2_free_pages(part, live[slot]);
+			free_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+			live[slot] = 0;
+			frees++;
+		}
+
+		start = ktime_get();
+		live[slot] = bpa2_alloc_pages(part, count, 1, GFP_KERNEL);
+		alloc_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		if (live[slot])
+			allocs++;
+		else
+			failures++;
+
+		if ((i & 0xff) == 0)
+			cond_resched();
+	}
+
+	bpa2_test_report(part, name);
+
+	for (i = 0; i < live_cnt; i++)
+		if (live[i])
+			bpa2_free_pages(part, live[i]);
+
+	if (allocs + failures)
+		do_div(alloc_ns, allocs + failures);
+	if (frees)
+		do_div(free_ns, frees);
+
+	printk(KERN_INFO "bpa2_test: %s: %u blocks, %u iterations, "
+			"%u failures\n", name, live_cnt, iterations, failures);
+	printk(KERN_INFO "bpa2_test: %s: average alloc %llu ns, free %llu ns\n",
+			name, alloc_ns, free_ns);
+}
+
+static int __init bpa2_test_init(void)
+{
+	struct bpa2_part *part;
+	unsigned long old_policy;
+	unsigned long *live;
+	int tested = 0;
+	int i;
+
+	part = bpa2_find_part(part_name);
+	if (!part) {
+		printk(KERN_ERR "bpa2_test: no '%s' partition\n", part_name);
+		return -ENODEV;
+	}
+
+	if (!blocks || !max_pages)
+		return -EINVAL;
+
+	live = vmalloc(blocks * sizeof(*live));
+	if (!live)
+		return -ENOMEM;
+
+	bpa2_test_report(part, part_name);
+
+	/* Run the same workload under each policy (or the requested one),
+	 * then give the partition its own policy back */
+	old_policy = bpa2_get_policy(part);
+
+	for (i = 0; i < ARRAY_SIZE(bpa2_test_policies); i++) {
+		if (policy && strcmp(policy, bpa2_test_policies[i].name) != 0)
+			continue;
+
+		bpa2_set_policy(part, bpa2_test_policies[i].policy);
+		bpa2_test_run(part, live, bpa2_test_policies[i].name);
+		tested++;
+	}
+
+	bpa2_set_policy(part, old_policy);
+
+	vfree(live);
+
+	if (!tested) {
+		printk(KERN_ERR "bpa2_test: unknown policy '%s'\n", policy);
+		return -EINVAL;
+	}
+
+	if (iterations)
+		bpa2_test_cache(part);
+
+	return 0;
+}
+module_init(bpa2_test_init);
+
+static void __exit bpa2_test_exit(void)
+{
+}
+module_exit(bpa2_test_exit);
+
+MODULE_AUTHOR("STMicroelectronics Limited");
+MODULE_DESCRIPTION("BPA2 allocator stress test and benchmark");
+MODULE_LICENSE("GPL");
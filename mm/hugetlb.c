@@ -21,6 +21,7 @@
 #include <linux/rmap.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/async_tx.h>
 
 #include <asm/page.h>
 #include <asm/pgtable.h>
@@ -500,6 +501,9 @@ void copy_huge_page(struct page *dst, struct page *src)
 	}
 
 	might_sleep();
+	if (!async_copy_pages(dst, src, huge_page_size(h)))
+		return;
+
 	for (i = 0; i < pages_per_huge_page(h); i++) {
 		cond_resched();
 		copy_highpage(dst + i, src + i);
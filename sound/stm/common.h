@@ -11,6 +11,7 @@
 #include <linux/slab.h>
 #include <linux/platform_device.h>
 #include <linux/stringify.h>
+#include <linux/ktime.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/info.h>
@@ -151,6 +152,47 @@ int snd_stm_pcm_hw_constraint_transfer_bytes(struct snd_pcm_runtime *runtime,
 
 
 
+/*
+ * PCM hardware pointer interpolation
+ *
+ * Reading the FDMA residue walks the channel registers and descriptor
+ * list under the channel lock. Instead, the last value read is kept with
+ * a timestamp, and for a short while the position is extrapolated from
+ * the stream rate. All calls but snd_stm_pcm_pos_invalidate() are made
+ * with the PCM stream lock held (ie. from the trigger and pointer ops).
+ */
+
+struct snd_stm_pcm_pos {
+	unsigned int buffer_bytes;
+	unsigned int frame_bytes;
+	unsigned int bytes_per_sec;
+
+	int valid;
+	ktime_t stamp;		/* When hwptr was read from the hardware */
+	unsigned int hwptr;	/* Last position read, in bytes */
+	unsigned int last;	/* Last position reported, in bytes */
+
+	unsigned long reads;	/* Statistics */
+	unsigned long interpolations;
+};
+
+void snd_stm_pcm_pos_start(struct snd_stm_pcm_pos *pos,
+		struct snd_pcm_runtime *runtime);
+int snd_stm_pcm_pos_interpolate(struct snd_stm_pcm_pos *pos,
+		unsigned int *hwptr);
+unsigned int snd_stm_pcm_pos_update(struct snd_stm_pcm_pos *pos,
+		unsigned int hwptr);
+
+static inline void snd_stm_pcm_pos_invalidate(struct snd_stm_pcm_pos *pos)
+{
+	pos->valid = 0;
+}
+
+void snd_stm_pcm_pos_info(struct snd_stm_pcm_pos *pos,
+		struct snd_info_buffer *buffer);
+
+
+
 /*
  * ALSA procfs additional entries
  */
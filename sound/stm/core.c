@@ -607,6 +607,113 @@ int snd_stm_pcm_hw_constraint_transfer_bytes(struct snd_pcm_runtime *runtime,
 
 
 
+/*
+ * PCM hardware pointer interpolation
+ */
+
+/* Maximum age of a hardware position snapshot (0 disables interpolation) */
+static unsigned int pos_max_age_us = 1000;
+module_param(pos_max_age_us, uint, S_IRUGO | S_IWUSR);
+
+void snd_stm_pcm_pos_start(struct snd_stm_pcm_pos *pos,
+		struct snd_pcm_runtime *runtime)
+{
+	snd_stm_printd(1, "snd_stm_pcm_pos_start(pos=%p, runtime=%p)\n",
+			pos, runtime);
+
+	BUG_ON(!pos);
+	BUG_ON(!runtime);
+
+	pos->buffer_bytes = frames_to_bytes(runtime, runtime->buffer_size);
+	pos->frame_bytes = frames_to_bytes(runtime, 1);
+	pos->bytes_per_sec = frames_to_bytes(runtime, runtime->rate);
+
+	pos->valid = 0;
+	pos->hwptr = 0;
+	pos->last = 0;
+}
+EXPORT_SYMBOL(snd_stm_pcm_pos_start);
+
+/* Is position a behind position b (by less than half a buffer)? */
+static inline int snd_stm_pcm_pos_behind(struct snd_stm_pcm_pos *pos,
+		unsigned int a, unsigned int b)
+{
+	unsigned int distance;
+
+	if (!pos->buffer_bytes)
+		return 0;
+
+	distance = (b + pos->buffer_bytes - a) % pos->buffer_bytes;
+
+	return distance && distance < pos->buffer_bytes / 2;
+}
+
+/* Returns 0 and the extrapolated position, or -EAGAIN if the snapshot is
+ * too old (or missing) and the hardware must be read again */
+int snd_stm_pcm_pos_interpolate(struct snd_stm_pcm_pos *pos,
+		unsigned int *hwptr)
+{
+	s64 age_ns;
+	unsigned int bytes;
+
+	if (!pos->valid)
+		return -EAGAIN;
+
+	age_ns = ktime_to_ns(ktime_sub(ktime_get(), pos->stamp));
+	if (age_ns < 0 || age_ns > (s64)pos_max_age_us * NSEC_PER_USEC)
+		return -EAGAIN;
+
+	bytes = div_u64((u64)age_ns * pos->bytes_per_sec, NSEC_PER_SEC);
+	bytes -= bytes % pos->frame_bytes;
+	if (bytes >= pos->buffer_bytes)
+		return -EAGAIN;
+
+	*hwptr = (pos->hwptr + bytes) % pos->buffer_bytes;
+
+	/* Never report a position older than a previous one */
+	if (snd_stm_pcm_pos_behind(pos, *hwptr, pos->last))
+		*hwptr = pos->last;
+	else
+		pos->last = *hwptr;
+
+	pos->interpolations++;
+
+	return 0;
+}
+EXPORT_SYMBOL(snd_stm_pcm_pos_interpolate);
+
+/* Records a position just read from the hardware, returns the position to
+ * be reported */
+unsigned int snd_stm_pcm_pos_update(struct snd_stm_pcm_pos *pos,
+		unsigned int hwptr)
+{
+	pos->hwptr = hwptr;
+	pos->stamp = ktime_get();
+	pos->valid = pos_max_age_us != 0;
+	pos->reads++;
+
+	/* The extrapolation may have been slightly ahead of the hardware;
+	 * hold the last reported position until the hardware catches up,
+	 * but keep the real position as the new reference */
+	if (snd_stm_pcm_pos_behind(pos, hwptr, pos->last))
+		return pos->last;
+
+	pos->last = hwptr;
+
+	return hwptr;
+}
+EXPORT_SYMBOL(snd_stm_pcm_pos_update);
+
+void snd_stm_pcm_pos_info(struct snd_stm_pcm_pos *pos,
+		struct snd_info_buffer *buffer)
+{
+	snd_iprintf(buffer, "position reads = %lu, interpolations = %lu\n",
+			pos->reads, pos->interpolations);
+}
+EXPORT_SYMBOL(snd_stm_pcm_pos_info);
+
+
+
 /*
  * Common ALSA controls routines
  */
@@ -99,6 +99,8 @@ struct snd_stm_pcm_player {
 	int buffer_bytes;
 	int period_bytes;
 
+	struct snd_stm_pcm_pos pos;
+
 	snd_stm_magic_field;
 };
 
@@ -141,6 +143,7 @@ static irqreturn_t snd_stm_pcm_player_irq_handler(int irq, void *dev_id)
 
 			snd_stm_printd(2, "Period elapsed ('%s')\n",
 					dev_name(pcm_player->device));
+			snd_stm_pcm_pos_invalidate(&pcm_player->pos);
 			snd_pcm_period_elapsed(pcm_player->substream);
 
 			result = IRQ_HANDLED;
@@ -158,6 +161,7 @@ static struct snd_pcm_hardware snd_stm_pcm_player_hw = {
 				SNDRV_PCM_INFO_MMAP_VALID |
 				SNDRV_PCM_INFO_INTERLEAVED |
 				SNDRV_PCM_INFO_BLOCK_TRANSFER |
+				SNDRV_PCM_INFO_NO_PERIOD_WAKEUP |
 				SNDRV_PCM_INFO_PAUSE),
 	.formats	= (SNDRV_PCM_FMTBIT_S32_LE |
 				SNDRV_PCM_FMTBIT_S16_LE),
@@ -659,6 +663,8 @@ static int snd_stm_pcm_player_start(struct snd_pcm_substream *substream)
 {
 	struct snd_stm_pcm_player *pcm_player =
 			snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	int period_bytes = pcm_player->period_bytes;
 
 	snd_stm_printd(1, "snd_stm_pcm_player_start(substream=0x%p)\n",
 			substream);
@@ -666,6 +672,14 @@ static int snd_stm_pcm_player_start(struct snd_pcm_substream *substream)
 	BUG_ON(!pcm_player);
 	BUG_ON(!snd_stm_magic_valid(pcm_player));
 
+	snd_stm_pcm_pos_start(&pcm_player->pos, runtime);
+
+	/* Without period wakeups the buffer is a single FDMA node, so the
+	 * FDMA interrupts only once per buffer and the residue lookup does
+	 * not have to walk the node list */
+	if (runtime->no_period_wakeup)
+		period_bytes = pcm_player->buffer_bytes;
+
 	/* Un-reset PCM player */
 
 	set__AUD_PCMOUT_RST__SRSTP__RUNNING(pcm_player);
@@ -675,8 +689,8 @@ static int snd_stm_pcm_player_start(struct snd_pcm_substream *substream)
 	BUG_ON(!pcm_player->dma_channel->device->device_prep_dma_cyclic);
 	pcm_player->dma_descriptor =
 		pcm_player->dma_channel->device->device_prep_dma_cyclic(
-			pcm_player->dma_channel, substream->runtime->dma_addr,
-			pcm_player->buffer_bytes, pcm_player->period_bytes,
+			pcm_player->dma_channel, runtime->dma_addr,
+			pcm_player->buffer_bytes, period_bytes,
 			DMA_MEM_TO_DEV, NULL);
 	if (!pcm_player->dma_descriptor) {
 		snd_stm_printe("Failed to prepare DMA descriptor\n");
@@ -687,11 +701,14 @@ static int snd_stm_pcm_player_start(struct snd_pcm_substream *substream)
 
 	pcm_player->dma_cookie = dmaengine_submit(pcm_player->dma_descriptor);
 
-	/* Enable player interrupts (and clear possible stalled ones) */
+	/* Enable player interrupts (and clear possible stalled ones);
+	 * the NSAMPLE (period) one is not needed when the application
+	 * schedules itself on a timer */
 
 	enable_irq(pcm_player->irq);
 	set__AUD_PCMOUT_ITS_CLR__NSAMPLE__CLEAR(pcm_player);
-	set__AUD_PCMOUT_IT_EN_SET__NSAMPLE__SET(pcm_player);
+	if (!runtime->no_period_wakeup)
+		set__AUD_PCMOUT_IT_EN_SET__NSAMPLE__SET(pcm_player);
 	set__AUD_PCMOUT_ITS_CLR__UNF__CLEAR(pcm_player);
 	set__AUD_PCMOUT_IT_EN_SET__UNF__SET(pcm_player);
 
@@ -703,7 +720,7 @@ static int snd_stm_pcm_player_start(struct snd_pcm_substream *substream)
 
 	if (pcm_player->conv_group) {
 		snd_stm_conv_enable(pcm_player->conv_group,
-				0, substream->runtime->channels - 1);
+				0, runtime->channels - 1);
 		snd_stm_conv_unmute(pcm_player->conv_group);
 	}
 
@@ -767,6 +784,10 @@ static int snd_stm_pcm_player_pause(struct snd_pcm_substream *substream)
 
 	set__AUD_PCMOUT_CTRL__MODE__MUTE(pcm_player);
 
+	/* Position is not moving anymore */
+
+	snd_stm_pcm_pos_invalidate(&pcm_player->pos);
+
 	return 0;
 }
 
@@ -785,6 +806,8 @@ static int snd_stm_pcm_player_release(struct snd_pcm_substream *substream)
 
 	set__AUD_PCMOUT_CTRL__MODE__PCM(pcm_player);
 
+	snd_stm_pcm_pos_invalidate(&pcm_player->pos);
+
 	return 0;
 }
 
@@ -814,7 +837,7 @@ static snd_pcm_uframes_t snd_stm_pcm_player_pointer(struct snd_pcm_substream
 	struct snd_stm_pcm_player *pcm_player =
 		snd_pcm_substream_chip(substream);
 	struct snd_pcm_runtime *runtime = substream->runtime;
-	int residue, hwptr;
+	unsigned int residue, hwptr;
 	snd_pcm_uframes_t pointer;
 	struct dma_tx_state state;
 	enum dma_status status;
@@ -826,15 +849,21 @@ static snd_pcm_uframes_t snd_stm_pcm_player_pointer(struct snd_pcm_substream
 	BUG_ON(!snd_stm_magic_valid(pcm_player));
 	BUG_ON(!runtime);
 
+	/* Use the recent snapshot of FDMA position, if there is one */
+
+	if (snd_stm_pcm_pos_interpolate(&pcm_player->pos, &hwptr) == 0)
+		return bytes_to_frames(runtime, hwptr);
+
 	status = pcm_player->dma_channel->device->device_tx_status(
 			pcm_player->dma_channel,
 			pcm_player->dma_cookie, &state);
 
 	residue = state.residue;
 	hwptr = (runtime->dma_bytes - residue) % runtime->dma_bytes;
+	hwptr = snd_stm_pcm_pos_update(&pcm_player->pos, hwptr);
 	pointer = bytes_to_frames(runtime, hwptr);
 
-	snd_stm_printd(2, "FDMA residue value is %i and buffer size is %u"
+	snd_stm_printd(2, "FDMA residue value is %u and buffer size is %u"
 			" bytes...\n", residue, runtime->dma_bytes);
 	snd_stm_printd(2, "... so HW pointer in frames is %lu (0x%lx)!\n",
 			pointer, pointer);
@@ -888,6 +917,8 @@ static void snd_stm_pcm_player_dump_registers(struct snd_info_entry *entry,
 	DUMP_REGISTER(STA);
 	DUMP_REGISTER(FMT);
 
+	snd_stm_pcm_pos_info(&pcm_player->pos, buffer);
+
 	snd_iprintf(buffer, "\n");
 }
 
@@ -134,6 +134,8 @@ struct snd_stm_uniperif_player {
 	int buffer_bytes;
 	int period_bytes;
 
+	struct snd_stm_pcm_pos pos;
+
 	/* Configuration */
 	unsigned int current_rate;
 	unsigned int current_format;
@@ -150,6 +152,7 @@ static struct snd_pcm_hardware snd_stm_uniperif_player_pcm_hw = {
 				SNDRV_PCM_INFO_MMAP_VALID |
 				SNDRV_PCM_INFO_INTERLEAVED |
 				SNDRV_PCM_INFO_BLOCK_TRANSFER |
+				SNDRV_PCM_INFO_NO_PERIOD_WAKEUP |
 				SNDRV_PCM_INFO_PAUSE),
 	.formats	= (SNDRV_PCM_FMTBIT_S32_LE |
 				SNDRV_PCM_FMTBIT_S16_LE),
@@ -183,6 +186,7 @@ static struct snd_pcm_hardware snd_stm_uniperif_player_raw_hw = {
 				SNDRV_PCM_INFO_MMAP_VALID |
 				SNDRV_PCM_INFO_INTERLEAVED |
 				SNDRV_PCM_INFO_BLOCK_TRANSFER |
+				SNDRV_PCM_INFO_NO_PERIOD_WAKEUP |
 				SNDRV_PCM_INFO_PAUSE),
 	.formats	= (SNDRV_PCM_FMTBIT_S32_LE),
 
@@ -476,6 +480,7 @@ static void snd_stm_uniperif_player_comp_cb(void *param)
 	BUG_ON(!snd_stm_magic_valid(player));
 	BUG_ON(!player->substream);
 
+	snd_stm_pcm_pos_invalidate(&player->pos);
 	snd_pcm_period_elapsed(player->substream);
 }
 
@@ -1181,6 +1186,8 @@ static int snd_stm_uniperif_player_start(struct snd_pcm_substream *substream)
 {
 	struct snd_stm_uniperif_player *player =
 			snd_pcm_substream_chip(substream);
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	int period_bytes = player->period_bytes;
 	unsigned int ctrl;
 	unsigned long irqflags;
 
@@ -1191,18 +1198,30 @@ static int snd_stm_uniperif_player_start(struct snd_pcm_substream *substream)
 
 	player->xrun = 0;
 
+	snd_stm_pcm_pos_start(&player->pos, runtime);
+
+	/*
+	 * Without period wakeups, make the whole buffer a single period, so
+	 * the FDMA only interrupts once per buffer
+	 * and the residue lookup has less nodes to walk.
+	 */
+	if (runtime->no_period_wakeup)
+		period_bytes = player->buffer_bytes;
+
 	/* Prepare the dma descriptor */
 	player->dma_descriptor = dma_audio_prep_tx_cyclic(player->dma_channel,
-			substream->runtime->dma_addr, player->buffer_bytes,
-			player->period_bytes);
+			runtime->dma_addr, player->buffer_bytes, period_bytes);
 	if (!player->dma_descriptor) {
 		dev_err(player->dev, "Failed to prepare DMA descriptor");
 		return -ENOMEM;
 	}
 
-	/* Set the dma callback */
-	player->dma_descriptor->callback = snd_stm_uniperif_player_comp_cb;
-	player->dma_descriptor->callback_param = player;
+	/* Set the dma callback (the application polls on a timer otherwise) */
+	if (!runtime->no_period_wakeup) {
+		player->dma_descriptor->callback =
+				snd_stm_uniperif_player_comp_cb;
+		player->dma_descriptor->callback_param = player;
+	}
 
 
 	/* If parking is enabled, just submit the next decsriptor and return */
@@ -1281,7 +1300,7 @@ static int snd_stm_uniperif_player_start(struct snd_pcm_substream *substream)
 	/* Wake up & unmute converter */
 	if (player->conv_group) {
 		snd_stm_conv_enable(player->conv_group,
-				0, substream->runtime->channels - 1);
+				0, runtime->channels - 1);
 		snd_stm_conv_unmute(player->conv_group);
 	}
 
@@ -1401,6 +1420,9 @@ static int snd_stm_uniperif_player_pause(struct snd_pcm_substream *substream)
 
 	spin_unlock_irqrestore(&player->default_settings_lock, irqflags);
 
+	/* The position snapshot is stale once the data flow has changed */
+	snd_stm_pcm_pos_invalidate(&player->pos);
+
 	return 0;
 }
 
@@ -1461,6 +1483,9 @@ static inline int snd_stm_uniperif_player_release(struct snd_pcm_substream
 
 	spin_unlock_irqrestore(&player->default_settings_lock, irqflags);
 
+	/* The position snapshot is stale once the data flow has changed */
+	snd_stm_pcm_pos_invalidate(&player->pos);
+
 	return 0;
 }
 
@@ -1491,7 +1516,7 @@ static snd_pcm_uframes_t snd_stm_uniperif_player_pointer(
 	struct snd_stm_uniperif_player *player =
 		snd_pcm_substream_chip(substream);
 	struct snd_pcm_runtime *runtime = substream->runtime;
-	int residue, hwptr;
+	unsigned int residue, hwptr;
 
 	BUG_ON(!player);
 	BUG_ON(!snd_stm_magic_valid(player));
@@ -1501,6 +1526,8 @@ static snd_pcm_uframes_t snd_stm_uniperif_player_pointer(
 	if (dma_audio_is_parking_active(player->dma_channel)) {
 		residue = 0;
 		hwptr = 0;
+	} else if (snd_stm_pcm_pos_interpolate(&player->pos, &hwptr) == 0) {
+		/* Recent enough snapshot of the FDMA position */
 	} else {
 		struct dma_tx_state state;
 		enum dma_status status;
@@ -1511,8 +1538,14 @@ static snd_pcm_uframes_t snd_stm_uniperif_player_pointer(
 
 		residue = state.residue;
 		hwptr = (runtime->dma_bytes - residue) % runtime->dma_bytes;
+		hwptr = snd_stm_pcm_pos_update(&player->pos, hwptr);
+	}
 
-		/* Set hwptr to the start of current period */
+	/*
+	 * Set hwptr to the start of current period, unless the application
+	 * is scheduling on a timer and needs the exact position.
+	 */
+	if (!runtime->no_period_wakeup) {
 		hwptr /= player->period_bytes;
 		hwptr *= player->period_bytes;
 	}
@@ -2044,6 +2077,8 @@ static void snd_stm_uniperif_player_dump_registers(struct snd_info_entry *entry,
 	DUMP_REGISTER(CRC_VALUE_IN);
 	DUMP_REGISTER(CRC_VALUE_OUT);
 
+	snd_stm_pcm_pos_info(&player->pos, buffer);
+
 	snd_iprintf(buffer, "\n");
 }
 